@@ -61,6 +61,9 @@ std::ostream& operator<<(std::ostream& os, const blk_access_mode_t buffered)
 
 void IOContext::aio_wait()
 {
+  // see bdev_ioring_inline_completion
+  while (poller && num_running.load() > 0 && poller->aio_poll(this)) {
+  }
   std::unique_lock l(lock);
   // see _aio_thread for waker logic
   while (num_running.load() > 0) {
@@ -75,6 +75,8 @@ enum struct blk_access_mode_t {
 blk_access_mode_t buffermode(bool buffered);
 std::ostream& operator<<(std::ostream& os, const blk_access_mode_t buffered);
 
+class BlockDevice;
+
 /// track in-flight io
 struct IOContext {
   enum {
@@ -89,6 +91,7 @@ private:
 public:
   CephContext* cct;
   void *priv;
+  BlockDevice *poller = nullptr;    ///< device reaping our aios in aio_wait()
 #ifdef HAVE_SPDK
   void *nvme_task_first = nullptr;
   void *nvme_task_last = nullptr;
@@ -235,6 +238,11 @@ public:
   }
 
   virtual void aio_submit(IOContext *ioc) = 0;
+  /// complete the aios of @ioc (and others) in the calling thread, returns
+  /// false when the caller should rather wait for the completion thread
+  virtual bool aio_poll(IOContext *ioc) {
+    return false;
+  }
 
   void set_no_exclusive_lock() {
     lock_exclusive = false;
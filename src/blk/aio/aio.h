@@ -12,6 +12,8 @@
 #include <sys/event.h>
 #endif
 
+#include <functional>
+
 #include <boost/intrusive/list.hpp>
 #include <boost/container/small_vector.hpp>
 
@@ -104,6 +106,22 @@ struct io_queue_t {
   virtual int submit_batch(aio_iter begin, aio_iter end,
 			   void *priv, int *retries, int submit_retries, int initial_delay_us) = 0;
   virtual int get_next_completed(int timeout_ms, aio_t **paio, int max) = 0;
+
+  /// non-blocking reap of the completed aios accepted by @can_complete, the
+  /// others are left to get_next_completed()
+  virtual int reap_completed(aio_t **paio, int max,
+			     const std::function<bool(const aio_t*)>& can_complete) {
+    return 0;
+  }
+  /// a buffer registered to the queue (fixed buffer), or nullptr if there
+  /// is none left
+  virtual ceph::unique_leakable_ptr<ceph::buffer::raw> get_registered_buffer(unsigned len) {
+    return nullptr;
+  }
+  /// the queue is polled for completions (no completion interrupts)
+  virtual bool is_polled() const {
+    return false;
+  }
 };
 
 struct aio_queue_t final : public io_queue_t {
@@ -89,7 +89,11 @@ KernelDevice::KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv, ai
   if (use_ioring && ioring_queue_t::supported()) {
     bool use_ioring_hipri = cct->_conf.get_val<bool>("bdev_ioring_hipri");
     bool use_ioring_sqthread_poll = cct->_conf.get_val<bool>("bdev_ioring_sqthread_poll");
-    io_queue = std::make_unique<ioring_queue_t>(iodepth, use_ioring_hipri, use_ioring_sqthread_poll);
+    auto reg_buffers = cct->_conf.get_val<uint64_t>("bdev_ioring_registered_buffers");
+    auto reg_buffer_size = cct->_conf.get_val<Option::size_t>("bdev_ioring_registered_buffer_size");
+    io_queue = std::make_unique<ioring_queue_t>(iodepth, use_ioring_hipri, use_ioring_sqthread_poll,
+                                                reg_buffers, reg_buffer_size);
+    aio_inline_completion = cct->_conf.get_val<bool>("bdev_ioring_inline_completion");
   } else {
     static bool once;
     if (use_ioring && !once) {
@@ -660,6 +664,77 @@ static bool is_expected_ioerr(const int r)
 	  );
 }
 
+void KernelDevice::_aio_finish(aio_t *aio)
+{
+  IOContext *ioc = static_cast<IOContext*>(aio->priv);
+  _aio_log_finish(ioc, aio->offset, aio->length);
+  if (aio->queue_item.is_linked()) {
+    std::lock_guard l(debug_queue_lock);
+    debug_aio_unlink(*aio);
+  }
+
+  // set flag indicating new ios have completed.  we do this *before*
+  // any completion or notifications so that any user flush() that
+  // follows the observed io completion will include this io.  Note
+  // that an earlier, racing flush() could observe and clear this
+  // flag, but that also ensures that the IO will be stable before the
+  // later flush() occurs.
+  io_since_flush.store(true);
+
+  long r = aio->get_return_value();
+  if (r < 0) {
+    derr << __func__ << " got r=" << r << " (" << cpp_strerror(r) << ")"
+	 << dendl;
+    if (ioc->allow_eio && is_expected_ioerr(r)) {
+      derr << __func__ << " translating the error to EIO for upper layer"
+	   << dendl;
+      ioc->set_return_value(-EIO);
+    } else {
+      if (is_expected_ioerr(r)) {
+	note_io_error_event(
+	  devname.c_str(),
+	  path.c_str(),
+	  r,
+#if defined(HAVE_POSIXAIO)
+	  aio->aio.aiocb.aio_lio_opcode,
+#else
+	  aio->iocb.aio_lio_opcode,
+#endif
+	  aio->offset,
+	  aio->length);
+	ceph_abort_msg(
+	  "Unexpected IO error. "
+	  "This may suggest a hardware issue. "
+	  "Please check your kernel log!");
+      }
+      ceph_abort_msg(
+	"Unexpected IO error. "
+	"This may suggest HW issue. Please check your dmesg!");
+    }
+  } else if (aio->length != (uint64_t)r) {
+    derr << "aio to 0x" << std::hex << aio->offset
+	 << "~" << aio->length << std::dec
+	 << " but returned: " << r << dendl;
+    ceph_abort_msg("unexpected aio return value: does not match length");
+  }
+
+  dout(10) << __func__ << " finished aio " << aio << " r " << r
+	   << " ioc " << ioc
+	   << " with " << (ioc->num_running.load() - 1)
+	   << " aios left" << dendl;
+
+  // NOTE: once num_running and we either call the callback or
+  // call aio_wake we cannot touch ioc or aio as the caller
+  // may free it.
+  if (ioc->priv) {
+    if (--ioc->num_running == 0) {
+      aio_callback(aio_callback_priv, ioc->priv);
+    }
+  } else {
+    ioc->try_aio_wake();
+  }
+}
+
 void KernelDevice::_aio_thread()
 {
   dout(10) << __func__ << " start" << dendl;
@@ -677,73 +752,7 @@ void KernelDevice::_aio_thread()
     if (r > 0) {
       dout(30) << __func__ << " got " << r << " completed aios" << dendl;
       for (int i = 0; i < r; ++i) {
-	IOContext *ioc = static_cast<IOContext*>(aio[i]->priv);
-	_aio_log_finish(ioc, aio[i]->offset, aio[i]->length);
-	if (aio[i]->queue_item.is_linked()) {
-	  std::lock_guard l(debug_queue_lock);
-	  debug_aio_unlink(*aio[i]);
-	}
-
-	// set flag indicating new ios have completed.  we do this *before*
-	// any completion or notifications so that any user flush() that
-	// follows the observed io completion will include this io.  Note
-	// that an earlier, racing flush() could observe and clear this
-	// flag, but that also ensures that the IO will be stable before the
-	// later flush() occurs.
-	io_since_flush.store(true);
-
-	long r = aio[i]->get_return_value();
-        if (r < 0) {
-          derr << __func__ << " got r=" << r << " (" << cpp_strerror(r) << ")"
-	       << dendl;
-          if (ioc->allow_eio && is_expected_ioerr(r)) {
-            derr << __func__ << " translating the error to EIO for upper layer"
-		 << dendl;
-            ioc->set_return_value(-EIO);
-          } else {
-	    if (is_expected_ioerr(r)) {
-	      note_io_error_event(
-		devname.c_str(),
-		path.c_str(),
-		r,
-#if defined(HAVE_POSIXAIO)
-                aio[i]->aio.aiocb.aio_lio_opcode,
-#else
-                aio[i]->iocb.aio_lio_opcode,
-#endif
-		aio[i]->offset,
-		aio[i]->length);
-	      ceph_abort_msg(
-		"Unexpected IO error. "
-		"This may suggest a hardware issue. "
-		"Please check your kernel log!");
-	    }
-	    ceph_abort_msg(
-	      "Unexpected IO error. "
-	      "This may suggest HW issue. Please check your dmesg!");
-          }
-        } else if (aio[i]->length != (uint64_t)r) {
-          derr << "aio to 0x" << std::hex << aio[i]->offset
-	       << "~" << aio[i]->length << std::dec
-               << " but returned: " << r << dendl;
-          ceph_abort_msg("unexpected aio return value: does not match length");
-        }
-
-        dout(10) << __func__ << " finished aio " << aio[i] << " r " << r
-                 << " ioc " << ioc
-                 << " with " << (ioc->num_running.load() - 1)
-                 << " aios left" << dendl;
-
-	// NOTE: once num_running and we either call the callback or
-	// call aio_wake we cannot touch ioc or aio[] as the caller
-	// may free it.
-	if (ioc->priv) {
-	  if (--ioc->num_running == 0) {
-	    aio_callback(aio_callback_priv, ioc->priv);
-	  }
-	} else {
-          ioc->try_aio_wake();
-	}
+	_aio_finish(aio[i]);
       }
     }
     if (cct->_conf->bdev_debug_aio) {
@@ -1012,6 +1021,11 @@ void KernelDevice::aio_submit(IOContext *ioc)
     }
   }
 
+  if (aio_inline_completion && !ioc->priv) {
+    // nobody but the waiter is notified, it can complete the aios itself
+    ioc->poller = this;
+  }
+
   void *priv = static_cast<void*>(ioc);
   int retry_max = cct->_conf->bdev_aio_submit_retry_max;
   int initial_delay_us = cct->_conf->bdev_aio_submit_retry_initial_delay_us;
@@ -1031,6 +1045,23 @@ void KernelDevice::aio_submit(IOContext *ioc)
   }
 }
 
+bool KernelDevice::aio_poll(IOContext *ioc)
+{
+  int max = cct->_conf->bdev_aio_reap_max;
+  aio_t *aio[max];
+  // the callbacks may need locks held by the waiter, those completions are
+  // left to the aio thread
+  int r = io_queue->reap_completed(aio, max, [](const aio_t *a) {
+    return static_cast<IOContext*>(a->priv)->priv == nullptr;
+  });
+  dout(30) << __func__ << " ioc " << ioc << " reaped " << r << " aios" << dendl;
+  for (int i = 0; i < r; ++i) {
+    _aio_finish(aio[i]);
+  }
+  // without completion interrupts keep polling until our aios are done
+  return r > 0 || io_queue->is_polled();
+}
+
 int KernelDevice::_sync_write(uint64_t off, bufferlist &bl, bool buffered, int write_hint)
 {
   uint64_t len = bl.length();
@@ -1472,8 +1503,13 @@ int KernelDevice::aio_read(
     ioc->pending_aios.push_back(aio_t(ioc, fd_directs[WRITE_LIFE_NOT_SET]));
     ++ioc->num_pending;
     aio_t& aio = ioc->pending_aios.back();
-    aio.bl.push_back(
-      ceph::buffer::ptr_node::create(create_custom_aligned(len, ioc)));
+    // a buffer kept in the cache holds its slot until it is trimmed, we
+    // fall back to a regular buffer while none is free
+    auto raw = io_queue->get_registered_buffer(len);
+    if (!raw) {
+      raw = create_custom_aligned(len, ioc);
+    }
+    aio.bl.push_back(ceph::buffer::ptr_node::create(std::move(raw)));
     aio.bl.prepare_iov(&aio.iov);
     aio.preadv(off, len);
     dout(30) << aio << dendl;
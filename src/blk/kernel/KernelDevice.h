@@ -60,6 +60,7 @@ private:
   aio_callback_t discard_callback;
   void *discard_callback_priv;
   bool aio_stop;
+  bool aio_inline_completion = false; ///< waiters reap their own aios
   bool need_notify = false;
   std::unique_ptr<PerfCounters> logger;
 
@@ -95,6 +96,7 @@ private:
   virtual void  _pre_close() { }  // hook for child implementations
 
   void _aio_thread();
+  void _aio_finish(aio_t *aio);
   void _discard_thread(DiscardThread* thr);
   bool _queue_discard(interval_set<uint64_t> &to_release);
   bool try_discard(interval_set<uint64_t> &to_release,
@@ -135,6 +137,7 @@ public:
   ~KernelDevice();
 
   void aio_submit(IOContext *ioc) override;
+  bool aio_poll(IOContext *ioc) override;
   void discard_drain() override;
   void swap_discard_queued(interval_set<uint64_t>& other) override;
   int collect_metadata(const std::string& prefix, std::map<std::string,std::string> *pm) const override;
@@ -6,18 +6,54 @@
 #if defined(HAVE_LIBURING)
 
 #include "liburing.h"
+#include "common/deleter.h"
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <algorithm>
+#include <atomic>
 #include <map>
+#include <mutex>
 
 using std::list;
 using std::make_unique;
 
+/*
+ * the registered buffers are slots of a single aligned arena, a slot given
+ * out by get_registered_buffer() is returned once its last bufferptr is gone
+ * (which may be after the ring was shut down, hence the shared_ptr)
+ */
+struct ioring_reg_slots {
+  ceph::bufferptr arena;
+  unsigned slot_size = 0;
+  unsigned num_slots = 0;
+  std::mutex lock;
+  std::vector<unsigned> free_slots;
+
+  bool find_slot(const iovec &iov, unsigned *slot) const {
+    const char *base = arena.c_str();
+    const char *addr = static_cast<const char*>(iov.iov_base);
+    if (addr < base || addr >= base + (uint64_t)slot_size * num_slots) {
+      return false;
+    }
+    unsigned idx = (addr - base) / slot_size;
+    if (addr + iov.iov_len > base + (uint64_t)slot_size * (idx + 1)) {
+      return false;
+    }
+    *slot = idx;
+    return true;
+  }
+};
+
 struct ioring_data {
   struct io_uring io_uring;
   pthread_mutex_t cq_mutex;
   pthread_mutex_t sq_mutex;
   int epoll_fd = -1;
+  int handoff_fd = -1;             ///< wakes get_next_completed() up
+  std::vector<aio_t*> handoff;     ///< reaped by a poller for get_next_completed(), under cq_mutex
+  std::atomic<int> inflight = {0}; ///< submitted, not reaped yet (may be reaped before counted)
   std::map<int, int> fixed_fds_map;
+  std::shared_ptr<ioring_reg_slots> reg_slots;
 };
 
 static int ioring_get_cqe(struct ioring_data *d, unsigned int max,
@@ -28,20 +64,38 @@ static int ioring_get_cqe(struct ioring_data *d, unsigned int max,
 
   unsigned nr = 0;
   unsigned head;
+
+  /* completions left by the pollers go first */
+  while (!d->handoff.empty() && nr < max) {
+    paio[nr++] = d->handoff.back();
+    d->handoff.pop_back();
+  }
+  if (nr == max)
+    return nr;
+
+  unsigned reaped = 0;
   io_uring_for_each_cqe(ring, head, cqe) {
     struct aio_t *io = (struct aio_t *)(uintptr_t) io_uring_cqe_get_data(cqe);
     io->rval = cqe->res;
 
     paio[nr++] = io;
+    ++reaped;
 
     if (nr == max)
       break;
   }
-  io_uring_cq_advance(ring, nr);
+  io_uring_cq_advance(ring, reaped);
+  d->inflight -= (int)reaped;
 
   return nr;
 }
 
+/* with IOPOLL nothing is posted to the CQ ring until someone polls */
+static void ioring_iopoll(struct ioring_data *d)
+{
+  io_uring_enter(d->io_uring.ring_fd, 0, 0, IORING_ENTER_GETEVENTS, NULL);
+}
+
 static int find_fixed_fd(struct ioring_data *d, int real_fd)
 {
   auto it = d->fixed_fds_map.find(real_fd);
@@ -58,7 +112,19 @@ static void init_sqe(struct ioring_data *d, struct io_uring_sqe *sqe,
 
   ceph_assert(fixed_fd != -1);
 
-  if (io->iocb.aio_lio_opcode == IO_CMD_PWRITEV)
+  unsigned slot;
+  if (d->reg_slots && io->iov.size() == 1 &&
+      d->reg_slots->find_slot(io->iov[0], &slot)) {
+    /* no page pinning/unpinning for a registered buffer */
+    if (io->iocb.aio_lio_opcode == IO_CMD_PWRITEV)
+      io_uring_prep_write_fixed(sqe, fixed_fd, io->iov[0].iov_base,
+				io->iov[0].iov_len, io->offset, slot);
+    else if (io->iocb.aio_lio_opcode == IO_CMD_PREADV)
+      io_uring_prep_read_fixed(sqe, fixed_fd, io->iov[0].iov_base,
+			       io->iov[0].iov_len, io->offset, slot);
+    else
+      ceph_assert(0);
+  } else if (io->iocb.aio_lio_opcode == IO_CMD_PWRITEV)
     io_uring_prep_writev(sqe, fixed_fd, &io->iov[0],
 			 io->iov.size(), io->offset);
   else if (io->iocb.aio_lio_opcode == IO_CMD_PREADV)
@@ -107,11 +173,37 @@ static void build_fixed_fds_map(struct ioring_data *d,
   }
 }
 
-ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_) :
+static int register_buffers(struct ioring_data *d, unsigned num,
+			    unsigned size)
+{
+  auto slots = std::make_shared<ioring_reg_slots>();
+  slots->arena = ceph::buffer::create_aligned_in_mempool(
+    (uint64_t)num * size, CEPH_PAGE_SIZE, mempool::mempool_buffer_anon);
+  slots->slot_size = size;
+  slots->num_slots = num;
+
+  std::vector<iovec> iovs(num);
+  for (unsigned i = 0; i < num; i++) {
+    iovs[i].iov_base = slots->arena.c_str() + (uint64_t)i * size;
+    iovs[i].iov_len = size;
+    slots->free_slots.push_back(num - 1 - i);
+  }
+  int ret = io_uring_register_buffers(&d->io_uring, iovs.data(), num);
+  if (ret < 0)
+    return ret;
+
+  d->reg_slots = std::move(slots);
+  return 0;
+}
+
+ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_,
+			       unsigned reg_buffers_, unsigned reg_buffer_size_) :
   d(make_unique<ioring_data>()),
   iodepth(iodepth_),
   hipri(hipri_),
-  sq_thread(sq_thread_)
+  sq_thread(sq_thread_),
+  reg_buffers(reg_buffers_),
+  reg_buffer_size(reg_buffer_size_)
 {
 }
 
@@ -144,25 +236,54 @@ int ioring_queue_t::init(std::vector<int> &fds)
 
   build_fixed_fds_map(d.get(), fds);
 
+  if (reg_buffers && reg_buffer_size) {
+    /* the registered buffers are an optimization only, go on without them
+       if they can't be registered (e.g. over RLIMIT_MEMLOCK) */
+    if (register_buffers(d.get(), reg_buffers, reg_buffer_size) < 0)
+      reg_buffers = 0;
+  }
+
   d->epoll_fd = epoll_create1(0);
   if (d->epoll_fd < 0) {
     ret = -errno;
-    goto unregister_files;
+    goto unregister_buffers;
   }
 
   struct epoll_event ev;
   ev.events = EPOLLIN;
+  ev.data.fd = d->io_uring.ring_fd;
   ret = epoll_ctl(d->epoll_fd, EPOLL_CTL_ADD, d->io_uring.ring_fd, &ev);
   if (ret < 0) {
     ret = -errno;
     goto close_epoll_fd;
   }
 
+  d->handoff_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (d->handoff_fd < 0) {
+    ret = -errno;
+    goto close_epoll_fd;
+  }
+  ev.events = EPOLLIN;
+  ev.data.fd = d->handoff_fd;
+  ret = epoll_ctl(d->epoll_fd, EPOLL_CTL_ADD, d->handoff_fd, &ev);
+  if (ret < 0) {
+    ret = -errno;
+    goto close_handoff_fd;
+  }
+
   return 0;
 
+close_handoff_fd:
+  close(d->handoff_fd);
+  d->handoff_fd = -1;
 close_epoll_fd:
   close(d->epoll_fd);
-unregister_files:
+  d->epoll_fd = -1;
+unregister_buffers:
+  if (d->reg_slots) {
+    io_uring_unregister_buffers(&d->io_uring);
+    d->reg_slots.reset();
+  }
   io_uring_unregister_files(&d->io_uring);
 close_ring_fd:
   io_uring_queue_exit(&d->io_uring);
@@ -173,8 +294,15 @@ close_ring_fd:
 void ioring_queue_t::shutdown()
 {
   d->fixed_fds_map.clear();
+  d->handoff.clear();
+  close(d->handoff_fd);
+  d->handoff_fd = -1;
   close(d->epoll_fd);
   d->epoll_fd = -1;
+  if (d->reg_slots) {
+    io_uring_unregister_buffers(&d->io_uring);
+    d->reg_slots.reset();
+  }
   io_uring_unregister_files(&d->io_uring);
   io_uring_queue_exit(&d->io_uring);
 }
@@ -189,29 +317,105 @@ int ioring_queue_t::submit_batch(aio_iter beg, aio_iter end,
   int rc = ioring_queue(d.get(), priv, beg, end);
   pthread_mutex_unlock(&d->sq_mutex);
 
+  /* an idle get_next_completed() blocks, it has to start polling now */
+  if (rc > 0 && d->inflight.fetch_add(rc) <= 0 && hipri)
+    eventfd_write(d->handoff_fd, 1);
+
   return rc;
 }
 
 int ioring_queue_t::get_next_completed(int timeout_ms, aio_t **paio, int max)
 {
 get_cqe:
+  if (hipri)
+    ioring_iopoll(d.get());
   pthread_mutex_lock(&d->cq_mutex);
   int events = ioring_get_cqe(d.get(), max, paio);
   pthread_mutex_unlock(&d->cq_mutex);
 
   if (events == 0) {
     struct epoll_event ev;
-    int ret = TEMP_FAILURE_RETRY(epoll_wait(d->epoll_fd, &ev, 1, timeout_ms));
+    /* polled completions never wake us up, come back soon to poll again
+       while some are due; otherwise block until submit_batch() wakes us */
+    int wait_ms = timeout_ms;
+    if (hipri && d->inflight.load() > 0)
+      wait_ms = std::min(timeout_ms, 1);
+    int ret = TEMP_FAILURE_RETRY(epoll_wait(d->epoll_fd, &ev, 1, wait_ms));
     if (ret < 0)
       events = -errno;
-    else if (ret > 0)
+    else if (ret > 0) {
+      if (ev.data.fd == d->handoff_fd) {
+	eventfd_t val;
+	eventfd_read(d->handoff_fd, &val);
+      }
       /* Time to reap */
       goto get_cqe;
+    }
   }
 
   return events;
 }
 
+int ioring_queue_t::reap_completed(aio_t **paio, int max,
+				   const std::function<bool(const aio_t*)>& can_complete)
+{
+  struct io_uring *ring = &d->io_uring;
+  struct io_uring_cqe *cqe;
+  unsigned head;
+  int nr = 0;
+  unsigned reaped = 0;
+  bool handed_off = false;
+
+  if (hipri)
+    ioring_iopoll(d.get());
+
+  pthread_mutex_lock(&d->cq_mutex);
+  io_uring_for_each_cqe(ring, head, cqe) {
+    if (nr == max)
+      break;
+    struct aio_t *io = (struct aio_t *)(uintptr_t) io_uring_cqe_get_data(cqe);
+    io->rval = cqe->res;
+    ++reaped;
+    if (can_complete(io)) {
+      paio[nr++] = io;
+    } else {
+      d->handoff.push_back(io);
+      handed_off = true;
+    }
+  }
+  io_uring_cq_advance(ring, reaped);
+  d->inflight -= (int)reaped;
+  pthread_mutex_unlock(&d->cq_mutex);
+
+  if (handed_off)
+    eventfd_write(d->handoff_fd, 1);
+
+  return nr;
+}
+
+ceph::unique_leakable_ptr<ceph::buffer::raw>
+ioring_queue_t::get_registered_buffer(unsigned len)
+{
+  auto slots = d->reg_slots;
+  if (!slots || len > slots->slot_size)
+    return nullptr;
+
+  unsigned slot;
+  {
+    std::lock_guard l(slots->lock);
+    if (slots->free_slots.empty())
+      return nullptr;
+    slot = slots->free_slots.back();
+    slots->free_slots.pop_back();
+  }
+  return ceph::buffer::claim_buffer(
+    len, slots->arena.c_str() + (uint64_t)slot * slots->slot_size,
+    make_deleter([slots, slot] {
+      std::lock_guard l(slots->lock);
+      slots->free_slots.push_back(slot);
+    }));
+}
+
 bool ioring_queue_t::supported()
 {
   struct io_uring ring;
@@ -227,7 +431,8 @@ bool ioring_queue_t::supported()
 
 struct ioring_data {};
 
-ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_)
+ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_,
+			       unsigned reg_buffers_, unsigned reg_buffer_size_)
 {
   ceph_assert(0);
 }
@@ -259,6 +464,18 @@ int ioring_queue_t::get_next_completed(int timeout_ms, aio_t **paio, int max)
   ceph_assert(0);
 }
 
+int ioring_queue_t::reap_completed(aio_t **paio, int max,
+				   const std::function<bool(const aio_t*)>& can_complete)
+{
+  ceph_assert(0);
+}
+
+ceph::unique_leakable_ptr<ceph::buffer::raw>
+ioring_queue_t::get_registered_buffer(unsigned len)
+{
+  ceph_assert(0);
+}
+
 bool ioring_queue_t::supported()
 {
   return false;
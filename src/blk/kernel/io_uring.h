@@ -19,13 +19,16 @@ struct ioring_queue_t final : public io_queue_t {
   unsigned iodepth = 0;
   bool hipri = false;
   bool sq_thread = false;
+  unsigned reg_buffers = 0;       ///< number of registered (fixed) buffers
+  unsigned reg_buffer_size = 0;   ///< size of every registered buffer
 
   typedef std::list<aio_t>::iterator aio_iter;
 
   // Returns true if arch is x86-64 and kernel supports io_uring
   static bool supported();
 
-  ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_);
+  ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_,
+		 unsigned reg_buffers_ = 0, unsigned reg_buffer_size_ = 0);
   ~ioring_queue_t() final;
 
   int init(std::vector<int> &fds) final;
@@ -34,4 +37,10 @@ struct ioring_queue_t final : public io_queue_t {
   int submit_batch(aio_iter begin, aio_iter end,
                    void *priv, int *retries, int submit_retries, int initial_delay_us) final;
   int get_next_completed(int timeout_ms, aio_t **paio, int max) final;
+  int reap_completed(aio_t **paio, int max,
+		     const std::function<bool(const aio_t*)>& can_complete) final;
+  ceph::unique_leakable_ptr<ceph::buffer::raw> get_registered_buffer(unsigned len) final;
+  bool is_polled() const final {
+    return hipri;
+  }
 };
@@ -85,6 +85,28 @@ static int cls_rc_refcount_get(cls_method_context_t hctx, bufferlist *in, buffer
   return 0;
 }
 
+/* drop the reference held by tag, returns false if there is nothing to drop */
+static bool drop_ref(obj_refcount& objr, const string& tag, bool implicit_ref)
+{
+  auto iter = objr.refs.find(tag);
+  if (iter == objr.refs.end()) {
+    if (!implicit_ref) {
+      return false;
+    }
+    iter = objr.refs.find(wildcard_tag);
+    if (iter == objr.refs.end()) {
+      return false;
+    }
+  }
+
+  if (objr.retired_refs.find(tag) != objr.retired_refs.end())
+    return false;
+
+  objr.retired_refs.insert(tag);
+  objr.refs.erase(iter);
+  return true;
+}
+
 static int cls_rc_refcount_put(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 {
   auto in_iter = in->cbegin();
@@ -109,23 +131,54 @@ static int cls_rc_refcount_put(cls_method_context_t hctx, bufferlist *in, buffer
 
   CLS_LOG(10, "cls_rc_refcount_put() tag=%s\n", op.tag.c_str());
 
-  bool found = false;
-  auto iter = objr.refs.find(op.tag);
-  if (iter != objr.refs.end()) {
-    found = true;
-  } else if (op.implicit_ref) {
-    iter = objr.refs.find(wildcard_tag);
-    if (iter != objr.refs.end()) {
-      found = true;
-    }
+  if (!drop_ref(objr, op.tag, op.implicit_ref))
+    return 0;
+
+  if (objr.refs.empty()) {
+    return cls_cxx_remove(hctx);
   }
 
-  if (!found ||
-      objr.retired_refs.find(op.tag) != objr.retired_refs.end())
-    return 0;
+  ret = set_refcount(hctx, objr);
+  if (ret < 0)
+    return ret;
 
-  objr.retired_refs.insert(op.tag);
-  objr.refs.erase(iter);
+  return 0;
+}
+
+/* same as put for a batch of tags, e.g. the tags of all the deleted objects
+ * sharing a (deduped) tail object, with a single read/write of the refcount */
+static int cls_rc_refcount_put_many(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  auto in_iter = in->cbegin();
+
+  cls_refcount_put_many_op op;
+  try {
+    decode(op, in_iter);
+  } catch (ceph::buffer::error& err) {
+    CLS_LOG(1, "ERROR: cls_rc_refcount_put_many(): failed to decode entry\n");
+    return -EINVAL;
+  }
+
+  obj_refcount objr;
+  int ret = read_refcount(hctx, op.implicit_ref, &objr);
+  if (ret < 0)
+    return ret;
+
+  if (objr.refs.empty()) {// shouldn't happen!
+    CLS_LOG(0, "ERROR: cls_rc_refcount_put_many() was called without any references!\n");
+    return -EINVAL;
+  }
+
+  CLS_LOG(10, "cls_rc_refcount_put_many() num_tags=%zu\n", op.tags.size());
+
+  bool modified = false;
+  for (const auto& tag : op.tags) {
+    if (drop_ref(objr, tag, op.implicit_ref)) {
+      modified = true;
+    }
+  }
+  if (!modified)
+    return 0;
 
   if (objr.refs.empty()) {
     return cls_cxx_remove(hctx);
@@ -201,6 +254,7 @@ CLS_INIT(refcount)
   cls_handle_t h_class;
   cls_method_handle_t h_refcount_get;
   cls_method_handle_t h_refcount_put;
+  cls_method_handle_t h_refcount_put_many;
   cls_method_handle_t h_refcount_set;
   cls_method_handle_t h_refcount_read;
 
@@ -209,6 +263,7 @@ CLS_INIT(refcount)
   /* refcount */
   cls_register_cxx_method(h_class, "get", CLS_METHOD_RD | CLS_METHOD_WR, cls_rc_refcount_get, &h_refcount_get);
   cls_register_cxx_method(h_class, "put", CLS_METHOD_RD | CLS_METHOD_WR, cls_rc_refcount_put, &h_refcount_put);
+  cls_register_cxx_method(h_class, "put_many", CLS_METHOD_RD | CLS_METHOD_WR, cls_rc_refcount_put_many, &h_refcount_put_many);
   cls_register_cxx_method(h_class, "set", CLS_METHOD_RD | CLS_METHOD_WR, cls_rc_refcount_set, &h_refcount_set);
   cls_register_cxx_method(h_class, "read", CLS_METHOD_RD, cls_rc_refcount_read, &h_refcount_read);
 
@@ -32,6 +32,16 @@ void cls_refcount_put(librados::ObjectWriteOperation& op, const string& tag, boo
   op.exec("refcount", "put", in);
 }
 
+void cls_refcount_put_many(librados::ObjectWriteOperation& op, const std::vector<string>& tags, bool implicit_ref)
+{
+  bufferlist in;
+  cls_refcount_put_many_op call;
+  call.tags = tags;
+  call.implicit_ref = implicit_ref;
+  encode(call, in);
+  op.exec("refcount", "put_many", in);
+}
+
 void cls_refcount_set(librados::ObjectWriteOperation& op, list<string>& refs)
 {
   bufferlist in;
@@ -6,6 +6,7 @@
 
 #include <list>
 #include <string>
+#include <vector>
 
 #include "include/rados/librados_fwd.hpp"
 #include "include/types.h"
@@ -34,6 +35,9 @@
 
 void cls_refcount_get(librados::ObjectWriteOperation& op, const std::string& tag, bool implicit_ref = false);
 void cls_refcount_put(librados::ObjectWriteOperation& op, const std::string& tag, bool implicit_ref = false);
+// drop the references of all @tags with a single call, the object is removed
+// once no reference is left. requires OSDs supporting refcount.put_many
+void cls_refcount_put_many(librados::ObjectWriteOperation& op, const std::vector<std::string>& tags, bool implicit_ref = false);
 void cls_refcount_set(librados::ObjectWriteOperation& op, std::list<std::string>& refs);
 // these overloads which call io_ctx.operate() or io_ctx.exec() should not be called in the rgw.
 // rgw_rados_operate() should be called after the overloads w/o calls to io_ctx.operate()/exec()
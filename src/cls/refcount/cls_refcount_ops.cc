@@ -42,6 +42,25 @@ list<cls_refcount_put_op> cls_refcount_put_op::generate_test_instances()
 
 
 
+void cls_refcount_put_many_op::dump(ceph::Formatter *f) const
+{
+  encode_json("tags", tags, f);
+  f->dump_int("implicit_ref", (int)implicit_ref);
+}
+
+list<cls_refcount_put_many_op> cls_refcount_put_many_op::generate_test_instances()
+{
+  list<cls_refcount_put_many_op> ls;
+  ls.emplace_back();
+  ls.emplace_back();
+  ls.back().tags.push_back("foo");
+  ls.back().tags.push_back("bar");
+  ls.back().implicit_ref = true;
+  return ls;
+}
+
+
+
 void cls_refcount_set_op::dump(ceph::Formatter *f) const
 {
   encode_json("refs", refs, f);
@@ -57,6 +57,32 @@ struct cls_refcount_put_op {
 };
 WRITE_CLASS_ENCODER(cls_refcount_put_op)
 
+struct cls_refcount_put_many_op {
+  std::vector<std::string> tags;
+  bool implicit_ref; // assume wildcard reference for
+                          // objects without a std::set ref
+
+  cls_refcount_put_many_op() : implicit_ref(false) {}
+
+  void encode(ceph::buffer::list& bl) const {
+    ENCODE_START(1, 1, bl);
+    encode(tags, bl);
+    encode(implicit_ref, bl);
+    ENCODE_FINISH(bl);
+  }
+
+  void decode(ceph::buffer::list::const_iterator& bl) {
+    DECODE_START(1, bl);
+    decode(tags, bl);
+    decode(implicit_ref, bl);
+    DECODE_FINISH(bl);
+  }
+
+  void dump(ceph::Formatter *f) const;
+  static std::list<cls_refcount_put_many_op> generate_test_instances();
+};
+WRITE_CLASS_ENCODER(cls_refcount_put_many_op)
+
 struct cls_refcount_set_op {
   std::list<std::string> refs;
 
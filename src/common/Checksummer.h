@@ -4,9 +4,13 @@
 #ifndef CEPH_OS_BLUESTORE_CHECKSUMMER
 #define CEPH_OS_BLUESTORE_CHECKSUMMER
 
+#include <algorithm>
+#include <cstring>
+
 #include "include/buffer.h"
 #include "include/byteorder.h"
 #include "include/ceph_assert.h"
+#include "include/crc32c.h"
 
 #include "xxHash/xxhash.h"
 
@@ -19,6 +23,7 @@ public:
     CSUM_CRC32C = 4,
     CSUM_CRC32C_16 = 5, // low 16 bits of crc32c
     CSUM_CRC32C_8 = 6,  // low 8 bits of crc32c
+    CSUM_XXH3_64 = 7,
     CSUM_MAX,
   };
   static const char *get_csum_type_string(unsigned t) {
@@ -29,6 +34,7 @@ public:
     case CSUM_CRC32C: return "crc32c";
     case CSUM_CRC32C_16: return "crc32c_16";
     case CSUM_CRC32C_8: return "crc32c_8";
+    case CSUM_XXH3_64: return "xxh3_64";
     default: return "???";
     }
   }
@@ -45,6 +51,8 @@ public:
       return CSUM_CRC32C_16;
     if (s == "crc32c_8")
       return CSUM_CRC32C_8;
+    if (s == "xxh3_64")
+      return CSUM_XXH3_64;
     return -EINVAL;
   }
 
@@ -56,6 +64,7 @@ public:
     case CSUM_CRC32C: return sizeof(crc32c::init_value_t);
     case CSUM_CRC32C_16: return sizeof(crc32c_16::init_value_t);
     case CSUM_CRC32C_8: return sizeof(crc32c_8::init_value_t);
+    case CSUM_XXH3_64: return sizeof(xxh3_64::init_value_t);
     default: return 0;
     }
   }
@@ -67,6 +76,7 @@ public:
     case CSUM_CRC32C: return 4;
     case CSUM_CRC32C_16: return 2;
     case CSUM_CRC32C_8: return 1;
+    case CSUM_XXH3_64: return 8;
     default: return 0;
     }
   }
@@ -90,6 +100,14 @@ public:
       ) {
       return p.crc32c(len, init_value);
     }
+    static init_value_t calc(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char *data
+      ) {
+      return ceph_crc32c(init_value, (const unsigned char*)data, len);
+    }
   };
 
   struct crc32c_16 {
@@ -111,6 +129,14 @@ public:
       ) {
       return p.crc32c(len, init_value) & 0xffff;
     }
+    static init_value_t calc(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char *data
+      ) {
+      return ceph_crc32c(init_value, (const unsigned char*)data, len) & 0xffff;
+    }
   };
 
   struct crc32c_8 {
@@ -132,6 +158,14 @@ public:
       ) {
       return p.crc32c(len, init_value) & 0xff;
     }
+    static init_value_t calc(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char *data
+      ) {
+      return ceph_crc32c(init_value, (const unsigned char*)data, len) & 0xff;
+    }
   };
 
   struct xxhash32 {
@@ -161,6 +195,14 @@ public:
       }
       return XXH32_digest(state);
     }
+    static init_value_t calc(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char *data
+      ) {
+      return XXH32(data, len, init_value);
+    }
   };
 
   struct xxhash64 {
@@ -190,8 +232,64 @@ public:
       }
       return XXH64_digest(state);
     }
+    static init_value_t calc(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char *data
+      ) {
+      return XXH64(data, len, init_value);
+    }
+  };
+
+  // XXH3 picks the widest vector unit the build targets (SSE2 at least on
+  // x86_64, NEON on aarch64) and is several times faster than xxhash64.
+  struct xxh3_64 {
+    typedef uint64_t init_value_t;
+    typedef ceph_le64 value_t;
+
+    typedef XXH3_state_t *state_t;
+    static void init(state_t *s) {
+      *s = XXH3_createState();
+    }
+    static void fini(state_t *s) {
+      XXH3_freeState(*s);
+    }
+
+    static init_value_t calc(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      ceph::buffer::list::const_iterator& p
+      ) {
+      XXH3_64bits_reset_withSeed(state, init_value);
+      while (len > 0) {
+	const char *data;
+	size_t l = p.get_ptr_and_advance(len, &data);
+	XXH3_64bits_update(state, data, l);
+	len -= l;
+      }
+      return XXH3_64bits_digest(state);
+    }
+    static init_value_t calc(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char *data
+      ) {
+      return XXH3_64bits_withSeed(data, len, init_value);
+    }
   };
 
+  /// returns the start of @bl if its first @length bytes are contiguous
+  static const char *get_contiguous(const ceph::buffer::list &bl,
+                                    size_t length) {
+    if (bl.get_num_buffers() == 0 || bl.front().length() < length) {
+      return nullptr;
+    }
+    return bl.front().c_str();
+  }
+
   template<class Alg>
   static int calculate(
     size_t csum_block_size,
@@ -213,18 +311,29 @@ public:
       ceph::buffer::ptr* csum_data) {
     ceph_assert(length % csum_block_size == 0);
     size_t blocks = length / csum_block_size;
-    ceph::buffer::list::const_iterator p = bl.begin();
     ceph_assert(bl.length() >= length);
 
-    typename Alg::state_t state;
-    Alg::init(&state);
-
     ceph_assert(csum_data->length() >= (offset + length) / csum_block_size *
 	   sizeof(typename Alg::value_t));
 
     typename Alg::value_t *pv =
       reinterpret_cast<typename Alg::value_t*>(csum_data->c_str());
     pv += offset / csum_block_size;
+
+    // fast path: no bufferlist iteration and no hash state
+    if (const char *data = get_contiguous(bl, length); data) {
+      typename Alg::state_t state{};
+      while (blocks--) {
+	*pv = Alg::calc(state, init_value, csum_block_size, data);
+	data += csum_block_size;
+	++pv;
+      }
+      return 0;
+    }
+
+    ceph::buffer::list::const_iterator p = bl.begin();
+    typename Alg::state_t state;
+    Alg::init(&state);
     while (blocks--) {
       *pv = Alg::calc(state, init_value, csum_block_size, p);
       ++pv;
@@ -243,16 +352,47 @@ public:
     uint64_t *bad_csum=0
     ) {
     ceph_assert(length % csum_block_size == 0);
-    ceph::buffer::list::const_iterator p = bl.begin();
     ceph_assert(bl.length() >= length);
 
-    typename Alg::state_t state;
-    Alg::init(&state);
-
     const typename Alg::value_t *pv =
       reinterpret_cast<const typename Alg::value_t*>(csum_data.c_str());
     pv += offset / csum_block_size;
     size_t pos = offset;
+
+    if (const char *data = get_contiguous(bl, length); data) {
+      // Checksum a batch of blocks back to back and compare the batch with a
+      // single memcmp; only a mismatching batch is looked at block by block.
+      constexpr size_t batch = 64;
+      typename Alg::value_t vals[batch];
+      typename Alg::state_t state{};
+      while (length > 0) {
+	size_t n = std::min(batch, length / csum_block_size);
+	for (size_t i = 0; i < n; ++i) {
+	  vals[i] = Alg::calc(state, -1, csum_block_size,
+			      data + i * csum_block_size);
+	}
+	if (memcmp(vals, pv, n * sizeof(typename Alg::value_t)) != 0) {
+	  for (size_t i = 0; i < n; ++i) {
+	    typename Alg::init_value_t v = vals[i];
+	    if (pv[i] != v) {
+	      if (bad_csum) {
+		*bad_csum = v;
+	      }
+	      return pos + i * csum_block_size;
+	    }
+	  }
+	}
+	data += n * csum_block_size;
+	pv += n;
+	pos += n * csum_block_size;
+	length -= n * csum_block_size;
+      }
+      return -1;  // no errors
+    }
+
+    ceph::buffer::list::const_iterator p = bl.begin();
+    typename Alg::state_t state;
+    Alg::init(&state);
     while (length > 0) {
       typename Alg::init_value_t v = Alg::calc(state, -1, csum_block_size, p);
       if (*pv != v) {
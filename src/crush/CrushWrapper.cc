@@ -375,6 +375,107 @@ bool CrushWrapper::subtree_contains(int root, int item) const
   return false;
 }
 
+bool CrushWrapper::rule_mapping_equal(const CrushWrapper& other, int rule,
+				      int64_t choose_args_index) const
+{
+  const crush_map *a = crush;
+  const crush_map *b = other.crush;
+  if (a->choose_local_tries != b->choose_local_tries ||
+      a->choose_local_fallback_tries != b->choose_local_fallback_tries ||
+      a->choose_total_tries != b->choose_total_tries ||
+      a->chooseleaf_descend_once != b->chooseleaf_descend_once ||
+      a->chooseleaf_vary_r != b->chooseleaf_vary_r ||
+      a->chooseleaf_stable != b->chooseleaf_stable ||
+      a->msr_descents != b->msr_descents ||
+      a->msr_collision_tries != b->msr_collision_tries ||
+      a->straw_calc_version != b->straw_calc_version) {
+    return false;
+  }
+  if (!rule_exists(rule) || !other.rule_exists(rule)) {
+    return !rule_exists(rule) && !other.rule_exists(rule);
+  }
+  const crush_rule *ra = a->rules[rule];
+  const crush_rule *rb = b->rules[rule];
+  if (ra->len != rb->len || ra->type != rb->type) {
+    return false;
+  }
+  set<int> todo;
+  for (unsigned i = 0; i < ra->len; i++) {
+    if (ra->steps[i].op != rb->steps[i].op ||
+	ra->steps[i].arg1 != rb->steps[i].arg1 ||
+	ra->steps[i].arg2 != rb->steps[i].arg2) {
+      return false;
+    }
+    if (ra->steps[i].op == CRUSH_RULE_TAKE && ra->steps[i].arg1 < 0) {
+      todo.insert(ra->steps[i].arg1);
+    }
+  }
+
+  crush_choose_arg_map args_a = choose_args_get_with_fallback(
+    choose_args_index);
+  crush_choose_arg_map args_b = other.choose_args_get_with_fallback(
+    choose_args_index);
+  auto same_args = [](const crush_choose_arg_map& m,
+		      const crush_choose_arg_map& n,
+		      unsigned pos) {
+    const crush_choose_arg *x = pos < m.size ? &m.args[pos] : nullptr;
+    const crush_choose_arg *y = pos < n.size ? &n.args[pos] : nullptr;
+    unsigned x_ids = x ? x->ids_size : 0, y_ids = y ? y->ids_size : 0;
+    unsigned x_ws = x ? x->weight_set_positions : 0;
+    unsigned y_ws = y ? y->weight_set_positions : 0;
+    if (x_ids != y_ids || x_ws != y_ws) {
+      return false;
+    }
+    if (x_ids && !std::equal(x->ids, x->ids + x_ids, y->ids)) {
+      return false;
+    }
+    for (unsigned j = 0; j < x_ws; j++) {
+      const crush_weight_set& wx = x->weight_set[j];
+      const crush_weight_set& wy = y->weight_set[j];
+      if (wx.size != wy.size ||
+	  !std::equal(wx.weights, wx.weights + wx.size, wy.weights)) {
+	return false;
+      }
+    }
+    return true;
+  };
+
+  set<int> seen;
+  while (!todo.empty()) {
+    int id = *todo.begin();
+    todo.erase(todo.begin());
+    if (!seen.insert(id).second) {
+      continue;
+    }
+    const crush_bucket *ba = get_bucket(id);
+    const crush_bucket *bb = other.get_bucket(id);
+    if (IS_ERR(ba) || IS_ERR(bb)) {
+      if (IS_ERR(ba) != IS_ERR(bb)) {
+	return false;
+      }
+      continue;
+    }
+    if (ba->alg != bb->alg || ba->hash != bb->hash || ba->type != bb->type ||
+	ba->size != bb->size || ba->weight != bb->weight) {
+      return false;
+    }
+    for (unsigned j = 0; j < ba->size; j++) {
+      if (ba->items[j] != bb->items[j] ||
+	  crush_get_bucket_item_weight(ba, j) !=
+	  crush_get_bucket_item_weight(bb, j)) {
+	return false;
+      }
+      if (ba->items[j] < 0) {
+	todo.insert(ba->items[j]);
+      }
+    }
+    if (!same_args(args_a, args_b, -1 - id)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 bool CrushWrapper::_maybe_remove_last_instance(CephContext *cct, int item, bool unlink_only)
 {
   // last instance?
@@ -665,6 +665,21 @@ public:
    */
   bool subtree_contains(int root, int item) const;
 
+  /**
+   * see if a rule maps every input the same way with another map
+   *
+   * Compares the tunables, the steps of the rule and the buckets and
+   * choose_args reachable from its takes. A false result only means
+   * that the mapping might have changed.
+   *
+   * @param other the map to compare with
+   * @param rule the rule id, in both maps
+   * @param choose_args_index the choose_args used with the rule
+   * @return true if the rule can't map any input differently
+   */
+  bool rule_mapping_equal(const CrushWrapper& other, int rule,
+			  int64_t choose_args_index) const;
+
 private:
   /**
    * search for an item in any bucket
@@ -1617,6 +1632,33 @@ public:
       out[i] = rawout[i];
   }
 
+  /**
+   * map count inputs at once
+   *
+   * The items of x[i] are left in out[i * maxout, i * maxout + out_len[i]),
+   * the workspace and choose_args are set up once for the whole batch.
+   */
+  template<typename WeightVector>
+  void do_rule_batch(int rule, const int *x, unsigned count,
+		     std::vector<int>& out, std::vector<int>& out_len,
+		     int maxout, const WeightVector& weight,
+		     uint64_t choose_args_index) const {
+    out.resize((size_t)count * maxout);
+    out_len.resize(count);
+    std::vector<char> work(crush_work_size(crush, maxout));
+    crush_init_workspace(crush, std::data(work));
+    crush_choose_arg_map arg_map = choose_args_get_with_fallback(
+      choose_args_index);
+    crush_do_rule_batch(crush, rule, x, count, std::data(out),
+			std::data(out_len), maxout,
+			std::data(weight), std::size(weight),
+			std::data(work), arg_map.args);
+    for (auto& n : out_len) {
+      if (n < 0)
+	n = 0;
+    }
+  }
+
   int _choose_type_stack(
     CephContext *cct,
     const std::vector<std::pair<int,int>>& stack,
@@ -270,6 +270,50 @@ static __u64 crush_ln(unsigned int xin)
 	return result;
 }
 
+#ifndef __KERNEL__
+/*
+ * Same as crush_ln() for the 16 bit inputs of straw2, without the data
+ * dependent branch so that loops over it can be vectorized: the shift
+ * normalizing x is taken from the exponent of its float conversion, which
+ * is exact for x < 2^24.
+ */
+static inline __u64 crush_ln16(unsigned int xin)
+{
+	union {
+		float f;
+		__u32 i;
+	} conv;
+	unsigned int x = xin + 1;
+	int bits;
+	__u64 index1, index2, RH, LH, LL, xl64, result;
+
+	conv.f = (float)x;
+	bits = 15 - (int)((conv.i >> 23) - 127);
+	bits = bits < 0 ? 0 : bits;
+	x <<= bits;
+
+	index1 = (x >> 8) << 1;
+	RH = __RH_LH_tbl[index1 - 256];
+	LH = __RH_LH_tbl[index1 + 1 - 256];
+
+	xl64 = (__s64)x * RH;
+	xl64 >>= 48;
+
+	result = 15 - bits;
+	result <<= (12 + 32);
+
+	index2 = xl64 & 0xff;
+	LL = __LL_tbl[index2];
+
+	LH = LH + LL;
+
+	LH >>= (48 - 12 - 32);
+	result += LH;
+
+	return result;
+}
+#endif
+
 
 /*
  * straw2
@@ -339,6 +383,34 @@ static inline __s64 generate_exponential_distribution(int type, int x, int y, in
 	return div64_s64(ln, weight);
 }
 
+#ifndef __KERNEL__
+#if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__) && \
+	!defined(__clang__)
+# define CRUSH_TARGET_CLONES \
+	__attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+# define CRUSH_TARGET_CLONES
+#endif
+
+#define CRUSH_STRAW2_BLOCK 64
+
+/*
+ * The hash and ln part of the rjenkins1 straw2 draws for a block of
+ * items.  It is a plain loop so that it can be vectorized, built for
+ * several instruction sets picked at runtime where supported.
+ */
+CRUSH_TARGET_CLONES
+static void bucket_straw2_ln(int x, int r, const __s32 *ids, unsigned int n,
+			     __s64 *ln)
+{
+	unsigned int i;
+	for (i = 0; i < n; i++) {
+		__u32 u = crush_hash32_rjenkins1_3(x, ids[i], r) & 0xffff;
+		ln[i] = crush_ln16(u) - 0x1000000000000ll;
+	}
+}
+#endif
+
 static int bucket_straw2_choose(const struct crush_bucket_straw2 *bucket,
 				int x, int r, const struct crush_choose_arg *arg,
                                 int position)
@@ -347,6 +419,31 @@ static int bucket_straw2_choose(const struct crush_bucket_straw2 *bucket,
 	__s64 draw, high_draw = 0;
         __u32 *weights = get_choose_arg_weights(bucket, arg, position);
         __s32 *ids = get_choose_arg_ids(bucket, arg);
+#ifndef __KERNEL__
+	if (bucket->h.hash == CRUSH_HASH_RJENKINS1) {
+		__s64 ln[CRUSH_STRAW2_BLOCK];
+		unsigned int start, j, n;
+		for (start = 0; start < bucket->h.size; start += n) {
+			n = MIN(bucket->h.size - start, CRUSH_STRAW2_BLOCK);
+			bucket_straw2_ln(x, r, ids + start, n, ln);
+			for (j = 0; j < n; j++) {
+				i = start + j;
+				/* same conversions as in
+				 * generate_exponential_distribution() */
+				if (weights[i]) {
+					draw = div64_s64(ln[j], (int)weights[i]);
+				} else {
+					draw = S64_MIN;
+				}
+				if (i == 0 || draw > high_draw) {
+					high = i;
+					high_draw = draw;
+				}
+			}
+		}
+		return bucket->h.items[high];
+	}
+#endif
 	for (i = 0; i < bucket->h.size; i++) {
                 dprintk("weight 0x%x item %d\n", weights[i], ids[i]);
 		if (weights[i]) {
@@ -2051,3 +2148,28 @@ int crush_do_rule(const struct crush_map *map,
 			choose_args);
 	}
 }
+
+/**
+ * crush_do_rule_batch - map a range of inputs with the same rule
+ * @x: array of count hash inputs
+ * @result: array of count * result_max items
+ * @result_len: array of count result sizes
+ *
+ * The workspace is reused across all of the inputs, see crush_do_rule()
+ * for the other arguments.
+ */
+void crush_do_rule_batch(const struct crush_map *map,
+			 int ruleno, const int *x, int count,
+			 int *result, int *result_len, int result_max,
+			 const __u32 *weight, int weight_max,
+			 void *cwin, const struct crush_choose_arg *choose_args)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		result_len[i] = crush_do_rule(map, ruleno, x[i],
+					      result + i * result_max,
+					      result_max, weight, weight_max,
+					      cwin, choose_args);
+	}
+}
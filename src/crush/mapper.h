@@ -94,6 +94,34 @@ extern int crush_do_rule(const struct crush_map *map,
 			 const __u32 *weights, int weight_max,
 			 void *cwin, const struct crush_choose_arg *choose_args);
 
+/** @ingroup API
+ *
+ * Same as crush_do_rule() for the __count__ inputs of the __x__
+ * array. The items mapped for __x[i]__ are stored at
+ * __result[i * result_max]__ and their number in __result_len[i]__.
+ * Mapping a whole pool at once saves the per call setup, and lets
+ * the straw2 draws of consecutive inputs share the same warm bucket
+ * data.
+ *
+ * @param map the crush_map
+ * @param ruleno a positive integer < __CRUSH_MAX_RULES__
+ * @param x an array of __count__ values to map
+ * @param count the size of the __x__ array
+ * @param result an array of items of size __count__ * __result_max__
+ * @param result_len an array of size __count__
+ * @param result_max the maximum number of items for each value
+ * @param weights an array of weights of size __weight_max__
+ * @param weight_max the size of the __weights__ array
+ * @param cwin must be an char array initialized by crush_init_workspace
+ * @param choose_args weights and ids for each known bucket
+ */
+extern void crush_do_rule_batch(const struct crush_map *map,
+				int ruleno, const int *x, int count,
+				int *result, int *result_len, int result_max,
+				const __u32 *weights, int weight_max,
+				void *cwin,
+				const struct crush_choose_arg *choose_args);
+
 /* Returns enough workspace for any crush rule within map to generate
    result_max outputs. The caller can then allocate this much on its own,
    either on the stack, in a per-thread long-lived buffer, or however it likes.*/
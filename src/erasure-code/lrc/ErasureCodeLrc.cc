@@ -245,6 +245,15 @@ int ErasureCodeLrc::layers_init(ostream *ss)
     if (err)
       return err;
   }
+  layers_support_delta = true;
+  layers_support_optimized = true;
+  for (const auto &layer : layers) {
+    uint64_t flags = layer.erasure_code->get_supported_optimizations();
+    if (!(flags & FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION))
+      layers_support_delta = false;
+    if (!(flags & FLAG_EC_PLUGIN_OPTIMIZED_SUPPORTED))
+      layers_support_optimized = false;
+  }
   return 0;
 }
 
@@ -1002,6 +1011,71 @@ int ErasureCodeLrc::encode_chunks(const shard_id_map<bufferptr> &in,
   return 0;
 }
 
+void ErasureCodeLrc::encode_delta(const bufferptr &old_data,
+                                  const bufferptr &new_data,
+                                  bufferptr *delta_maybe_in_place)
+{
+  ceph_assert(layers_support_delta);
+  // a delta is the xor of the old and new data whatever the layer
+  layers.front().erasure_code->encode_delta(old_data, new_data,
+                                            delta_maybe_in_place);
+}
+
+/*
+ * The coding chunks of a layer may be data chunks of the layers
+ * encoded after it (the local groups protect the global parity too).
+ * The deltas are therefore pushed through the layers in encoding
+ * order, each one turning the deltas of its data chunks into deltas
+ * of its coding chunks, before being applied to the chunks of out.
+ */
+void ErasureCodeLrc::apply_delta(const shard_id_map<bufferptr> &in,
+                                 shard_id_map<bufferptr> &out)
+{
+  ceph_assert(layers_support_delta);
+  shard_id_map<bufferptr> deltas(get_chunk_count());
+  unsigned int blocksize = 0;
+  for (const auto& [shard, ptr] : in) {
+    if (out.contains(shard))
+      continue;
+    if (blocksize == 0) blocksize = ptr.length();
+    else ceph_assert(blocksize == ptr.length());
+    deltas[shard] = ptr;
+  }
+  if (blocksize == 0)
+    return;
+
+  for (const auto &layer : layers) {
+    shard_id_map<bufferptr> layer_in(get_chunk_count());
+    shard_id_map<bufferptr> layer_out(get_chunk_count());
+    shard_id_t j;
+    for (const auto& c : layer.data) {
+      if (deltas.contains(shard_id_t(c)))
+        layer_in[j] = deltas[shard_id_t(c)];
+      ++j;
+    }
+    if (layer_in.empty())
+      continue;
+    for (const auto& c : layer.coding) {
+      if (!deltas.contains(shard_id_t(c))) {
+        bufferptr ptr(buffer::create_aligned(blocksize, SIMD_ALIGN));
+        ptr.zero();
+        deltas[shard_id_t(c)] = ptr;
+      }
+      layer_in[j] = deltas[shard_id_t(c)];
+      layer_out[j] = deltas[shard_id_t(c)];
+      ++j;
+    }
+    layer.erasure_code->apply_delta(layer_in, layer_out);
+  }
+
+  for (auto& [shard, ptr] : out) {
+    if (!deltas.contains(shard))
+      continue;
+    ceph_assert(ptr.length() == blocksize);
+    layers.front().erasure_code->encode_delta(ptr, deltas[shard], &ptr);
+  }
+}
+
 IGNORE_DEPRECATED
 [[deprecated]]
 int ErasureCodeLrc::decode_chunks(const set<int> &want_to_read,
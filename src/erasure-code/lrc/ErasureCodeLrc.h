@@ -62,6 +62,8 @@ public:
   };
   std::vector<Layer> layers;
   std::string directory;
+  bool layers_support_delta = false;
+  bool layers_support_optimized = false;
   unsigned int chunk_count;
   unsigned int data_chunk_count;
   std::string rule_root;
@@ -106,9 +108,18 @@ public:
 			     std::ostream *ss) const override;
 
   uint64_t get_supported_optimizations() const override {
-    return FLAG_EC_PLUGIN_PARTIAL_READ_OPTIMIZATION |
+    uint64_t flags = FLAG_EC_PLUGIN_PARTIAL_READ_OPTIMIZATION |
       FLAG_EC_PLUGIN_PARTIAL_WRITE_OPTIMIZATION |
       FLAG_EC_PLUGIN_ZERO_INPUT_ZERO_OUTPUT_OPTIMIZATION;
+    // the layers are linear codes chained together, deltas can be pushed
+    // through them as long as each of them knows how to apply one
+    if (layers_support_delta)
+      flags |= FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION;
+    // the layers implement the shard_id_map interfaces used by the
+    // optimized EC pools, including the local parity they protect
+    if (layers_support_optimized)
+      flags |= FLAG_EC_PLUGIN_OPTIMIZED_SUPPORTED;
+    return flags;
   }
 
   unsigned int get_chunk_count() const override {
@@ -128,6 +139,11 @@ public:
                   std::map<int, ceph::buffer::list> *encoded) override;
   int encode_chunks(const shard_id_map<bufferptr> &in,
                     shard_id_map<bufferptr> &out);
+  void encode_delta(const ceph::bufferptr &old_data,
+                    const ceph::bufferptr &new_data,
+                    ceph::bufferptr *delta_maybe_in_place) override;
+  void apply_delta(const shard_id_map<ceph::bufferptr> &in,
+                   shard_id_map<ceph::bufferptr> &out) override;
   [[deprecated]]
   int decode_chunks(const std::set<int> &want_to_read,
 		    const std::map<int, ceph::buffer::list> &chunks,
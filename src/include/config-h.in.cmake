@@ -369,6 +369,9 @@
 /* Backend RADOS for Rados Gateway */
 #cmakedefine WITH_RADOSGW_RADOS
 
+/* Defined if BLAKE3 is built with its oneTBB parallel hashing */
+#cmakedefine WITH_BLAKE3_TBB
+
 /* Defined if std::map::merge() is supported */
 #cmakedefine HAVE_STDLIB_MAP_SPLICING
 
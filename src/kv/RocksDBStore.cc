@@ -1891,20 +1891,35 @@ void RocksDBStore::RocksDBTransactionImpl::merge(
   }
 }
 
+rocksdb::Status RocksDBStore::get_value(
+    const string &prefix,
+    const string &key,
+    rocksdb::PinnableSlice *value)
+{
+  auto cf = get_cf_handle(prefix, key);
+  if (cf) {
+    return db->Get(rocksdb::ReadOptions(),
+		   cf,
+		   rocksdb::Slice(key),
+		   value);
+  }
+  string k = combine_strings(prefix, key);
+  return db->Get(rocksdb::ReadOptions(),
+		 default_cf,
+		 rocksdb::Slice(k),
+		 value);
+}
+
 int RocksDBStore::get(
     const string &prefix,
     const std::set<string> &keys,
     std::map<string, bufferlist> *out)
 {
-  rocksdb::PinnableSlice value;
   utime_t start = ceph_clock_now();
-  if (cf_handles.count(prefix) > 0) {
+  if (keys.size() < 2) {
+    rocksdb::PinnableSlice value;
     for (auto& key : keys) {
-      auto cf_handle = get_cf_handle(prefix, key);
-      auto status = db->Get(rocksdb::ReadOptions(),
-			    cf_handle,
-			    rocksdb::Slice(key),
-			    &value);
+      auto status = get_value(prefix, key, &value);
       if (status.ok()) {
 	(*out)[key].append(value.data(), value.size());
       } else if (status.IsIOError()) {
@@ -1912,20 +1927,41 @@ int RocksDBStore::get(
       }
       value.Reset();
     }
+    utime_t lat = ceph_clock_now() - start;
+    logger->tinc(l_rocksdb_get_latency, lat);
+    return 0;
+  }
+  // a single MultiGet lets rocksdb batch the lookups and read the data
+  // blocks of all keys in parallel
+  std::vector<rocksdb::ColumnFamilyHandle*> cfs;
+  std::vector<string> combined;
+  std::vector<rocksdb::Slice> slices;
+  cfs.reserve(keys.size());
+  slices.reserve(keys.size());
+  if (cf_handles.count(prefix) > 0) {
+    for (auto& key : keys) {
+      cfs.push_back(get_cf_handle(prefix, key));
+      slices.emplace_back(key);
+    }
   } else {
+    combined.reserve(keys.size());
     for (auto& key : keys) {
-      string k = combine_strings(prefix, key);
-      auto status = db->Get(rocksdb::ReadOptions(),
-			    default_cf,
-			    rocksdb::Slice(k),
-			    &value);
-      if (status.ok()) {
-	(*out)[key].append(value.data(), value.size());
-      } else if (status.IsIOError()) {
-	ceph_abort_msg(status.getState());
-      }
-      value.Reset();
+      combined.push_back(combine_strings(prefix, key));
+      cfs.push_back(default_cf);
+      slices.emplace_back(combined.back());
+    }
+  }
+  std::vector<string> values;
+  auto statuses = db->MultiGet(rocksdb::ReadOptions(), cfs, slices, &values);
+  size_t i = 0;
+  for (auto& key : keys) {
+    auto& status = statuses[i];
+    if (status.ok()) {
+      (*out)[key].append(values[i]);
+    } else if (status.IsIOError()) {
+      ceph_abort_msg(status.getState());
     }
+    ++i;
   }
   utime_t lat = ceph_clock_now() - start;
   logger->tinc(l_rocksdb_get_latency, lat);
@@ -1941,20 +1977,7 @@ int RocksDBStore::get(
   utime_t start = ceph_clock_now();
   int r = 0;
   rocksdb::PinnableSlice value;
-  rocksdb::Status s;
-  auto cf = get_cf_handle(prefix, key);
-  if (cf) {
-    s = db->Get(rocksdb::ReadOptions(),
-		cf,
-		rocksdb::Slice(key),
-		&value);
-  } else {
-    string k = combine_strings(prefix, key);
-    s = db->Get(rocksdb::ReadOptions(),
-		default_cf,
-		rocksdb::Slice(k),
-		&value);
-  }
+  rocksdb::Status s = get_value(prefix, key, &value);
   if (s.ok()) {
     out->append(value.data(), value.size());
   } else if (s.IsNotFound()) {
@@ -790,6 +790,10 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
              << latest_full << dendl;
   }
 
+  // the mapping can only follow a single incremental
+  mapping_inc.reset();
+  bool can_map_inc = true;
+
   if ((latest_full > 0) && (latest_full > osdmap.epoch)) {
     bufferlist latest_bl;
     get_version_full(latest_full, latest_bl);
@@ -797,6 +801,7 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
     dout(7) << __func__ << " loading latest full map e" << latest_full << dendl;
     osdmap = OSDMap();
     osdmap.decode(latest_bl);
+    can_map_inc = false;
   }
 
   bufferlist bl;
@@ -884,6 +889,7 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
 
 	osdmap = OSDMap();
 	osdmap.decode(orig_full_bl);
+	can_map_inc = false;
 
 	dout(20) << __func__ << " canonical full osdmap:\n";
 	JSONFormatter jf(true);
@@ -918,6 +924,12 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
 	osd_epochs.erase(osd);
       }
     }
+    if (can_map_inc && !mapping_inc) {
+      mapping_inc.emplace(std::move(inc));
+    } else {
+      can_map_inc = false;
+      mapping_inc.reset();
+    }
   }
 
   if (t) {
@@ -1082,8 +1094,17 @@ void OSDMonitor::start_mapping()
   }
   if (!osdmap.get_pools().empty()) {
     auto fin = new C_UpdateCreatingPGs(this, osdmap.get_epoch());
-    mapping_job = mapping.start_update(osdmap, mapper,
-				       g_conf()->mon_osd_mapping_pgs_per_chunk);
+    if (mapping_inc && mapping_inc->epoch == osdmap.get_epoch() &&
+	g_conf().get_val<bool>("mon_osd_mapping_incremental")) {
+      // only remaps the pgs the incremental may have moved, if the
+      // mapping is still at the previous epoch
+      mapping_job = mapping.start_update(
+	osdmap, *mapping_inc, mapper,
+	g_conf()->mon_osd_mapping_pgs_per_chunk);
+    } else {
+      mapping_job = mapping.start_update(
+	osdmap, mapper, g_conf()->mon_osd_mapping_pgs_per_chunk);
+    }
     dout(10) << __func__ << " started mapping job " << mapping_job.get()
 	     << " at " << fin->start << dendl;
     mapping_job->set_finish_event(fin);
@@ -391,6 +391,8 @@ private:
   ParallelPGMapper mapper;                        ///< for background pg work
   OSDMapMapping mapping;                          ///< pg <-> osd mappings
   std::unique_ptr<ParallelPGMapper::Job> mapping_job;  ///< background mapping job
+  /// the incremental of osdmap, if it was the only one applied since the last mapping
+  std::optional<OSDMap::Incremental> mapping_inc;
   void start_mapping();
 
   void update_logger();
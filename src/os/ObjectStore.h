@@ -432,6 +432,25 @@ public:
    */
   virtual void set_collection_commit_queue(const coll_t &cid, ContextQueue *commit_queue) = 0;
 
+  /**
+   * prefetch -- hint that objects are about to be read
+   *
+   * The store may load the metadata of the objects (and their content,
+   * with PREFETCH_DATA) in the background so that the synchronous reads
+   * which follow hit the cache.  This is advisory only, it does not block
+   * on I/O and hints may be dropped.
+   *
+   * @param c collection of the objects
+   * @param oids objects, in the order they are going to be read
+   * @param flags PREFETCH_*
+   */
+  enum {
+    PREFETCH_DATA = 1,  ///< object content is going to be read as well
+  };
+  virtual void prefetch(CollectionHandle& c,
+			const std::vector<ghobject_t>& oids,
+			uint32_t flags = 0) {}
+
   /**
    * Synchronous read operations
    */
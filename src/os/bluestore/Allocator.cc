@@ -10,6 +10,7 @@
 #include "BtreeAllocator.h"
 #include "Btree2Allocator.h"
 #include "HybridAllocator.h"
+#include "ZonedAllocator.h"
 #include "common/debug.h"
 #include "common/admin_socket.h"
 
@@ -60,6 +61,10 @@ Allocator *Allocator::create(
       cct->_conf.get_val<uint64_t>("bluestore_hybrid_alloc_mem_cap"),
       cct->_conf.get_val<double>("bluestore_btree2_alloc_weight_factor"),
       name);
+  } else if (type == "zoned") {
+    return new ZonedAllocator(cct, size, block_size,
+      cct->_conf.get_val<Option::size_t>("bluestore_zone_size"),
+      name);
   }
   if (alloc == nullptr) {
     lderr(cct) << "Allocator::" << __func__ << " unknown alloc type "
@@ -277,6 +277,9 @@ void BlueFS::_init_logger()
 		    "Files written to WAL");
   b.add_u64_counter(l_bluefs_files_written_sst, "files_written_sst",
 		    "Files written to SSTs");
+  b.add_u64_counter(l_bluefs_wal_prealloc_bytes, "wal_prealloc_bytes",
+		    "Bytes allocated ahead of the writes to WAL files",
+		    NULL, 0, unit_t(UNIT_BYTES));
   b.add_u64_counter(l_bluefs_write_count_wal, "write_count_wal",
 		    "Write op count to WAL");
   b.add_u64_counter(l_bluefs_write_count_sst, "write_count_sst",
@@ -3943,13 +3946,7 @@ int BlueFS::_flush_range_F(FileWriter *h, uint64_t offset, uint64_t length)
   if (allocated < end) {
     // we should never run out of log space here; see the min runway check
     // in _flush_and_sync_log.
-    int r = _allocate(vselector->select_prefer_bdev(h->file->vselector_hint),
-		      end - allocated,
-                      0,
-		      &h->file->fnode,
-		      [&](const bluefs_extent_t& e) {
-		        vselector->add_usage(h->file->vselector_hint, e);
-	              });
+    int r = _allocate_file(h->file.get(), end - allocated);
     if (r < 0) {
       derr << __func__ << " allocated: 0x" << std::hex << allocated
            << " offset: 0x" << offset << " length: 0x" << length << std::dec
@@ -4532,6 +4529,36 @@ int BlueFS::_allocate(uint8_t id, uint64_t len,
   return 0;
 }
 
+// Envelope (WAL) files only dirty their metadata when they allocate, so
+// every allocation is a BlueFS log write + flush in the WAL fsync path.
+// Allocate those in bluefs_wal_prealloc_size chunks to keep that rare;
+// the unused tail is given back when RocksDB truncates the WAL on close.
+// If the device cannot fit the whole chunk, fall back to the plain want.
+int BlueFS::_allocate_file(File *f, uint64_t want)
+{
+  auto update = [&](const bluefs_extent_t& e) {
+    vselector->add_usage(f->vselector_hint, e);
+  };
+  auto id = vselector->select_prefer_bdev(f->vselector_hint);
+  if (f->envelope_mode()) {
+    uint64_t prealloc = cct->_conf.get_val<Option::size_t>(
+      "bluefs_wal_prealloc_size");
+    if (prealloc > want) {
+      dout(20) << __func__ << " ino " << f->fnode.ino << " 0x" << std::hex
+	       << want << " -> 0x" << prealloc << std::dec << dendl;
+      int r = _allocate(id, prealloc, 0, &f->fnode, update);
+      if (r == 0) {
+	logger->inc(l_bluefs_wal_prealloc_bytes, prealloc - want);
+	return 0;
+      }
+      dout(10) << __func__ << " ino " << f->fnode.ino << " failed to"
+	       << " preallocate 0x" << std::hex << prealloc
+	       << ", retrying with 0x" << want << std::dec << dendl;
+    }
+  }
+  return _allocate(id, want, 0, &f->fnode, update);
+}
+
 int BlueFS::preallocate(FileRef f, uint64_t off, uint64_t len)/*_LF*/
 {
   std::lock_guard ll(log.lock);
@@ -4545,15 +4572,7 @@ int BlueFS::preallocate(FileRef f, uint64_t off, uint64_t len)/*_LF*/
   ceph_assert(f->fnode.ino > 1);
   uint64_t allocated = f->fnode.get_allocated();
   if (off + len > allocated) {
-    uint64_t want = off + len - allocated;
-
-    int r = _allocate(vselector->select_prefer_bdev(f->vselector_hint),
-      want,
-      0,
-      &f->fnode,
-      [&](const bluefs_extent_t& e) {
-	vselector->add_usage(f->vselector_hint, e);
-      });
+    int r = _allocate_file(f.get(), off + len - allocated);
     if (r < 0)
       return r;
     log.t.op_file_update_inc(f->fnode);
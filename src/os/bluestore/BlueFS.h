@@ -41,6 +41,7 @@ enum {
   l_bluefs_logged_bytes,
   l_bluefs_files_written_wal,
   l_bluefs_files_written_sst,
+  l_bluefs_wal_prealloc_bytes,
   l_bluefs_write_count_wal,
   l_bluefs_write_count_sst,
   l_bluefs_bytes_written_wal,
@@ -658,6 +659,7 @@ private:
                 update_fn_t cb = nullptr,
                 size_t alloc_attempts = 0,
                 bool permit_dev_fallback = true);
+  int _allocate_file(File *f, uint64_t want);
 
   /* signal replay log to include h->file in nearest log flush */
   int _signal_dirty_to_log_D(FileWriter *h);
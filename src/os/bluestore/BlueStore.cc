@@ -48,6 +48,7 @@
 #include "common/PriorityCache.h"
 #include "common/url_escape.h"
 #include "Allocator.h"
+#include "ZonedAllocator.h"
 #include "FreelistManager.h"
 #include "BlueFS.h"
 #include "BlueRocksEnv.h"
@@ -140,6 +141,7 @@ const string PREFIX_DEFERRED = "L";    // id -> deferred_transaction_t
 const string PREFIX_ALLOC = "B";       // u64 offset -> u64 length (freelist)
 const string PREFIX_ALLOC_BITMAP = "b";// (see BitmapFreelistManager)
 const string PREFIX_SHARED_BLOB = "X"; // u64 SB id -> shared_blob_t
+const string PREFIX_ALLOC_JOURNAL = "J"; // NCB allocation checkpoint + deltas
 
 const string BLUESTORE_GLOBAL_STATFS_KEY = "bluestore_statfs";
 
@@ -562,6 +564,26 @@ static void get_deferred_key(uint64_t seq, string *out)
   _key_encode_u64(seq, out);
 }
 
+// allocation journal keys:
+//   H              -> alloc_journal_header_t
+//   C + u64 region -> interval_set<uint64_t> free extents inside the region
+//   D + u64 seq    -> interval_set<uint64_t> allocated + released
+static const string ALLOC_JOURNAL_HEADER_KEY = "H";
+
+static void get_alloc_journal_region_key(uint64_t region, string *out)
+{
+  out->clear();
+  out->push_back('C');
+  _key_encode_u64(region, out);
+}
+
+static void get_alloc_journal_delta_key(uint64_t seq, string *out)
+{
+  out->clear();
+  out->push_back('D');
+  _key_encode_u64(seq, out);
+}
+
 static void get_pool_stat_key(int64_t pool_id, string *key)
 {
   key->clear();
@@ -1223,6 +1245,131 @@ BlueStore::OnodeCacheShard *BlueStore::OnodeCacheShard::create(
   return c;
 }
 
+void BlueStore::OnodeCacheShard::_warm_rm(WarmOnode *w)
+{
+  warm_lru.erase(warm_lru.iterator_to(*w));
+  warm_bytes -= w->key->size() + w->value.size() + sizeof(*w);
+  auto p = warm_map.find(std::string_view(*w->key));
+  ceph_assert(p != warm_map.end());
+  warm_map.erase(p);
+}
+
+void BlueStore::OnodeCacheShard::_warm_trim_to(uint64_t new_bytes)
+{
+  while (warm_bytes > new_bytes && !warm_lru.empty()) {
+    _warm_rm(&warm_lru.back());
+  }
+}
+
+void BlueStore::OnodeCacheShard::set_warm_max(uint64_t max_bytes)
+{
+  std::lock_guard l(lock);
+  warm_max = max_bytes;
+  _warm_trim_to(max_bytes);
+}
+
+bool BlueStore::OnodeCacheShard::warm_lookup(std::string_view key, bufferlist *v)
+{
+  if (!warm_max) {
+    return false;
+  }
+  std::lock_guard l(lock);
+  auto p = warm_map.find(key);
+  if (p == warm_map.end()) {
+    return false;
+  }
+  WarmOnode& w = p->second;
+  warm_lru.erase(warm_lru.iterator_to(w));
+  warm_lru.push_front(w);
+  v->append(w.value.data(), w.value.size());
+  return true;
+}
+
+void BlueStore::OnodeCacheShard::warm_update(std::string_view key,
+                                             const bufferlist& v)
+{
+  if (!warm_max) {
+    return;
+  }
+  std::lock_guard l(lock);
+  auto p = warm_map.find(key);
+  if (p != warm_map.end()) {
+    _warm_rm(&p->second);
+  }
+  if (key.size() + v.length() + sizeof(WarmOnode) > warm_max) {
+    return;
+  }
+  auto [q, inserted] = warm_map.emplace(
+    std::piecewise_construct,
+    std::forward_as_tuple(key.data(), key.size()),
+    std::forward_as_tuple());
+  ceph_assert(inserted);
+  WarmOnode& w = q->second;
+  w.key = &q->first;
+  w.value.resize(v.length());
+  v.begin().copy(v.length(), w.value.data());
+  warm_lru.push_front(w);
+  warm_bytes += key.size() + v.length() + sizeof(w);
+  _warm_trim_to(warm_max);
+}
+
+void BlueStore::OnodeCacheShard::warm_remove(std::string_view key)
+{
+  if (!warm_max) {
+    return;
+  }
+  std::lock_guard l(lock);
+  auto p = warm_map.find(key);
+  if (p != warm_map.end()) {
+    _warm_rm(&p->second);
+  }
+}
+
+void BlueStore::OnodeCacheShard::_warm_split(OnodeCacheShard *to,
+                                             int64_t pool, int bits,
+                                             uint32_t ps)
+{
+  if (to == this || warm_map.empty()) {
+    return;
+  }
+  // Entries of the child must follow its collection to the other shard,
+  // otherwise they would miss the write-through updates made there.
+  std::vector<WarmOnode*> moving;
+  for (auto& w : warm_lru) {
+    ghobject_t oid;
+    if (get_key_object(*w.key, &oid) < 0 ||
+        (oid.hobj.pool == pool && oid.match(bits, ps))) {
+      moving.push_back(&w);
+    }
+  }
+  for (auto w : moving) {
+    if (to->warm_max) {
+      auto [q, inserted] = to->warm_map.emplace(
+        std::piecewise_construct,
+        std::forward_as_tuple(w->key->data(), w->key->size()),
+        std::forward_as_tuple());
+      if (inserted) {
+        WarmOnode& nw = q->second;
+        nw.key = &q->first;
+        nw.value.swap(w->value);
+        to->warm_lru.push_back(nw);
+        to->warm_bytes += nw.key->size() + nw.value.size() + sizeof(nw);
+        warm_bytes -= nw.value.size();
+      }
+    }
+    _warm_rm(w);
+  }
+  to->_warm_trim_to(to->warm_max);
+}
+
+void BlueStore::OnodeCacheShard::add_warm_stats(uint64_t *onodes,
+                                                uint64_t *bytes)
+{
+  std::lock_guard l(lock);
+  *onodes += warm_map.size();
+  *bytes += warm_bytes;
+}
+
 // LruBufferCacheShard
 struct LruBufferCacheShard : public BlueStore::BufferCacheShard {
   typedef boost::intrusive::list<
@@ -5337,8 +5484,17 @@ BlueStore::OnodeRef BlueStore::Collection::get_onode(
   int r = -ENOENT;
   Onode *on;
   if (!is_createop) {
-    r = store->db->get(PREFIX_OBJ, key.c_str(), key.size(), &v);
-    ldout(store->cct, 20) << " r " << r << " v.len " << v.length() << dendl;
+    if (get_onode_cache()->warm_lookup(key, &v)) {
+      r = 0;
+      store->logger->inc(l_bluestore_onode_warm_hits);
+      ldout(store->cct, 20) << " warm v.len " << v.length() << dendl;
+    } else {
+      r = store->db->get(PREFIX_OBJ, key.c_str(), key.size(), &v);
+      ldout(store->cct, 20) << " r " << r << " v.len " << v.length() << dendl;
+      if (r >= 0 && v.length()) {
+        get_onode_cache()->warm_update(key, v);
+      }
+    }
   }
   if (v.length() == 0) {
     ceph_assert(r == -ENOENT);
@@ -5354,6 +5510,63 @@ BlueStore::OnodeRef BlueStore::Collection::get_onode(
   return onode_space.add_onode(oid, o);
 }
 
+size_t BlueStore::Collection::prefetch_onodes(
+  const vector<ghobject_t>& oids,
+  vector<OnodeRef> *onodes)
+{
+  ceph_assert(ceph_mutex_is_locked(lock));
+
+  spg_t pgid;
+  bool is_pg = cid.is_pg(&pgid);
+  map<string, const ghobject_t*> missing;
+  for (auto& oid : oids) {
+    if (is_pg && !oid.match(cnode.bits, pgid.ps())) {
+      // just a hint, the pg may have been split meanwhile
+      continue;
+    }
+    OnodeRef o = onode_space.lookup(oid);
+    if (o) {
+      onodes->push_back(o);
+      continue;
+    }
+    string key;
+    get_object_key(store->cct, oid, &key);
+    missing.emplace(std::move(key), &oid);
+  }
+
+  map<string, bufferlist> values;
+  set<string> keys;
+  for (auto& [key, oid] : missing) {
+    bufferlist v;
+    if (get_onode_cache()->warm_lookup(key, &v)) {
+      values.emplace(key, std::move(v));
+    } else {
+      keys.insert(key);
+    }
+  }
+  if (!keys.empty()) {
+    map<string, bufferlist> loaded;
+    store->db->get(PREFIX_OBJ, keys, &loaded);
+    for (auto& [key, v] : loaded) {
+      if (v.length()) {
+	get_onode_cache()->warm_update(key, v);
+	values.emplace(key, std::move(v));
+      }
+    }
+  }
+  ldout(store->cct, 20) << __func__ << " " << oids.size() << " oids, "
+			<< onodes->size() << " cached, " << values.size()
+			<< " loaded (" << keys.size() << " from kv)" << dendl;
+
+  for (auto& [key, v] : values) {
+    const ghobject_t& oid = *missing[key];
+    OnodeRef o(Onode::create_decode(this, oid, key, v, true,
+				    store->segment_size != 0));
+    onodes->push_back(onode_space.add_onode(oid, o));
+  }
+  return values.size();
+}
+
 void BlueStore::Collection::split_cache(
   Collection *dest)
 {
@@ -5374,6 +5587,8 @@ void BlueStore::Collection::split_cache(
   bool is_pg = dest->cid.is_pg(&destpg);
   ceph_assert(is_pg);
 
+  ocache->_warm_split(ocache_dest, destpg.pool(), destbits, destpg.pgid.ps());
+
   auto p = onode_space.onode_map.begin();
   while (p != onode_space.onode_map.end()) {
     OnodeRef o = p->second;
@@ -5667,6 +5882,10 @@ void BlueStore::MempoolThread::_resize_shards(bool interval_stats)
                    << " data_used: " << data_used << dendl;
   }
 
+  int64_t warm_alloc =
+     static_cast<int64_t>(store->cache_meta_warm_ratio * meta_alloc);
+  meta_alloc -= warm_alloc;
+
   uint64_t max_shard_onodes = static_cast<uint64_t>(
       (meta_alloc / (double) onode_shards) / meta_cache->get_bytes_per_onode());
   uint64_t max_shard_buffer = static_cast<uint64_t>(data_alloc / buffer_shards);
@@ -5676,6 +5895,7 @@ void BlueStore::MempoolThread::_resize_shards(bool interval_stats)
 
   for (auto i : store->onode_cache_shards) {
     i->set_max(max_shard_onodes);
+    i->set_warm_max(warm_alloc / onode_shards);
   }
   for (auto i : store->buffer_cache_shards) {
     i->set_max(max_shard_buffer);
@@ -5749,8 +5969,10 @@ BlueStore::BlueStore(CephContext *cct,
   : ObjectStore(cct, path),
     throttle(cct),
     finisher(cct, "commit_finisher", "cfin"),
+    prefetch_finisher(cct, "prefetch_finisher", "bstore_pf"),
     kv_sync_thread(this),
     kv_finalize_thread(this),
+    zoned_cleaner_thread(this),
     min_alloc_size(_min_alloc_size),
     min_alloc_size_order(std::countr_zero(_min_alloc_size)),
     mempool_thread(this)
@@ -5803,6 +6025,7 @@ std::vector<std::string> BlueStore::get_tracked_keys() const noexcept
     "bluestore_deferred_batch_ops"s,
     "bluestore_deferred_batch_ops_hdd"s,
     "bluestore_deferred_batch_ops_ssd"s,
+    "bluestore_deferred_adaptive"s,
     "bluestore_throttle_bytes"s,
     "bluestore_throttle_deferred_bytes"s,
     "bluestore_throttle_cost_per_io_hdd"s,
@@ -5873,7 +6096,8 @@ void BlueStore::handle_conf_change(const ConfigProxy& conf,
       changed.count("bluestore_max_alloc_size") ||
       changed.count("bluestore_deferred_batch_ops") ||
       changed.count("bluestore_deferred_batch_ops_hdd") ||
-      changed.count("bluestore_deferred_batch_ops_ssd")) {
+      changed.count("bluestore_deferred_batch_ops_ssd") ||
+      changed.count("bluestore_deferred_adaptive")) {
     if (bdev) {
       // only after startup
       _set_alloc_sizes();
@@ -6110,6 +6334,14 @@ int BlueStore::_set_cache_sizes()
     return -EINVAL;
   }
 
+  cache_meta_warm_ratio =
+    cct->_conf.get_val<double>("bluestore_cache_meta_warm_ratio");
+  if (cache_meta_warm_ratio < 0 || cache_meta_warm_ratio > 1.0) {
+    derr << __func__ << " bluestore_cache_meta_warm_ratio ("
+         << cache_meta_warm_ratio << ") must be in range [0,1.0]" << dendl;
+    return -EINVAL;
+  }
+
   cache_kv_ratio = cct->_conf.get_val<double>("bluestore_cache_kv_ratio");
   if (cache_kv_ratio < 0 || cache_kv_ratio > 1.0) {
     derr << __func__ << " bluestore_cache_kv_ratio (" << cache_kv_ratio
@@ -6144,6 +6376,7 @@ int BlueStore::_set_cache_sizes()
     
   dout(1) << __func__ << " cache_size " << cache_size
           << " meta " << cache_meta_ratio
+	  << " (warm " << cache_meta_warm_ratio << ")"
 	  << " kv " << cache_kv_ratio
 	  << " kv_onode " << cache_kv_onode_ratio
 	  << " data " << cache_data_ratio
@@ -6420,6 +6653,13 @@ void BlueStore::_init_logger()
 		    NULL,
 		    PerfCountersBuilder::PRIO_DEBUGONLY,
 		    unit_t(UNIT_BYTES));
+  b.add_u64(l_bluestore_deferred_cutoff, "deferred_cutoff",
+	    "Current size threshold for deferred writes",
+	    NULL,
+	    PerfCountersBuilder::PRIO_USEFUL,
+	    unit_t(UNIT_BYTES));
+  b.add_u64(l_bluestore_deferred_batch_ops, "deferred_batch_ops",
+	    "Current number of deferred writes batched before submit");
 
   b.add_u64_counter(l_bluestore_write_big_skipped_blobs,
       "write_big_skipped_blobs",
@@ -6475,6 +6715,21 @@ void BlueStore::_init_logger()
   b.add_u64_counter(l_bluestore_onode_shard_misses,
 		    "onode_shard_misses",
 		    "Count of onode shard cache lookups misses");
+  b.add_u64_counter(l_bluestore_prefetch_onodes, "prefetch_onodes",
+		    "Onodes loaded ahead of the readers by prefetch hints");
+  b.add_u64_counter(l_bluestore_prefetch_dropped, "prefetch_dropped",
+		    "Objects of prefetch hints dropped as the queue was full");
+  b.add_u64_counter(l_bluestore_zoned_cleaned_zones, "zoned_cleaned_zones",
+		    "Zones whose live data was relocated by the cleaner");
+  b.add_u64_counter(l_bluestore_zoned_relocated_bytes, "zoned_relocated_bytes",
+		    "Bytes of live data relocated by the zoned cleaner",
+		    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_onode_warm_hits, "onode_warm_hits",
+		    "Count of onode cache misses served by the warm tier");
+  b.add_u64(l_bluestore_onode_warm_onodes, "onodes_warm",
+	    "Number of encoded onodes in the warm tier");
+  b.add_u64(l_bluestore_onode_warm_bytes, "onodes_warm_bytes",
+	    "Size of encoded onodes in the warm tier");
   b.add_u64(l_bluestore_extents, "onode_extents",
 	    "Number of extents in cache");
   b.add_u64(l_bluestore_blobs, "onode_blobs",
@@ -7123,6 +7378,20 @@ void BlueStore::_set_alloc_sizes(void)
       deferred_batch_ops = cct->_conf->bluestore_deferred_batch_ops_ssd;
     }
   }
+  // the adaptive policy starts over from the configured values
+  prefer_deferred_size_conf = prefer_deferred_size.load();
+  deferred_batch_ops_conf = deferred_batch_ops.load();
+  {
+    std::lock_guard l(deferred_policy_lock);
+    deferred_db_lat = 0;
+    deferred_main_lat = 0;
+    deferred_db_sampled = deferred_main_sampled = false;
+    deferred_policy_stamp = mono_clock::now();
+  }
+  if (logger) {
+    logger->set(l_bluestore_deferred_cutoff, prefer_deferred_size);
+    logger->set(l_bluestore_deferred_batch_ops, deferred_batch_ops);
+  }
 
   dout(10) << __func__ << " min_alloc_size 0x" << std::hex << min_alloc_size
 	   << std::dec << " order " << (int)min_alloc_size_order
@@ -7386,6 +7655,10 @@ int BlueStore::_init_alloc()
     }
     if (restore_allocator(alloc, &num, &bytes) == 0) {
       dout(5) << __func__ << "::NCB::restore_allocator() completed successfully alloc=" << alloc << dendl;
+    } else if (cct->_conf->bluestore_allocation_journal &&
+	       alloc_journal_restore(alloc, &num, &bytes) == 0) {
+      // unplanned shutdown, but the checkpoint + deltas in RocksDB are good
+      dout(0) << __func__ << "::NCB::restored allocation from the allocation journal" << dendl;
     } else {
       // This must mean that we had an unplanned shutdown and didn't manage to destage the allocator
       dout(0) << __func__ << "::NCB::restore_allocator() failed! Run Full Recovery from ONodes (might take a while) ..." << dendl;
@@ -7450,6 +7723,7 @@ void BlueStore::_close_alloc()
 
   shared_alloc.reset();
   alloc = nullptr;
+  alloc_journal_enabled = false;
 }
 
 int BlueStore::_open_fsid(bool create)
@@ -7920,6 +8194,13 @@ int BlueStore::_open_db_and_around(bool read_only, bool to_repair)
     dout(10) << __func__ << "::NCB::need_to_destage_allocation_file was set" << dendl;
   }
 
+  if (!read_only && !to_repair) {
+    r = alloc_journal_open();
+    if (r < 0) {
+      goto out_alloc;
+    }
+  }
+
   return 0;
 
 out_alloc:
@@ -8163,6 +8444,16 @@ int BlueStore::_open_db(bool create, bool to_repair_db, bool read_only)
       }
       options += options_annex;
     }
+    // with several kv sync lanes the commits reach rocksdb concurrently;
+    // let one write group append to the WAL while the previous one is
+    // still inserting into the memtables
+    if (cct->_conf.get_val<uint64_t>("bluestore_kv_sync_lanes") > 1 &&
+	options.find("enable_pipelined_write") == string::npos) {
+      if (!options.empty() && *options.rbegin() != ',') {
+	options += ',';
+      }
+      options += "enable_pipelined_write=true";
+    }
 
     if (cct->_conf.get_val<bool>("bluestore_rocksdb_cf")) {
       sharding_def = cct->_conf.get_val<std::string>("bluestore_rocksdb_cfs");
@@ -11704,6 +11995,9 @@ int BlueStore::_fsck_on_open(BlueStore::FSCKDepth depth, bool repair)
     dout(5) << __func__ << " applying repair results" << dendl;
     repaired = repairer.apply(db);
     dout(5) << __func__ << " repair applied" << dendl;
+    // repair fixes the allocation state without journaling the changes,
+    // the checkpoint written on open no longer matches it
+    alloc_journal_invalidate();
   }
   if (repair && bdev_labels_in_repair.size() > 0) {
     // should not happen when labels are disabled
@@ -12383,8 +12677,11 @@ void BlueStore::refresh_perf_counters()
   uint64_t num_blobs = 0;
   uint64_t num_buffers = 0;
   uint64_t num_buffer_bytes = 0;
+  uint64_t num_warm_onodes = 0;
+  uint64_t num_warm_bytes = 0;
   for (auto c : onode_cache_shards) {
     c->add_stats(&num_onodes, &num_pinned_onodes);
+    c->add_warm_stats(&num_warm_onodes, &num_warm_bytes);
   }
   for (auto c : buffer_cache_shards) {
     c->add_stats(&num_extents, &num_blobs,
@@ -12392,6 +12689,8 @@ void BlueStore::refresh_perf_counters()
   }
   logger->set(l_bluestore_onodes, num_onodes);
   logger->set(l_bluestore_pinned_onodes, num_pinned_onodes);
+  logger->set(l_bluestore_onode_warm_onodes, num_warm_onodes);
+  logger->set(l_bluestore_onode_warm_bytes, num_warm_bytes);
   logger->set(l_bluestore_extents, num_extents);
   logger->set(l_bluestore_blobs, num_blobs);
   logger->set(l_bluestore_buffers, num_buffers);
@@ -12420,6 +12719,99 @@ ObjectStore::CollectionHandle BlueStore::create_new_collection(
   return c;
 }
 
+struct BlueStore::C_Prefetch : public Context {
+  BlueStore *store;
+  BlueStore::CollectionRef c;
+  vector<ghobject_t> oids;
+  uint32_t flags;
+  C_Prefetch(BlueStore *store, BlueStore::CollectionRef c,
+	     vector<ghobject_t> oids, uint32_t flags)
+    : store(store), c(std::move(c)), oids(std::move(oids)), flags(flags) {}
+  void finish(int r) override {
+    store->_prefetch(c.get(), oids, flags);
+  }
+};
+
+void BlueStore::prefetch(
+  CollectionHandle& c_,
+  const vector<ghobject_t>& oids,
+  uint32_t flags)
+{
+  Collection *c = static_cast<Collection *>(c_.get());
+  uint64_t max_queued = cct->_conf->bluestore_prefetch_max_queued;
+  if (oids.empty() || !c->exists || !max_queued) {
+    return;
+  }
+  if (prefetch_queued + oids.size() > max_queued) {
+    // we are behind the readers already, more hints would only add load
+    dout(20) << __func__ << " " << c->cid << " dropping " << oids.size()
+	     << " oids, " << prefetch_queued << " queued" << dendl;
+    logger->inc(l_bluestore_prefetch_dropped, oids.size());
+    return;
+  }
+  dout(15) << __func__ << " " << c->cid << " " << oids.size() << " oids"
+	   << " flags 0x" << std::hex << flags << std::dec << dendl;
+  prefetch_queued += oids.size();
+  prefetch_finisher.queue(new C_Prefetch(this, c, oids, flags));
+}
+
+void BlueStore::_prefetch(
+  Collection *c,
+  const vector<ghobject_t>& oids,
+  uint32_t flags)
+{
+  vector<OnodeRef> onodes;
+  onodes.reserve(oids.size());
+  {
+    std::shared_lock l(c->lock);
+    if (c->exists) {
+      size_t loaded = c->prefetch_onodes(oids, &onodes);
+      logger->inc(l_bluestore_prefetch_onodes, loaded);
+
+      // Extent map shards are only faulted in by the readers holding the
+      // object, here we just pull them into the kv cache with a single
+      // lookup so the readers do not wait for the device.
+      set<string> shard_keys;
+      string key;
+      for (auto& o : onodes) {
+	for (auto& s : o->extent_map.shards) {
+	  if (!s.loaded) {
+	    generate_extent_shard_key_and_apply(
+	      o->key, s.shard_info->offset, &key,
+	      [&](const string& final_key) {
+		shard_keys.insert(final_key);
+	      });
+	  }
+	}
+      }
+      if (!shard_keys.empty()) {
+	map<string, bufferlist> ignored;
+	db->get(PREFIX_OBJ, shard_keys, &ignored);
+      }
+    }
+  }
+
+  if (flags & PREFETCH_DATA) {
+    uint64_t max_size = cct->_conf->bluestore_prefetch_data_max_object_size;
+    for (auto& o : onodes) {
+      // only objects with an unsharded extent map, reading does not
+      // modify those
+      if (o->onode.size == 0 || o->onode.size > max_size ||
+	  !o->extent_map.shards.empty()) {
+	continue;
+      }
+      std::shared_lock l(c->lock);
+      if (!c->exists || !o->exists) {
+	continue;
+      }
+      bufferlist bl;
+      _do_read(c, o, 0, o->onode.size, bl,
+	       CEPH_OSD_OP_FLAG_FADVISE_WILLNEED);
+    }
+  }
+  prefetch_queued -= oids.size();
+}
+
 void BlueStore::set_collection_commit_queue(
     const coll_t& cid,
     ContextQueue *commit_queue)
@@ -14382,6 +14774,25 @@ void BlueStore::_txc_state_proc(TransContext *txc)
 	  _txc_apply_kv(txc, true);
 	}
       }
+      // a sequencer is always mapped to the same lane, this keeps the
+      // order of its kv transactions
+      if (KVSyncLane *lane = _get_kv_sync_lane(txc->osr.get()); lane) {
+	std::lock_guard l(lane->lock);
+	lane->queue.push_back(txc);
+	if (!lane->in_progress) {
+	  lane->in_progress = true;
+	  lane->cond.notify_one();
+	}
+	if (txc->get_state() != TransContext::STATE_KV_SUBMITTED) {
+	  lane->queue_unsubmitted.push_back(txc);
+	  ++txc->osr->kv_committing_serially;
+	}
+	if (txc->had_ios)
+	  lane->ios++;
+	lane->throttle_costs += txc->cost;
+	++lane->throttle_txcs;
+	return;
+      }
       {
 	std::lock_guard l(kv_lock);
 	kv_queue.push_back(txc);
@@ -14486,6 +14897,9 @@ void BlueStore::_txc_write_nodes(TransContext *txc, KeyValueDB::Transaction t)
     }
     o->flushing_count++;
   }
+  if (zoned_cleaner_enabled && !txc->allocated.empty()) {
+    _zoned_index_add(txc);
+  }
 
   // objects we modified but didn't affect the onode
   auto p = txc->modified_objects.begin();
@@ -14538,7 +14952,7 @@ void BlueStore::_txc_finalize_kv(TransContext *txc, KeyValueDB::Transaction t)
 	   << " released 0x" << txc->released
 	   << std::dec << dendl;
 
-  if (!fm->is_null_manager())
+  if (!fm->is_null_manager() || alloc_journal_enabled)
   {
     // We have to handle the case where we allocate *and* deallocate the
     // same region in this transaction.  The freelist doesn't like that.
@@ -14564,18 +14978,22 @@ void BlueStore::_txc_finalize_kv(TransContext *txc, KeyValueDB::Transaction t)
       }
     }
 
-    // update freelist with non-overlap sets
-    for (interval_set<uint64_t>::iterator p = pallocated->begin();
-	 p != pallocated->end();
-	 ++p) {
-      fm->allocate(p.get_start(), p.get_len(), t);
-    }
-    for (interval_set<uint64_t>::iterator p = preleased->begin();
-	 p != preleased->end();
-	 ++p) {
-      dout(20) << __func__ << " release 0x" << std::hex << p.get_start()
-	       << "~" << p.get_len() << std::dec << dendl;
-      fm->release(p.get_start(), p.get_len(), t);
+    if (fm->is_null_manager()) {
+      _alloc_journal_queue_delta(*pallocated, *preleased, t);
+    } else {
+      // update freelist with non-overlap sets
+      for (interval_set<uint64_t>::iterator p = pallocated->begin();
+	   p != pallocated->end();
+	   ++p) {
+	fm->allocate(p.get_start(), p.get_len(), t);
+      }
+      for (interval_set<uint64_t>::iterator p = preleased->begin();
+	   p != preleased->end();
+	   ++p) {
+	dout(20) << __func__ << " release 0x" << std::hex << p.get_start()
+		 << "~" << p.get_len() << std::dec << dendl;
+	fm->release(p.get_start(), p.get_len(), t);
+      }
     }
   }
 
@@ -14705,6 +15123,11 @@ void BlueStore::_txc_finish(TransContext *txc)
 
       osr->q.pop_front();
       releasing_txc.push_back(*txc);
+      if (zoned_cleaner_enabled) {
+	// counted before the q is seen empty, see _zoned_wait_released()
+	std::lock_guard l(zoned_release_lock);
+	++zoned_releasing;
+      }
     }
 
     if (osr->q.empty()) {
@@ -14729,6 +15152,12 @@ void BlueStore::_txc_finish(TransContext *txc)
     throttle.log_state_latency(*txc, logger, l_bluestore_state_done_lat);
     throttle.complete(*txc);
     delete txc;
+    if (zoned_cleaner_enabled) {
+      std::lock_guard l(zoned_release_lock);
+      if (--zoned_releasing == 0) {
+	zoned_release_cond.notify_all();
+      }
+    }
   }
 
   if (submit_deferred) {
@@ -14757,7 +15186,11 @@ void BlueStore::_txc_release_alloc(TransContext *txc)
                !alloc)) {
       goto out;
   }
-  discard_queued = bdev->try_discard(txc->released);
+  // with the zoned allocator the cleaner waits for the space to be
+  // released, a zone is reset once all of it is
+  if (!zoned_cleaner_enabled) {
+    discard_queued = bdev->try_discard(txc->released);
+  }
   // if async discard succeeded, will do alloc->release when discard callback
   // else we should release here
   if (!discard_queued) {
@@ -14927,13 +15360,38 @@ void BlueStore::_kv_start()
   dout(10) << __func__ << dendl;
 
   finisher.start();
+  prefetch_finisher.start();
+  compress_pool.start(
+    cct->_conf.get_val<uint64_t>("bluestore_compression_threads"));
   kv_sync_thread.create("bstore_kv_sync");
+  ceph_assert(kv_sync_lanes.empty());
+  auto lanes = cct->_conf.get_val<uint64_t>("bluestore_kv_sync_lanes");
+  for (unsigned id = 1; id < lanes; ++id) {
+    kv_sync_lanes.emplace_back(std::make_unique<KVSyncLane>(this, id));
+    kv_sync_lanes.back()->create("bstore_kv_lane");
+  }
   kv_finalize_thread.create("bstore_kv_final");
+  if (alloc && alloc->get_type() == std::string_view("zoned")) {
+    zoned_cleaner_enabled = true;
+    zoned_cleaner_thread.create("bstore_zclean");
+  }
 }
 
 void BlueStore::_kv_stop()
 {
   dout(10) << __func__ << dendl;
+  if (zoned_cleaner_thread.is_started()) {
+    {
+      std::lock_guard l(zoned_cleaner_lock);
+      zoned_cleaner_stop = true;
+      zoned_cleaner_cond.notify_all();
+    }
+    zoned_cleaner_thread.join();
+    zoned_cleaner_stop = false;
+  }
+  prefetch_finisher.wait_for_empty();
+  prefetch_finisher.stop();
+  compress_pool.shutdown();
   {
     std::unique_lock l{kv_lock};
     while (!kv_sync_started) {
@@ -14942,6 +15400,19 @@ void BlueStore::_kv_stop()
     kv_stop = true;
     kv_cond.notify_all();
   }
+  // lanes hand their txcs over to the finalize thread, stop them first
+  for (auto& lane : kv_sync_lanes) {
+    std::unique_lock l{lane->lock};
+    while (!lane->started) {
+      lane->cond.wait(l);
+    }
+    lane->stop = true;
+    lane->cond.notify_all();
+  }
+  for (auto& lane : kv_sync_lanes) {
+    lane->join();
+  }
+  kv_sync_lanes.clear();
   {
     std::unique_lock l{kv_finalize_lock};
     while (!kv_finalize_started) {
@@ -14953,6 +15424,13 @@ void BlueStore::_kv_stop()
   kv_sync_thread.join();
   kv_finalize_thread.join();
   ceph_assert(removed_collections.empty());
+  if (zoned_cleaner_enabled) {
+    zoned_cleaner_enabled = false;
+    ceph_assert(zoned_releasing == 0);
+    std::lock_guard l(zoned_index_lock);
+    zoned_index.clear();
+    zoned_index_complete = false;
+  }
   {
     std::lock_guard l(kv_lock);
     kv_stop = false;
@@ -14997,7 +15475,7 @@ void BlueStore::_kv_sync_thread()
     ceph_assert(kv_committing.empty());
     if (kv_queue.empty() &&
 	((deferred_done_queue.empty() && deferred_stable_queue.empty()) ||
-	 !deferred_aggressive)) {
+	 (!deferred_aggressive && !deferred_kick))) {
       if (kv_stop)
 	break;
       dout(20) << __func__ << " sleep" << dendl;
@@ -15021,6 +15499,7 @@ void BlueStore::_kv_sync_thread()
       kv_submitting.swap(kv_queue_unsubmitted);
       deferred_done.swap(deferred_done_queue);
       deferred_stable.swap(deferred_stable_queue);
+      deferred_kick = false;
       aios = kv_ios;
       costs = kv_throttle_costs;
       txcs = kv_throttle_txcs;
@@ -15083,23 +15562,12 @@ void BlueStore::_kv_sync_thread()
       // it.  in either case, we increase the max in the earlier txn
       // we submit.
       uint64_t new_nid_max = 0, new_blobid_max = 0;
-      if (nid_last + cct->_conf->bluestore_nid_prealloc/2 > nid_max) {
-	KeyValueDB::Transaction t =
-	  kv_submitting.empty() ? synct : kv_submitting.front()->t;
-	new_nid_max = nid_last + cct->_conf->bluestore_nid_prealloc;
-	bufferlist bl;
-	encode(new_nid_max, bl);
-	t->set(PREFIX_SUPER, "nid_max", bl);
-	dout(10) << __func__ << " new_nid_max " << new_nid_max << dendl;
-      }
-      if (blobid_last + cct->_conf->bluestore_blobid_prealloc/2 > blobid_max) {
-	KeyValueDB::Transaction t =
-	  kv_submitting.empty() ? synct : kv_submitting.front()->t;
-	new_blobid_max = blobid_last + cct->_conf->bluestore_blobid_prealloc;
-	bufferlist bl;
-	encode(new_blobid_max, bl);
-	t->set(PREFIX_SUPER, "blobid_max", bl);
-	dout(10) << __func__ << " new_blobid_max " << new_blobid_max << dendl;
+      std::unique_lock id_max_l{id_max_lock, std::defer_lock};
+      if (_kv_need_id_max_update()) {
+	id_max_l.lock();
+	_kv_prepare_id_max(
+	  kv_submitting.empty() ? synct : kv_submitting.front()->t,
+	  &new_nid_max, &new_blobid_max);
       }
 
       for (auto txc : kv_committing) {
@@ -15172,39 +15640,11 @@ void BlueStore::_kv_sync_thread()
       }
 #endif
 
-      {
-	std::unique_lock m{kv_finalize_lock};
-	if (kv_committing_to_finalize.empty()) {
-	  kv_committing_to_finalize.swap(kv_committing);
-	} else {
-	  kv_committing_to_finalize.insert(
-	      kv_committing_to_finalize.end(),
-	      kv_committing.begin(),
-	      kv_committing.end());
-	  kv_committing.clear();
-	}
-	if (deferred_stable_to_finalize.empty()) {
-	  deferred_stable_to_finalize.swap(deferred_stable);
-	} else {
-	  deferred_stable_to_finalize.insert(
-	      deferred_stable_to_finalize.end(),
-	      deferred_stable.begin(),
-	      deferred_stable.end());
-	  deferred_stable.clear();
-	}
-	if (!kv_finalize_in_progress) {
-	  kv_finalize_in_progress = true;
-	  kv_finalize_cond.notify_one();
-	}
-      }
+      _kv_queue_finalize(kv_committing, deferred_stable);
 
-      if (new_nid_max) {
-	nid_max = new_nid_max;
-	dout(10) << __func__ << " nid_max now " << nid_max << dendl;
-      }
-      if (new_blobid_max) {
-	blobid_max = new_blobid_max;
-	dout(10) << __func__ << " blobid_max now " << blobid_max << dendl;
+      if (id_max_l.owns_lock()) {
+	_kv_commit_id_max(new_nid_max, new_blobid_max);
+	id_max_l.unlock();
       }
 
       {
@@ -15229,104 +15669,782 @@ void BlueStore::_kv_sync_thread()
 	  l_bluestore_kv_sync_lat,
 	  dur,
 	  cct->_conf->bluestore_log_op_age);
+	_deferred_policy_note(true, dur_kv);
       }
 
       l.lock();
       // previously deferred "done" are now "stable" by virtue of this
       // commit cycle.
       deferred_stable_queue.swap(deferred_done);
+      if (!kv_sync_lanes.empty() && !deferred_stable_queue.empty()) {
+	// the txcs may all go through the lanes, don't wait for one of ours
+	// to clean them up
+	deferred_kick = true;
+      }
     }
   }
   dout(10) << __func__ << " finish" << dendl;
   kv_sync_started = false;
 }
 
-void BlueStore::_kv_finalize_thread()
+bool BlueStore::_kv_need_id_max_update() const
 {
-  deque<TransContext*> kv_committed;
-  deque<DeferredBatch*> deferred_stable;
-  dout(10) << __func__ << " start" << dendl;
-  std::unique_lock l(kv_finalize_lock);
-  ceph_assert(!kv_finalize_started);
-  kv_finalize_started = true;
-  kv_finalize_cond.notify_all();
-  while (true) {
-    ceph_assert(kv_committed.empty());
-    ceph_assert(deferred_stable.empty());
-    if (kv_committing_to_finalize.empty() &&
-	deferred_stable_to_finalize.empty()) {
-      if (kv_finalize_stop)
-	break;
-      dout(20) << __func__ << " sleep" << dendl;
-      kv_finalize_in_progress = false;
-      kv_finalize_cond.wait(l);
-      dout(20) << __func__ << " wake" << dendl;
-    } else {
-      kv_committed.swap(kv_committing_to_finalize);
-      deferred_stable.swap(deferred_stable_to_finalize);
-      l.unlock();
-      dout(20) << __func__ << " kv_committed " << kv_committed << dendl;
-      dout(20) << __func__ << " deferred_stable " << deferred_stable << dendl;
-
-      auto start = mono_clock::now();
-
-      while (!kv_committed.empty()) {
-	TransContext *txc = kv_committed.front();
-	ceph_assert(txc->get_state() == TransContext::STATE_KV_SUBMITTED);
-	_txc_state_proc(txc);
-	kv_committed.pop_front();
-      }
-
-      for (auto b : deferred_stable) {
-	auto p = b->txcs.begin();
-	while (p != b->txcs.end()) {
-	  TransContext *txc = &*p;
-	  p = b->txcs.erase(p); // unlink here because
-	  _txc_state_proc(txc); // this may destroy txc
-	}
-	delete b;
-      }
-      deferred_stable.clear();
-
-      if (!deferred_aggressive) {
-	if (deferred_queue_size >= deferred_batch_ops.load() ||
-	    throttle.should_submit_deferred()) {
-	  deferred_try_submit();
-	}
-      }
-
-      // this is as good a place as any ...
-      _reap_collections();
-      log_latency("kv_final",
-	l_bluestore_kv_final_lat,
-	mono_clock::now() - start,
-	cct->_conf->bluestore_log_op_age);
+  return nid_last + cct->_conf->bluestore_nid_prealloc/2 > nid_max ||
+    blobid_last + cct->_conf->bluestore_blobid_prealloc/2 > blobid_max;
+}
 
-      l.lock();
-    }
+void BlueStore::_kv_prepare_id_max(KeyValueDB::Transaction t,
+				   uint64_t *new_nid_max,
+				   uint64_t *new_blobid_max)
+{
+  ceph_assert(ceph_mutex_is_locked(id_max_lock));
+  // checked again, another kv sync thread may have updated them already
+  if (nid_last + cct->_conf->bluestore_nid_prealloc/2 > nid_max) {
+    *new_nid_max = nid_last + cct->_conf->bluestore_nid_prealloc;
+    bufferlist bl;
+    encode(*new_nid_max, bl);
+    t->set(PREFIX_SUPER, "nid_max", bl);
+    dout(10) << __func__ << " new_nid_max " << *new_nid_max << dendl;
+  }
+  if (blobid_last + cct->_conf->bluestore_blobid_prealloc/2 > blobid_max) {
+    *new_blobid_max = blobid_last + cct->_conf->bluestore_blobid_prealloc;
+    bufferlist bl;
+    encode(*new_blobid_max, bl);
+    t->set(PREFIX_SUPER, "blobid_max", bl);
+    dout(10) << __func__ << " new_blobid_max " << *new_blobid_max << dendl;
   }
-  dout(10) << __func__ << " finish" << dendl;
-  kv_finalize_started = false;
 }
 
-
-bluestore_deferred_op_t *BlueStore::_get_deferred_op(
-  TransContext *txc, uint64_t len)
+void BlueStore::_kv_commit_id_max(uint64_t new_nid_max, uint64_t new_blobid_max)
 {
-  if (!txc->deferred_txn) {
-    txc->deferred_txn = new bluestore_deferred_transaction_t;
+  ceph_assert(ceph_mutex_is_locked(id_max_lock));
+  if (new_nid_max) {
+    nid_max = new_nid_max;
+    dout(10) << __func__ << " nid_max now " << nid_max << dendl;
+  }
+  if (new_blobid_max) {
+    blobid_max = new_blobid_max;
+    dout(10) << __func__ << " blobid_max now " << blobid_max << dendl;
   }
-  txc->deferred_txn->ops.push_back(bluestore_deferred_op_t());
-  logger->inc(l_bluestore_issued_deferred_writes);
-  logger->inc(l_bluestore_issued_deferred_write_bytes, len);
-  return &txc->deferred_txn->ops.back();
 }
 
-void BlueStore::_deferred_queue(TransContext *txc)
+void BlueStore::_kv_queue_finalize(deque<TransContext*>& committed,
+				   deque<DeferredBatch*>& deferred_stable)
 {
-  dout(20) << __func__ << " txc " << txc << " osr " << txc->osr << dendl;
-
-  DeferredBatch *tmp;
+  std::unique_lock m{kv_finalize_lock};
+  if (kv_committing_to_finalize.empty()) {
+    kv_committing_to_finalize.swap(committed);
+  } else {
+    kv_committing_to_finalize.insert(
+	kv_committing_to_finalize.end(),
+	committed.begin(),
+	committed.end());
+    committed.clear();
+  }
+  if (deferred_stable_to_finalize.empty()) {
+    deferred_stable_to_finalize.swap(deferred_stable);
+  } else {
+    deferred_stable_to_finalize.insert(
+	deferred_stable_to_finalize.end(),
+	deferred_stable.begin(),
+	deferred_stable.end());
+    deferred_stable.clear();
+  }
+  if (!kv_finalize_in_progress) {
+    kv_finalize_in_progress = true;
+    kv_finalize_cond.notify_one();
+  }
+}
+
+void BlueStore::CompressPool::start(unsigned num)
+{
+  ceph_assert(workers.empty());
+  stop = false;
+  for (unsigned i = 0; i < num; ++i) {
+    workers.emplace_back(std::make_unique<Worker>(this));
+    workers.back()->create("bstore_compress");
+  }
+}
+
+void BlueStore::CompressPool::shutdown()
+{
+  {
+    std::lock_guard l(lock);
+    stop = true;
+    // run() returns once its batch is done, whoever did the work, so
+    // entries of batches the submitter finished alone may still be queued;
+    // there is nothing left to do for them
+    queue.clear();
+    cond.notify_all();
+  }
+  for (auto& w : workers) {
+    w->join();
+  }
+  workers.clear();
+}
+
+void BlueStore::CompressPool::run(size_t count, std::function<void(size_t)> fn)
+{
+  if (count <= 1 || workers.empty()) {
+    for (size_t i = 0; i < count; ++i) {
+      fn(i);
+    }
+    return;
+  }
+  auto b = std::make_shared<Batch>();
+  b->fn = std::move(fn);
+  b->count = count;
+  {
+    std::lock_guard l(lock);
+    // one entry per helper we want, a worker picking it up joins the batch
+    // (or finds nothing left to do)
+    size_t helpers = std::min(count - 1, workers.size());
+    for (size_t i = 0; i < helpers; ++i) {
+      queue.push_back(b);
+    }
+    cond.notify_all();
+  }
+  _run_batch(*b);
+  std::unique_lock l(lock);
+  done_cond.wait(l, [&] { return b->done == b->count; });
+}
+
+void BlueStore::CompressPool::_run_batch(Batch& b)
+{
+  size_t n = 0;
+  for (size_t i = b.next++; i < b.count; i = b.next++) {
+    b.fn(i);
+    ++n;
+  }
+  if (n) {
+    std::lock_guard l(lock);
+    b.done += n;
+    if (b.done == b.count) {
+      done_cond.notify_all();
+    }
+  }
+}
+
+void BlueStore::CompressPool::_worker()
+{
+  std::unique_lock l(lock);
+  while (!stop) {
+    if (queue.empty()) {
+      cond.wait(l);
+      continue;
+    }
+    auto b = std::move(queue.front());
+    queue.pop_front();
+    l.unlock();
+    _run_batch(*b);
+    l.lock();
+  }
+}
+
+void BlueStore::_kv_sync_lane_thread(KVSyncLane *lane)
+{
+  dout(10) << __func__ << " lane " << lane->id << " start" << dendl;
+  deque<TransContext*> kv_committing;  ///< currently syncing
+  deque<DeferredBatch*> no_deferred;   ///< deferred ios are left to kv_sync_thread
+  std::unique_lock l{lane->lock};
+  ceph_assert(!lane->started);
+  lane->started = true;
+  lane->cond.notify_all();
+
+  while (true) {
+    ceph_assert(kv_committing.empty());
+    if (lane->queue.empty()) {
+      if (lane->stop)
+	break;
+      dout(20) << __func__ << " lane " << lane->id << " sleep" << dendl;
+      lane->in_progress = false;
+      lane->cond.wait(l);
+      dout(20) << __func__ << " lane " << lane->id << " wake" << dendl;
+      continue;
+    }
+
+    deque<TransContext*> kv_submitting;
+    dout(20) << __func__ << " lane " << lane->id
+	     << " committing " << lane->queue.size()
+	     << " submitting " << lane->queue_unsubmitted.size() << dendl;
+    kv_committing.swap(lane->queue);
+    kv_submitting.swap(lane->queue_unsubmitted);
+    uint64_t aios = lane->ios;
+    uint64_t costs = lane->throttle_costs;
+    uint64_t txcs = lane->throttle_txcs;
+    lane->ios = 0;
+    lane->throttle_costs = 0;
+    lane->throttle_txcs = 0;
+    l.unlock();
+
+    auto start = mono_clock::now();
+    if (aios) {
+      // the data of our txcs must be stable before their metadata
+      bdev->flush();
+    }
+    auto after_flush = mono_clock::now();
+
+    KeyValueDB::Transaction synct = db->get_transaction();
+
+    // a txc past the persisted {nid,blobid}_max must wait for the update to
+    // commit, otherwise the update is left to whichever thread gets the lock
+    uint64_t new_nid_max = 0, new_blobid_max = 0;
+    std::unique_lock id_max_l{id_max_lock, std::defer_lock};
+    bool past_id_max = false;
+    for (auto txc : kv_submitting) {
+      if (txc->last_nid >= nid_max || txc->last_blobid >= blobid_max) {
+	past_id_max = true;
+	break;
+      }
+    }
+    if (past_id_max) {
+      id_max_l.lock();
+    } else if (_kv_need_id_max_update()) {
+      id_max_l.try_lock();
+    }
+    if (id_max_l.owns_lock()) {
+      _kv_prepare_id_max(
+	kv_submitting.empty() ? synct : kv_submitting.front()->t,
+	&new_nid_max, &new_blobid_max);
+    }
+
+    for (auto txc : kv_committing) {
+      throttle.log_state_latency(*txc, logger, l_bluestore_state_kv_queued_lat);
+      if (txc->get_state() == TransContext::STATE_KV_QUEUED) {
+	_txc_apply_kv(txc, false);
+	--txc->osr->kv_committing_serially;
+      } else {
+	ceph_assert(txc->get_state() == TransContext::STATE_KV_SUBMITTED);
+      }
+      if (txc->had_ios) {
+	--txc->osr->txc_with_unstable_io;
+      }
+    }
+
+    throttle.release_kv_throttle(costs, txcs);
+
+    int r = db_was_opened_read_only || cct->_conf->bluestore_debug_omit_kv_commit ?
+      0 : db->submit_transaction_sync(synct);
+    ceph_assert(r == 0);
+
+    int committing_size = kv_committing.size();
+    _kv_queue_finalize(kv_committing, no_deferred);
+
+    if (id_max_l.owns_lock()) {
+      _kv_commit_id_max(new_nid_max, new_blobid_max);
+      id_max_l.unlock();
+    }
+
+    {
+      // deferred ios are only retired by kv_sync_thread, make sure it
+      // does not wait for a txc of its own sequencers
+      std::lock_guard m(kv_lock);
+      if (!deferred_done_queue.empty()) {
+	deferred_kick = true;
+	if (!kv_sync_in_progress) {
+	  kv_sync_in_progress = true;
+	  kv_cond.notify_one();
+	}
+      }
+    }
+
+    {
+      auto finish = mono_clock::now();
+      ceph::timespan dur_flush = after_flush - start;
+      ceph::timespan dur_kv = finish - after_flush;
+      ceph::timespan dur = finish - start;
+      dout(20) << __func__ << " lane " << lane->id
+	       << " committed " << committing_size
+	       << " in " << dur
+	       << " (" << dur_flush << " flush + " << dur_kv << " kv commit)"
+	       << dendl;
+      log_latency("kv_flush",
+	l_bluestore_kv_flush_lat,
+	dur_flush,
+	cct->_conf->bluestore_log_op_age);
+      log_latency("kv_commit",
+	l_bluestore_kv_commit_lat,
+	dur_kv,
+	cct->_conf->bluestore_log_op_age);
+      log_latency("kv_sync",
+	l_bluestore_kv_sync_lat,
+	dur,
+	cct->_conf->bluestore_log_op_age);
+      _deferred_policy_note(true, dur_kv);
+    }
+
+    l.lock();
+  }
+  dout(10) << __func__ << " lane " << lane->id << " finish" << dendl;
+  lane->started = false;
+}
+
+void BlueStore::_kv_finalize_thread()
+{
+  deque<TransContext*> kv_committed;
+  deque<DeferredBatch*> deferred_stable;
+  dout(10) << __func__ << " start" << dendl;
+  std::unique_lock l(kv_finalize_lock);
+  ceph_assert(!kv_finalize_started);
+  kv_finalize_started = true;
+  kv_finalize_cond.notify_all();
+  while (true) {
+    ceph_assert(kv_committed.empty());
+    ceph_assert(deferred_stable.empty());
+    if (kv_committing_to_finalize.empty() &&
+	deferred_stable_to_finalize.empty()) {
+      if (kv_finalize_stop)
+	break;
+      dout(20) << __func__ << " sleep" << dendl;
+      kv_finalize_in_progress = false;
+      kv_finalize_cond.wait(l);
+      dout(20) << __func__ << " wake" << dendl;
+    } else {
+      kv_committed.swap(kv_committing_to_finalize);
+      deferred_stable.swap(deferred_stable_to_finalize);
+      l.unlock();
+      dout(20) << __func__ << " kv_committed " << kv_committed << dendl;
+      dout(20) << __func__ << " deferred_stable " << deferred_stable << dendl;
+
+      auto start = mono_clock::now();
+
+      while (!kv_committed.empty()) {
+	TransContext *txc = kv_committed.front();
+	ceph_assert(txc->get_state() == TransContext::STATE_KV_SUBMITTED);
+	_txc_state_proc(txc);
+	kv_committed.pop_front();
+      }
+
+      for (auto b : deferred_stable) {
+	auto p = b->txcs.begin();
+	while (p != b->txcs.end()) {
+	  TransContext *txc = &*p;
+	  p = b->txcs.erase(p); // unlink here because
+	  _txc_state_proc(txc); // this may destroy txc
+	}
+	delete b;
+      }
+      deferred_stable.clear();
+
+      _deferred_policy_update();
+      if (!deferred_aggressive) {
+	if (deferred_queue_size >= deferred_batch_ops.load() ||
+	    throttle.should_submit_deferred()) {
+	  deferred_try_submit();
+	}
+      }
+
+      if (alloc_journal_enabled &&
+	  alloc_journal_seq - alloc_journal_ckpt_seq >=
+	    cct->_conf->bluestore_allocation_journal_compact_deltas) {
+	_alloc_journal_compact();
+      }
+
+      // this is as good a place as any ...
+      _reap_collections();
+      log_latency("kv_final",
+	l_bluestore_kv_final_lat,
+	mono_clock::now() - start,
+	cct->_conf->bluestore_log_op_age);
+
+      l.lock();
+    }
+  }
+  dout(10) << __func__ << " finish" << dendl;
+  kv_finalize_started = false;
+}
+
+
+void BlueStore::_zoned_cleaner_thread()
+{
+  dout(10) << __func__ << " start" << dendl;
+  auto za = static_cast<ZonedAllocator*>(alloc);
+  std::unique_lock l{zoned_cleaner_lock};
+  while (!zoned_cleaner_stop) {
+    zoned_cleaner_cond.wait_for(l, ceph::make_timespan(
+      cct->_conf.get_val<double>("bluestore_zoned_cleaner_interval")));
+    if (zoned_cleaner_stop) {
+      break;
+    }
+    double free_ratio =
+      cct->_conf.get_val<double>("bluestore_zoned_cleaner_free_ratio");
+    uint64_t free = za->get_free();
+    if (free >= free_ratio * za->get_capacity()) {
+      continue;
+    }
+    uint64_t min_dead = za->get_zone_size() *
+      cct->_conf.get_val<double>("bluestore_zoned_cleaner_min_dead_ratio");
+    dout(10) << __func__ << " free 0x" << std::hex << free << std::dec
+	     << dendl;
+    l.unlock();
+    int64_t r = _zoned_clean(min_dead);
+    if (r < 0 && r != -ENOENT) {
+      dout(5) << __func__ << " cleaning failed: " << cpp_strerror(r)
+	      << dendl;
+    }
+    l.lock();
+  }
+  dout(10) << __func__ << " finish" << dendl;
+}
+
+int64_t BlueStore::_zoned_clean(uint64_t min_dead)
+{
+  auto za = static_cast<ZonedAllocator*>(alloc);
+  uint64_t zone_size = za->get_zone_size();
+  int64_t zone_start = -1;
+  {
+    // zones left with live data by an earlier pass go first, unless
+    // they got reset meanwhile
+    std::lock_guard l(zoned_index_lock);
+    while (zone_start < 0 && !zoned_requeued.empty()) {
+      uint64_t zone = zoned_requeued.front();
+      zoned_requeued.pop_front();
+      if (za->is_zone_full(zone) && za->get_zone_live(zone) > 0) {
+	zone_start = zone;
+      }
+    }
+  }
+  if (zone_start >= 0) {
+    dout(10) << __func__ << " cleaning requeued zone at 0x" << std::hex
+	     << zone_start << std::dec << dendl;
+  } else {
+    interval_set<uint64_t> unmovable;
+    _zoned_get_unmovable(&unmovable);
+    uint64_t zone_dead = 0;
+    zone_start = za->pick_zone_to_clean(min_dead, unmovable, &zone_dead);
+    if (zone_start < 0) {
+      dout(20) << __func__ << " no zone with 0x" << std::hex << min_dead
+	       << " dead bytes" << std::dec << dendl;
+      return -ENOENT;
+    }
+    // bluefs might have taken space in the zone before it got sealed
+    unmovable.clear();
+    _zoned_get_unmovable(&unmovable);
+    if (unmovable.intersects(zone_start, zone_size)) {
+      dout(10) << __func__ << " zone 0x" << std::hex << zone_start << std::dec
+	       << " became unmovable, leaving it" << dendl;
+      return -EBUSY;
+    }
+    dout(10) << __func__ << " cleaning zone at 0x" << std::hex << zone_start
+	     << " dead 0x" << zone_dead << std::dec << dendl;
+  }
+  int r = _zoned_clean_zone(zone_start, zone_size);
+  if (r < 0) {
+    // the zone stays sealed, try again on the next pass
+    std::lock_guard l(zoned_index_lock);
+    zoned_requeued.push_back(zone_start);
+    return r;
+  }
+  return zone_start;
+}
+
+void BlueStore::_zoned_get_unmovable(interval_set<uint64_t> *unmovable)
+{
+  unmovable->union_insert(0, _get_ondisk_reserved());
+  uint64_t lsize = std::max<uint64_t>(BDEV_LABEL_BLOCK_SIZE, min_alloc_size);
+  for (uint64_t position : bdev_label_positions) {
+    if (position + lsize <= bdev->get_size()) {
+      unmovable->union_insert(position, lsize);
+    }
+  }
+  if (bluefs) {
+    bluefs->foreach_block_extents(
+      bluefs_layout.shared_bdev,
+      [&](uint64_t start, uint32_t len) {
+	unmovable->union_insert(start, len);
+      });
+  }
+}
+
+void BlueStore::_zoned_index_add(TransContext *txc)
+{
+  uint64_t zone_size = static_cast<ZonedAllocator*>(alloc)->get_zone_size();
+  std::lock_guard l(zoned_index_lock);
+  for (auto p = txc->allocated.begin(); p != txc->allocated.end(); ++p) {
+    for (uint64_t zone = p2align(p.get_start(), zone_size);
+	 zone < p.get_end();
+	 zone += zone_size) {
+      auto& objects = zoned_index[zone];
+      for (auto& o : txc->onodes) {
+	if (o->exists) {
+	  objects.emplace(o->c->cid, o->oid);
+	}
+      }
+    }
+  }
+}
+
+void BlueStore::_zoned_wait_released()
+{
+  std::unique_lock l(zoned_release_lock);
+  zoned_release_cond.wait(l, [this] { return zoned_releasing == 0; });
+}
+
+int BlueStore::_zoned_clean_zone(uint64_t zone_start, uint64_t zone_len)
+{
+  auto start = mono_clock::now();
+  auto za = static_cast<ZonedAllocator*>(alloc);
+  uint64_t zone_end = std::min(zone_start + zone_len, bdev->get_size());
+  uint64_t relocated = 0;
+  bool complete = true;
+  int r = 0;
+
+  // objects which had space allocated in the zone, taken once the txcs
+  // which allocated there before the zone got sealed are through
+  std::map<coll_t, std::vector<ghobject_t>> indexed;
+  bool index_complete;
+  {
+    std::unique_lock zl(zoned_submit_lock);
+    std::lock_guard l(zoned_index_lock);
+    index_complete = zoned_index_complete;
+    auto p = zoned_index.find(zone_start);
+    if (p != zoned_index.end()) {
+      for (auto& [cid, oid] : p->second) {
+	indexed[cid].push_back(oid);
+      }
+      zoned_index.erase(p);
+    }
+  }
+  for (auto p = indexed.begin(); p != indexed.end() && r >= 0; ++p) {
+    CollectionRef c = _get_collection(p->first);
+    if (c) {
+      r = _zoned_relocate(c, p->second, zone_start, zone_end, &relocated,
+			  &complete);
+    }
+  }
+
+  // the index misses the objects written before mount, and the clones
+  // sharing blobs with the indexed ones: walk all objects if anything
+  // is left, which also fills the index in
+  if (r >= 0 && !zoned_cleaner_stop &&
+      (!index_complete || za->get_zone_live(zone_start) > 0)) {
+    dout(10) << __func__ << " zone 0x" << std::hex << zone_start
+	     << " live 0x" << za->get_zone_live(zone_start) << std::dec
+	     << " after indexed objects, walking all" << dendl;
+    std::vector<CollectionRef> colls;
+    {
+      std::shared_lock l(coll_lock);
+      for (auto& [cid, c] : coll_map) {
+	colls.push_back(c);
+      }
+    }
+    for (auto i = colls.begin(); i != colls.end() && r >= 0; ++i) {
+      auto& c = *i;
+      ghobject_t next;
+      while (r >= 0 && !zoned_cleaner_stop && !next.is_max()) {
+	std::vector<ghobject_t> ls;
+	{
+	  std::shared_lock l(c->lock);
+	  if (!c->exists) {
+	    break;
+	  }
+	  int lr = _collection_list(c.get(), next, ghobject_t::get_max(), 128,
+				    false, &ls, &next);
+	  if (lr < 0) {
+	    complete = false;
+	    break;
+	  }
+	}
+	r = _zoned_relocate(c, ls, zone_start, zone_end, &relocated,
+			    &complete);
+      }
+    }
+    if (r >= 0 && !zoned_cleaner_stop) {
+      std::lock_guard l(zoned_index_lock);
+      zoned_index_complete = true;
+    }
+  }
+  if (r < 0 || zoned_cleaner_stop) {
+    complete = false;
+  }
+
+  uint64_t live = 0;
+  if (complete) {
+    // whatever still refers to the zone is being removed by txcs in
+    // flight: wait for those submitted so far and let them release it
+    { std::unique_lock zl(zoned_submit_lock); }
+    _osr_drain_all();
+    _zoned_wait_released();
+    // clones made after the collection got listed and objects moved in by
+    // a split of a collection already walked are left behind
+    live = za->get_zone_live(zone_start);
+    if (live) {
+      dout(5) << __func__ << " zone 0x" << std::hex << zone_start
+	      << " still has 0x" << live << " live bytes" << std::dec
+	      << ", requeuing" << dendl;
+    } else {
+      logger->inc(l_bluestore_zoned_cleaned_zones);
+    }
+  }
+  dout(10) << __func__ << " zone 0x" << std::hex << zone_start
+	   << " relocated 0x" << relocated << std::dec
+	   << (complete ? "" : " incomplete")
+	   << " in " << timespan_str(mono_clock::now() - start)
+	   << " = " << r << dendl;
+  if (r < 0) {
+    return r;
+  }
+  return complete && !live ? 0 : -EAGAIN;
+}
+
+int BlueStore::_zoned_relocate(
+  CollectionRef& c,
+  const std::vector<ghobject_t>& oids,
+  uint64_t zone_start,
+  uint64_t zone_end,
+  uint64_t *relocated,
+  bool *complete)
+{
+  uint64_t zone_size = static_cast<ZonedAllocator*>(alloc)->get_zone_size();
+  uint64_t batch_bytes = cct->_conf.get_val<Option::size_t>(
+    "bluestore_zoned_cleaner_batch_bytes");
+  int r = 0;
+  auto p = oids.begin();
+  while (r >= 0 && p != oids.end() && !zoned_cleaner_stop) {
+    // no other txc is prepared while the batch is: the onodes it writes
+    // are not changed under it
+    std::unique_lock zl(zoned_submit_lock);
+    std::unique_lock l(c->lock);
+    if (!c->exists) {
+      break;
+    }
+    TransContext *txc = nullptr;
+    uint64_t bytes = 0;
+    // allocated before an object is touched, bluefs shares the allocator
+    // and might take the space between the check and the write
+    PExtentVector reserved;
+    uint64_t reserved_bytes = 0;
+    for (; p != oids.end() && bytes < batch_bytes; ++p) {
+      OnodeRef o = c->get_onode(*p, false);
+      if (!o || !o->exists) {
+	continue;
+      }
+      // the logical ranges backed by blobs living in the zone, and the
+      // other zones the object is in
+      interval_set<uint64_t> ranges;
+      std::set<uint64_t> zones;
+      o->extent_map.fault_range(db, 0, OBJECT_MAX_SIZE);
+      for (auto& e : o->extent_map.extent_map) {
+	for (auto& pe : e.blob->get_blob().get_extents()) {
+	  if (!pe.is_valid()) {
+	    continue;
+	  }
+	  if (pe.offset < zone_end && pe.end() > zone_start) {
+	    ranges.union_insert(e.logical_offset, e.length);
+	  } else {
+	    zones.insert(p2align<uint64_t>(pe.offset, zone_size));
+	  }
+	}
+      }
+      if (!zones.empty()) {
+	std::lock_guard il(zoned_index_lock);
+	for (auto zone : zones) {
+	  zoned_index[zone].emplace(c->cid, o->oid);
+	}
+      }
+      if (ranges.empty()) {
+	continue;
+      }
+      uint64_t need = 0;
+      for (auto q = ranges.begin(); q != ranges.end(); ++q) {
+	need += p2roundup(q.get_end(), min_alloc_size) -
+	  p2align(q.get_start(), min_alloc_size);
+      }
+      if (need > reserved_bytes) {
+	PExtentVector extents;
+	int64_t got = alloc->allocate(need - reserved_bytes, min_alloc_size,
+				      0, -1, &extents);
+	if (got > 0) {
+	  reserved_bytes += got;
+	  reserved.insert(reserved.end(), extents.begin(), extents.end());
+	} else if (!extents.empty()) {
+	  alloc->release(extents);
+	}
+	if (reserved_bytes < need) {
+	  dout(5) << __func__ << " " << o->oid
+		  << " not enough free space to relocate 0x" << std::hex
+		  << need << std::dec << dendl;
+	  *complete = false;
+	  r = -ENOSPC;
+	  break;
+	}
+      }
+      std::map<uint64_t, bufferlist> relocate;
+      for (auto q = ranges.begin(); q != ranges.end() && r >= 0; ++q) {
+	bufferlist bl;
+	r = _do_read(c.get(), o, q.get_start(), q.get_len(), bl, 0);
+	if (r < 0) {
+	  derr << __func__ << " " << o->oid << " failed to read 0x" << std::hex
+	       << q.get_start() << "~" << q.get_len() << std::dec << ": "
+	       << cpp_strerror(r) << dendl;
+	} else if (bl.length()) {
+	  relocate[q.get_start()].claim_append(bl);
+	}
+      }
+      if (r < 0) {
+	*complete = false;
+	r = 0;
+	continue;
+      }
+      if (!txc) {
+	txc = _txc_create(c.get(), c->osr.get(), nullptr);
+	spg_t pgid;
+	if (c->cid.is_pg(&pgid)) {
+	  txc->osd_pool_id = pgid.pool();
+	}
+      }
+      // always into new blobs, overwriting the ones in place would leave
+      // the data in the zone
+      for (auto& [offset, bl] : relocate) {
+	txc->bytes += bl.length();
+	bytes += bl.length();
+	int wr = _do_write(txc, c, o, offset, bl.length(), bl, 0, true,
+			   &reserved);
+	ceph_assert(wr == 0); // the space is reserved
+	reserved_bytes = 0;
+	for (auto& e : reserved) {
+	  reserved_bytes += e.length;
+	}
+      }
+      txc->write_onode(o);
+      dout(20) << __func__ << " " << o->oid << " relocating 0x" << std::hex
+	       << ranges << std::dec << dendl;
+    }
+    if (!reserved.empty()) {
+      alloc->release(reserved);
+    }
+    if (!txc) {
+      continue;
+    }
+    _txc_submit(txc, nullptr);
+    l.unlock();
+    zl.unlock();
+    // the old blobs are released once the txc is done
+    _osr_drain(c->osr.get());
+    _zoned_wait_released();
+    *relocated += bytes;
+    logger->inc(l_bluestore_zoned_relocated_bytes, bytes);
+  }
+  return r;
+}
+
+bluestore_deferred_op_t *BlueStore::_get_deferred_op(
+  TransContext *txc, uint64_t len)
+{
+  if (!txc->deferred_txn) {
+    txc->deferred_txn = new bluestore_deferred_transaction_t;
+  }
+  txc->deferred_txn->ops.push_back(bluestore_deferred_op_t());
+  logger->inc(l_bluestore_issued_deferred_writes);
+  logger->inc(l_bluestore_issued_deferred_write_bytes, len);
+  return &txc->deferred_txn->ops.back();
+}
+
+void BlueStore::_deferred_queue(TransContext *txc)
+{
+  dout(20) << __func__ << " txc " << txc << " osr " << txc->osr << dendl;
+
+  DeferredBatch *tmp;
   txc->osr->deferred_lock.lock();
   {
     if (!txc->osr->deferred_pending) {
@@ -15403,6 +16521,96 @@ void BlueStore::deferred_try_submit()
   }
 }
 
+void BlueStore::_deferred_policy_note(bool db, ceph::timespan lat)
+{
+  double sample = std::chrono::duration<double>(lat).count();
+  std::lock_guard l(deferred_policy_lock);
+  double& avg = db ? deferred_db_lat : deferred_main_lat;
+  // EWMA with a 1/8 weight, same as the classic TCP RTT estimator
+  avg = avg ? avg + (sample - avg) / 8 : sample;
+  (db ? deferred_db_sampled : deferred_main_sampled) = true;
+}
+
+// Feedback control of the deferred write cutoff and batch size.
+//
+// Deferred writes land on the DB device first and are replayed to the main
+// device later.  When the main device is saturated (slow replays or a growing
+// deferred backlog) the replay competes with client io: halve the cutoff so
+// fewer writes take the deferred path and double the batch size so that the
+// remaining replays coalesce better.  When the DB device is the slow one
+// only the cutoff is reduced.  Once both devices are back under their
+// latency targets the cutoff grows additively towards the configured
+// bluestore_prefer_deferred_size* and the batch size shrinks back to the
+// configured bluestore_deferred_batch_ops*; these are never exceeded.
+// The cutoff never drops below min_alloc_size (or the configured value if
+// that is smaller): sub-allocation-unit overwrites are deferred anyway, so
+// going lower only loses the ability to recover quickly.
+void BlueStore::_deferred_policy_update()
+{
+  if (!cct->_conf->bluestore_deferred_adaptive) {
+    return;
+  }
+  auto now = mono_clock::now();
+  double db_lat, main_lat;
+  {
+    std::lock_guard l(deferred_policy_lock);
+    if (now - deferred_policy_stamp < make_timespan(
+	  cct->_conf->bluestore_deferred_adaptive_interval)) {
+      return;
+    }
+    deferred_policy_stamp = now;
+    // a device we stopped sending io to would otherwise keep its last
+    // (high) latency forever, let the estimate decay instead
+    if (!deferred_db_sampled) {
+      deferred_db_lat /= 2;
+    }
+    if (!deferred_main_sampled) {
+      deferred_main_lat /= 2;
+    }
+    deferred_db_sampled = deferred_main_sampled = false;
+    db_lat = deferred_db_lat;
+    main_lat = deferred_main_lat;
+  }
+  double backlog = throttle.get_deferred_fill();
+  bool main_busy =
+    main_lat > cct->_conf->bluestore_deferred_adaptive_main_latency ||
+    backlog > cct->_conf->bluestore_deferred_adaptive_backlog_ratio;
+  bool db_busy = db_lat > cct->_conf->bluestore_deferred_adaptive_db_latency;
+
+  uint64_t cutoff = prefer_deferred_size;
+  uint64_t cutoff_conf = prefer_deferred_size_conf;
+  int batch_ops = deferred_batch_ops;
+  int batch_ops_conf = deferred_batch_ops_conf;
+  if (main_busy || db_busy) {
+    uint64_t floor = std::min<uint64_t>(min_alloc_size, cutoff_conf);
+    cutoff = std::max<uint64_t>(p2align(cutoff / 2, block_size), floor);
+  } else if (cutoff < cutoff_conf) {
+    uint64_t step = std::max(block_size, p2align(cutoff_conf / 8, block_size));
+    cutoff = std::min(cutoff + step, cutoff_conf);
+  }
+  if (main_busy) {
+    int max_ops = batch_ops_conf *
+      (int)cct->_conf->bluestore_deferred_adaptive_max_batch_factor;
+    batch_ops = std::max(std::min(batch_ops * 2, max_ops), batch_ops);
+  } else {
+    batch_ops = std::max(batch_ops / 2, batch_ops_conf);
+  }
+
+  if (cutoff != prefer_deferred_size || batch_ops != deferred_batch_ops) {
+    dout(10) << __func__ << " db_lat " << db_lat
+	     << " main_lat " << main_lat
+	     << " backlog " << backlog
+	     << " prefer_deferred_size 0x" << std::hex
+	     << prefer_deferred_size << " -> 0x" << cutoff << std::dec
+	     << " deferred_batch_ops " << deferred_batch_ops
+	     << " -> " << batch_ops << dendl;
+    prefer_deferred_size = cutoff;
+    deferred_batch_ops = batch_ops;
+    logger->set(l_bluestore_deferred_cutoff, cutoff);
+    logger->set(l_bluestore_deferred_batch_ops, batch_ops);
+  }
+}
+
 void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
 {
   dout(10) << __func__ << " osr " << osr
@@ -15457,6 +16665,7 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
     ++i;
   }
 
+  b->submitted = mono_clock::now();
   bdev->aio_submit(&b->ioc);
 }
 
@@ -15473,6 +16682,7 @@ void BlueStore::_deferred_aio_finish(OpSequencer *osr)
   dout(10) << __func__ << " osr " << osr << dendl;
   ceph_assert(osr->deferred_running);
   DeferredBatch *b = osr->deferred_running;
+  _deferred_policy_note(false, mono_clock::now() - b->submitted);
 
   {
     osr->deferred_lock.lock();
@@ -15674,6 +16884,12 @@ int BlueStore::queue_transactions(
   OpSequencer *osr = c->osr.get();
   dout(10) << __func__ << " ch " << c << " " << c->cid << dendl;
 
+  // the zoned cleaner relocates objects in txcs of its own
+  std::shared_lock zl(zoned_submit_lock, std::defer_lock);
+  if (zoned_cleaner_enabled) {
+    zl.lock();
+  }
+
   // prepare
   TransContext *txc = _txc_create(static_cast<Collection*>(ch.get()), osr,
 				  &on_commit, op);
@@ -15682,6 +16898,44 @@ int BlueStore::queue_transactions(
     txc->bytes += (*p).get_num_bytes();
     _txc_add_transaction(txc, &(*p));
   }
+  auto throttle_lat = _txc_submit(txc, handle);
+  if (zl.owns_lock()) {
+    zl.unlock();
+  }
+
+  // we're immediately readable (unlike FileStore)
+  for (auto c : on_applied_sync) {
+    c->complete(0);
+  }
+  if (!on_applied.empty()) {
+    if (c->commit_queue) {
+      c->commit_queue->queue(on_applied);
+    } else {
+      finisher.queue(on_applied);
+    }
+  }
+
+#ifdef WITH_BLKIN
+  if (txc->trace) {
+    txc->trace.event("txc applied");
+  }
+#endif
+
+  log_latency("submit_transact",
+    l_bluestore_submit_lat,
+    mono_clock::now() - start,
+    cct->_conf->bluestore_log_op_age);
+  log_latency("throttle_transact",
+    l_bluestore_throttle_lat,
+    throttle_lat,
+    cct->_conf->bluestore_log_op_age);
+  return 0;
+}
+
+ceph::timespan BlueStore::_txc_submit(
+  TransContext *txc,
+  ThreadPool::TPHandle *handle)
+{
   _txc_calc_cost(txc);
 
   _txc_write_nodes(txc, txc->t);
@@ -15739,33 +16993,7 @@ int BlueStore::queue_transactions(
   // execute (start)
   _txc_state_proc(txc);
 
-  // we're immediately readable (unlike FileStore)
-  for (auto c : on_applied_sync) {
-    c->complete(0);
-  }
-  if (!on_applied.empty()) {
-    if (c->commit_queue) {
-      c->commit_queue->queue(on_applied);
-    } else {
-      finisher.queue(on_applied);
-    }
-  }
-
-#ifdef WITH_BLKIN
-  if (txc->trace) {
-    txc->trace.event("txc applied");
-  }
-#endif
-
-  log_latency("submit_transact",
-    l_bluestore_submit_lat,
-    mono_clock::now() - start,
-    cct->_conf->bluestore_log_op_age);
-  log_latency("throttle_transact",
-    l_bluestore_throttle_lat,
-    tend - tstart,
-    cct->_conf->bluestore_log_op_age);
-  return 0;
+  return tend - tstart;
 }
 
 void BlueStore::_txc_aio_submit(TransContext *txc)
@@ -16284,6 +17512,10 @@ void BlueStore::_do_write_small(
     prev_ep = ep;
     --prev_ep;
   }
+  if (wctx->fresh_alloc) {
+    // neither overwrite nor reuse any blob, go straight to a new one
+    ep = prev_ep = end;
+  }
 
   boost::container::flat_set<const bluestore_blob_t*> inspected_blobs;
   // We don't want to have more blobs than min alloc units fit
@@ -16768,8 +18000,14 @@ void BlueStore::_do_write_big(
     uint32_t b_off = 0;
     uint32_t l = 0;
 
-    //attempting to reuse existing blob
-    if (!wctx->compress) {
+    if (wctx->fresh_alloc) {
+      // enforce target blob alignment with max_bsize, but never write
+      // into an existing blob
+      l = max_bsize - p2phase(offset, max_bsize);
+      l = std::min(uint64_t(l), length);
+      o->extent_map.punch_hole(c, offset, l, &wctx->old_extents);
+    } else if (!wctx->compress) {
+      //attempting to reuse existing blob
       // enforce target blob alignment with max_bsize
       l = max_bsize - p2phase(offset, max_bsize);
       l = std::min(uint64_t(l), length);
@@ -16990,18 +18228,43 @@ int BlueStore::_do_alloc_write(
   // and the condition is : (data_size < deferred).
 
   auto max_bsize = std::max(wctx->target_blob_size, min_alloc_size);
-  for (auto& wi : wctx->writes) {
-    if (wctx->compressor && wi.blob_length > min_alloc_size) {
-      auto start = mono_clock::now();
-
-      // compress
-      ceph_assert(wi.b_off == 0);
-      ceph_assert(wi.blob_length == wi.bl.length());
 
+  // compress all candidate blobs up front, on the compression workers
+  // (if any) and the calling thread together
+  struct compress_result_t {
+    int r = 0;
+    bufferlist bl;
+    std::optional<int32_t> message;
+    ceph::timespan lat;
+  };
+  std::vector<compress_result_t> compressed;
+  if (wctx->compressor) {
+    std::vector<size_t> to_compress;
+    for (size_t i = 0; i < wctx->writes.size(); ++i) {
+      auto& wi = wctx->writes[i];
+      if (wi.blob_length > min_alloc_size) {
+	ceph_assert(wi.b_off == 0);
+	ceph_assert(wi.blob_length == wi.bl.length());
+	to_compress.push_back(i);
+      }
+    }
+    compressed.resize(wctx->writes.size());
+    compress_pool.run(to_compress.size(), [&](size_t n) {
+      auto& wi = wctx->writes[to_compress[n]];
+      auto& res = compressed[to_compress[n]];
+      auto start = mono_clock::now();
       // FIXME: memory alignment here is bad
-      bufferlist t;
-      std::optional<int32_t> compressor_message;
-      int r = wctx->compressor->compress(wi.bl, t, compressor_message);
+      res.r = wctx->compressor->compress(wi.bl, res.bl, res.message);
+      res.lat = mono_clock::now() - start;
+    });
+  }
+
+  for (size_t i = 0; i < wctx->writes.size(); ++i) {
+    auto& wi = wctx->writes[i];
+    if (wctx->compressor && wi.blob_length > min_alloc_size) {
+      bufferlist& t = compressed[i].bl;
+      std::optional<int32_t>& compressor_message = compressed[i].message;
+      int r = compressed[i].r;
       uint64_t want_len_raw = wi.blob_length * wctx->crr;
       uint64_t want_len = p2roundup(want_len_raw, min_alloc_size);
       bool rejected = false;
@@ -17067,7 +18330,7 @@ int BlueStore::_do_alloc_write(
       }
       log_latency("compress@_do_alloc_write",
 	l_bluestore_compress_lat,
-        mono_clock::now() - start,
+	compressed[i].lat,
 	cct->_conf->bluestore_log_op_age );
     } else {
       need += wi.blob_length;
@@ -17077,11 +18340,30 @@ int BlueStore::_do_alloc_write(
   PExtentVector prealloc;
   prealloc.reserve(2 * wctx->writes.size());
   int64_t prealloc_left = 0;
+  uint64_t want = need;
+  if (wctx->reserved) {
+    auto p = wctx->reserved->begin();
+    for (; want > 0 && p != wctx->reserved->end(); ++p) {
+      uint64_t l = std::min<uint64_t>(want, p->length);
+      prealloc.emplace_back(p->offset, l);
+      prealloc_left += l;
+      want -= l;
+      if (l < p->length) {
+	p->offset += l;
+	p->length -= l;
+	break;
+      }
+    }
+    wctx->reserved->erase(wctx->reserved->begin(), p);
+  }
   auto start = mono_clock::now();
-  prealloc_left = alloc->allocate(
-    need, min_alloc_size, need,
-    use_last_allocator_lookup_position ? -1 : 0,
-    &prealloc);
+  if (want > 0) {
+    int64_t got = alloc->allocate(
+      want, min_alloc_size, want,
+      use_last_allocator_lookup_position ? -1 : 0,
+      &prealloc);
+    prealloc_left = got < 0 ? got : prealloc_left + got;
+  }
   log_latency("allocator@_do_alloc_write",
     l_bluestore_allocator_lat,
     mono_clock::now() - start,
@@ -17221,7 +18503,7 @@ int BlueStore::_do_alloc_write(
 
     // queue io
     if (!g_conf()->bluestore_debug_omit_block_device_write) {
-      if (data_size < prefer_deferred_size_snapshot) {
+      if (!wctx->fresh_alloc && data_size < prefer_deferred_size_snapshot) {
 	dout(20) << __func__ << " deferring 0x" << std::hex
 		 << l->length()  << " write via deferred, pds=0x"
                  << prefer_deferred_size_snapshot
@@ -17527,7 +18809,9 @@ int BlueStore::_do_write(
   uint64_t offset,
   uint64_t length,
   bufferlist& bl,
-  uint32_t fadvise_flags)
+  uint32_t fadvise_flags,
+  bool fresh_alloc,
+  PExtentVector *reserved)
 {
   int r = 0;
 
@@ -17542,6 +18826,7 @@ int BlueStore::_do_write(
            << " expected_object_size " << o->onode.expected_object_size
            << " expected_write_size " << o->onode.expected_write_size
            << std::dec
+	   << (fresh_alloc ? " fresh_alloc" : "")
 	   << dendl;
   _dump_onode<30>(cct, *o);
 
@@ -17558,6 +18843,9 @@ int BlueStore::_do_write(
 
   WriteContext wctx;
   _choose_write_options(c, o, fadvise_flags, &wctx);
+  // zoned devices are only written at the zone write pointers
+  wctx.fresh_alloc = fresh_alloc || zoned_cleaner_enabled;
+  wctx.reserved = reserved;
   o->extent_map.fault_range(db, offset, length);
   _do_write_data(txc, c, o, offset, length, bl, &wctx);
   r = _do_alloc_write(txc, c, o, &wctx);
@@ -17567,9 +18855,12 @@ int BlueStore::_do_write(
     goto out;
   }
 
-  if (wctx.extents_to_gc.empty() ||
-      wctx.extents_to_gc.range_start() > offset ||
-      wctx.extents_to_gc.range_end() < offset + length) {
+  // a relocation rewrites whole blobs, nothing is left to collect and
+  // there is no space reserved for it
+  if (!reserved &&
+      (wctx.extents_to_gc.empty() ||
+       wctx.extents_to_gc.range_start() > offset ||
+       wctx.extents_to_gc.range_end() < offset + length)) {
     benefit = gc.estimate(offset,
 			  length,
 			  o->extent_map,
@@ -17771,7 +19062,7 @@ int BlueStore::_write(TransContext *txc,
     r = -E2BIG;
   } else {
     _assign_nid(txc, o);
-    if (use_write_v2) {
+    if (use_write_v2 && !zoned_cleaner_enabled) {
       r = _do_write_v2(txc, c, o, offset, length, bl, fadvise_flags);
     } else {
       r = _do_write(txc, c, o, offset, length, bl, fadvise_flags);
@@ -17937,6 +19228,7 @@ int BlueStore::_do_remove(
     );
   }
   txc->t->rmkey(PREFIX_OBJ, o->key.c_str(), o->key.size());
+  c->get_onode_cache()->warm_remove(o->key);
   txc->note_removed_object(o);
   o->extent_map.clear();
   o->onode = bluestore_onode_t();
@@ -18545,6 +19837,7 @@ int BlueStore::_rename(TransContext *txc,
   }
 
   txc->t->rmkey(PREFIX_OBJ, oldo->key.c_str(), oldo->key.size());
+  c->get_onode_cache()->warm_remove(oldo->key);
 
   // rewrite shards
   {
@@ -19256,6 +20549,7 @@ void BlueStore::_record_onode(OnodeRef& o, KeyValueDB::Transaction &txn)
 
 
   txn->set(PREFIX_OBJ, o->key.c_str(), o->key.size(), bl);
+  o->c->get_onode_cache()->warm_update(o->key, bl);
 }
 
 void BlueStore::_log_alerts(osd_alert_list_t& alerts)
@@ -20769,6 +22063,371 @@ int BlueStore::read_allocation_from_drive_on_startup()
 
 
 
+//-----------------------------------------------------------------------------------
+// Allocation journal
+// The allocation file is only valid after a clean shutdown, so with NULL-FM an
+// unplanned shutdown forces a full scan of all onodes and shared-blobs.
+// When bluestore_allocation_journal is set we keep a copy of the free-space in
+// RocksDB instead:
+//  - a checkpoint split into fixed size regions (one key per region)
+//  - a delta (allocated + released) appended to the txc KV transaction for
+//    every txc changing the allocation map, so the delta commits atomically
+//    with the onodes referencing the space
+// The kv_finalize thread periodically folds the deltas into the checkpoint,
+// rewriting only the regions touched by them.
+// The allocation map on disk excludes BlueFS (like the allocation file) and
+// BlueFS extents are added back when BlueFS is mounted.
+//-----------------------------------------------------------------------------------
+struct alloc_journal_header_t {
+  uint64_t seq = 0;             // last delta folded into the checkpoint
+  uint64_t region_size = 0;
+  uint64_t bdev_size = 0;
+  uint64_t min_alloc_size = 0;
+
+  DENC(alloc_journal_header_t, v, p) {
+    DENC_START(1, 1, p);
+    denc(v.seq, p);
+    denc(v.region_size, p);
+    denc(v.bdev_size, p);
+    denc(v.min_alloc_size, p);
+    DENC_FINISH(p);
+  }
+};
+WRITE_CLASS_DENC(alloc_journal_header_t)
+
+// free-space view of a delta, replaying deltas in seq order reproduces the
+// committed allocation map
+static void apply_alloc_journal_delta(interval_set<uint64_t> &free_extents,
+				      const interval_set<uint64_t> &allocated,
+				      const interval_set<uint64_t> &released)
+{
+  interval_set<uint64_t> overlap;
+  overlap.intersection_of(free_extents, allocated);
+  free_extents.subtract(overlap);
+  free_extents.union_of(released);
+}
+
+static int decode_alloc_journal_delta(const bufferlist &bl,
+				      interval_set<uint64_t> *allocated,
+				      interval_set<uint64_t> *released)
+{
+  auto p = bl.cbegin();
+  try {
+    decode(*allocated, p);
+    decode(*released, p);
+  } catch (ceph::buffer::error& e) {
+    return -EIO;
+  }
+  return 0;
+}
+
+//---------------------------------------------------------
+int BlueStore::alloc_journal_open()
+{
+  alloc_journal_enabled = false;
+  alloc_journal_seq = 0;
+  alloc_journal_ckpt_seq = 0;
+  if (!fm->is_null_manager() || !cct->_conf->bluestore_allocation_journal) {
+    // a stale journal must never be replayed after the map changed behind it
+    alloc_journal_invalidate();
+    return 0;
+  }
+
+  int ret = alloc_journal_write_checkpoint(alloc);
+  if (ret < 0) {
+    derr << __func__ << "::NCB::failed writing allocation checkpoint" << dendl;
+    return ret;
+  }
+  alloc_journal_enabled = true;
+  return 0;
+}
+
+//---------------------------------------------------------
+// drop the checkpoint and all deltas, the next mount falls back to the onode
+// scan and writes a new checkpoint
+void BlueStore::alloc_journal_invalidate()
+{
+  alloc_journal_enabled = false;
+  bufferlist bl;
+  if (db->get(PREFIX_ALLOC_JOURNAL, ALLOC_JOURNAL_HEADER_KEY, &bl) == 0) {
+    dout(1) << __func__ << "::NCB::removing the allocation journal" << dendl;
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rmkeys_by_prefix(PREFIX_ALLOC_JOURNAL);
+    db->submit_transaction_sync(t);
+  }
+}
+
+//---------------------------------------------------------
+// called on mount with no txc in flight so the allocator is consistent with the DB
+int BlueStore::alloc_journal_write_checkpoint(Allocator* src_allocator)
+{
+  utime_t start_time = ceph_clock_now();
+  unique_ptr<Allocator> allocator(clone_allocator_without_bluefs(src_allocator));
+  if (!allocator) {
+    return -ENOMEM;
+  }
+  // remove allocations that are used by bdev label copies
+  if (bdev_label_multi == true) {
+    _main_bdev_label_remove(allocator.get());
+  }
+
+  alloc_journal_region_size = std::max<uint64_t>(
+    p2roundup<uint64_t>(cct->_conf->bluestore_allocation_journal_region_size,
+			min_alloc_size),
+    min_alloc_size);
+  KeyValueDB::Transaction t = db->get_transaction();
+  t->rmkeys_by_prefix(PREFIX_ALLOC_JOURNAL);
+
+  uint64_t region_count = 0;
+  uint64_t cur_region = 0;
+  interval_set<uint64_t> region_free;
+  auto flush_region = [&]() {
+    bufferlist bl;
+    encode(region_free, bl);
+    string key;
+    get_alloc_journal_region_key(cur_region, &key);
+    t->set(PREFIX_ALLOC_JOURNAL, key, bl);
+    region_free.clear();
+    region_count++;
+  };
+  // the bitmap allocator iterates in offset order
+  allocator->foreach([&](uint64_t offset, uint64_t length) {
+    while (length > 0) {
+      uint64_t region = offset / alloc_journal_region_size;
+      if (region != cur_region && !region_free.empty()) {
+	flush_region();
+      }
+      cur_region = region;
+      uint64_t len = std::min(length,
+			      (region + 1) * alloc_journal_region_size - offset);
+      region_free.insert(offset, len);
+      offset += len;
+      length -= len;
+    }
+  });
+  if (!region_free.empty()) {
+    flush_region();
+  }
+
+  alloc_journal_header_t header;
+  header.seq = alloc_journal_seq;
+  header.region_size = alloc_journal_region_size;
+  header.bdev_size = bdev->get_size();
+  header.min_alloc_size = min_alloc_size;
+  bufferlist bl;
+  encode(header, bl);
+  t->set(PREFIX_ALLOC_JOURNAL, ALLOC_JOURNAL_HEADER_KEY, bl);
+  db->submit_transaction_sync(t);
+  alloc_journal_ckpt_seq = header.seq;
+
+  utime_t duration = ceph_clock_now() - start_time;
+  dout(5) << __func__ << "::NCB::regions=" << region_count
+	  << " region_size=" << alloc_journal_region_size
+	  << " time=" << duration << " seconds" << dendl;
+  return 0;
+}
+
+//---------------------------------------------------------
+void BlueStore::_alloc_journal_queue_delta(
+  const interval_set<uint64_t>& allocated,
+  const interval_set<uint64_t>& released,
+  KeyValueDB::Transaction t)
+{
+  if (allocated.empty() && released.empty()) {
+    return;
+  }
+  // A release is handed back to the allocator only after its txc committed, so
+  // any later allocation of the same space is finalized with a higher seq.
+  uint64_t seq = ++alloc_journal_seq;
+  bufferlist bl;
+  encode(allocated, bl);
+  encode(released, bl);
+  string key;
+  get_alloc_journal_delta_key(seq, &key);
+  t->set(PREFIX_ALLOC_JOURNAL, key, bl);
+}
+
+//---------------------------------------------------------
+// called from the kv_finalize thread only
+void BlueStore::_alloc_journal_compact()
+{
+  auto start = mono_clock::now();
+  uint64_t last_seq = alloc_journal_seq;
+  uint64_t seq = alloc_journal_ckpt_seq;
+  std::vector<std::pair<interval_set<uint64_t>, interval_set<uint64_t>>> deltas;
+  std::set<uint64_t> regions;
+  auto touch = [&](const interval_set<uint64_t>& extents) {
+    for (auto p = extents.begin(); p != extents.end(); ++p) {
+      uint64_t first = p.get_start() / alloc_journal_region_size;
+      uint64_t last = (p.get_end() - 1) / alloc_journal_region_size;
+      for (uint64_t r = first; r <= last; ++r) {
+	regions.insert(r);
+      }
+    }
+  };
+
+  // Only fold the committed prefix of the log: a missing seq belongs to a txc
+  // which is still in flight and would be lost if we moved past it.
+  string key;
+  get_alloc_journal_delta_key(seq + 1, &key);
+  KeyValueDB::Iterator it = db->get_iterator(PREFIX_ALLOC_JOURNAL);
+  for (it->lower_bound(key); it->valid() && seq < last_seq; it->next()) {
+    get_alloc_journal_delta_key(seq + 1, &key);
+    if (it->key() != key) {
+      break;
+    }
+    deltas.emplace_back();
+    if (decode_alloc_journal_delta(it->value(),
+				   &deltas.back().first,
+				   &deltas.back().second) < 0) {
+      derr << __func__ << " failed to decode delta "
+	   << pretty_binary_string(it->key()) << ", disabling the journal" << dendl;
+      alloc_journal_enabled = false;
+      KeyValueDB::Transaction t = db->get_transaction();
+      t->rmkey(PREFIX_ALLOC_JOURNAL, ALLOC_JOURNAL_HEADER_KEY);
+      db->submit_transaction(t);
+      return;
+    }
+    touch(deltas.back().first);
+    touch(deltas.back().second);
+    ++seq;
+  }
+  if (deltas.empty()) {
+    return;
+  }
+
+  interval_set<uint64_t> free_extents;
+  for (auto r : regions) {
+    bufferlist bl;
+    get_alloc_journal_region_key(r, &key);
+    if (db->get(PREFIX_ALLOC_JOURNAL, key, &bl) == 0) {
+      interval_set<uint64_t> region_free;
+      auto p = bl.cbegin();
+      decode(region_free, p);
+      free_extents.union_of(region_free);
+    }
+  }
+  for (auto& [allocated, released] : deltas) {
+    apply_alloc_journal_delta(free_extents, allocated, released);
+  }
+
+  KeyValueDB::Transaction t = db->get_transaction();
+  for (auto r : regions) {
+    uint64_t r_start = r * alloc_journal_region_size;
+    interval_set<uint64_t> region_free;
+    region_free.insert(r_start, alloc_journal_region_size);
+    region_free.intersection_of(free_extents);
+    get_alloc_journal_region_key(r, &key);
+    if (region_free.empty()) {
+      t->rmkey(PREFIX_ALLOC_JOURNAL, key);
+    } else {
+      bufferlist bl;
+      encode(region_free, bl);
+      t->set(PREFIX_ALLOC_JOURNAL, key, bl);
+    }
+  }
+  alloc_journal_header_t header;
+  header.seq = seq;
+  header.region_size = alloc_journal_region_size;
+  header.bdev_size = bdev->get_size();
+  header.min_alloc_size = min_alloc_size;
+  bufferlist bl;
+  encode(header, bl);
+  t->set(PREFIX_ALLOC_JOURNAL, ALLOC_JOURNAL_HEADER_KEY, bl);
+  string end_key;
+  get_alloc_journal_delta_key(alloc_journal_ckpt_seq + 1, &key);
+  get_alloc_journal_delta_key(seq + 1, &end_key);
+  t->rm_range_keys(PREFIX_ALLOC_JOURNAL, key, end_key);
+  db->submit_transaction(t);
+
+  dout(10) << __func__ << " folded deltas 0x" << std::hex
+	   << alloc_journal_ckpt_seq + 1 << "..0x" << seq
+	   << " into 0x" << regions.size() << std::dec << " regions in "
+	   << ceph::to_seconds<double>(mono_clock::now() - start) << "s"
+	   << dendl;
+  alloc_journal_ckpt_seq = seq;
+}
+
+//---------------------------------------------------------
+// used after an unplanned shutdown, the DB is open in read-only mode
+int BlueStore::alloc_journal_restore(Allocator* allocator, uint64_t *num, uint64_t *bytes)
+{
+  utime_t start_time = ceph_clock_now();
+  bufferlist bl;
+  int ret = db->get(PREFIX_ALLOC_JOURNAL, ALLOC_JOURNAL_HEADER_KEY, &bl);
+  if (ret < 0) {
+    dout(1) << __func__ << "::NCB::no allocation journal" << dendl;
+    return ret;
+  }
+  alloc_journal_header_t header;
+  try {
+    auto p = bl.cbegin();
+    decode(header, p);
+  } catch (ceph::buffer::error& e) {
+    derr << __func__ << "::NCB::failed to decode the journal header" << dendl;
+    return -EIO;
+  }
+  if (header.min_alloc_size != min_alloc_size ||
+      header.bdev_size > bdev->get_size() ||
+      header.region_size == 0) {
+    derr << __func__ << "::NCB::journal header mismatch: min_alloc_size="
+	 << header.min_alloc_size << "/" << min_alloc_size
+	 << " bdev_size=" << header.bdev_size << "/" << bdev->get_size()
+	 << " region_size=" << header.region_size << dendl;
+    return -EINVAL;
+  }
+
+  interval_set<uint64_t> free_extents;
+  uint64_t region_count = 0, delta_count = 0;
+  KeyValueDB::Iterator it = db->get_iterator(PREFIX_ALLOC_JOURNAL);
+  string key, end_key;
+  get_alloc_journal_region_key(0, &key);
+  get_alloc_journal_delta_key(0, &end_key);
+  for (it->lower_bound(key); it->valid() && it->key() < end_key; it->next()) {
+    interval_set<uint64_t> region_free;
+    bufferlist value = it->value();
+    try {
+      auto p = value.cbegin();
+      decode(region_free, p);
+    } catch (ceph::buffer::error& e) {
+      derr << __func__ << "::NCB::failed to decode region "
+	   << pretty_binary_string(it->key()) << dendl;
+      return -EIO;
+    }
+    // regions are disjoint, adjacent extents are merged by insert()
+    for (auto p = region_free.begin(); p != region_free.end(); ++p) {
+      free_extents.insert(p.get_start(), p.get_len());
+    }
+    region_count++;
+  }
+
+  // deltas past a gap are valid, the missing txc never committed
+  get_alloc_journal_delta_key(header.seq + 1, &key);
+  for (it->lower_bound(key); it->valid(); it->next()) {
+    interval_set<uint64_t> allocated, released;
+    if (decode_alloc_journal_delta(it->value(), &allocated, &released) < 0) {
+      derr << __func__ << "::NCB::failed to decode delta "
+	   << pretty_binary_string(it->key()) << dendl;
+      return -EIO;
+    }
+    apply_alloc_journal_delta(free_extents, allocated, released);
+    delta_count++;
+  }
+
+  for (auto p = free_extents.begin(); p != free_extents.end(); ++p) {
+    allocator->init_add_free(p.get_start(), p.get_len());
+    (*num)++;
+    (*bytes) += p.get_len();
+  }
+
+  utime_t duration = ceph_clock_now() - start_time;
+  dout(1) << __func__ << "::NCB::regions=" << region_count
+	  << " deltas=" << delta_count << " extents=" << *num
+	  << " free=" << *bytes << " time=" << duration << " seconds" << dendl;
+  return 0;
+}
+
+
 // Only used for debugging purposes - we build a secondary allocator from the Onodes and compare it to the existing one
 // Not meant to be run by customers
 #ifdef CEPH_BLUESTORE_TOOL_RESTORE_ALLOCATION
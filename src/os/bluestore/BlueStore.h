@@ -150,6 +150,8 @@ enum {
   l_bluestore_issued_deferred_write_bytes,
   l_bluestore_submitted_deferred_writes,
   l_bluestore_submitted_deferred_write_bytes,
+  l_bluestore_deferred_cutoff,
+  l_bluestore_deferred_batch_ops,
 
   l_bluestore_write_big_skipped_blobs,
   l_bluestore_write_big_skipped_bytes,
@@ -176,6 +178,13 @@ enum {
   l_bluestore_onode_misses,
   l_bluestore_onode_shard_hits,
   l_bluestore_onode_shard_misses,
+  l_bluestore_onode_warm_hits,
+  l_bluestore_prefetch_onodes,
+  l_bluestore_prefetch_dropped,
+  l_bluestore_zoned_cleaned_zones,
+  l_bluestore_zoned_relocated_bytes,
+  l_bluestore_onode_warm_onodes,
+  l_bluestore_onode_warm_bytes,
   l_bluestore_extents,
   l_bluestore_blobs,
   l_bluestore_spanning_blobs,
@@ -1542,6 +1551,46 @@ public:
   struct OnodeCacheShard : public CacheShard {
     std::array<std::pair<ghobject_t, ceph::mono_clock::time_point>, 64> dumped_onodes;
 
+    /// warm tier entry: the onode exactly as encoded under PREFIX_OBJ
+    struct WarmOnode {
+      boost::intrusive::list_member_hook<> lru_item;
+      const mempool::bluestore_cache_warm_onode::string *key = nullptr;
+      mempool::bluestore_cache_warm_onode::string value;
+    };
+    struct warm_key_hash {
+      using is_transparent = void;
+      size_t operator()(std::string_view k) const {
+        return std::hash<std::string_view>{}(k);
+      }
+    };
+    struct warm_key_eq {
+      using is_transparent = void;
+      bool operator()(std::string_view a, std::string_view b) const {
+        return a == b;
+      }
+    };
+    typedef boost::intrusive::list<
+      WarmOnode,
+      boost::intrusive::member_hook<
+        WarmOnode,
+        boost::intrusive::list_member_hook<>,
+        &WarmOnode::lru_item> > warm_lru_t;
+
+    // The warm tier keeps encoded onodes of recently used objects so a miss
+    // in the (large) decoded tier doesn't need a RocksDB lookup. Entries are
+    // written through on every onode update, hence they never go stale and
+    // may be shared with the decoded tier. Sharded extent maps are not kept
+    // here, those are faulted in from RocksDB as before.
+    mempool::bluestore_cache_warm_onode::unordered_map<
+      mempool::bluestore_cache_warm_onode::string, WarmOnode,
+      warm_key_hash, warm_key_eq> warm_map;
+    warm_lru_t warm_lru;
+    uint64_t warm_bytes = 0;
+    std::atomic<uint64_t> warm_max = {0};
+
+    void _warm_rm(WarmOnode *w);
+    void _warm_trim_to(uint64_t new_bytes);
+
   public:
     OnodeCacheShard(CephContext* cct) : CacheShard(cct) {}
     static OnodeCacheShard *create(CephContext* cct, std::string type,
@@ -1558,6 +1607,14 @@ public:
     bool empty() {
       return _get_num() == 0;
     }
+
+    void set_warm_max(uint64_t max_bytes);
+    bool warm_lookup(std::string_view key, ceph::buffer::list *v);
+    void warm_update(std::string_view key, const ceph::buffer::list& v);
+    void warm_remove(std::string_view key);
+    /// move entries of objects now owned by another collection (under both locks)
+    void _warm_split(OnodeCacheShard *to, int64_t pool, int bits, uint32_t ps);
+    void add_warm_stats(uint64_t *onodes, uint64_t *bytes);
   };
 
   /// A Generic buffer Cache Shard
@@ -1677,6 +1734,10 @@ public:
       return onode_space.cache;
     }
     OnodeRef get_onode(const ghobject_t& oid, bool create, bool is_createop=false);
+    /// load the onodes not cached yet with a single kv lookup, returns
+    /// the number of onodes loaded
+    size_t prefetch_onodes(const std::vector<ghobject_t>& oids,
+			   std::vector<OnodeRef> *onodes);
 
     // the terminology is confusing here, sorry!
     //
@@ -2107,6 +2168,11 @@ public:
     bool should_submit_deferred() {
       return throttle_deferred_bytes.past_midpoint();
     }
+    /// fraction of the deferred throttle in use
+    double get_deferred_fill() {
+      auto max = throttle_deferred_bytes.get_max();
+      return max ? (double)throttle_deferred_bytes.get_current() / max : 0.0;
+    }
     void reset_throttle(const ConfigProxy &conf) {
       throttle_bytes.reset_max(conf->bluestore_throttle_bytes);
       throttle_deferred_bytes.reset_max(
@@ -2135,6 +2201,7 @@ public:
     std::map<uint64_t,deferred_io> iomap; ///< map of ios in this batch
     deferred_queue_t txcs;           ///< txcs in this batch
     IOContext ioc;                   ///< our aios
+    ceph::mono_clock::time_point submitted; ///< when our aios were issued
     /// bytes of pending io for each deferred seq (may be 0)
     std::map<uint64_t,int> seq_bytes;
 
@@ -2308,6 +2375,69 @@ public:
       return NULL;
     }
   };
+  /// relocates the live data of zones with dead space (zoned allocator only)
+  struct ZonedCleanerThread : public Thread {
+    BlueStore *store;
+    explicit ZonedCleanerThread(BlueStore *s) : store(s) {}
+    void *entry() override {
+      store->_zoned_cleaner_thread();
+      return NULL;
+    }
+  };
+  /// an additional kv sync thread, commits the txcs of the sequencers mapped
+  /// to it (see bluestore_kv_sync_lanes). lane 0 is the kv_sync_thread itself.
+  struct KVSyncLane : public Thread {
+    BlueStore *store;
+    const unsigned id;
+    ceph::mutex lock = ceph::make_mutex("BlueStore::KVSyncLane::lock");
+    ceph::condition_variable cond;
+    bool started = false;
+    bool stop = false;
+    bool in_progress = false;
+    std::deque<TransContext*> queue;             ///< ready, already submitted
+    std::deque<TransContext*> queue_unsubmitted; ///< ready, need submit by lane
+    uint64_t ios = 0;
+    uint64_t throttle_costs = 0;
+    uint64_t throttle_txcs = 0;
+
+    KVSyncLane(BlueStore *s, unsigned id) : store(s), id(id) {}
+    void *entry() override {
+      store->_kv_sync_lane_thread(this);
+      return NULL;
+    }
+  };
+
+  /// workers sharing the blob compression of large writes
+  struct CompressPool {
+    struct Batch {
+      std::function<void(size_t)> fn;
+      size_t count = 0;
+      std::atomic<size_t> next = {0};  ///< next index to run
+      size_t done = 0;                 ///< indexes finished, under lock
+    };
+    struct Worker : public Thread {
+      CompressPool *pool;
+      explicit Worker(CompressPool *p) : pool(p) {}
+      void *entry() override {
+	pool->_worker();
+	return NULL;
+      }
+    };
+    ceph::mutex lock = ceph::make_mutex("BlueStore::CompressPool::lock");
+    ceph::condition_variable cond;      ///< wakes up the workers
+    ceph::condition_variable done_cond; ///< wakes up the submitters
+    std::deque<std::shared_ptr<Batch>> queue;
+    std::vector<std::unique_ptr<Worker>> workers;
+    bool stop = false;
+
+    void start(unsigned num);
+    void shutdown();
+    /// run fn(0) .. fn(count - 1), the caller takes part in the work
+    void run(size_t count, std::function<void(size_t)> fn);
+  private:
+    void _run_batch(Batch& b);
+    void _worker();
+  } compress_pool;
 
   struct BigDeferredWriteContext {
     uint64_t off = 0;     // original logical offset
@@ -2358,6 +2488,12 @@ private:
   bool db_was_opened_read_only = true;
   bool need_to_destage_allocation_file = false;
 
+  // allocation journal (NCB only, see bluestore_allocation_journal)
+  std::atomic_bool alloc_journal_enabled = {false};
+  std::atomic<uint64_t> alloc_journal_seq = {0}; ///< last delta seq handed out
+  uint64_t alloc_journal_ckpt_seq = 0;  ///< deltas folded into the checkpoint
+  uint64_t alloc_journal_region_size = 0;
+
   ///< rwlock to protect coll_map/new_coll_map
   ceph::shared_mutex coll_lock = ceph::make_shared_mutex("BlueStore::coll_lock");
   mempool::bluestore_cache_other::unordered_map<coll_t, CollectionRef> coll_map;
@@ -2385,6 +2521,8 @@ private:
   std::atomic_int deferred_queue_size = {0};         ///< num txc's queued across all osrs
   std::atomic_int deferred_aggressive = {0}; ///< aggressive wakeup of kv thread
   Finisher  finisher;
+  Finisher  prefetch_finisher;
+  std::atomic<uint64_t> prefetch_queued = {0}; ///< objects waiting for prefetch
   utime_t  deferred_last_submitted = utime_t();
 
   KVSyncThread kv_sync_thread;
@@ -2400,6 +2538,11 @@ private:
   std::deque<TransContext*> kv_committing;        ///< currently syncing
   std::deque<DeferredBatch*> deferred_done_queue;   ///< deferred ios done
   bool kv_sync_in_progress = false;
+  bool deferred_kick = false; ///< deferred work left for kv_sync_thread by the lanes
+
+  std::vector<std::unique_ptr<KVSyncLane>> kv_sync_lanes;
+  ///< serializes the {nid,blobid}_max updates of the kv sync threads
+  ceph::mutex id_max_lock = ceph::make_mutex("BlueStore::id_max_lock");
 
   KVFinalizeThread kv_finalize_thread;
   ceph::mutex kv_finalize_lock = ceph::make_mutex("BlueStore::kv_finalize_lock");
@@ -2408,6 +2551,28 @@ private:
   std::deque<DeferredBatch*> deferred_stable_to_finalize; ///< pending finalization
   bool kv_finalize_in_progress = false;
 
+  ZonedCleanerThread zoned_cleaner_thread;
+  ceph::mutex zoned_cleaner_lock = ceph::make_mutex("BlueStore::zoned_cleaner_lock");
+  ceph::condition_variable zoned_cleaner_cond;
+  std::atomic<bool> zoned_cleaner_stop = false;
+  bool zoned_cleaner_enabled = false;
+  /// taken shared by queue_transactions, exclusively by the cleaner while
+  /// it prepares a batch, so its txcs never interleave with others
+  ceph::shared_mutex zoned_submit_lock =
+    ceph::make_shared_mutex("BlueStore::zoned_submit_lock");
+  /// txcs done but not yet released to the allocator
+  ceph::mutex zoned_release_lock = ceph::make_mutex("BlueStore::zoned_release_lock");
+  ceph::condition_variable zoned_release_cond;
+  uint64_t zoned_releasing = 0;
+  /// objects which had space allocated in a zone, by zone start. Entries
+  /// might be stale, the index is complete only once the cleaner walked
+  /// all objects after mount.
+  ceph::mutex zoned_index_lock = ceph::make_mutex("BlueStore::zoned_index_lock");
+  std::map<uint64_t, std::set<std::pair<coll_t, ghobject_t>>> zoned_index;
+  bool zoned_index_complete = false;
+  /// sealed zones a pass left live data in, cleaned first by the next one
+  std::deque<uint64_t> zoned_requeued;
+
   PerfCounters *logger = nullptr;
 
   std::list<CollectionRef> removed_collections;
@@ -2450,6 +2615,17 @@ private:
   ///< size threshold for forced deferred writes
   std::atomic<uint64_t> prefer_deferred_size = {0};
 
+  // adaptive deferred policy, see _deferred_policy_update()
+  std::atomic<uint64_t> prefer_deferred_size_conf = {0}; ///< configured (max) cutoff
+  std::atomic<int> deferred_batch_ops_conf = {0};        ///< configured (min) batch size
+  ceph::mutex deferred_policy_lock =
+    ceph::make_mutex("BlueStore::deferred_policy_lock");
+  double deferred_db_lat = 0;   ///< smoothed kv commit latency, sec
+  double deferred_main_lat = 0; ///< smoothed deferred batch aio latency, sec
+  bool deferred_db_sampled = false;   ///< deferred_db_lat updated this period
+  bool deferred_main_sampled = false; ///< deferred_main_lat updated this period
+  ceph::mono_clock::time_point deferred_policy_stamp;
+
   ///< approx cost per io, in bytes
   std::atomic<uint64_t> throttle_cost_per_io = {0};
 
@@ -2472,6 +2648,7 @@ private:
   // cache trim control
   uint64_t cache_size = 0;       ///< total cache size
   double cache_meta_ratio = 0;   ///< cache ratio dedicated to metadata
+  double cache_meta_warm_ratio = 0; ///< part of the metadata cache kept as encoded onodes
   double cache_kv_ratio = 0;     ///< cache ratio dedicated to kv (e.g., rocksdb)
   double cache_kv_onode_ratio = 0; ///< cache ratio dedicated to kv onodes (e.g., rocksdb onode CF)
   double cache_data_ratio = 0;   ///< cache ratio dedicated to object data
@@ -2653,6 +2830,10 @@ private:
         }
       }
       virtual uint64_t _get_used_bytes() const {
+        return _get_decoded_bytes() +
+          mempool::bluestore_cache_warm_onode::allocated_bytes();
+      }
+      uint64_t _get_decoded_bytes() const {
         return mempool::bluestore_blob::allocated_bytes() +
           mempool::bluestore_extent::allocated_bytes() +
           mempool::bluestore_cache_buffer::allocated_bytes() +
@@ -2683,7 +2864,7 @@ private:
         return (2 > onode_num) ? 2 : onode_num;
       }
       double get_bytes_per_onode() const {
-        return (double)_get_used_bytes() / (double)_get_num_onodes();
+        return (double)_get_decoded_bytes() / (double)_get_num_onodes();
       }
     };
     std::shared_ptr<MetaCache> meta_cache;
@@ -2883,6 +3064,9 @@ private:
 			    TrackedOpRef osd_op=TrackedOpRef());
   void _txc_update_store_statfs(TransContext *txc);
   void _txc_add_transaction(TransContext *txc, Transaction *t);
+  /// encode the prepared txc, take the throttle and start its state machine,
+  /// returns the time spent throttled
+  ceph::timespan _txc_submit(TransContext *txc, ThreadPool::TPHandle *handle);
   void _txc_calc_cost(TransContext *txc);
   void _txc_write_nodes(TransContext *txc, KeyValueDB::Transaction t);
   void _txc_state_proc(TransContext *txc);
@@ -2908,13 +3092,46 @@ private:
   void _kv_start();
   void _kv_stop();
   void _kv_sync_thread();
+  void _kv_sync_lane_thread(KVSyncLane *lane);
   void _kv_finalize_thread();
+  void _zoned_cleaner_thread();
+  /// cleans a zone left with live data by an earlier pass, or picks one
+  /// with min_dead bytes, and relocates its live data. Returns the zone
+  /// start, -ENOENT if there was none, or the error the zone got requeued
+  /// for.
+  int64_t _zoned_clean(uint64_t min_dead);
+  /// 0 once the zone has no live data, -EAGAIN if some is left
+  int _zoned_clean_zone(uint64_t zone_start, uint64_t zone_len);
+  int _zoned_relocate(CollectionRef& c,
+		      const std::vector<ghobject_t>& oids,
+		      uint64_t zone_start, uint64_t zone_end,
+		      uint64_t *relocated,
+		      bool *complete);
+  void _zoned_get_unmovable(interval_set<uint64_t> *unmovable);
+  void _zoned_index_add(TransContext *txc);
+  void _zoned_wait_released();
+  KVSyncLane *_get_kv_sync_lane(const OpSequencer *osr) {
+    if (kv_sync_lanes.empty()) {
+      return nullptr;
+    }
+    auto n = osr->get_sequencer_id() % (kv_sync_lanes.size() + 1);
+    return n ? kv_sync_lanes[n - 1].get() : nullptr;
+  }
+  bool _kv_need_id_max_update() const;
+  void _kv_prepare_id_max(KeyValueDB::Transaction t,
+			  uint64_t *new_nid_max,
+			  uint64_t *new_blobid_max);
+  void _kv_commit_id_max(uint64_t new_nid_max, uint64_t new_blobid_max);
+  void _kv_queue_finalize(std::deque<TransContext*>& committed,
+			  std::deque<DeferredBatch*>& deferred_stable);
 
   bluestore_deferred_op_t *_get_deferred_op(TransContext *txc, uint64_t len);
   void _deferred_queue(TransContext *txc);
 public:
   void deferred_try_submit();
 private:
+  void _deferred_policy_note(bool db, ceph::timespan lat);
+  void _deferred_policy_update();
   void _deferred_submit_unlock(OpSequencer *osr);
   void _deferred_aio_finish(OpSequencer *osr);
   int _deferred_replay();
@@ -3345,6 +3562,16 @@ public:
   void set_collection_commit_queue(const coll_t& cid,
 				   ContextQueue *commit_queue) override;
 
+  void prefetch(CollectionHandle& c,
+		const std::vector<ghobject_t>& oids,
+		uint32_t flags) override;
+private:
+  struct C_Prefetch;
+  void _prefetch(Collection *c,
+		 const std::vector<ghobject_t>& oids,
+		 uint32_t flags);
+public:
+
   bool collection_exists(const coll_t& c) override;
   int collection_empty(CollectionHandle& c, bool *empty) override;
   int collection_bits(CollectionHandle& c) override;
@@ -3560,6 +3787,15 @@ public:
   void debug_set_prefer_deferred_size(uint64_t s) {
     prefer_deferred_size = s;
   }
+  void debug_deferred_policy_note(bool db, ceph::timespan lat) {
+    _deferred_policy_note(db, lat);
+  }
+  void debug_deferred_policy_update() {
+    _deferred_policy_update();
+  }
+  int64_t debug_zoned_clean(uint64_t min_dead) {
+    return _zoned_clean(min_dead);
+  }
   inline void log_latency(const char* name,
     int idx,
     const ceph::timespan& lat,
@@ -3661,6 +3897,8 @@ private:
     uint8_t csum_type = 0;          ///< checksum type for new blobs
     unsigned csum_order = 0;        ///< target checksum chunk order
     uint64_t target_blob_size = 0;  ///< target (max) blob size
+    bool fresh_alloc = false;       ///< always write to new blobs, never deferred
+    PExtentVector *reserved = nullptr; ///< space set aside by the caller, used before allocating
 
     old_extent_map_t old_extents;   ///< must deref these blobs
     interval_set<uint64_t> extents_to_gc; ///< extents for garbage collection
@@ -3711,6 +3949,8 @@ private:
       target_blob_size = other.target_blob_size;
       csum_type = other.csum_type;
       csum_order = other.csum_order;
+      fresh_alloc = other.fresh_alloc;
+      reserved = other.reserved;
     }
     void write(
       uint64_t loffs,
@@ -3808,7 +4048,9 @@ private:
 		OnodeRef& o,
 		uint64_t offset, uint64_t length,
 		ceph::buffer::list& bl,
-		uint32_t fadvise_flags);
+		uint32_t fadvise_flags,
+		bool fresh_alloc = false,
+		PExtentVector *reserved = nullptr);
   void _do_write_data(TransContext *txc,
                       CollectionRef& c,
                       OnodeRef& o,
@@ -4128,6 +4370,14 @@ private:
   int  reset_fm_for_restore();
   int  verify_rocksdb_allocations(Allocator *allocator);
   Allocator* clone_allocator_without_bluefs(Allocator *src_allocator);
+  int  alloc_journal_open();
+  void alloc_journal_invalidate();
+  int  alloc_journal_write_checkpoint(Allocator* src_allocator);
+  int  alloc_journal_restore(Allocator* allocator, uint64_t *num, uint64_t *bytes);
+  void _alloc_journal_queue_delta(const interval_set<uint64_t>& allocated,
+				  const interval_set<uint64_t>& released,
+				  KeyValueDB::Transaction t);
+  void _alloc_journal_compact();
   Allocator* initialize_allocator_from_freelist(FreelistManager *real_fm);
   void copy_allocator_content_to_fm(Allocator *allocator, FreelistManager *real_fm);
 
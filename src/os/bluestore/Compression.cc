@@ -198,28 +198,36 @@ int32_t Estimator::split_and_compress(
   blob_sizes.back() = size - blob_size * (blobs - 1);
   int32_t disk_needed = 0;
   uint32_t bl_src_off = 0;
+  size_t first = bd.size();
   for (auto& i: blob_sizes) {
     bd.emplace_back();
     bd.back().real_length = i;
     bd.back().compressed_length = 0;
     bd.back().object_data.substr_of(data_bl, bl_src_off, i);
     bl_src_off += i;
+  }
+  // blobs are compressed independently, spread them over the workers
+  std::vector<bufferlist> compressed(blobs);
+  std::vector<std::optional<int32_t>> compressor_messages(blobs);
+  bluestore->compress_pool.run(blobs, [&](size_t n) {
     // FIXME: memory alignment here is bad
-    bufferlist t;
-    std::optional<int32_t> compressor_message;
-    int r = wctx->compressor->compress(bd.back().object_data, t, compressor_message);
+    int r = wctx->compressor->compress(
+      bd[first + n].object_data, compressed[n], compressor_messages[n]);
     ceph_assert(r == 0);
+  });
+  for (uint32_t n = 0; n < blobs; n++) {
+    auto& b = bd[first + n];
     bluestore_compression_header_t chdr;
     chdr.type = wctx->compressor->get_type();
-    chdr.length = t.length();
-    chdr.compressor_message = compressor_message;
-    encode(chdr, bd.back().disk_data);
-    bd.back().disk_data.claim_append(t);
-    uint32_t len = bd.back().disk_data.length();
-    bd.back().compressed_length = len;
+    chdr.length = compressed[n].length();
+    chdr.compressor_message = compressor_messages[n];
+    encode(chdr, b.disk_data);
+    b.disk_data.claim_append(compressed[n]);
+    uint32_t len = b.disk_data.length();
+    b.compressed_length = len;
     uint32_t rem = p2nphase(len, au_size);
     if (rem > 0) {
-      bd.back().disk_data.append_zero(rem);
+      b.disk_data.append_zero(rem);
     }
     actual_compressed += len;
     actual_compressed_plus_pad += len + rem;
@@ -0,0 +1,364 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:nil -*-
+// vim: ts=8 sw=2 sts=2 expandtab
+
+#include <bit>
+
+#include "ZonedAllocator.h"
+#include "bluestore_types.h"
+#include "common/debug.h"
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_bluestore
+#undef dout_prefix
+#define dout_prefix *_dout << "zonedalloc 0x" << this << " "
+
+ZonedAllocator::ZonedAllocator(CephContext* cct,
+                               int64_t capacity,
+                               int64_t _block_size,
+                               uint64_t _zone_size,
+                               std::string_view name)
+  : AllocatorBase(name, capacity, _block_size),
+    cct(cct),
+    zone_size(_zone_size)
+{
+  ceph_assert(cct != nullptr);
+  ceph_assert(block_size > 0);
+  ceph_assert(zone_size > 0 && zone_size % block_size == 0);
+  // everything is allocated until told otherwise by init_add_free()
+  zones.resize(div_round_up(capacity, zone_size));
+  for (size_t i = 0; i < zones.size(); ++i) {
+    zones[i].write_pointer = _zone_len(i);
+  }
+  ldout(cct, 1) << __func__ << " 0x" << std::hex << capacity
+                << " in " << std::dec << zones.size() << " zones of 0x"
+                << std::hex << zone_size << std::dec << dendl;
+}
+
+ZonedAllocator::~ZonedAllocator()
+{
+}
+
+template <typename F>
+void ZonedAllocator::_foreach_zone_piece(uint64_t offset, uint64_t length,
+                                         F&& f)
+{
+  ceph_assert(offset + length <= (uint64_t)device_size);
+  while (length > 0) {
+    size_t zone = offset / zone_size;
+    uint64_t zone_start = _zone_start(zone);
+    uint64_t end = std::min(offset + length, zone_start + _zone_len(zone));
+    f(zone, offset - zone_start, end - offset);
+    length -= end - offset;
+    offset = end;
+  }
+}
+
+void ZonedAllocator::_add_dead(size_t zone, uint64_t offset, uint64_t length)
+{
+  auto& z = zones[zone];
+  ceph_assert(offset + length <= z.write_pointer);
+  dead.insert(_zone_start(zone) + offset, length);
+  z.num_dead_bytes += length;
+  num_dead += length;
+}
+
+void ZonedAllocator::_maybe_reset(size_t zone)
+{
+  auto& z = zones[zone];
+  if (z.write_pointer == 0 || z.num_dead_bytes < z.write_pointer) {
+    return;
+  }
+  ceph_assert(z.num_dead_bytes == z.write_pointer);
+  ldout(cct, 10) << __func__ << " zone " << zone << " at 0x" << std::hex
+                 << _zone_start(zone) << "~" << z.write_pointer << std::dec
+                 << dendl;
+  dead.erase(_zone_start(zone), z.write_pointer);
+  num_dead -= z.write_pointer;
+  num_free += z.write_pointer;
+  z.write_pointer = 0;
+  z.num_dead_bytes = 0;
+  ++num_resets;
+}
+
+int64_t ZonedAllocator::allocate(
+  uint64_t want_size,
+  uint64_t alloc_unit,
+  uint64_t max_alloc_size,
+  int64_t hint,
+  PExtentVector *extents)
+{
+  ldout(cct, 10) << __func__ << " want_size 0x" << std::hex << want_size
+                 << " alloc_unit 0x" << alloc_unit
+                 << " max_alloc_size 0x" << max_alloc_size
+                 << std::dec << dendl;
+  ceph_assert(std::has_single_bit(alloc_unit));
+  ceph_assert(alloc_unit % block_size == 0);
+  uint64_t want = p2roundup(want_size, alloc_unit);
+  // bluestore_pextent_t length is 32 bit
+  uint64_t max_len = p2align<uint64_t>(
+    std::numeric_limits<uint32_t>::max(), alloc_unit);
+  if (max_alloc_size) {
+    max_len = std::min(max_len, p2align(max_alloc_size, alloc_unit));
+  }
+  ceph_assert(max_len > 0);
+
+  std::lock_guard l(lock);
+  uint64_t allocated = 0;
+  size_t tried = 0;
+  while (allocated < want && tried < zones.size()) {
+    auto& z = zones[open_zone];
+    uint64_t zone_start = _zone_start(open_zone);
+    uint64_t zone_len = _zone_len(open_zone);
+    uint64_t start =
+      p2roundup(zone_start + z.write_pointer, alloc_unit) - zone_start;
+    uint64_t len = start < zone_len ? p2align(zone_len - start, alloc_unit) : 0;
+    len = std::min({len, want - allocated, max_len});
+    if (len == 0) {
+      open_zone = (open_zone + 1) % zones.size();
+      ++tried;
+      continue;
+    }
+    if (start > z.write_pointer) {
+      // the gap in front of an aligned extent is never written
+      uint64_t pad = start - z.write_pointer;
+      z.write_pointer = start;
+      num_free -= pad;
+      _add_dead(open_zone, start - pad, pad);
+    }
+    z.write_pointer += len;
+    num_free -= len;
+    extents->emplace_back(zone_start + start, len);
+    allocated += len;
+    ldout(cct, 20) << __func__ << " zone " << open_zone << " 0x" << std::hex
+                   << zone_start + start << "~" << len << std::dec << dendl;
+  }
+  return allocated ? (int64_t)allocated : -ENOSPC;
+}
+
+void ZonedAllocator::release(
+  const interval_set<uint64_t>& release_set)
+{
+  std::lock_guard l(lock);
+  for (auto& p : release_set) {
+    const auto offset = p.first;
+    const auto length = p.second;
+    ldout(cct, 10) << __func__ << " 0x" << std::hex << offset << "~" << length
+                   << std::dec << dendl;
+    _foreach_zone_piece(offset, length,
+      [&](size_t zone, uint64_t off, uint64_t len) {
+        _add_dead(zone, off, len);
+        _maybe_reset(zone);
+      });
+  }
+}
+
+uint64_t ZonedAllocator::get_free()
+{
+  std::lock_guard l(lock);
+  return num_free;
+}
+
+double ZonedAllocator::get_fragmentation()
+{
+  std::lock_guard l(lock);
+  uint64_t used = device_size - num_free;
+  return used ? (double)num_dead / used : 0.0;
+}
+
+void ZonedAllocator::dump()
+{
+  std::lock_guard l(lock);
+  ldout(cct, 0) << __func__ << " zones " << zones.size()
+                << " zone_size 0x" << std::hex << zone_size
+                << " free 0x" << num_free << " dead 0x" << num_dead
+                << std::dec << " resets " << num_resets
+                << " open zone " << open_zone << dendl;
+  for (size_t i = 0; i < zones.size(); ++i) {
+    if (zones[i].write_pointer == 0) {
+      continue;
+    }
+    ldout(cct, 0) << __func__ << "  zone " << i << " wp 0x" << std::hex
+                  << zones[i].write_pointer << " dead 0x"
+                  << zones[i].num_dead_bytes << std::dec << dendl;
+  }
+}
+
+void ZonedAllocator::foreach(
+  std::function<void(uint64_t offset, uint64_t length)> notify)
+{
+  std::lock_guard l(lock);
+  uint64_t pending_offset = 0, pending_length = 0;
+  auto emit = [&](uint64_t offset, uint64_t length) {
+    if (pending_length && pending_offset + pending_length == offset) {
+      pending_length += length;
+      return;
+    }
+    if (pending_length) {
+      notify(pending_offset, pending_length);
+    }
+    pending_offset = offset;
+    pending_length = length;
+  };
+  auto p = dead.begin();
+  for (size_t i = 0; i < zones.size(); ++i) {
+    uint64_t zone_start = _zone_start(i);
+    uint64_t wp = zone_start + zones[i].write_pointer;
+    // dead extents might span adjacent zones, they are emitted as a whole
+    for (; p != dead.end() && p.get_start() < wp; ++p) {
+      emit(p.get_start(), p.get_len());
+    }
+    uint64_t zone_end = zone_start + _zone_len(i);
+    if (wp < zone_end) {
+      emit(wp, zone_end - wp);
+    }
+  }
+  if (pending_length) {
+    notify(pending_offset, pending_length);
+  }
+}
+
+void ZonedAllocator::_init_add_free(size_t zone, uint64_t offset,
+                                    uint64_t length)
+{
+  auto& z = zones[zone];
+  uint64_t end = offset + length;
+  ceph_assert(end <= z.write_pointer);
+  if (end < z.write_pointer) {
+    _add_dead(zone, offset, length);
+    _maybe_reset(zone);
+    return;
+  }
+  // free space at the write pointer was never written, rewind the pointer
+  // over it and over the dead space right in front of it
+  z.write_pointer = offset;
+  num_free += length;
+  uint64_t zone_start = _zone_start(zone);
+  uint64_t dead_start, dead_length;
+  while (z.write_pointer > 0 &&
+         dead.contains(zone_start + z.write_pointer - 1,
+                       &dead_start, &dead_length)) {
+    uint64_t start = std::max(dead_start, zone_start);
+    uint64_t len = zone_start + z.write_pointer - start;
+    dead.erase(start, len);
+    z.num_dead_bytes -= len;
+    num_dead -= len;
+    num_free += len;
+    z.write_pointer -= len;
+  }
+  _maybe_reset(zone);
+}
+
+void ZonedAllocator::init_add_free(uint64_t offset, uint64_t length)
+{
+  if (!length)
+    return;
+  ldout(cct, 10) << __func__ << " 0x" << std::hex << offset << "~" << length
+                 << std::dec << dendl;
+  std::lock_guard l(lock);
+  _foreach_zone_piece(offset, length,
+    [&](size_t zone, uint64_t off, uint64_t len) {
+      _init_add_free(zone, off, len);
+    });
+}
+
+void ZonedAllocator::_init_rm_free(size_t zone, uint64_t offset,
+                                   uint64_t length)
+{
+  auto& z = zones[zone];
+  uint64_t end = offset + length;
+  if (end <= z.write_pointer) {
+    dead.erase(_zone_start(zone) + offset, length);
+    ceph_assert(z.num_dead_bytes >= length);
+    z.num_dead_bytes -= length;
+    num_dead -= length;
+  } else if (offset >= z.write_pointer) {
+    // the space skipped below the range can't be written anymore
+    uint64_t wp = z.write_pointer;
+    z.write_pointer = end;
+    num_free -= end - wp;
+    if (offset > wp) {
+      _add_dead(zone, wp, offset - wp);
+    }
+  } else {
+    uint64_t wp = z.write_pointer;
+    _init_rm_free(zone, offset, wp - offset);
+    _init_rm_free(zone, wp, end - wp);
+  }
+}
+
+void ZonedAllocator::init_rm_free(uint64_t offset, uint64_t length)
+{
+  if (!length)
+    return;
+  ldout(cct, 10) << __func__ << " 0x" << std::hex << offset << "~" << length
+                 << std::dec << dendl;
+  std::lock_guard l(lock);
+  _foreach_zone_piece(offset, length,
+    [&](size_t zone, uint64_t off, uint64_t len) {
+      _init_rm_free(zone, off, len);
+    });
+}
+
+void ZonedAllocator::_seal(size_t zone)
+{
+  auto& z = zones[zone];
+  uint64_t zone_len = _zone_len(zone);
+  if (z.write_pointer < zone_len) {
+    uint64_t pad = zone_len - z.write_pointer;
+    z.write_pointer = zone_len;
+    num_free -= pad;
+    _add_dead(zone, zone_len - pad, pad);
+  }
+  _maybe_reset(zone);
+}
+
+uint64_t ZonedAllocator::get_zone_live(uint64_t zone_start)
+{
+  std::lock_guard l(lock);
+  auto& z = zones[zone_start / zone_size];
+  return z.write_pointer - z.num_dead_bytes;
+}
+
+bool ZonedAllocator::is_zone_full(uint64_t zone_start)
+{
+  std::lock_guard l(lock);
+  size_t zone = zone_start / zone_size;
+  return zones[zone].write_pointer == _zone_len(zone);
+}
+
+int64_t ZonedAllocator::pick_zone_to_clean(uint64_t min_dead,
+                                           const interval_set<uint64_t>& busy,
+                                           uint64_t *zone_dead)
+{
+  std::lock_guard l(lock);
+  int64_t best = -1;
+  uint64_t best_dead = std::max<uint64_t>(min_dead, 1) - 1;
+  for (size_t i = 0; i < zones.size(); ++i) {
+    if ((i == open_zone && zones[i].write_pointer < _zone_len(i)) ||
+        zones[i].num_dead_bytes <= best_dead ||
+        busy.intersects(_zone_start(i), _zone_len(i))) {
+      continue;
+    }
+    best = i;
+    best_dead = zones[i].num_dead_bytes;
+  }
+  if (best < 0) {
+    return -1;
+  }
+  if (zone_dead) {
+    *zone_dead = best_dead;
+  }
+  ldout(cct, 10) << __func__ << " zone " << best << " dead 0x" << std::hex
+                 << best_dead << std::dec << dendl;
+  _seal(best);
+  return _zone_start(best);
+}
+
+void ZonedAllocator::shutdown()
+{
+  std::lock_guard l(lock);
+  dead.clear();
+  zones.clear();
+  num_free = 0;
+  num_dead = 0;
+}
@@ -0,0 +1,133 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:nil -*-
+// vim: ts=8 sw=2 sts=2 expandtab
+
+#ifndef CEPH_OS_BLUESTORE_ZONEDALLOCATOR_H
+#define CEPH_OS_BLUESTORE_ZONEDALLOCATOR_H
+
+#include <mutex>
+
+#include "Allocator.h"
+#include "AllocatorBase.h"
+#include "include/btree_map.h"
+#include "include/interval_set.h"
+#include "os/bluestore/bluestore_types.h"
+#include "include/mempool.h"
+#include "common/ceph_mutex.h"
+
+/*
+ * Append-only allocator for zoned (host-managed SMR, ZNS) devices.
+ *
+ * The device is split into fixed size zones, each having a write pointer.
+ * Space is only ever handed out at the write pointer of the open zone, so
+ * writes into a zone are strictly sequential. Released space below a write
+ * pointer is dead: it can't be reused until every byte of the zone is dead
+ * and the zone is reset. Zones are emulated on top of an ordinary device,
+ * relocating the live data of a zone is up to the cleaner (see
+ * BlueStore::_zoned_cleaner_thread).
+ */
+class ZonedAllocator : public AllocatorBase {
+  CephContext* cct;
+  ceph::mutex lock = ceph::make_mutex("ZonedAllocator::lock");
+
+  struct zone_state_t {
+    uint64_t write_pointer = 0;   ///< relative to the zone start
+    uint64_t num_dead_bytes = 0;  ///< released bytes below the write pointer
+  };
+
+  template <typename K, typename V> using allocator_t =
+    mempool::bluestore_alloc::pool_allocator<std::pair<const K, V>>;
+  template <typename K, typename V> using btree_map_t =
+    btree::btree_map<K, V, std::less<K>, allocator_t<K, V>>;
+  using interval_set_t = interval_set<uint64_t, btree_map_t>;
+
+  const uint64_t zone_size;
+  std::vector<zone_state_t> zones;
+  interval_set_t dead;          ///< released space below the write pointers
+  uint64_t num_free = 0;        ///< bytes above the write pointers
+  uint64_t num_dead = 0;
+  uint64_t num_resets = 0;
+  size_t open_zone = 0;
+
+  uint64_t _zone_start(size_t zone) const {
+    return zone * zone_size;
+  }
+  uint64_t _zone_len(size_t zone) const {
+    return std::min<uint64_t>(zone_size, device_size - _zone_start(zone));
+  }
+  void _add_dead(size_t zone, uint64_t offset, uint64_t length);
+  void _maybe_reset(size_t zone);
+  void _seal(size_t zone);
+  void _init_add_free(size_t zone, uint64_t offset, uint64_t length);
+  void _init_rm_free(size_t zone, uint64_t offset, uint64_t length);
+  template <typename F>
+  void _foreach_zone_piece(uint64_t offset, uint64_t length, F&& f);
+
+public:
+  ZonedAllocator(CephContext* cct,
+                 int64_t size,
+                 int64_t block_size,
+                 uint64_t zone_size,
+                 std::string_view name);
+  ~ZonedAllocator() override;
+  const char* get_type() const override
+  {
+    return "zoned";
+  }
+
+  /*
+   * Extents are always taken at the write pointer of the open zone,
+   * moving to the next zone with room left once it is full. The hint
+   * is ignored.
+   */
+  int64_t allocate(
+    uint64_t want_size, uint64_t alloc_unit, uint64_t max_alloc_size,
+    int64_t hint, PExtentVector *extents) override;
+
+  void release(
+    const interval_set<uint64_t>& release_set) override;
+
+  /*
+   * Only the space above the write pointers can be allocated, dead space
+   * is not accounted as free until its zone is reset.
+   */
+  uint64_t get_free() override;
+  // share of the allocated space which is dead
+  double get_fragmentation() override;
+
+  void dump() override;
+  // reports both the dead and the never written space
+  void foreach(std::function<void(uint64_t offset, uint64_t length)> notify) override;
+
+  void init_add_free(uint64_t offset, uint64_t length) override;
+  void init_rm_free(uint64_t offset, uint64_t length) override;
+
+  void shutdown() override;
+
+  uint64_t get_zone_size() const {
+    return zone_size;
+  }
+  uint64_t get_dead() {
+    std::lock_guard l(lock);
+    return num_dead;
+  }
+  uint64_t get_num_resets() {
+    std::lock_guard l(lock);
+    return num_resets;
+  }
+  // bytes below the write pointer of the zone which are not dead
+  uint64_t get_zone_live(uint64_t zone_start);
+  // whether the zone is full (or sealed) and not reset yet
+  bool is_zone_full(uint64_t zone_start);
+  /*
+   * Returns the start of the zone with the most dead space, or -1 when no
+   * zone has at least min_dead bytes of it. The open zone is skipped while
+   * it is still being filled, as are the zones intersecting busy. The
+   * picked zone is sealed: its space above the write pointer is made dead
+   * so nothing is allocated in it until it is reset.
+   */
+  int64_t pick_zone_to_clean(uint64_t min_dead,
+                             const interval_set<uint64_t>& busy = {},
+                             uint64_t *zone_dead = nullptr);
+};
+
+#endif
@@ -900,6 +900,10 @@ void bluestore_blob_t::calc_csum(uint64_t b_off, const bufferlist& bl)
     Checksummer::calculate<Checksummer::crc32c_8>(
       get_csum_chunk_size(), b_off, bl.length(), bl, &csum_data);
     break;
+  case Checksummer::CSUM_XXH3_64:
+    Checksummer::calculate<Checksummer::xxh3_64>(
+      get_csum_chunk_size(), b_off, bl.length(), bl, &csum_data);
+    break;
   }
 }
 
@@ -932,6 +936,10 @@ int bluestore_blob_t::verify_csum(uint64_t b_off, const bufferlist& bl,
     *b_bad_off = Checksummer::verify<Checksummer::crc32c_8>(
       get_csum_chunk_size(), b_off, bl.length(), bl, csum_data, bad_csum);
     break;
+  case Checksummer::CSUM_XXH3_64:
+    *b_bad_off = Checksummer::verify<Checksummer::xxh3_64>(
+      get_csum_chunk_size(), b_off, bl.length(), bl, csum_data, bad_csum);
+    break;
   default:
     r = -EOPNOTSUPP;
     break;
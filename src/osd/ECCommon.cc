@@ -1689,7 +1689,8 @@ ECTransaction::WritePlan ECCommon::get_write_plan(
                                        writable_shards,
                                        object_in_cache, old_object_size,
                                        oi, soi,
-                                       rmw_pipeline.ec_pdw_write_mode);
+                                       rmw_pipeline.ec_pdw_write_mode,
+                                       rmw_pipeline.ec_pdw_read_op_cost);
 
       if (plan.to_read) plans.want_read = true;
       plans.plans.emplace_back(std::move(plan));
@@ -661,6 +661,7 @@ struct ECCommon {
     ECCommon &ec_backend;
     ECExtentCache extent_cache;
     uint64_t ec_pdw_write_mode;
+    uint64_t ec_pdw_read_op_cost;
     bool next_write_all_shards = false;
 
     RMWPipeline(CephContext *cct,
@@ -675,7 +676,9 @@ struct ECCommon {
         parent(parent),
         ec_backend(ec_backend),
         extent_cache(*this, ec_extent_cache_lru, sinfo, cct),
-        ec_pdw_write_mode(cct->_conf.get_val<uint64_t>("ec_pdw_write_mode")) {}
+        ec_pdw_write_mode(cct->_conf.get_val<uint64_t>("ec_pdw_write_mode")),
+        ec_pdw_read_op_cost(
+          cct->_conf.get_val<Option::size_t>("ec_pdw_read_op_cost")) {}
   };
 
 
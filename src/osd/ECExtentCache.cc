@@ -49,11 +49,15 @@ void ECExtentCache::Object::request(OpRef &op) {
    * post-invalidate ops are honoured.
    */
   if (op->reads && !cache_invalidate_expected) {
+    uint64_t hit_bytes = 0;
+    uint64_t miss_bytes = 0;
     for (auto &&[shard, eset] : *(op->reads)) {
       extent_set request = eset;
       if (do_not_read.contains(shard)) {
         request.subtract(do_not_read.at(shard));
       }
+      hit_bytes += eset.size() - request.size();
+      miss_bytes += request.size();
 
       if (!request.empty()) {
         requesting[shard].union_of(request);
@@ -61,6 +65,7 @@ void ECExtentCache::Object::request(OpRef &op) {
         requesting_ops.emplace_back(op);
       }
     }
+    pg.lru.account_read(hit_bytes, miss_bytes);
   }
 
 
@@ -382,6 +387,9 @@ shared_ptr<shard_extent_map_t> ECExtentCache::LRU::find(
     cache = c;
     auto it = lru_iter; // Intentional copy.
     erase(it, false);
+    hits++;
+  } else {
+    misses++;
   }
   return cache;
 }
@@ -400,10 +408,59 @@ void ECExtentCache::LRU::remove_object(const hobject_t &oid) {
 void ECExtentCache::LRU::free_maybe() {
   while (max_size < size) {
     auto it = lru.begin();
+    evictions++;
+    evicted_bytes += map.at(*it).second->size();
     erase(it, true);
   }
 }
 
+void ECExtentCache::LRU::set_max_size(uint64_t new_max_size) {
+  std::lock_guard lock{mutex};
+  max_size = new_max_size;
+  free_maybe();
+}
+
+ECExtentCache::LRU::stats_t ECExtentCache::LRU::get_stats() {
+  stats_t stats;
+  std::lock_guard lock{mutex};
+  stats.lines = map.size();
+  stats.bytes = size;
+  stats.max_bytes = max_size;
+  stats.hits = hits;
+  stats.misses = misses;
+  stats.evictions = evictions;
+  stats.evicted_bytes = evicted_bytes;
+  stats.read_hit_bytes = read_hit_bytes;
+  stats.read_miss_bytes = read_miss_bytes;
+  return stats;
+}
+
+ECExtentCache::LRU::stats_t &ECExtentCache::LRU::stats_t::operator+=(
+    const stats_t &o) {
+  lines += o.lines;
+  bytes += o.bytes;
+  max_bytes += o.max_bytes;
+  hits += o.hits;
+  misses += o.misses;
+  evictions += o.evictions;
+  evicted_bytes += o.evicted_bytes;
+  read_hit_bytes += o.read_hit_bytes;
+  read_miss_bytes += o.read_miss_bytes;
+  return *this;
+}
+
+void ECExtentCache::LRU::stats_t::dump(ceph::Formatter *f) const {
+  f->dump_unsigned("lines", lines);
+  f->dump_unsigned("bytes", bytes);
+  f->dump_unsigned("max_bytes", max_bytes);
+  f->dump_unsigned("hits", hits);
+  f->dump_unsigned("misses", misses);
+  f->dump_unsigned("evictions", evictions);
+  f->dump_unsigned("evicted_bytes", evicted_bytes);
+  f->dump_unsigned("read_hit_bytes", read_hit_bytes);
+  f->dump_unsigned("read_miss_bytes", read_miss_bytes);
+}
+
 void ECExtentCache::LRU::discard() {
   std::lock_guard lock{mutex};
   lru.clear();
@@ -30,8 +30,13 @@
  * reactor. Some effort has been made to limit the frequency that this mutex is
  * taken.
  *
- * The LRU has a maximum size (defined in the constructor) and will keep its
- * usage below this amount.
+ * The LRU has a maximum size (defined in the constructor, and adjustable with
+ * set_max_size()) and will keep its usage below this amount. The OSD derives
+ * it from osd_memory_target, see ec_extent_cache_memory_ratio. Lines handed
+ * to the LRU survive the IO which read or wrote them, so a later IO to the
+ * same stripes, typically the next small sequential write, finds the old data
+ * and parity without reading them from the shards again. The LRU counts these
+ * hits, the misses and its evictions, see get_stats().
  *
  * Cache Lines
  *
@@ -75,7 +80,10 @@
 
 #pragma once
 
+#include <atomic>
+
 #include "ECUtil.h"
+#include "common/Formatter.h"
 #include "include/Context.h"
 
 class ECExtentCache {
@@ -120,6 +128,21 @@ class ECExtentCache {
       }
     };
 
+    struct stats_t {
+      uint64_t lines = 0;
+      uint64_t bytes = 0;
+      uint64_t max_bytes = 0;
+      uint64_t hits = 0;            ///< lines found in the LRU by a new IO
+      uint64_t misses = 0;          ///< lines not found
+      uint64_t evictions = 0;       ///< lines dropped to stay within budget
+      uint64_t evicted_bytes = 0;
+      uint64_t read_hit_bytes = 0;  ///< IO reads not sent to the shards
+      uint64_t read_miss_bytes = 0; ///< IO reads sent to the shards
+
+      stats_t &operator+=(const stats_t &o);
+      void dump(ceph::Formatter *f) const;
+    };
+
    private:
     friend class Object;
     friend class ECExtentCache;
@@ -129,6 +152,13 @@ class ECExtentCache {
     std::list<Key> lru;
     uint64_t max_size = 0;
     uint64_t size = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t evicted_bytes = 0;
+    // Counted outside the mutex, by the owner of the IO.
+    std::atomic<uint64_t> read_hit_bytes = 0;
+    std::atomic<uint64_t> read_miss_bytes = 0;
     ceph::mutex mutex = ceph::make_mutex("ECExtentCache::LRU");
 
     void free_maybe();
@@ -140,9 +170,17 @@ class ECExtentCache {
     std::shared_ptr<ECUtil::shard_extent_map_t> find(
         const hobject_t &oid, uint64_t offset);
     void remove_object(const hobject_t &oid);
+    void account_read(uint64_t hit_bytes, uint64_t miss_bytes) {
+      read_hit_bytes += hit_bytes;
+      read_miss_bytes += miss_bytes;
+    }
 
    public:
     explicit LRU(uint64_t max_size) : map(), max_size(max_size) {}
+
+    // Evicts straight away if the LRU is now over budget.
+    void set_max_size(uint64_t new_max_size);
+    stats_t get_stats();
   };
 
   class Op {
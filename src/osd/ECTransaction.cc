@@ -127,7 +127,8 @@ ECTransaction::WritePlanObj::WritePlanObj(
     uint64_t orig_size,
     const std::optional<object_info_t> &oi,
     const std::optional<object_info_t> &soi,
-    unsigned pdw_write_mode
+    unsigned pdw_write_mode,
+    uint64_t pdw_read_op_cost
   ) :
   hoid(hoid),
   will_write(sinfo.get_k_plus_m()),
@@ -225,10 +226,16 @@ ECTransaction::WritePlanObj::WritePlanObj(
           // Some kind of reconstruct is needed for conventional, but NOT for PDW!
           do_parity_delta_write = true;
         } else {
-          /* Everything we need for both is available, opt for whichever is fewer
-           * reads. Choose PDW in a tie as it's slightly more performant at random I/O.
+          /* Everything we need for both is available, opt for whichever is
+           * cheaper to read, each shard read costing pdw_read_op_cost bytes on
+           * top of its length. Choose PDW in a tie as it's slightly more
+           * performant at random I/O.
            */
-          do_parity_delta_write = pdw_read_shards.size() <= read_shards.size();
+          uint64_t pdw_cost = pdw_read_shards.size() * pdw_read_op_cost +
+                              pdw_reads.size();
+          uint64_t rmw_cost = read_shards.size() * pdw_read_op_cost +
+                              reads.size();
+          do_parity_delta_write = pdw_cost <= rmw_cost;
         }
 
         if (do_parity_delta_write) {
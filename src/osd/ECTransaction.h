@@ -43,7 +43,8 @@ class WritePlanObj {
       uint64_t orig_size,
       const std::optional<object_info_t> &oi,
       const std::optional<object_info_t> &soi,
-      unsigned pdw_write_mode);
+      unsigned pdw_write_mode,
+      uint64_t pdw_read_op_cost);
 
   void print(std::ostream &os) const {
     os << "{hoid: " << hoid
@@ -2917,6 +2917,23 @@ will start to track new ops received afterwards.";
     f->open_object_section("pq");
     op_shardedwq.dump(f);
     f->close_section();
+  } else if (prefix == "dump_ec_extent_cache") {
+    ECExtentCache::LRU::stats_t total;
+    f->open_object_section("ec_extent_cache");
+    f->open_array_section("shards");
+    for (auto shard : shards) {
+      auto stats = shard->ec_extent_cache_lru.get_stats();
+      f->open_object_section("shard");
+      f->dump_unsigned("shard_id", shard->shard_id);
+      stats.dump(f);
+      f->close_section();
+      total += stats;
+    }
+    f->close_section();
+    f->open_object_section("total");
+    total.dump(f);
+    f->close_section();
+    f->close_section();
   } else if (prefix == "dump_blocklist") {
     list<pair<entity_addr_t,utime_t> > bl;
     list<pair<entity_addr_t,utime_t> > rbl;
@@ -3594,6 +3611,17 @@ int OSD::get_num_op_shards()
     return cct->_conf->osd_op_num_shards_ssd;
 }
 
+uint64_t OSD::get_ec_extent_cache_size() const
+{
+  uint64_t size = cct->_conf.get_val<uint64_t>("ec_extent_cache_size");
+  double ratio = cct->_conf.get_val<double>("ec_extent_cache_memory_ratio");
+  if (ratio <= 0 || num_shards == 0) {
+    return size;
+  }
+  uint64_t target = cct->_conf.get_val<Option::size_t>("osd_memory_target");
+  return std::max(size, static_cast<uint64_t>(target * ratio) / num_shards);
+}
+
 int OSD::get_num_op_threads()
 {
   if (cct->_conf->osd_op_num_threads_per_shard)
@@ -4127,6 +4155,11 @@ void OSD::final_init()
 				     asok_hook,
 				     "dump op queue state");
   ceph_assert(r == 0);
+  r = admin_socket->register_command("dump_ec_extent_cache",
+				     asok_hook,
+				     "dump the size and hit rates of the EC "
+				     "extent cache of each op shard");
+  ceph_assert(r == 0);
   r = admin_socket->register_command("dump_blocklist",
 				     asok_hook,
 				     "dump blocklisted clients and times");
@@ -6408,6 +6441,18 @@ void OSD::tick_without_osd_lock()
   logger->set(l_osd_cached_crc_adjusted, ceph::buffer::get_cached_crc_adjusted());
   logger->set(l_osd_missed_crc, ceph::buffer::get_missed_crc());
 
+  ECExtentCache::LRU::stats_t ec_cache_stats;
+  for (auto shard : shards) {
+    ec_cache_stats += shard->ec_extent_cache_lru.get_stats();
+  }
+  logger->set(l_osd_ec_cache_bytes, ec_cache_stats.bytes);
+  logger->set(l_osd_ec_cache_hit, ec_cache_stats.hits);
+  logger->set(l_osd_ec_cache_miss, ec_cache_stats.misses);
+  logger->set(l_osd_ec_cache_evict, ec_cache_stats.evictions);
+  logger->set(l_osd_ec_cache_evict_bytes, ec_cache_stats.evicted_bytes);
+  logger->set(l_osd_ec_cache_read_hit_bytes, ec_cache_stats.read_hit_bytes);
+  logger->set(l_osd_ec_cache_read_miss_bytes, ec_cache_stats.read_miss_bytes);
+
   // refresh osd stats
   struct store_statfs_t stbuf;
   osd_alert_list_t alerts;
@@ -10080,7 +10125,10 @@ std::vector<std::string> OSD::get_tracked_keys() const noexcept
     "osd_scrub_interval_randomize_ratio"s,
     "osd_op_thread_timeout"s,
     "osd_op_thread_suicide_timeout"s,
-    "osd_max_scrubs"s
+    "osd_max_scrubs"s,
+    "osd_memory_target"s,
+    "ec_extent_cache_size"s,
+    "ec_extent_cache_memory_ratio"s
   };
 }
 
@@ -10229,6 +10277,16 @@ void OSD::handle_conf_change(const ConfigProxy& conf,
   if (changed.count("osd_op_thread_suicide_timeout")) {
     op_shardedwq.set_suicide_timeout(g_conf().get_val<int64_t>("osd_op_thread_suicide_timeout"));
   }
+  if (changed.count("osd_memory_target") ||
+      changed.count("ec_extent_cache_size") ||
+      changed.count("ec_extent_cache_memory_ratio")) {
+    uint64_t size = get_ec_extent_cache_size();
+    dout(10) << __func__ << " ec extent cache size " << size
+             << " per shard" << dendl;
+    for (auto shard : shards) {
+      shard->ec_extent_cache_lru.set_max_size(size);
+    }
+  }
 }
 
 void OSD::maybe_override_max_osd_capacity_for_qos()
@@ -11032,8 +11090,7 @@ OSDShard::OSDShard(
       cct, osd->whoami, osd->num_shards, id, osd->store->is_rotational(),
       osd->store->get_type(), osd_op_queue, osd_op_queue_cut_off)),
     context_queue(sdata_wait_lock, sdata_cond),
-    ec_extent_cache_lru(cct->_conf.get_val<uint64_t>(
-      "ec_extent_cache_size"))
+    ec_extent_cache_lru(osd->get_ec_extent_cache_size())
 {
   dout(0) << "using op scheduler " << *scheduler << dendl;
 }
@@ -2203,6 +2203,7 @@ private:
 
   size_t get_num_cache_shards();
   int get_num_op_shards();
+  uint64_t get_ec_extent_cache_size() const;
   int get_num_op_threads();
 
   float get_osd_recovery_sleep();
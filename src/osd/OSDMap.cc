@@ -3093,17 +3093,9 @@ void OSDMap::_pg_to_up_acting_osds(
   _get_temp_osds(*pool, pg, &_acting, &_acting_primary);
   if (_acting.empty() || up || up_primary) {
     _pg_to_raw_osds(*pool, pg, &raw, &pps);
-    _apply_upmap(*pool, pg, &raw);
-    _raw_to_up_osds(*pool, raw, &_up);
-    _up_primary = _pick_primary(_up);
-    _apply_primary_affinity(pps, *pool, &_up, &_up_primary);
-    if (_acting.empty()) {
-      _acting = _up;
-      if (_acting_primary == -1) {
-        _acting_primary = _up_primary;
-      }
-    }
-  
+    _raw_to_up_acting_osds(*pool, pg, pps, &raw, &_up, &_up_primary,
+                           &_acting, &_acting_primary);
+
     if (up)
       up->swap(_up);
     if (up_primary)
@@ -3116,6 +3108,109 @@ void OSDMap::_pg_to_up_acting_osds(
     *acting_primary = _acting_primary;
 }
 
+void OSDMap::_raw_to_up_acting_osds(
+  const pg_pool_t& pool, pg_t pg, ps_t pps,
+  vector<int> *raw,
+  vector<int> *up, int *up_primary,
+  vector<int> *acting, int *acting_primary) const
+{
+  _apply_upmap(pool, pg, raw);
+  _raw_to_up_osds(pool, *raw, up);
+  *up_primary = _pick_primary(*up);
+  _apply_primary_affinity(pps, pool, up, up_primary);
+  if (acting->empty()) {
+    *acting = *up;
+    if (*acting_primary == -1) {
+      *acting_primary = *up_primary;
+    }
+  }
+}
+
+void OSDMap::pg_range_to_up_acting_osds(
+  int64_t pool, unsigned ps_begin, unsigned ps_end,
+  std::function<void(ps_t ps, const vector<int>& raw,
+                     vector<int>& up, int up_primary,
+                     vector<int>& acting, int acting_primary)> f) const
+{
+  ceph_assert(ps_begin <= ps_end);
+  const pg_pool_t *pi = get_pg_pool(pool);
+  if (!pi) {
+    vector<int> up, acting;
+    for (unsigned ps = ps_begin; ps < ps_end; ++ps) {
+      f(ps, up, up, -1, acting, -1);
+    }
+    return;
+  }
+  unsigned count = ps_end - ps_begin;
+  unsigned size = pi->get_size();
+  vector<int> pps(count);
+  for (unsigned k = 0; k < count; ++k) {
+    pps[k] = pi->raw_pg_to_pps(pg_t(ps_begin + k, pool));
+  }
+  // run the rule for the whole range, the rest is done pg by pg as in
+  // _pg_to_up_acting_osds()
+  vector<int> raw_all, raw_len;
+  int ruleno = pi->get_crush_rule();
+  if (ruleno >= 0) {
+    crush->do_rule_batch(ruleno, pps.data(), count, raw_all, raw_len,
+                         size, osd_weight, pool);
+  }
+  vector<int> crush_out, raw, up, acting;
+  for (unsigned k = 0; k < count; ++k) {
+    pg_t pg(ps_begin + k, pool);
+    crush_out.clear();
+    if (ruleno >= 0) {
+      auto first = raw_all.begin() + (size_t)k * size;
+      crush_out.assign(first, first + raw_len[k]);
+    }
+    raw = crush_out;
+    _remove_nonexistent_osds(*pi, raw);
+    int up_primary, acting_primary;
+    up.clear();
+    acting.clear();
+    _get_temp_osds(*pi, pg, &acting, &acting_primary);
+    _raw_to_up_acting_osds(*pi, pg, pps[k], &raw, &up, &up_primary,
+                           &acting, &acting_primary);
+    f(pg.ps(), crush_out, up, up_primary, acting, acting_primary);
+  }
+}
+
+void OSDMap::get_temp_and_upmap_pgs(const std::set<int>& osds,
+                                    std::set<pg_t> *pgs) const
+{
+  auto mentions = [&osds](int osd) {
+    return osds.count(osd) > 0;
+  };
+  for (const auto& [pg, temp] : *pg_temp) {
+    if (std::any_of(temp.begin(), temp.end(), mentions)) {
+      pgs->insert(pg);
+    }
+  }
+  for (auto& [pg, primary] : *primary_temp) {
+    if (mentions(primary)) {
+      pgs->insert(pg);
+    }
+  }
+  for (auto& [pg, um] : pg_upmap) {
+    if (std::any_of(um.begin(), um.end(), mentions)) {
+      pgs->insert(pg);
+    }
+  }
+  for (auto& [pg, items] : pg_upmap_items) {
+    for (auto& [from, to] : items) {
+      if (mentions(from) || mentions(to)) {
+        pgs->insert(pg);
+        break;
+      }
+    }
+  }
+  for (auto& [pg, primary] : pg_upmap_primaries) {
+    if (mentions(primary)) {
+      pgs->insert(pg);
+    }
+  }
+}
+
 int OSDMap::calc_pg_role_broken(int osd, const vector<int>& acting, int nrep)
 {
   // This implementation is broken for EC PGs since the osd may appear
@@ -31,6 +31,7 @@
 #include <map>
 #include <memory>
 #include <random>
+#include <functional>
 
 #include "include/btree_map.h"
 #include "include/common_fwd.h"
@@ -683,6 +684,7 @@ private:
   uint32_t crush_version = 1;
 
   friend class OSDMonitor;
+  friend class UpmapBalancer;
 
  public:
   OSDMap() : epoch(0), 
@@ -1270,6 +1272,13 @@ private:
   void _get_temp_osds(const pg_pool_t& pool, pg_t pg,
                       std::vector<int> *temp_pg, int *temp_primary) const;
 
+  /// raw -> up, and acting unless already set by the temp mappings
+  void _raw_to_up_acting_osds(const pg_pool_t& pool, pg_t pg, ps_t pps,
+                              std::vector<int> *raw,
+                              std::vector<int> *up, int *up_primary,
+                              std::vector<int> *acting,
+                              int *acting_primary) const;
+
   /**
    *  map to up and acting. Fills in whatever fields are non-NULL.
    */
@@ -1315,6 +1324,20 @@ public:
     int up_primary, acting_primary;
     pg_to_up_acting_osds(pg, &up, &up_primary, &acting, &acting_primary);
   }
+  /**
+   * map the pgs [ps_begin, ps_end) of a pool to their up and acting sets,
+   * calling f for each of them. Same as pg_to_up_acting_osds() for each
+   * pg, but the CRUSH rule is run over the whole range at once. raw is
+   * the output of the rule, before any existence, upmap or temp check.
+   */
+  void pg_range_to_up_acting_osds(
+    int64_t pool, unsigned ps_begin, unsigned ps_end,
+    std::function<void(ps_t ps, const std::vector<int>& raw,
+                       std::vector<int>& up, int up_primary,
+                       std::vector<int>& acting, int acting_primary)> f) const;
+  /// pgs with a pg_temp or pg_upmap* entry that mentions any of osds
+  void get_temp_and_upmap_pgs(const std::set<int>& osds,
+                              std::set<pg_t> *pgs) const;
   bool pg_is_ec(pg_t pg) const {
     auto i = pools.find(pg.pool());
     ceph_assert(i != pools.end());
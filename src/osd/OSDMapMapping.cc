@@ -8,6 +8,7 @@
 
 #include "common/debug.h"
 #include "crush/crush.h" // for CRUSH_ITEM_NONE
+#include "crush/CrushWrapper.h"
 
 using std::vector;
 
@@ -33,13 +34,15 @@ void OSDMapMapping::_init_mappings(const OSDMap& osdmap)
 	q = pools.erase(q);
       } else {
 	// keep it
+	q->second.set_pool(p.second);
 	++q;
 	continue;
       }
     }
-    pools.emplace(p.first, PoolMapping(p.second.get_size(),
-				       p.second.get_pg_num(),
-				       p.second.is_erasure()));
+    auto r = pools.emplace(p.first, PoolMapping(p.second.get_size(),
+						p.second.get_pg_num(),
+						p.second.is_erasure()));
+    r.first->second.set_pool(p.second);
   }
   pools.erase(q, pools.end());
   ceph_assert(pools.size() == osdmap.get_pools().size());
@@ -55,11 +58,162 @@ void OSDMapMapping::update(const OSDMap& osdmap)
   //_dump();  // for debugging
 }
 
+void OSDMapMapping::update(const OSDMap& osdmap,
+			   const OSDMap::Incremental& inc)
+{
+  std::set<int64_t> changed_pools;
+  vector<pg_t> changed_pgs;
+  if (!_get_changed(osdmap, inc, &changed_pools, &changed_pgs)) {
+    update(osdmap);
+    return;
+  }
+  _start(osdmap);
+  for (auto pool : changed_pools) {
+    _update_range(osdmap, pool, 0, osdmap.get_pg_pool(pool)->get_pg_num());
+  }
+  _update_pgs(osdmap, changed_pgs);
+  _finish(osdmap);
+}
+
 void OSDMapMapping::update(const OSDMap& osdmap, pg_t pgid)
 {
   _update_range(osdmap, pgid.pool(), pgid.ps(), pgid.ps() + 1);
 }
 
+std::unique_ptr<OSDMapMapping::MappingJob> OSDMapMapping::start_update(
+  const OSDMap& osdmap,
+  const OSDMap::Incremental& inc,
+  ParallelPGMapper& mapper,
+  unsigned pgs_per_item)
+{
+  std::set<int64_t> changed_pools;
+  vector<pg_t> changed_pgs;
+  if (!_get_changed(osdmap, inc, &changed_pools, &changed_pgs)) {
+    return start_update(osdmap, mapper, pgs_per_item);
+  }
+  std::unique_ptr<MappingJob> job(new MappingJob(&osdmap, this));
+  if (changed_pools.empty() && changed_pgs.empty()) {
+    // nothing to queue, and so no shard to complete the job
+    job->finish = ceph_clock_now();
+    job->complete();
+  } else {
+    mapper.queue(job.get(), pgs_per_item, changed_pools, changed_pgs);
+  }
+  return job;
+}
+
+bool OSDMapMapping::_get_changed(
+  const OSDMap& osdmap,
+  const OSDMap::Incremental& inc,
+  std::set<int64_t> *changed_pools,
+  vector<pg_t> *changed_pgs) const
+{
+  if (!complete || !crush ||
+      epoch + 1 != inc.epoch ||
+      osdmap.get_epoch() != inc.epoch ||
+      inc.fullmap.length() ||
+      osd_weight.size() != (size_t)osdmap.get_max_osd()) {
+    return false;
+  }
+
+  // pools whose pgs might all have moved
+  for (auto& [poolid, pi] : osdmap.get_pools()) {
+    auto p = pools.find(poolid);
+    if (p == pools.end() || !p->second.same_placement(pi) ||
+	(inc.crush.length() &&
+	 !crush->rule_mapping_equal(*osdmap.crush, pi.get_crush_rule(),
+				    poolid))) {
+      changed_pools->insert(poolid);
+    }
+  }
+
+  // osds whose state, weight or affinity changed
+  std::set<int> osds;
+  for (auto& p : inc.new_state) {
+    osds.insert(p.first);
+  }
+  for (auto& p : inc.new_up_client) {
+    osds.insert(p.first);
+  }
+  for (auto& p : inc.new_primary_affinity) {
+    osds.insert(p.first);
+  }
+  for (auto& [osd, weight] : inc.new_weight) {
+    osds.insert(osd);
+    if (osd < 0 || osd >= osdmap.get_max_osd()) {
+      continue;
+    }
+    // a lower weight only rejects the osd more often, which can only move
+    // the pgs that have it in their CRUSH output.  a higher one might pull
+    // in any pg which has rejected it before.  MSR rules retry whole
+    // descents, they are not given the benefit of the doubt.
+    bool raised = osdmap.get_weight(osd) > osd_weight[osd];
+    for (auto& [poolid, pi] : osdmap.get_pools()) {
+      int rule = pi.get_crush_rule();
+      if (changed_pools->count(poolid) ||
+	  (!raised && !osdmap.crush->is_msr_rule(rule))) {
+	continue;
+      }
+      std::set<int> roots;
+      osdmap.crush->find_takes_by_rule(rule, &roots);
+      for (auto root : roots) {
+	if (osdmap.crush->subtree_contains(root, osd)) {
+	  changed_pools->insert(poolid);
+	  break;
+	}
+      }
+    }
+  }
+
+  std::set<pg_t> pgs;
+  if (!osds.empty()) {
+    std::vector<bool> mask(osdmap.get_max_osd());
+    for (auto osd : osds) {
+      if (osd >= 0 && osd < osdmap.get_max_osd()) {
+	mask[osd] = true;
+      }
+    }
+    for (auto& [poolid, pm] : pools) {
+      if (changed_pools->count(poolid)) {
+	continue;
+      }
+      for (unsigned ps = 0; ps < pm.pg_num; ++ps) {
+	if (pm.mentions(ps, mask)) {
+	  pgs.insert(pg_t(ps, poolid));
+	}
+      }
+    }
+    osdmap.get_temp_and_upmap_pgs(osds, &pgs);
+  }
+  for (auto& p : inc.new_pg_temp) {
+    pgs.insert(p.first);
+  }
+  for (auto& p : inc.new_primary_temp) {
+    pgs.insert(p.first);
+  }
+  for (auto& p : inc.new_pg_upmap) {
+    pgs.insert(p.first);
+  }
+  for (auto& p : inc.new_pg_upmap_items) {
+    pgs.insert(p.first);
+  }
+  for (auto& p : inc.new_pg_upmap_primary) {
+    pgs.insert(p.first);
+  }
+  pgs.insert(inc.old_pg_upmap.begin(), inc.old_pg_upmap.end());
+  pgs.insert(inc.old_pg_upmap_items.begin(), inc.old_pg_upmap_items.end());
+  pgs.insert(inc.old_pg_upmap_primary.begin(), inc.old_pg_upmap_primary.end());
+
+  for (auto& pg : pgs) {
+    const pg_pool_t *pi = osdmap.get_pg_pool(pg.pool());
+    if (pi && pg.ps() < pi->get_pg_num() &&
+	!changed_pools->count(pg.pool())) {
+      changed_pgs->push_back(pg);
+    }
+  }
+  return true;
+}
+
 void OSDMapMapping::_build_rmap(const OSDMap& osdmap)
 {
   acting_rmap.resize(osdmap.get_max_osd());
@@ -91,6 +245,12 @@ void OSDMapMapping::_finish(const OSDMap& osdmap)
 {
   _build_rmap(osdmap);
   epoch = osdmap.get_epoch();
+  crush = osdmap.crush;
+  osd_weight.resize(osdmap.get_max_osd());
+  for (int osd = 0; osd < osdmap.get_max_osd(); ++osd) {
+    osd_weight[osd] = osdmap.get_weight(osd);
+  }
+  complete = true;
 }
 
 void OSDMapMapping::_dump()
@@ -115,14 +275,21 @@ void OSDMapMapping::_update_range(
   ceph_assert(i != pools.end());
   ceph_assert(pg_begin <= pg_end);
   ceph_assert(pg_end <= i->second.pg_num);
-  for (unsigned ps = pg_begin; ps < pg_end; ++ps) {
-    std::vector<int> up, acting;
-    int up_primary, acting_primary;
-    osdmap.pg_to_up_acting_osds(
-      pg_t(ps, pool),
-      &up, &up_primary, &acting, &acting_primary);
-    i->second.set(ps, std::move(up), up_primary,
-		  std::move(acting), acting_primary);
+  osdmap.pg_range_to_up_acting_osds(
+    pool, pg_begin, pg_end,
+    [&](ps_t ps, const std::vector<int>& raw,
+	std::vector<int>& up, int up_primary,
+	std::vector<int>& acting, int acting_primary) {
+      i->second.set(ps, up, up_primary, acting, acting_primary, raw);
+    });
+}
+
+void OSDMapMapping::_update_pgs(
+  const OSDMap& osdmap,
+  const std::vector<pg_t>& pgs)
+{
+  for (auto& pg : pgs) {
+    _update_range(osdmap, pg.pool(), pg.ps(), pg.ps() + 1);
   }
 }
 
@@ -161,47 +328,84 @@ void ParallelPGMapper::WQ::_process(Item *i, ThreadPool::TPHandle &h)
   i->job->finish_one();
 }
 
-void ParallelPGMapper::queue(
+bool ParallelPGMapper::_queue_pgs(
   Job *job,
   unsigned pgs_per_item,
   const vector<pg_t>& input_pgs)
 {
   bool any = false;
-  if (!input_pgs.empty()) {
-    unsigned i = 0;
-    vector<pg_t> item_pgs;
-    item_pgs.reserve(pgs_per_item);
-    for (auto& pg : input_pgs) {
-      if (i < pgs_per_item) {
-        ++i;
-        item_pgs.push_back(pg);
-      }
-      if (i >= pgs_per_item) {
-        job->start_one();
-        wq.queue(new Item(job, item_pgs));
-        i = 0;
-        item_pgs.clear();
-        any = true;
-      }
+  unsigned i = 0;
+  vector<pg_t> item_pgs;
+  item_pgs.reserve(pgs_per_item);
+  for (auto& pg : input_pgs) {
+    if (i < pgs_per_item) {
+      ++i;
+      item_pgs.push_back(pg);
     }
-    if (!item_pgs.empty()) {
+    if (i >= pgs_per_item) {
       job->start_one();
       wq.queue(new Item(job, item_pgs));
+      i = 0;
+      item_pgs.clear();
       any = true;
     }
+  }
+  if (!item_pgs.empty()) {
+    job->start_one();
+    wq.queue(new Item(job, item_pgs));
+    any = true;
+  }
+  return any;
+}
+
+bool ParallelPGMapper::_queue_pool(
+  Job *job,
+  unsigned pgs_per_item,
+  int64_t pool,
+  unsigned pg_num)
+{
+  bool any = false;
+  for (unsigned ps = 0; ps < pg_num; ps += pgs_per_item) {
+    unsigned ps_end = std::min(ps + pgs_per_item, pg_num);
+    job->start_one();
+    wq.queue(new Item(job, pool, ps, ps_end));
+    ldout(cct, 20) << __func__ << " " << job << " " << pool << " [" << ps
+		   << "," << ps_end << ")" << dendl;
+    any = true;
+  }
+  return any;
+}
+
+void ParallelPGMapper::queue(
+  Job *job,
+  unsigned pgs_per_item,
+  const vector<pg_t>& input_pgs)
+{
+  bool any = false;
+  if (!input_pgs.empty()) {
+    any = _queue_pgs(job, pgs_per_item, input_pgs);
     ceph_assert(any);
     return;
   }
   // no input pgs, load all from map
   for (auto& p : job->osdmap->get_pools()) {
-    for (unsigned ps = 0; ps < p.second.get_pg_num(); ps += pgs_per_item) {
-      unsigned ps_end = std::min(ps + pgs_per_item, p.second.get_pg_num());
-      job->start_one();
-      wq.queue(new Item(job, p.first, ps, ps_end));
-      ldout(cct, 20) << __func__ << " " << job << " " << p.first << " [" << ps
-		     << "," << ps_end << ")" << dendl;
-      any = true;
-    }
+    any |= _queue_pool(job, pgs_per_item, p.first, p.second.get_pg_num());
+  }
+  ceph_assert(any);
+}
+
+void ParallelPGMapper::queue(
+  Job *job,
+  unsigned pgs_per_item,
+  const std::set<int64_t>& pools,
+  const vector<pg_t>& input_pgs)
+{
+  bool any = false;
+  for (auto pool : pools) {
+    const pg_pool_t *pi = job->osdmap->get_pg_pool(pool);
+    ceph_assert(pi);
+    any |= _queue_pool(job, pgs_per_item, pool, pi->get_pg_num());
   }
+  any |= _queue_pgs(job, pgs_per_item, input_pgs);
   ceph_assert(any);
 }
@@ -5,15 +5,18 @@
 #ifndef CEPH_OSDMAPMAPPING_H
 #define CEPH_OSDMAPMAPPING_H
 
+#include <memory>
+#include <set>
 #include <vector>
 #include <map>
 
 #include "osd/osd_types.h"
+#include "osd/OSDMap.h"
 #include "common/WorkQueue.h"
 #include "common/Clock.h" // for ceph_clock_now()
 #include "common/Cond.h"
 
-class OSDMap;
+class CrushWrapper;
 
 /// work queue to perform work on batches of pgids on multiple CPUs
 class ParallelPGMapper {
@@ -97,6 +100,11 @@ public:
 protected:
   CephContext *cct;
 
+  bool _queue_pgs(Job *job, unsigned pgs_per_item,
+		  const std::vector<pg_t>& input_pgs);
+  bool _queue_pool(Job *job, unsigned pgs_per_item,
+		   int64_t pool, unsigned pg_num);
+
   struct Item {
     Job *job;
     int64_t pool;
@@ -165,6 +173,12 @@ public:
     Job *job,
     unsigned pgs_per_item,
     const std::vector<pg_t>& input_pgs);
+  /// queue every pg of the given pools, and then the given pgs
+  void queue(
+    Job *job,
+    unsigned pgs_per_item,
+    const std::set<int64_t>& pools,
+    const std::vector<pg_t>& input_pgs);
 
   void drain() {
     wq.drain();
@@ -184,6 +198,11 @@ private:
     unsigned size = 0;
     unsigned pg_num = 0;
     bool erasure = false;
+    // the rest of the pool the placement of its pgs depends on
+    unsigned pgp_num = 0;
+    int crush_rule = -1;
+    uint64_t flags = 0;
+    shard_id_set nonprimary_shards;
     mempool::osdmap_mapping::vector<int32_t> table;
 
     size_t row_size() const {
@@ -193,7 +212,29 @@ private:
 	1 + // num acting
 	1 + // num up
 	size + // acting
-	size;  // up
+	size + // up
+	1 + // num raw
+	size;  // raw (CRUSH output)
+    }
+
+    static constexpr uint64_t PLACEMENT_FLAGS =
+      pg_pool_t::FLAG_HASHPSPOOL | pg_pool_t::FLAG_EC_OPTIMIZATIONS;
+
+    void set_pool(const pg_pool_t& pi) {
+      pgp_num = pi.get_pgp_num();
+      crush_rule = pi.get_crush_rule();
+      flags = pi.get_flags() & PLACEMENT_FLAGS;
+      nonprimary_shards = pi.nonprimary_shards;
+    }
+    /// true if pi places its pgs the same way as the mapped pool
+    bool same_placement(const pg_pool_t& pi) const {
+      return pg_num == pi.get_pg_num() &&
+	size == pi.get_size() &&
+	erasure == pi.is_erasure() &&
+	pgp_num == pi.get_pgp_num() &&
+	crush_rule == pi.get_crush_rule() &&
+	flags == (pi.get_flags() & PLACEMENT_FLAGS) &&
+	nonprimary_shards == pi.nonprimary_shards;
     }
 
     PoolMapping(int s, int p, bool e)
@@ -233,7 +274,8 @@ private:
 	     const std::vector<int>& up,
 	     int up_primary,
 	     const std::vector<int>& acting,
-	     int acting_primary) {
+	     int acting_primary,
+	     const std::vector<int>& raw) {
       int32_t *row = &table[row_size() * ps];
       row[0] = acting_primary;
       row[1] = up_primary;
@@ -248,6 +290,36 @@ private:
       for (int i = 0; i < row[3]; ++i) {
 	row[4 + size + i] = up[i];
       }
+      int32_t *raw_row = row + 4 + 2 * size;
+      raw_row[0] = std::min<int32_t>(raw.size(), size);
+      for (int i = 0; i < raw_row[0]; ++i) {
+	raw_row[1 + i] = raw[i];
+      }
+    }
+
+    /// true if the raw, up or acting set of the pg has one of osds
+    bool mentions(size_t ps, const std::vector<bool>& osds) const {
+      const int32_t *row = &table[row_size() * ps];
+      auto in = [&osds](int32_t osd) {
+	return osd >= 0 && (size_t)osd < osds.size() && osds[osd];
+      };
+      for (int i = 0; i < row[2]; ++i) {
+	if (in(row[4 + i])) {
+	  return true;
+	}
+      }
+      for (int i = 0; i < row[3]; ++i) {
+	if (in(row[4 + size + i])) {
+	  return true;
+	}
+      }
+      const int32_t *raw_row = row + 4 + 2 * size;
+      for (int i = 0; i < raw_row[0]; ++i) {
+	if (in(raw_row[1 + i])) {
+	  return true;
+	}
+      }
+      return false;
     }
   };
 
@@ -257,16 +329,41 @@ private:
   //unused: mempool::osdmap_mapping::vector<std::vector<pg_t>> up_rmap;  // osd -> pg
   epoch_t epoch = 0;
   uint64_t num_pgs = 0;
+  bool complete = false;  ///< every pg is mapped as of epoch
+
+  // what the mapping at epoch was computed from, to tell which pgs an
+  // incremental can move
+  std::shared_ptr<CrushWrapper> crush;
+  mempool::osdmap_mapping::vector<uint32_t> osd_weight;
 
   void _init_mappings(const OSDMap& osdmap);
   void _update_range(
     const OSDMap& map,
     int64_t pool,
     unsigned pg_begin, unsigned pg_end);
+  void _update_pgs(
+    const OSDMap& map,
+    const std::vector<pg_t>& pgs);
+
+  /**
+   * find the pgs which might map differently once inc is applied
+   *
+   * @param osdmap the map with inc applied
+   * @param inc the incremental right after the mapped epoch
+   * @param pools [out] pools to remap entirely
+   * @param pgs [out] pgs to remap, out of those pools
+   * @return false if everything has to be remapped
+   */
+  bool _get_changed(
+    const OSDMap& osdmap,
+    const OSDMap::Incremental& inc,
+    std::set<int64_t> *pools,
+    std::vector<pg_t> *pgs) const;
 
   void _build_rmap(const OSDMap& osdmap);
 
   void _start(const OSDMap& osdmap) {
+    complete = false;
     _init_mappings(osdmap);
   }
   void _finish(const OSDMap& osdmap);
@@ -281,7 +378,9 @@ private:
       : Job(osdmap), mapping(m) {
       mapping->_start(*osdmap);
     }
-    void process(const std::vector<pg_t>& pgs) override {}
+    void process(const std::vector<pg_t>& pgs) override {
+      mapping->_update_pgs(*osdmap, pgs);
+    }
     void process(int64_t pool, unsigned ps_begin, unsigned ps_end) override {
       mapping->_update_range(*osdmap, pool, ps_begin, ps_end);
     }
@@ -292,6 +391,7 @@ private:
   friend class OSDMapTest;
   // for testing only
   void update(const OSDMap& map);
+  void update(const OSDMap& map, const OSDMap::Incremental& inc);
 
 public:
   void get(pg_t pgid,
@@ -343,6 +443,17 @@ public:
     return job;
   }
 
+  /**
+   * update the mapping to the epoch of inc, which must be the map
+   * right after the mapped one, remapping only the pgs which might
+   * have moved. Falls back to start_update(map, ...) otherwise.
+   */
+  std::unique_ptr<MappingJob> start_update(
+    const OSDMap& map,
+    const OSDMap::Incremental& inc,
+    ParallelPGMapper& mapper,
+    unsigned pgs_per_item);
+
   epoch_t get_epoch() const {
     return epoch;
   }
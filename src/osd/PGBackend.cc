@@ -642,6 +642,19 @@ int PGBackend::objects_get_attr(
   return r;
 }
 
+void PGBackend::objects_prefetch(
+  const vector<hobject_t> &ls,
+  uint32_t flags)
+{
+  vector<ghobject_t> oids;
+  oids.reserve(ls.size());
+  for (auto &hoid : ls) {
+    oids.emplace_back(
+      hoid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard);
+  }
+  store->prefetch(ch, oids, flags);
+}
+
 int PGBackend::objects_get_attrs(
   const hobject_t &hoid,
   map<string, bufferlist, less<>> *out)
@@ -816,6 +829,10 @@ int PGBackend::be_scan_list(
   dout(10) << __func__ << " " << pos << dendl;
   ceph_assert(!pos.done());
   ceph_assert(pos.pos < pos.ls.size());
+  if (pos.pos == 0 && !pos.metadata_done) {
+    // the whole chunk is scanned in order, let the store warm up
+    objects_prefetch(pos.ls, pos.deep ? ObjectStore::PREFETCH_DATA : 0);
+  }
   hobject_t& poid = pos.ls[pos.pos];
   auto& perf_logger = *(get_parent()->get_logger());
 
@@ -591,6 +591,11 @@ typedef std::shared_ptr<const OSDMap> OSDMapRef;
      const std::string &attr,
      ceph::buffer::list *out);
 
+   /// hint the store about objects we are going to read in order
+   void objects_prefetch(
+     const std::vector<hobject_t> &ls,
+     uint32_t flags = 0);
+
    virtual int objects_get_attrs(
      const hobject_t &hoid,
      std::map<std::string, ceph::buffer::list, std::less<>> *out);
@@ -14472,6 +14472,7 @@ void PrimaryLogPG::scan_range_primary(
   ceph_assert(r >= 0);
   dout(10) << " got " << ls.size() << " items, next " << bi->end << dendl;
   dout(20) << ls << dendl;
+  pgbackend->objects_prefetch(ls);
 
   for (vector<hobject_t>::iterator p = ls.begin(); p != ls.end(); ++p) {
     handle.reset_tp_timeout();
@@ -14542,6 +14543,7 @@ void PrimaryLogPG::scan_range_replica(
   ceph_assert(r >= 0);
   dout(10) << " got " << ls.size() << " items, next " << bi->end << dendl;
   dout(20) << ls << dendl;
+  pgbackend->objects_prefetch(ls);
 
   for (vector<hobject_t>::iterator p = ls.begin(); p != ls.end(); ++p) {
     handle.reset_tp_timeout();
@@ -0,0 +1,570 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:nil -*-
+// vim: ts=8 sw=2 sts=2 expandtab
+
+#include "UpmapBalancer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "common/debug.h"
+
+#define dout_subsys ceph_subsys_osd
+#undef dout_prefix
+#define dout_prefix *_dout << "upmap_balancer "
+
+using std::map;
+using std::pair;
+using std::set;
+using std::vector;
+
+static constexpr unsigned PGS_PER_CHUNK = 1024;
+// moves have to improve the score by more than rounding errors
+static constexpr double MIN_IMPROVEMENT = 1e-12;
+
+UpmapBalancer::UpmapBalancer(
+  CephContext *cct,
+  const OSDMap& osdmap,
+  const options_t& opts,
+  const set<int64_t>& only_pools,
+  const map<pg_t,uint64_t>& pg_bytes)
+  : cct(cct), opts(opts)
+{
+  tmp_osd_map.deepish_copy_from(osdmap);
+  int max_osd = tmp_osd_map.get_max_osd();
+  for (unsigned m = 0; m < NUM_METRICS; ++m) {
+    target[m].assign(max_osd, 0);
+    load[m].assign(max_osd, 0);
+  }
+
+  // sum and count of the known pg sizes of each pool
+  map<int64_t,pair<uint64_t,uint64_t>> known;
+  for (auto& [pgid, bytes] : pg_bytes) {
+    auto& k = known[pgid.pool()];
+    k.first += bytes;
+    ++k.second;
+  }
+
+  bool allow_primary_upmaps = opts.primary_upmaps &&
+    tmp_osd_map.get_require_min_compat_client() >= ceph_release_t::reef;
+
+  for (auto& [pid, pool] : tmp_osd_map.get_pools()) {
+    if (!only_pools.empty() && !only_pools.count(pid))
+      continue;
+    map<int,float> pmap;
+    int r = tmp_osd_map.crush->get_rule_weight_osd_map(pool.get_crush_rule(),
+                                                       &pmap);
+    if (r < 0) {
+      ldout(cct, 10) << __func__ << " skipping pool " << pid
+                     << ", no weights for rule " << pool.get_crush_rule()
+                     << dendl;
+      continue;
+    }
+    map<int,double> weights;
+    double weight_total = 0;
+    double affinity_total = 0;
+    for (auto [osd, w] : pmap) {
+      if (osd < 0 || osd >= max_osd)
+        continue;
+      double adjusted = w * tmp_osd_map.get_weightf(osd);
+      if (adjusted <= 0)
+        continue;
+      weights[osd] = adjusted;
+      weight_total += adjusted;
+      affinity_total += adjusted * tmp_osd_map.get_primary_affinityf(osd);
+    }
+    if (weight_total == 0) {
+      ldout(cct, 10) << __func__ << " skipping pool " << pid
+                     << ", all its osds are out" << dendl;
+      continue;
+    }
+
+    // every shard of an erasure coded pg stores 1/k of its data
+    uint64_t data_shards = 1;
+    if (pool.is_erasure()) {
+      auto& profile =
+        tmp_osd_map.get_erasure_code_profile(pool.erasure_code_profile);
+      auto k = profile.find("k");
+      if (k != profile.end())
+        data_shards = std::max(1, atoi(k->second.c_str()));
+    }
+
+    pool_state_t p;
+    p.id = pid;
+    p.pool = &pool;
+    p.primary_upmaps = allow_primary_upmaps && pool.is_replicated();
+    unsigned pg_num = pool.get_pg_num();
+    unsigned size = pool.get_size();
+    p.shard_bytes.resize(pg_num);
+    p.pgs.resize(pg_num);
+    auto k = known.find(pid);
+    double pool_bytes = 0;
+    for (unsigned ps = 0; ps < pg_num; ++ps) {
+      uint64_t bytes = 1;
+      if (!pg_bytes.empty()) {
+        auto b = pg_bytes.find(pg_t(ps, pid));
+        if (b != pg_bytes.end())
+          bytes = div_round_up(b->second, data_shards);
+        else if (k != known.end())
+          bytes = div_round_up(k->second.first / k->second.second,
+                               data_shards);
+        else
+          bytes = 0;
+      }
+      p.shard_bytes[ps] = bytes;
+      pool_bytes += (double)bytes * size;
+    }
+    if (pg_num)
+      p.avg_shard_bytes = pool_bytes / ((double)pg_num * size);
+
+    for (auto& [osd, w] : weights) {
+      p.osds.push_back(osd);
+      target[BYTES][osd] += pool_bytes * w / weight_total;
+      target[PGS][osd] += (double)pg_num * size * w / weight_total;
+      if (affinity_total > 0)
+        target[PRIMARIES][osd] += (double)pg_num * w *
+          tmp_osd_map.get_primary_affinityf(osd) / affinity_total;
+    }
+    ldout(cct, 10) << __func__ << " pool " << pid << " pg_num " << pg_num
+                   << " bytes " << pool_bytes << " on " << p.osds.size()
+                   << " osds" << dendl;
+
+    p.first_chunk = chunks.size();
+    for (unsigned ps = 0; ps < pg_num; ps += PGS_PER_CHUNK)
+      chunks.emplace_back(pools.size(), ps);
+    pool_index[pid] = pools.size();
+    pools.push_back(std::move(p));
+  }
+
+  const double weight[NUM_METRICS] = {
+    opts.bytes_weight, opts.pgs_weight, opts.primaries_weight
+  };
+  for (unsigned m = 0; m < NUM_METRICS; ++m) {
+    double total = 0;
+    unsigned num = 0;
+    for (auto t : target[m]) {
+      if (t > 0) {
+        total += t;
+        ++num;
+      }
+    }
+    if (total > 0) {
+      coef[m] = weight[m] / total;
+      // holding anything without a share weighs like being 100x over
+      min_target[m] = total / num / 100;
+    }
+  }
+}
+
+UpmapBalancer::~UpmapBalancer()
+{
+  if (tp) {
+    tp->stop();
+  }
+}
+
+struct UpmapBalancer::ChunkJob : public ParallelPGMapper::Job {
+  UpmapBalancer *balancer;
+  const std::function<void(size_t)>& f;
+  ChunkJob(UpmapBalancer *b, const std::function<void(size_t)>& f)
+    : Job(&b->tmp_osd_map), balancer(b), f(f) {}
+  void process(const vector<pg_t>& pgs) override {
+    ceph_abort_msg("chunks are queued by pool");
+  }
+  void process(int64_t pool, unsigned ps_begin, unsigned ps_end) override {
+    auto& p = balancer->pools[balancer->pool_index.at(pool)];
+    f(p.first_chunk + ps_begin / PGS_PER_CHUNK);
+  }
+  void complete() override {}
+};
+
+void UpmapBalancer::_for_each_chunk(const std::function<void(size_t)>& f)
+{
+  if (opts.num_threads <= 1 || chunks.size() <= 1) {
+    for (size_t i = 0; i < chunks.size(); ++i) {
+      f(i);
+    }
+    return;
+  }
+  if (!tp) {
+    tp = std::make_unique<ThreadPool>(cct, "UpmapBalancer::tp",
+                                      "upmap_balancer", opts.num_threads);
+    mapper = std::make_unique<ParallelPGMapper>(cct, tp.get());
+    tp->start();
+  }
+  set<int64_t> pool_ids;
+  for (auto& p : pools) {
+    pool_ids.insert(p.id);
+  }
+  ChunkJob job(this, f);
+  mapper->queue(&job, PGS_PER_CHUNK, pool_ids, {});
+  job.wait();
+}
+
+void UpmapBalancer::_map_pgs()
+{
+  _for_each_chunk([this](size_t c) {
+    auto& p = pools[chunks[c].first];
+    unsigned end = std::min<unsigned>(chunks[c].second + PGS_PER_CHUNK,
+                                      p.pgs.size());
+    for (unsigned ps = chunks[c].second; ps < end; ++ps) {
+      auto& s = p.pgs[ps];
+      pg_t pgid(ps, p.id);
+      tmp_osd_map.pg_to_up_acting_osds(pgid, &s.up, &s.primary,
+                                       nullptr, nullptr);
+      s.skip = tmp_osd_map.pg_upmap.count(pgid);
+    }
+  });
+}
+
+void UpmapBalancer::_update_loads()
+{
+  for (auto& l : load) {
+    std::fill(l.begin(), l.end(), 0);
+  }
+  for (auto& p : pools) {
+    for (unsigned ps = 0; ps < p.pgs.size(); ++ps) {
+      auto& s = p.pgs[ps];
+      for (auto osd : s.up) {
+        if (osd < 0 || osd >= (int)load[PGS].size())
+          continue;
+        load[BYTES][osd] += p.shard_bytes[ps];
+        load[PGS][osd] += 1;
+      }
+      if (s.primary >= 0 && s.primary < (int)load[PRIMARIES].size())
+        load[PRIMARIES][s.primary] += 1;
+    }
+  }
+}
+
+UpmapBalancer::score_t UpmapBalancer::_score() const
+{
+  double var[NUM_METRICS] = {0};
+  for (unsigned m = 0; m < NUM_METRICS; ++m) {
+    if (coef[m] == 0)
+      continue;
+    double sum = 0, total = 0;
+    for (unsigned osd = 0; osd < target[m].size(); ++osd) {
+      double dev = load[m][osd] - target[m][osd];
+      sum += dev * dev / std::max(target[m][osd], min_target[m]);
+      total += target[m][osd];
+    }
+    var[m] = sum / total;
+  }
+  const double weight[NUM_METRICS] = {
+    opts.bytes_weight, opts.pgs_weight, opts.primaries_weight
+  };
+  score_t s;
+  s.bytes = std::sqrt(var[BYTES]);
+  s.pgs = std::sqrt(var[PGS]);
+  s.primaries = std::sqrt(var[PRIMARIES]);
+  double weighted = 0, weight_total = 0;
+  for (unsigned m = 0; m < NUM_METRICS; ++m) {
+    if (coef[m] == 0)
+      continue;
+    weighted += weight[m] * var[m];
+    weight_total += weight[m];
+  }
+  if (weight_total > 0)
+    s.total = std::sqrt(weighted / weight_total);
+  return s;
+}
+
+UpmapBalancer::score_t UpmapBalancer::calc_score()
+{
+  _map_pgs();
+  _update_loads();
+  return _score();
+}
+
+void UpmapBalancer::_add_change(vector<change_t>& changes, int osd,
+                                const double (&d)[NUM_METRICS], double sign)
+{
+  auto c = std::find_if(changes.begin(), changes.end(),
+                        [osd](const change_t& c) { return c.osd == osd; });
+  if (c == changes.end()) {
+    c = changes.insert(changes.end(), change_t{osd, {0}});
+  }
+  for (unsigned m = 0; m < NUM_METRICS; ++m) {
+    c->d[m] += sign * d[m];
+  }
+}
+
+void UpmapBalancer::_get_changes(const pool_state_t& p, unsigned ps,
+                                 const vector<int>& up, int primary,
+                                 double sign, vector<change_t>& changes) const
+{
+  const double shard[NUM_METRICS] = {(double)p.shard_bytes[ps], 1, 0};
+  for (auto osd : up) {
+    if (osd < 0 || osd >= (int)load[PGS].size())
+      continue;
+    _add_change(changes, osd, shard, sign);
+  }
+  if (primary >= 0 && primary < (int)load[PRIMARIES].size()) {
+    const double prim[NUM_METRICS] = {0, 0, 1};
+    _add_change(changes, primary, prim, sign);
+  }
+}
+
+double UpmapBalancer::_delta(const vector<change_t>& changes) const
+{
+  // change of sum((load - target)^2 / target) * coef
+  double delta = 0;
+  for (auto& c : changes) {
+    for (unsigned m = 0; m < NUM_METRICS; ++m) {
+      if (c.d[m] == 0 || coef[m] == 0)
+        continue;
+      double dev = load[m][c.osd] - target[m][c.osd];
+      delta += coef[m] * (2 * dev * c.d[m] + c.d[m] * c.d[m]) /
+        std::max(target[m][c.osd], min_target[m]);
+    }
+  }
+  return delta;
+}
+
+void UpmapBalancer::_pick_targets()
+{
+  vector<pair<double,int>> gains;
+  for (auto& p : pools) {
+    // what adding an average shard to each osd would do
+    const double shard[NUM_METRICS] = {
+      p.avg_shard_bytes, 1, 1.0 / std::max(1u, p.pool->get_size())
+    };
+    gains.clear();
+    for (auto osd : p.osds) {
+      vector<change_t> changes;
+      _add_change(changes, osd, shard, 1);
+      gains.emplace_back(_delta(changes), osd);
+    }
+    size_t n = std::min<size_t>(opts.max_targets, gains.size());
+    std::partial_sort(gains.begin(), gains.begin() + n, gains.end());
+    p.targets.clear();
+    for (size_t i = 0; i < n; ++i) {
+      p.targets.push_back(gains[i].second);
+    }
+    ldout(cct, 20) << __func__ << " pool " << p.id << " targets " << p.targets
+                   << dendl;
+  }
+}
+
+void UpmapBalancer::_find_moves(size_t chunk, vector<move_t> *moves)
+{
+  auto& p = pools[chunks[chunk].first];
+  unsigned end = std::min<unsigned>(chunks[chunk].second + PGS_PER_CHUNK,
+                                    p.pgs.size());
+  vector<change_t> changes;
+  for (unsigned ps = chunks[chunk].second; ps < end; ++ps) {
+    auto& s = p.pgs[ps];
+    if (s.skip || s.up.empty())
+      continue;
+    pg_t pgid(ps, p.id);
+    bool primary_upmapped = tmp_osd_map.pg_upmap_primaries.count(pgid);
+    move_t best{(int)chunks[chunk].first, ps, -1, -1, false, -MIN_IMPROVEMENT};
+
+    for (auto from : s.up) {
+      if (from == CRUSH_ITEM_NONE)
+        continue;
+      // moving it would silently drop the pg_upmap_primary
+      if (from == s.primary && primary_upmapped)
+        continue;
+      const double shard[NUM_METRICS] = {
+        (double)p.shard_bytes[ps], 1, from == s.primary ? 1.0 : 0.0
+      };
+      for (auto to : p.targets) {
+        if (std::find(s.up.begin(), s.up.end(), to) != s.up.end())
+          continue;
+        changes.clear();
+        _add_change(changes, from, shard, -1);
+        _add_change(changes, to, shard, 1);
+        double delta = _delta(changes);
+        if (delta < best.delta) {
+          best.from = from;
+          best.to = to;
+          best.primary = false;
+          best.delta = delta;
+        }
+      }
+    }
+
+    if (p.primary_upmaps && s.primary >= 0) {
+      const double prim[NUM_METRICS] = {0, 0, 1};
+      for (auto to : s.up) {
+        if (to == CRUSH_ITEM_NONE || to == s.primary)
+          continue;
+        changes.clear();
+        _add_change(changes, s.primary, prim, -1);
+        _add_change(changes, to, prim, 1);
+        double delta = _delta(changes);
+        if (delta < best.delta) {
+          best.from = s.primary;
+          best.to = to;
+          best.primary = true;
+          best.delta = delta;
+        }
+      }
+    }
+
+    if (best.to >= 0)
+      moves->push_back(best);
+  }
+}
+
+bool UpmapBalancer::_apply_move(const move_t& m,
+                                OSDMap::Incremental *pending_inc,
+                                round_t *round)
+{
+  auto& p = pools[m.pool];
+  auto& s = p.pgs[m.ps];
+  pg_t pgid(m.ps, p.id);
+  uint64_t bytes = m.primary ? 0 : p.shard_bytes[m.ps];
+
+  // the loads changed since the move was found, check it still pays off
+  vector<int> new_up = s.up;
+  int new_primary = m.primary || s.primary == m.from ? m.to : s.primary;
+  if (!m.primary) {
+    std::replace(new_up.begin(), new_up.end(), m.from, m.to);
+  }
+  vector<change_t> changes;
+  _get_changes(p, m.ps, s.up, s.primary, -1, changes);
+  _get_changes(p, m.ps, new_up, new_primary, 1, changes);
+  if (_delta(changes) >= -MIN_IMPROVEMENT)
+    return false;
+  if (!m.primary) {
+    if (opts.max_bytes && round->bytes + bytes > opts.max_bytes)
+      return false;
+    int r = tmp_osd_map.crush->verify_upmap(cct, p.pool->get_crush_rule(),
+                                            p.pool->get_size(), new_up);
+    if (r < 0) {
+      ldout(cct, 20) << __func__ << " " << pgid << " " << s.up << " -> "
+                     << new_up << " violates the crush rule" << dendl;
+      return false;
+    }
+  }
+
+  // try it on the map, as existing remaps and primary affinity have a say
+  auto& items = tmp_osd_map.pg_upmap_items;
+  auto& primaries = tmp_osd_map.pg_upmap_primaries;
+  auto old_items = items.find(pgid) != items.end() ?
+    std::make_optional(items[pgid]) : std::nullopt;
+  auto old_primary = primaries.find(pgid) != primaries.end() ?
+    std::make_optional(primaries[pgid]) : std::nullopt;
+  if (m.primary) {
+    primaries[pgid] = m.to;
+  } else {
+    auto pairs = old_items.value_or(
+      mempool::osdmap::vector<pair<int32_t,int32_t>>());
+    // redirect a remap to the osd we move away from, if there is one
+    auto q = std::find_if(pairs.begin(), pairs.end(),
+                          [&m](auto& i) { return i.second == m.from; });
+    if (q == pairs.end()) {
+      pairs.emplace_back(m.from, m.to);
+    } else if (q->first == m.to) {
+      pairs.erase(q);
+    } else {
+      q->second = m.to;
+    }
+    if (pairs.empty())
+      items.erase(pgid);
+    else
+      items[pgid] = pairs;
+  }
+  auto revert = [&] {
+    if (old_items)
+      items[pgid] = *old_items;
+    else
+      items.erase(pgid);
+    if (old_primary)
+      primaries[pgid] = *old_primary;
+    else
+      primaries.erase(pgid);
+  };
+
+  vector<int> up;
+  int primary;
+  tmp_osd_map.pg_to_up_acting_osds(pgid, &up, &primary, nullptr, nullptr);
+  if ((m.primary && primary != m.to) ||
+      (!m.primary && up != new_up)) {
+    ldout(cct, 20) << __func__ << " " << pgid << " mapped to " << up
+                   << " primary " << primary << ", expected " << new_up
+                   << " primary " << new_primary << dendl;
+    revert();
+    return false;
+  }
+  if (primary != new_primary) {
+    changes.clear();
+    _get_changes(p, m.ps, s.up, s.primary, -1, changes);
+    _get_changes(p, m.ps, up, primary, 1, changes);
+    if (_delta(changes) >= -MIN_IMPROVEMENT) {
+      revert();
+      return false;
+    }
+  }
+
+  ldout(cct, 10) << __func__ << " " << pgid << " " << s.up << " primary "
+                 << s.primary << " -> " << up << " primary " << primary
+                 << dendl;
+  for (auto& c : changes) {
+    for (unsigned i = 0; i < NUM_METRICS; ++i) {
+      load[i][c.osd] += c.d[i];
+    }
+  }
+  s.up = up;
+  s.primary = primary;
+  if (m.primary) {
+    pending_inc->new_pg_upmap_primary[pgid] = m.to;
+    pending_inc->old_pg_upmap_primary.erase(pgid);
+    ++round->primary_moves;
+  } else {
+    auto q = items.find(pgid);
+    if (q != items.end()) {
+      pending_inc->new_pg_upmap_items[pgid] = q->second;
+      pending_inc->old_pg_upmap_items.erase(pgid);
+    } else {
+      pending_inc->new_pg_upmap_items.erase(pgid);
+      pending_inc->old_pg_upmap_items.insert(pgid);
+    }
+    ++round->moves;
+    round->bytes += bytes;
+  }
+  return true;
+}
+
+int UpmapBalancer::run_round(OSDMap::Incremental *pending_inc,
+                             round_t *round)
+{
+  round_t r;
+  _map_pgs();
+  _update_loads();
+  r.before = _score();
+  _pick_targets();
+
+  vector<vector<move_t>> found(chunks.size());
+  _for_each_chunk([this, &found](size_t c) {
+    _find_moves(c, &found[c]);
+  });
+  vector<move_t> moves;
+  for (auto& f : found) {
+    moves.insert(moves.end(), f.begin(), f.end());
+  }
+  std::sort(moves.begin(), moves.end(),
+            [](const move_t& a, const move_t& b) {
+              return a.delta < b.delta;
+            });
+  ldout(cct, 10) << __func__ << " " << moves.size() << " candidate moves"
+                 << dendl;
+
+  unsigned changed = 0;
+  for (auto& m : moves) {
+    if (changed >= opts.max_moves)
+      break;
+    if (_apply_move(m, pending_inc, &r))
+      ++changed;
+  }
+  r.after = _score();
+  ldout(cct, 10) << __func__ << " moved " << r.moves << " pgs, "
+                 << r.bytes << " bytes, " << r.primary_moves
+                 << " primaries, score " << r.before.total << " -> "
+                 << r.after.total << dendl;
+  if (round)
+    *round = r;
+  return changed;
+}
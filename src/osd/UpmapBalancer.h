@@ -0,0 +1,163 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:nil -*-
+// vim: ts=8 sw=2 sts=2 expandtab
+
+#ifndef CEPH_UPMAPBALANCER_H
+#define CEPH_UPMAPBALANCER_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "common/WorkQueue.h"
+#include "osd/osd_types.h"
+#include "osd/OSDMap.h"
+#include "osd/OSDMapMapping.h"
+
+/*
+ * Objective driven pg_upmap balancer.
+ *
+ * OSDMap::calc_pg_upmaps only evens out the number of PGs on each OSD.
+ * This engine scores a distribution by the bytes, the PGs and the
+ * primaries every OSD holds, each against the share its weight entitles
+ * it to, and greedily applies the moves lowering the weighted sum of the
+ * three the most.  Moving a replica to another OSD is tried for all pools,
+ * handing the primary role to another replica (pg_upmap_primary) for the
+ * replicated ones, which costs no data movement.
+ *
+ * Each call to run_round() maps the PGs and scores candidate moves on
+ * opts.num_threads threads of a ParallelPGMapper, kept for the lifetime of
+ * the balancer, then applies the best of them until either
+ * opts.max_moves changes or opts.max_bytes of data movement are reached.
+ * The moves are applied to a private copy of the map as well, so a series
+ * of rounds simulates a balancer working on the cluster.
+ */
+class UpmapBalancer {
+public:
+  struct options_t {
+    double bytes_weight = 1.0;
+    double pgs_weight = 1.0;
+    double primaries_weight = 1.0;
+    unsigned max_moves = 10;     ///< changes per round
+    uint64_t max_bytes = 0;      ///< bytes moved per round, 0 for no limit
+    unsigned num_threads = 1;
+    unsigned max_targets = 16;   ///< least loaded osds tried per pool
+    bool primary_upmaps = true;  ///< also use pg_upmap_primary if allowed
+  };
+
+  /// relative standard deviation from the target of each objective
+  struct score_t {
+    double bytes = 0;
+    double pgs = 0;
+    double primaries = 0;
+    double total = 0;  ///< as weighted by the options
+  };
+
+  struct round_t {
+    unsigned moves = 0;          ///< replicas moved
+    unsigned primary_moves = 0;  ///< primaries handed over
+    uint64_t bytes = 0;          ///< data moved
+    score_t before, after;
+  };
+
+  /**
+   * @param pools     pools to balance, all of them if empty
+   * @param pg_bytes  bytes stored by each pg, as reported by its stats.
+   *                  PGs missing use the average of their pool, pools
+   *                  missing are taken as empty. If no stats are given at
+   *                  all every PG counts the same.
+   */
+  UpmapBalancer(CephContext *cct,
+                const OSDMap& osdmap,
+                const options_t& opts,
+                const std::set<int64_t>& pools = {},
+                const std::map<pg_t,uint64_t>& pg_bytes = {});
+  ~UpmapBalancer();
+
+  score_t calc_score();
+
+  /// compute and apply one round of moves, return the number of changes
+  int run_round(OSDMap::Incremental *pending_inc, round_t *round = nullptr);
+
+  /// the map with all the rounds run so far applied
+  const OSDMap& get_osdmap() const {
+    return tmp_osd_map;
+  }
+
+private:
+  enum {
+    BYTES = 0,
+    PGS,
+    PRIMARIES,
+    NUM_METRICS
+  };
+
+  struct pg_state_t {
+    std::vector<int> up;
+    int primary = -1;
+    bool skip = false;  ///< has an explicit pg_upmap
+  };
+
+  struct pool_state_t {
+    int64_t id;
+    const pg_pool_t *pool;
+    bool primary_upmaps;
+    size_t first_chunk;
+    double avg_shard_bytes = 0;
+    std::vector<int> osds;              ///< with a share of the pool
+    std::vector<uint64_t> shard_bytes;  ///< by ps
+    std::vector<pg_state_t> pgs;        ///< by ps
+    std::vector<int> targets;           ///< least loaded osds this round
+  };
+
+  struct move_t {
+    int pool;    ///< index into pools
+    unsigned ps;
+    int from;
+    int to;
+    bool primary;  ///< hands over the primary role only
+    double delta;
+  };
+
+  /// load change of an osd caused by a move
+  struct change_t {
+    int osd;
+    double d[NUM_METRICS];
+  };
+
+  CephContext *cct;
+  OSDMap tmp_osd_map;
+  const options_t opts;
+
+  std::vector<pool_state_t> pools;
+  std::map<int64_t,size_t> pool_index;               ///< by pool id
+  std::vector<std::pair<unsigned,unsigned>> chunks;  ///< pool, first ps
+
+  struct ChunkJob;
+  std::unique_ptr<ThreadPool> tp;  ///< if opts.num_threads > 1
+  std::unique_ptr<ParallelPGMapper> mapper;
+
+  std::vector<double> target[NUM_METRICS];  ///< by osd
+  std::vector<double> load[NUM_METRICS];    ///< by osd
+  double coef[NUM_METRICS] = {0};
+  double min_target[NUM_METRICS] = {0};  ///< for osds without a share
+
+  score_t _score() const;
+  void _for_each_chunk(const std::function<void(size_t)>& f);
+  void _map_pgs();
+  void _update_loads();
+  void _pick_targets();
+  void _find_moves(size_t chunk, std::vector<move_t> *moves);
+  bool _apply_move(const move_t& m, OSDMap::Incremental *pending_inc,
+                   round_t *round);
+
+  static void _add_change(std::vector<change_t>& changes, int osd,
+                          const double (&d)[NUM_METRICS], double sign);
+  void _get_changes(const pool_state_t& p, unsigned ps,
+                    const std::vector<int>& up, int primary,
+                    double sign, std::vector<change_t>& changes) const;
+  double _delta(const std::vector<change_t>& changes) const;
+};
+
+#endif
@@ -228,6 +228,31 @@ PerfCounters *build_osd_logger(CephContext *cct) {
   osd_plb.add_u64(l_osd_missed_crc, "missed_crc", 
     "Total number of crc cache misses");
 
+  osd_plb.add_u64(
+    l_osd_ec_cache_bytes, "ec_cache_bytes",
+    "Bytes held by the EC extent cache LRUs", NULL, 0, unit_t(UNIT_BYTES));
+  osd_plb.add_u64(
+    l_osd_ec_cache_hit, "ec_cache_hit",
+    "EC extent cache lines found in the LRU");
+  osd_plb.add_u64(
+    l_osd_ec_cache_miss, "ec_cache_miss",
+    "EC extent cache lines not found in the LRU");
+  osd_plb.add_u64(
+    l_osd_ec_cache_evict, "ec_cache_evict",
+    "EC extent cache lines evicted from the LRU");
+  osd_plb.add_u64(
+    l_osd_ec_cache_evict_bytes, "ec_cache_evict_bytes",
+    "Bytes evicted from the EC extent cache LRU", NULL, 0,
+    unit_t(UNIT_BYTES));
+  osd_plb.add_u64(
+    l_osd_ec_cache_read_hit_bytes, "ec_cache_read_hit_bytes",
+    "Bytes of EC writes' reads served without reading the shards", NULL, 0,
+    unit_t(UNIT_BYTES));
+  osd_plb.add_u64(
+    l_osd_ec_cache_read_miss_bytes, "ec_cache_read_miss_bytes",
+    "Bytes of EC writes' reads sent to the shards", NULL, 0,
+    unit_t(UNIT_BYTES));
+
   osd_plb.add_u64(l_osd_pg, "numpg", "Placement groups",
 		  "pgs", PerfCountersBuilder::PRIO_USEFUL);
   osd_plb.add_u64(
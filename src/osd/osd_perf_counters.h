@@ -82,6 +82,14 @@ enum osd_counter_idx_t {
   l_osd_cached_crc_adjusted,
   l_osd_missed_crc,
 
+  l_osd_ec_cache_bytes,
+  l_osd_ec_cache_hit,
+  l_osd_ec_cache_miss,
+  l_osd_ec_cache_evict,
+  l_osd_ec_cache_evict_bytes,
+  l_osd_ec_cache_read_hit_bytes,
+  l_osd_ec_cache_read_miss_bytes,
+
   l_osd_pg,
   l_osd_pg_primary,
   l_osd_pg_replica,
@@ -32,12 +32,14 @@
 #include "rgw_sal_config.h"
 #include "rgw_lib.h"
 #include "rgw_placement_types.h"
+#include "rgw_compression_types.h"
 #include "driver/rados/rgw_bucket.h"
 #include "driver/rados/rgw_sal_rados.h"
 #include "cls/rgw/cls_rgw_ops.h"
 #include "cls/rgw/cls_rgw_client.h"
 #include "cls/rgw/cls_rgw_const.h"
 #include "cls/refcount/cls_refcount_client.h"
+#include "cls/cas/cls_cas_client.h"
 #include "cls/version/cls_version_client.h"
 #include "fmt/ranges.h"
 #include "osd/osd_types.h"
@@ -58,6 +60,9 @@
 #include <cinttypes>
 #include <cstring>
 #include <span>
+#include <array>
+#include <deque>
+#include <optional>
 #include <mutex>
 #include <thread>
 
@@ -74,8 +79,12 @@ using namespace rgw::dedup;
 #include "rgw_dedup_store.h"
 #include "rgw_dedup_cluster.h"
 #include "rgw_dedup_epoch.h"
+#include "rgw_dedup_incremental.h"
 #include "rgw_perf_counters.h"
 #include "include/ceph_assert.h"
+#include "include/ceph_hash.h"
+#include "include/crc32c.h"
+#include "include/intarith.h"
 
 static constexpr auto dout_subsys = ceph_subsys_rgw_dedup;
 
@@ -443,8 +452,10 @@ namespace rgw::dedup {
                                             const disk_record_t *p_rec,
                                             disk_block_id_t block_id,
                                             record_id_t rec_id,
+                                            bool delta,
                                             md5_stats_t *p_stats,
-                                            remapper_t *remapper)
+                                            remapper_t *remapper,
+                                            spill_runs_t *p_spill)
   {
     uint32_t size_4k_units = byte_size_to_disk_blocks(p_rec->s.obj_bytes_size);
     storage_class_idx_t sc_idx = remapper->remap(p_rec->stor_class, dpp,
@@ -460,12 +471,18 @@ namespace rgw::dedup {
                        << ", obj=" << p_rec->obj_name << ", block_id="
                        << (uint32_t)block_id << ", rec_id=" << (uint32_t)rec_id
                        << ", shared_manifest=" << has_shared_manifest
+                       << ", delta=" << delta
                        << "::num_parts=" << p_rec->s.num_parts
                        << "::size_4k_units=" << key.size_4k_units
                        << "::ETAG=" << std::hex << p_rec->s.md5_high
                        << p_rec->s.md5_low << std::dec << dendl;
 
-    int ret = p_table->add_entry(&key, block_id, rec_id, has_shared_manifest);
+    if (p_spill && p_table->need_spill()) {
+      // the md5 shard holds more objects than the table can fit, move the
+      // current entries to a sorted run and continue with an empty table
+      p_spill->spill_table(p_table, p_stats);
+    }
+    int ret = p_table->add_entry(&key, block_id, rec_id, has_shared_manifest, delta);
     if (ret == 0) {
       p_stats->loaded_objects ++;
       ldpp_dout(dpp, 20) << __func__ << "::" << p_rec->bucket_name << "/"
@@ -730,6 +747,16 @@ namespace rgw::dedup {
     }
   }
 
+  //---------------------------------------------------------------------------
+  static void calc_manifest_hash(const bufferlist &manifest_bl,
+                                 bufferlist       *p_manifest_hash_bl) // OUT PARAM
+  {
+    bufferlist hash_bl;
+    crypto::digest<crypto::SHA1>(manifest_bl).encode(hash_bl);
+    // Use a shorter hash (64bit instead of 160bit)
+    hash_bl.splice(0, 8, p_manifest_hash_bl);
+  }
+
   //---------------------------------------------------------------------------
   int Background::dedup_object(const disk_record_t *p_src_rec,
                                const disk_record_t *p_tgt_rec,
@@ -761,10 +788,8 @@ namespace rgw::dedup {
     ldpp_dout(dpp, 20) << __func__ << "::num_parts=" << p_tgt_rec->s.num_parts
                        << "::ETAG=" << etag_bl.to_str() << dendl;
 
-    bufferlist hash_bl, manifest_hash_bl, tgt_hash_bl;
-    crypto::digest<crypto::SHA1>(p_src_rec->manifest_bl).encode(hash_bl);
-    // Use a shorter hash (64bit instead of 160bit)
-    hash_bl.splice(0, 8, &manifest_hash_bl);
+    bufferlist manifest_hash_bl, tgt_hash_bl;
+    calc_manifest_hash(p_src_rec->manifest_bl, &manifest_hash_bl);
     librados::ObjectWriteOperation tgt_op;
     init_cmp_pairs(p_tgt_rec, etag_bl, tgt_hash_bl, &tgt_op);
     tgt_op.setxattr(RGW_ATTR_SHARE_MANIFEST, manifest_hash_bl);
@@ -827,12 +852,184 @@ namespace rgw::dedup {
       }
     }
 
-    // do we need to set compression on the head object or is it set on tail?
-    // RGW_ATTR_COMPRESSION
+    // compression/encryption attributes are kept on the head-object and are
+    // identical on SRC and TGT (verified by the transform hash)
     return ret;
   }
 
   //---------------------------------------------------------------------------
+  // Small objects keep all their data in the head-object which can't be shared
+  // (RGW updates head-objects in place), so the SRC data is moved into a blob
+  // rados-object which is described by a manifest without a head (head_size=0).
+  // The blob is a regular tail-object refcounted with the ref_tag of every
+  // object sharing it, so it is released by the GC like any other tail.
+  // The SRC is promoted on its first dedup (blob written + SRC head truncated)
+  // and every TGT then points its manifest at the blob and drops its own data.
+  int Background::dedup_small_object(const disk_record_t *p_src_rec,
+                                     const disk_record_t *p_tgt_rec,
+                                     md5_stats_t         *p_stats,
+                                     bool                 has_shared_manifest_src)
+  {
+    RGWObjManifest blob_manifest;
+    try {
+      auto bl_iter = p_src_rec->manifest_bl.cbegin();
+      decode(blob_manifest, bl_iter);
+    } catch (buffer::error& err) {
+      ldpp_dout(dpp, 1) << __func__ << "::ERROR: bad src manifest" << dendl;
+      return -EINVAL;
+    }
+
+    // a SRC promoted on a previous scan already points at a blob
+    const bool promoted_src = (blob_manifest.get_head_size() == 0);
+    const uint64_t data_size = blob_manifest.get_obj_size();
+    if (!promoted_src) {
+      if (unlikely(blob_manifest.get_head_size() != data_size)) {
+        ldpp_dout(dpp, 5) << __func__ << "::ERR: src has tail objects::"
+                          << p_src_rec->obj_name << dendl;
+        return -EINVAL;
+      }
+      // the ref_tag is unique per object so it makes a unique blob name
+      std::string tag(p_src_rec->ref_tag.c_str());
+      std::replace_if(tag.begin(), tag.end(),
+                      [](char c) { return !isalnum(c) && c != '.' && c != '-'; },
+                      '_');
+      blob_manifest.set_prefix("._dedup_" + tag + "_");
+      blob_manifest.set_head_size(0);
+      blob_manifest.set_trivial_rule(0, d_head_object_size);
+    }
+    bufferlist blob_manifest_bl;
+    encode(blob_manifest, blob_manifest_bl);
+    bufferlist manifest_hash_bl;
+    calc_manifest_hash(blob_manifest_bl, &manifest_hash_bl);
+    ldpp_dout(dpp, 20) << __func__ << "::DEDUP From: "
+                       << p_src_rec->bucket_name << "/" << p_src_rec->obj_name << " -> "
+                       << p_tgt_rec->bucket_name << "/" << p_tgt_rec->obj_name << dendl;
+
+    std::string src_oid, tgt_oid;
+    librados::IoCtx src_ioctx, tgt_ioctx;
+    int ret1 = get_ioctx(dpp, driver, store, p_src_rec, &src_ioctx, &src_oid);
+    int ret2 = get_ioctx(dpp, driver, store, p_tgt_rec, &tgt_ioctx, &tgt_oid);
+    if (unlikely(ret1 != 0 || ret2 != 0)) {
+      ldpp_dout(dpp, 1) << __func__ << "::ERR: failed get_ioctx()" << dendl;
+      return (ret1 ? ret1 : ret2);
+    }
+
+    bufferlist etag_bl;
+    etag_to_bufferlist(p_tgt_rec->s.md5_high, p_tgt_rec->s.md5_low, p_tgt_rec->s.num_parts, &etag_bl);
+    int ret = 0;
+    if (!promoted_src && !has_shared_manifest_src) {
+      rgw_raw_obj blob_obj = blob_manifest.obj_begin(dpp).get_location().get_raw_obj(rados);
+      rgw_rados_ref blob;
+      ret = rgw_get_rados_ref(dpp, rados_handle, blob_obj, &blob);
+      if (unlikely(ret < 0)) {
+        ldpp_dout(dpp, 1) << __func__ << "::ERR: failed to open context "
+                          << blob_obj << dendl;
+        p_stats->failed_small_blob++;
+        return ret;
+      }
+
+      bufferlist data_bl;
+      d_ctl.metadata_access_throttle.acquire();
+      ret = src_ioctx.read(src_oid, data_bl, 0, 0);
+      if (unlikely(ret < 0 || data_bl.length() != data_size)) {
+        ldpp_dout(dpp, 5) << __func__ << "::ERR: failed to read " << src_oid
+                          << "::len=" << data_bl.length() << "::" << cpp_strerror(-ret) << dendl;
+        p_stats->failed_small_blob++;
+        return (ret < 0 ? ret : -ENODATA);
+      }
+
+      // the blob is created with a single (non-implicit) reference held by SRC
+      librados::ObjectWriteOperation blob_op;
+      blob_op.create(true);
+      blob_op.write_full(data_bl);
+      cls_refcount_get(blob_op, p_src_rec->ref_tag, false);
+      ret = blob.ioctx.operate(blob_obj.oid, &blob_op);
+      if (unlikely(ret != 0)) {
+        ldpp_dout(dpp, 1) << __func__ << "::ERR: failed to write blob "
+                          << blob_obj.oid << "::" << cpp_strerror(-ret) << dendl;
+        p_stats->failed_small_blob++;
+        return ret;
+      }
+
+      // the cmpxattr guarantees that the head data we copied is still valid
+      bufferlist src_hash_bl;
+      librados::ObjectWriteOperation src_op;
+      init_cmp_pairs(p_src_rec, etag_bl, src_hash_bl, &src_op);
+      src_op.setxattr(RGW_ATTR_SHARE_MANIFEST, manifest_hash_bl);
+      src_op.setxattr(RGW_ATTR_MANIFEST, blob_manifest_bl);
+      if (p_src_rec->s.flags.hash_calculated()) {
+        src_op.setxattr(RGW_ATTR_BLAKE3, src_hash_bl);
+        p_stats->set_hash_attrs++;
+      }
+      src_op.truncate(0);
+      d_ctl.metadata_access_throttle.acquire();
+      ldpp_dout(dpp, 20) << __func__ << "::send SRC CLS (Blob_Manifest)" << dendl;
+      ret = src_ioctx.operate(src_oid, &src_op);
+      if (unlikely(ret != 0)) {
+        ldpp_dout(dpp, 1) << __func__ << "::ERR: failed src_ioctx.operate("
+                          << src_oid << "), err is " << cpp_strerror(-ret) << dendl;
+        // dropping the only reference removes the blob
+        librados::ObjectWriteOperation put_op;
+        cls_refcount_put(put_op, p_src_rec->ref_tag, false);
+        int put_ret = blob.ioctx.operate(blob_obj.oid, &put_op);
+        if (unlikely(put_ret != 0)) {
+          ldpp_dout(dpp, 1) << __func__ << "::ERR: failed to remove blob "
+                            << blob_obj.oid << ", it is leaked::"
+                            << cpp_strerror(-put_ret) << dendl;
+          p_stats->failed_small_blob_rollback++;
+        }
+        p_stats->failed_small_blob++;
+        return ret;
+      }
+      p_stats->small_blobs++;
+    }
+
+    bufferlist tgt_hash_bl;
+    librados::ObjectWriteOperation tgt_op;
+    init_cmp_pairs(p_tgt_rec, etag_bl, tgt_hash_bl, &tgt_op);
+    tgt_op.setxattr(RGW_ATTR_SHARE_MANIFEST, manifest_hash_bl);
+    tgt_op.setxattr(RGW_ATTR_MANIFEST, blob_manifest_bl);
+    if (p_tgt_rec->s.flags.hash_calculated()) {
+      tgt_op.setxattr(RGW_ATTR_BLAKE3, tgt_hash_bl);
+      p_stats->set_hash_attrs++;
+    }
+    tgt_op.truncate(0);
+
+    string ref_tag = p_tgt_rec->ref_tag;
+    ldpp_dout(dpp, 20) << __func__ << "::ref_tag=" << ref_tag << dendl;
+    ret = inc_ref_count_by_manifest(ref_tag, tgt_oid, blob_manifest);
+    if (ret == 0) {
+      d_ctl.metadata_access_throttle.acquire();
+      ldpp_dout(dpp, 20) << __func__ << "::send TGT CLS (Blob_Manifest)" << dendl;
+      ret = tgt_ioctx.operate(tgt_oid, &tgt_op);
+      if (unlikely(ret != 0)) {
+        ldpp_dout(dpp, 1) << __func__ << "::ERR: failed tgt_ioctx.operate("
+                          << tgt_oid << "), err is " << cpp_strerror(-ret) << dendl;
+        rollback_ref_by_manifest(ref_tag, tgt_oid, blob_manifest);
+        return ret;
+      }
+    }
+
+    return ret;
+  }
+
+  //---------------------------------------------------------------------------
+  static inline void blake3_update_bl(blake3_hasher *p_hmac, const bufferlist &bl)
+  {
+    for (const auto& bptr : bl.buffers()) {
+#ifdef WITH_BLAKE3_TBB
+      // hash large buffers with the BLAKE3 tree mode across the TBB pool
+      blake3_hasher_update_tbb(p_hmac, (const unsigned char *)bptr.c_str(), bptr.length());
+#else
+      blake3_hasher_update(p_hmac, (const unsigned char *)bptr.c_str(), bptr.length());
+#endif
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  // The rados-objects are read with a window of concurrent AIO reads and each
+  // read is hashed (in manifest order) as soon as it completes, so the hashing
+  // overlaps with the reads of the following rados-objects
   int Background::calc_object_blake3(const disk_record_t *p_rec, uint8_t *p_hash)
   {
     ldpp_dout(dpp, 20) << __func__ << "::obj_name=" << p_rec->obj_name << dendl;
@@ -846,32 +1043,75 @@ namespace rgw::dedup {
       return -EINVAL;
     }
 
+    struct aio_read_t {
+      librados::IoCtx          ioctx;
+      std::string              oid;
+      bufferlist               bl;
+      librados::AioCompletion *c = nullptr;
+    };
+    // std::deque keeps the bufferlist addresses stable while reads are inflight
+    std::deque<aio_read_t> inflight;
+
     blake3_hasher hmac;
     blake3_hasher_init(&hmac);
-    for (auto p = manifest.obj_begin(dpp); p != manifest.obj_end(dpp); ++p) {
-      rgw_raw_obj raw_obj = p.get_location().get_raw_obj(rados);
-      rgw_rados_ref obj;
-      int ret = rgw_get_rados_ref(dpp, rados_handle, raw_obj, &obj);
-      if (ret < 0) {
-        ldpp_dout(dpp, 1) << __func__ << "::failed rgw_get_rados_ref() for oid: "
-                          << raw_obj.oid << ", err is " << cpp_strerror(-ret) << dendl;
-        return ret;
-      }
+    int ret = 0;
+    auto p = manifest.obj_begin(dpp);
+    const auto p_end = manifest.obj_end(dpp);
+    while (ret == 0 && (p != p_end || !inflight.empty())) {
+      while (p != p_end && inflight.size() < d_verify_max_aio) {
+        rgw_raw_obj raw_obj = p.get_location().get_raw_obj(rados);
+        ++p;
+        rgw_rados_ref obj;
+        ret = rgw_get_rados_ref(dpp, rados_handle, raw_obj, &obj);
+        if (ret < 0) {
+          ldpp_dout(dpp, 1) << __func__ << "::failed rgw_get_rados_ref() for oid: "
+                            << raw_obj.oid << ", err is " << cpp_strerror(-ret) << dendl;
+          break;
+        }
 
-      bufferlist bl;
-      librados::IoCtx ioctx = obj.ioctx;
-      // read full object
-      ret = ioctx.read(raw_obj.oid, bl, 0, 0);
-      if (ret > 0) {
-        for (const auto& bptr : bl.buffers()) {
-          blake3_hasher_update(&hmac, (const unsigned char *)bptr.c_str(), bptr.length());
+        aio_read_t &rd = inflight.emplace_back();
+        rd.ioctx = obj.ioctx;
+        rd.oid = raw_obj.oid;
+        rd.c = librados::Rados::aio_create_completion();
+        librados::ObjectReadOperation op;
+        // read full object
+        op.read(0, 0, &rd.bl, nullptr);
+        ret = rd.ioctx.aio_operate(rd.oid, rd.c, &op, nullptr);
+        if (unlikely(ret < 0)) {
+          ldpp_dout(dpp, 1) << __func__ << "::ERR: failed aio_operate() for "
+                            << rd.oid << ", error is " << cpp_strerror(-ret) << dendl;
+          rd.c->release();
+          inflight.pop_back();
+          break;
         }
       }
+      if (ret < 0 || inflight.empty()) {
+        break;
+      }
+
+      aio_read_t &rd = inflight.front();
+      rd.c->wait_for_complete();
+      ret = rd.c->get_return_value();
+      rd.c->release();
+      if (ret >= 0 && rd.bl.length() > 0) {
+        blake3_update_bl(&hmac, rd.bl);
+        ret = 0;
+      }
       else {
-        ldpp_dout(dpp, 1) << __func__ << "::ERR: failed to read " << raw_obj.oid
+        ldpp_dout(dpp, 1) << __func__ << "::ERR: failed to read " << rd.oid
                           << ", error is " << cpp_strerror(-ret) << dendl;
-        return ret;
+        ret = (ret == 0 ? -ENODATA : ret);
       }
+      inflight.pop_front();
+    }
+
+    // reads are never cancelled, wait for them before releasing the buffers
+    for (auto &rd : inflight) {
+      rd.c->wait_for_complete();
+      rd.c->release();
+    }
+    if (ret < 0) {
+      return ret;
     }
 
     blake3_hasher_finalize(&hmac, p_hash, BLAKE3_OUT_LEN);
@@ -900,6 +1140,44 @@ namespace rgw::dedup {
                        << p_tgt_rec->s.md5_low << std::dec << dendl;
   }
 
+  //---------------------------------------------------------------------------
+  // SSE-S3 objects encrypted with a convergent key hold identical ciphertext
+  // for identical data under the same bucket key.
+  // All other encryption modes use a unique key per object
+  static bool is_convergent_encryption(const rgw::sal::Attrs &attrs)
+  {
+    auto itr = attrs.find(RGW_ATTR_CRYPT_MODE);
+    return (itr != attrs.end() && itr->second.to_str() == "AES256" &&
+            attrs.find(RGW_ATTR_CRYPT_CONVERGENT) != attrs.end() &&
+            attrs.find(RGW_ATTR_CRYPT_PARTS) == attrs.end());
+  }
+
+  //---------------------------------------------------------------------------
+  // A compressed/encrypted target keeps its own head-object attributes after
+  // dedup so it can only share the tail-objects of a source stored with the
+  // very same transform (compression type and block layout, encryption key)
+  static uint32_t calc_xform_hash(const rgw::sal::Attrs &attrs)
+  {
+    static constexpr const char* xform_attrs[] = {
+      RGW_ATTR_COMPRESSION,
+      RGW_ATTR_CRYPT_MODE,
+      RGW_ATTR_CRYPT_KEYID,
+      RGW_ATTR_CRYPT_CONVERGENT
+    };
+    uint32_t crc = -1;
+    bool found = false;
+    for (const char *name : xform_attrs) {
+      auto itr = attrs.find(name);
+      if (itr != attrs.end()) {
+        crc = ceph_crc32c(crc, (const unsigned char*)name, strlen(name));
+        crc = itr->second.crc32c(crc);
+        found = true;
+      }
+    }
+    // zero is reserved for plain objects
+    return found ? (crc ? crc : 1) : 0;
+  }
+
   //---------------------------------------------------------------------------
   int Background::add_obj_attrs_to_record(rgw_bucket            *p_rb,
                                           disk_record_t         *p_rec,
@@ -923,6 +1201,7 @@ namespace rgw::dedup {
       }
     }
     p_rec->s.ref_tag_len = p_rec->ref_tag.length();
+    p_rec->s.xform_hash = calc_xform_hash(attrs);
 
     // clear bufferlist first
     p_rec->manifest_bl.clear();
@@ -1093,7 +1372,8 @@ namespace rgw::dedup {
     }
 
     const rgw::sal::Attrs& attrs = p_obj->get_attrs();
-    if (attrs.find(RGW_ATTR_CRYPT_MODE) != attrs.end()) {
+    const bool encrypted = (attrs.find(RGW_ATTR_CRYPT_MODE) != attrs.end());
+    if (encrypted && !is_convergent_encryption(attrs)) {
       p_stats->ingress_skip_encrypted++;
       p_stats->ingress_skip_encrypted_bytes += ondisk_byte_size;
       ldpp_dout(dpp, 20) <<__func__ << "::Skipping encrypted object "
@@ -1101,13 +1381,26 @@ namespace rgw::dedup {
       return 0;
     }
 
-    // TBD: We should be able to support RGW_ATTR_COMPRESSION when all copies are compressed
-    if (attrs.find(RGW_ATTR_COMPRESSION) != attrs.end()) {
-      p_stats->ingress_skip_compressed++;
-      p_stats->ingress_skip_compressed_bytes += ondisk_byte_size;
-      ldpp_dout(dpp, 20) <<__func__ << "::Skipping compressed object "
-                         << p_rec->obj_name << dendl;
-      return 0;
+    // The ETAG is calculated on the logical data so compressed objects are
+    // matched like plain objects, the transform hash added to the record
+    // makes sure we only share tails stored with the same compression layout
+    auto citr = attrs.find(RGW_ATTR_COMPRESSION);
+    if (citr != attrs.end()) {
+      RGWCompressionInfo cs_info;
+      try {
+        auto bl_iter = citr->second.cbegin();
+        decode(cs_info, bl_iter);
+      } catch (buffer::error& err) {
+        p_stats->ingress_skip_compressed++;
+        p_stats->ingress_skip_compressed_bytes += ondisk_byte_size;
+        ldpp_dout(dpp, 10) <<__func__ << "::Skipping compressed object with bad "
+                           << "compression info " << p_rec->obj_name << dendl;
+        return 0;
+      }
+    }
+    if (encrypted || citr != attrs.end()) {
+      p_stats->ingress_transformed_objs++;
+      p_stats->ingress_transformed_objs_bytes += ondisk_byte_size;
     }
 
     // extract ETAG and Size and compare with values taken from the bucket-index
@@ -1306,6 +1599,16 @@ namespace rgw::dedup {
       return 0;
     }
 
+    if (unlikely(src_rec.s.xform_hash != p_tgt_rec->s.xform_hash)) {
+      // same logical data stored with a different compression/encryption
+      p_stats->xform_mismatch++;
+      ldpp_dout(dpp, 10) << __func__ << "::transform mismatch::"
+                         << src_rec.obj_name << "::0x" << std::hex
+                         << src_rec.s.xform_hash << "::" << p_tgt_rec->obj_name
+                         << "::0x" << p_tgt_rec->s.xform_hash << std::dec << dendl;
+      return 0;
+    }
+
     if (memcmp(src_rec.s.hash, p_tgt_rec->s.hash, sizeof(src_rec.s.hash)) != 0) {
       p_stats->hash_mismatch++;
       ldpp_dout(dpp, 10) << __func__ << "::HASH mismatch" << dendl;
@@ -1321,13 +1624,27 @@ namespace rgw::dedup {
       return 0;
     }
 
-    ret = dedup_object(&src_rec, p_tgt_rec, p_stats, src_val.has_shared_manifest());
+    // the table only holds small objects when small-object dedup is enabled
+    const bool small_object = (p_tgt_rec->s.num_parts == 0 &&
+                               p_tgt_rec->s.obj_bytes_size <= d_head_object_size);
+    if (small_object) {
+      ret = dedup_small_object(&src_rec, p_tgt_rec, p_stats, src_val.has_shared_manifest());
+    }
+    else {
+      ret = dedup_object(&src_rec, p_tgt_rec, p_stats, src_val.has_shared_manifest());
+    }
     if (ret == 0) {
-      p_stats->deduped_objects++;
-      p_stats->deduped_objects_bytes += dedupable_objects_bytes;
-      if (p_tgt_rec->s.num_parts == 0) {
-        // single part objects duplicate the head object when dedup is used
-        p_stats->dup_head_bytes += d_head_object_size;
+      if (small_object) {
+        p_stats->deduped_small_objects++;
+        p_stats->deduped_small_objects_bytes += ondisk_byte_size;
+      }
+      else {
+        p_stats->deduped_objects++;
+        p_stats->deduped_objects_bytes += dedupable_objects_bytes;
+        if (p_tgt_rec->s.num_parts == 0) {
+          // single part objects duplicate the head object when dedup is used
+          p_stats->dup_head_bytes += d_head_object_size;
+        }
       }
 
       // mark the SRC object as a providor of a shared manifest
@@ -1349,6 +1666,287 @@ namespace rgw::dedup {
     return 0;
   }
 
+  //---------------------------------------------------------------------------
+  static std::string calc_chunk_fingerprint(const bufferlist &bl)
+  {
+    std::array<unsigned char, BLAKE3_OUT_LEN> hash;
+    blake3_hasher hmac;
+    blake3_hasher_init(&hmac);
+    for (const auto& bptr : bl.buffers()) {
+      blake3_hasher_update(&hmac, (const unsigned char *)bptr.c_str(), bptr.length());
+    }
+    blake3_hasher_finalize(&hmac, hash.data(), hash.size());
+    return std::string(buf_to_hex(hash).data());
+  }
+
+  //---------------------------------------------------------------------------
+  // release the local copy of a chunked tail-object, reads are served from the
+  // chunk-pool
+  int Background::evict_tail_object(librados::IoCtx   &ioctx,
+                                    const std::string &oid)
+  {
+    librados::ObjectReadOperation evict_op;
+    evict_op.tier_evict();
+    int ret = ioctx.operate(oid, &evict_op, nullptr);
+    if (unlikely(ret != 0)) {
+      ldpp_dout(dpp, 5) << __func__ << "::ERR: failed tier_evict(" << oid
+                        << "), error is " << cpp_strerror(-ret) << dendl;
+    }
+    return ret;
+  }
+
+  //---------------------------------------------------------------------------
+  // Split a single tail-object into content-defined chunks stored once in the
+  // chunk-pool (named by their fingerprint) and turn the tail-object into a
+  // RADOS manifest object referencing them.
+  // This is the same mechanism used by ceph-dedup-tool: the OSD maintains the
+  // chunk refcount (cls_cas) so the chunks are released when the tail is removed
+  int Background::chunk_dedup_tail_object(librados::IoCtx   &ioctx,
+                                          const std::string &oid,
+                                          md5_stats_t       *p_stats) /* IN-OUT */
+  {
+    bufferlist attr_bl;
+    int ret = ioctx.getxattr(oid, RGW_DEDUP_ATTR_CHUNKED, attr_bl);
+    if (ret >= 0) {
+      // Any write to an evicted tail (a refcount change by CopyObject, by a
+      // later full-object dedup or by GC of a copy) makes the OSD promote its
+      // chunks back. The eviction keeps the object size, so there is no cheap
+      // way to tell the two apart; evicting an evicted tail only punches the
+      // same holes again
+      ldpp_dout(dpp, 20) << __func__ << "::already chunked::" << oid << dendl;
+      ret = evict_tail_object(ioctx, oid);
+      if (ret == 0) {
+        p_stats->evicted_chunked_tails++;
+      }
+      return ret;
+    }
+
+    // a tail shared with other objects (CopyObject, pending GC of a removed
+    // copy) would be promoted back as soon as they drop their reference
+    std::list<std::string> refs;
+    std::string tail_oid = oid;
+    ret = cls_refcount_read(ioctx, tail_oid, &refs, true);
+    if (unlikely(ret < 0)) {
+      ldpp_dout(dpp, 5) << __func__ << "::ERR: failed cls_refcount_read(" << oid
+                        << "), error is " << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+    if (refs.size() > 1) {
+      ldpp_dout(dpp, 20) << __func__ << "::shared tail::" << oid
+                         << "::refs=" << refs.size() << dendl;
+      p_stats->skipped_shared_tails++;
+      return 0;
+    }
+
+    bufferlist bl;
+    // read full object
+    ret = ioctx.read(oid, bl, 0, 0);
+    if (unlikely(ret <= 0)) {
+      ldpp_dout(dpp, 5) << __func__ << "::ERR: failed to read " << oid
+                        << ", error is " << cpp_strerror(-ret) << dendl;
+      return (ret == 0 ? -ENODATA : ret);
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t>> chunks;
+    d_cdc->calc_chunks(bl, &chunks);
+    std::vector<std::string> fingerprints;
+    fingerprints.reserve(chunks.size());
+    for (const auto& [offset, length] : chunks) {
+      bufferlist chunk_bl;
+      chunk_bl.substr_of(bl, offset, length);
+      fingerprints.push_back(calc_chunk_fingerprint(chunk_bl));
+    }
+
+    // An earlier session might have failed after setting some of the chunks,
+    // and set_chunk() refuses offsets already in the chunk-map. The chunking
+    // is deterministic and chunks are set in order, so a fingerprint the tail
+    // references N times is set on its first N offsets
+    std::map<std::string, int> already_set;
+    if (!fingerprints.empty() &&
+        cls_cas_references_chunk(ioctx, oid, fingerprints.front()) > 0) {
+      for (const auto& fp : fingerprints) {
+        if (!already_set.contains(fp)) {
+          already_set[fp] = std::max(cls_cas_references_chunk(ioctx, oid, fp), 0);
+        }
+      }
+    }
+
+    // the chunk is created (or referenced) on behalf of the tail so it is never
+    // left without references, and that reference is dropped once set_chunk()
+    // took its own
+    const hobject_t soid(sobject_t(oid, CEPH_NOSNAP));
+    for (unsigned i = 0; i < chunks.size(); i++) {
+      const auto& [offset, length] = chunks[i];
+      const std::string& fingerprint = fingerprints[i];
+      auto itr = already_set.find(fingerprint);
+      if (itr != already_set.end() && itr->second > 0) {
+        itr->second--;
+        p_stats->chunks++;
+        continue;
+      }
+
+      uint64_t size;
+      time_t   mtime;
+      if (d_chunk_ioctx.stat(fingerprint, &size, &mtime) == 0) {
+        p_stats->dup_chunks++;
+        p_stats->dup_chunks_bytes += length;
+      }
+      bufferlist chunk_bl;
+      chunk_bl.substr_of(bl, offset, length);
+      librados::ObjectWriteOperation wop;
+      cls_cas_chunk_create_or_get_ref(wop, soid, chunk_bl);
+      ret = d_chunk_ioctx.operate(fingerprint, &wop);
+      if (unlikely(ret != 0)) {
+        ldpp_dout(dpp, 5) << __func__ << "::ERR: failed to store chunk "
+                          << fingerprint << ", error is " << cpp_strerror(-ret)
+                          << dendl;
+        return ret;
+      }
+
+      librados::ObjectReadOperation op;
+      op.set_chunk(offset, length, d_chunk_ioctx, fingerprint, 0,
+                   CEPH_OSD_OP_FLAG_WITH_REFERENCE);
+      ret = ioctx.operate(oid, &op, nullptr);
+      librados::ObjectWriteOperation put_op;
+      cls_cas_chunk_put_ref(put_op, soid);
+      int put_ret = d_chunk_ioctx.operate(fingerprint, &put_op);
+      if (unlikely(ret != 0)) {
+        ldpp_dout(dpp, 5) << __func__ << "::ERR: failed set_chunk(" << oid
+                          << "), error is " << cpp_strerror(-ret) << dendl;
+        return ret;
+      }
+      if (unlikely(put_ret != 0)) {
+        // the chunk keeps an extra reference, which only costs its space
+        ldpp_dout(dpp, 5) << __func__ << "::ERR: failed chunk_put_ref("
+                          << fingerprint << "), error is "
+                          << cpp_strerror(-put_ret) << dendl;
+      }
+      p_stats->chunks++;
+    }
+
+    ret = ioctx.setxattr(oid, RGW_DEDUP_ATTR_CHUNKED, attr_bl);
+    if (unlikely(ret != 0)) {
+      ldpp_dout(dpp, 5) << __func__ << "::ERR: failed setxattr(" << oid
+                        << "), error is " << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+
+    ret = evict_tail_object(ioctx, oid);
+    if (unlikely(ret != 0)) {
+      return ret;
+    }
+    p_stats->chunked_tail_objs++;
+    return 0;
+  }
+
+  //---------------------------------------------------------------------------
+  // Singleton objects can't benefit from full-object dedup, but their data
+  // might still overlap with other objects (shifted copies, appended logs, VM
+  // images etc.) so we dedup their tail-objects at chunk granularity.
+  // The head-object is left intact as RGW updates it in place.
+  int Background::chunk_dedup_record(dedup_table_t       *p_table,
+                                     const disk_record_t *p_rec,
+                                     md5_stats_t         *p_stats, /* IN-OUT */
+                                     remapper_t          *remapper)
+  {
+    uint32_t size_4k_units = byte_size_to_disk_blocks(p_rec->s.obj_bytes_size);
+    uint64_t ondisk_byte_size = disk_blocks_to_byte_size(size_4k_units);
+    if (ondisk_byte_size <= d_head_object_size) {
+      // no tail-objects
+      return 0;
+    }
+    storage_class_idx_t sc_idx = remapper->remap(p_rec->stor_class, dpp,
+                                                 &p_stats->failed_map_overflow);
+    if (unlikely(sc_idx == remapper_t::NULL_IDX)) {
+      return -EOVERFLOW;
+    }
+    key_t key(p_rec->s.md5_high, p_rec->s.md5_low, size_4k_units,
+              p_rec->s.num_parts, sc_idx);
+    dedup_table_t::value_t val;
+    int ret = p_table->get_val(&key, &val);
+    if (ret != 0 || !val.is_singleton()) {
+      // duplicates are handled by the full-object dedup
+      return 0;
+    }
+
+    rgw_bucket b{p_rec->tenant_name, p_rec->bucket_name, p_rec->bucket_id};
+    unique_ptr<rgw::sal::Bucket> bucket;
+    ret = driver->load_bucket(dpp, b, &bucket, null_yield);
+    if (unlikely(ret != 0)) {
+      p_stats->ingress_failed_load_bucket++;
+      ldpp_dout(dpp, 15) << __func__ << "::Failed driver->load_bucket(): "
+                         << cpp_strerror(-ret) << dendl;
+      return 0;
+    }
+    const rgw_obj_index_key roi_key(p_rec->obj_name, p_rec->instance);
+    unique_ptr<rgw::sal::Object> p_obj = bucket->get_object(roi_key);
+    if (unlikely(!p_obj)) {
+      p_stats->ingress_failed_get_object++;
+      ldpp_dout(dpp, 15) << __func__ << "::Failed bucket->get_object("
+                         << p_rec->obj_name << ")" << dendl;
+      return 0;
+    }
+
+    d_ctl.metadata_access_throttle.acquire();
+    ret = p_obj->get_obj_attrs(null_yield, dpp);
+    if (unlikely(ret < 0)) {
+      p_stats->ingress_failed_get_obj_attrs++;
+      ldpp_dout(dpp, 10) << __func__ << "::ERR: failed to stat object(" << p_rec->obj_name
+                         << "), returned error: " << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+
+    const rgw::sal::Attrs& attrs = p_obj->get_attrs();
+    // encrypted/compressed data won't share chunks with other objects, and
+    // tail-objects shared by a previous full-object dedup are left alone
+    if (attrs.find(RGW_ATTR_CRYPT_MODE) != attrs.end() ||
+        attrs.find(RGW_ATTR_COMPRESSION) != attrs.end() ||
+        attrs.find(RGW_ATTR_SHARE_MANIFEST) != attrs.end()) {
+      ldpp_dout(dpp, 20) << __func__ << "::Skipping object " << p_rec->obj_name << dendl;
+      return 0;
+    }
+
+    auto itr = attrs.find(RGW_ATTR_MANIFEST);
+    if (itr == attrs.end()) {
+      ldpp_dout(dpp, 5)  << __func__ << "::ERROR: no manifest" << dendl;
+      return -EINVAL;
+    }
+    RGWObjManifest manifest;
+    try {
+      auto bl_iter = itr->second.cbegin();
+      decode(manifest, bl_iter);
+    } catch (buffer::error& err) {
+      ldpp_dout(dpp, 1)  << __func__ << "::ERROR: unable to decode manifest" << dendl;
+      return -EINVAL;
+    }
+
+    ldpp_dout(dpp, 20) << __func__ << "::" << p_rec->bucket_name << "/"
+                       << p_rec->obj_name << dendl;
+    const uint64_t head_size = manifest.get_head_size();
+    for (auto p = manifest.obj_begin(dpp); p != manifest.obj_end(dpp); ++p) {
+      if (p.get_ofs() < head_size) {
+        // skip the head-object
+        continue;
+      }
+      rgw_raw_obj raw_obj = p.get_location().get_raw_obj(rados);
+      rgw_rados_ref obj;
+      ret = rgw_get_rados_ref(dpp, rados_handle, raw_obj, &obj);
+      if (unlikely(ret < 0)) {
+        ldpp_dout(dpp, 1) << __func__ << "::failed rgw_get_rados_ref() for oid: "
+                          << raw_obj.oid << ", err is " << cpp_strerror(-ret) << dendl;
+        p_stats->failed_chunk_dedup++;
+        return ret;
+      }
+      ret = chunk_dedup_tail_object(obj.ioctx, raw_obj.oid, p_stats);
+      if (unlikely(ret != 0)) {
+        p_stats->failed_chunk_dedup++;
+        return ret;
+      }
+    }
+    p_stats->chunked_objects++;
+    return 0;
+  }
+
 #endif // #ifdef FULL_DEDUP_SUPPORT
   //---------------------------------------------------------------------------
   const char* Background::dedup_step_name(dedup_step_t step)
@@ -1357,9 +1955,10 @@ namespace rgw::dedup {
                                   "STEP_BUCKET_INDEX_INGRESS",
                                   "STEP_BUILD_TABLE",
                                   "STEP_READ_ATTRIBUTES",
-                                  "STEP_REMOVE_DUPLICATES"};
+                                  "STEP_REMOVE_DUPLICATES",
+                                  "STEP_CHUNK_DEDUP"};
     static const char* undefined_step = "UNDEFINED_STEP";
-    if (step >= STEP_NONE && step <= STEP_REMOVE_DUPLICATES) {
+    if (step >= STEP_NONE && step <= STEP_CHUNK_DEDUP) {
       return names[step];
     }
     else {
@@ -1368,15 +1967,34 @@ namespace rgw::dedup {
   }
 
   //---------------------------------------------------------------------------
-  int Background::process_all_slabs(dedup_table_t *p_table,
+  static inline std::string record_identity(const disk_record_t *p_rec)
+  {
+    std::string id;
+    id.reserve(p_rec->bucket_id.size() + p_rec->obj_name.size() +
+               p_rec->instance.size() + 2);
+    id.append(p_rec->bucket_id).push_back('\0');
+    id.append(p_rec->obj_name).push_back('\0');
+    id.append(p_rec->instance);
+    return id;
+  }
+
+  // On incremental scans @p_delta_objs holds the objects ingested by this scan.
+  // A baseline record of an object which was ingested again is stale and must
+  // be skipped, otherwise the object could be deduped against itself.
+  //---------------------------------------------------------------------------
+  int Background::process_all_slabs(librados::IoCtx &ioctx,
+                                    dedup_table_t *p_table,
                                     dedup_step_t step,
                                     md5_shard_t md5_shard,
                                     work_shard_t worker_id,
                                     uint32_t *p_slab_count,
                                     md5_stats_t *p_stats, /* IN-OUT */
                                     disk_block_seq_t *p_disk_block_seq,
-                                    remapper_t *remapper)
+                                    remapper_t *remapper,
+                                    std::unordered_set<std::string> *p_delta_objs,
+                                    spill_runs_t *p_spill)
   {
+    const bool baseline_slabs = (worker_id == BASELINE_WORK_SHARD);
     char block_buff[sizeof(disk_block_t)];
     const int MAX_OBJ_LOAD_FAILURE = 3;
     const int MAX_BAD_BLOCKS = 2;
@@ -1388,7 +2006,7 @@ namespace rgw::dedup {
     *p_slab_count = 0;
     while (has_more) {
       bufferlist bl;
-      int ret = load_slab(d_dedup_cluster_ioctx, bl, md5_shard, worker_id, seq_number, dpp);
+      int ret = load_slab(ioctx, bl, md5_shard, worker_id, seq_number, dpp);
       if (unlikely(ret < 0)) {
         ldpp_dout(dpp, 1) << __func__ << "::ERR::Failed loading object!! md5_shard=" << md5_shard
                           << ", worker_id=" << worker_id << ", seq_number=" << seq_number
@@ -1447,8 +2065,26 @@ namespace rgw::dedup {
             return ret;
           }
 
+          if (p_delta_objs) {
+            if (baseline_slabs) {
+              if (p_delta_objs->contains(record_identity(&rec))) {
+                continue;
+              }
+            }
+            else if (step == STEP_BUILD_TABLE) {
+              p_delta_objs->insert(record_identity(&rec));
+            }
+          }
+
           if (step == STEP_BUILD_TABLE) {
-            add_record_to_dedup_table(p_table, &rec, disk_block_id, rec_id, p_stats, remapper);
+            bool delta = (d_incremental && !baseline_slabs);
+            add_record_to_dedup_table(p_table, &rec, disk_block_id, rec_id, delta,
+                                      p_stats, remapper, p_spill);
+            if (p_disk_block_seq) {
+              // carry the record to the baseline of the next scan
+              disk_block_seq_t::record_info_t rec_info;
+              p_disk_block_seq->add_record(d_next_baseline_ioctx, &rec, &rec_info);
+            }
             slab_rec_count++;
           }
 #ifdef FULL_DEDUP_SUPPORT
@@ -1462,6 +2098,10 @@ namespace rgw::dedup {
                                 p_stats, remapper);
             slab_rec_count++;
           }
+          else if (step == STEP_CHUNK_DEDUP) {
+            chunk_dedup_record(p_table, &rec, p_stats, remapper);
+            slab_rec_count++;
+          }
 #endif // #ifdef FULL_DEDUP_SUPPORT
           else {
             ceph_abort("unexpected step");
@@ -1550,7 +2190,7 @@ namespace rgw::dedup {
         p_worker_stats->ingress_skip_too_small++;
         p_worker_stats->ingress_skip_too_small_bytes += ondisk_byte_size;
 
-        if (ondisk_byte_size >= 64*1024) {
+        if (ondisk_byte_size >= MIN_SMALL_OBJ_DEDUP_SIZE) {
           p_worker_stats->ingress_skip_too_small_64KB++;
           p_worker_stats->ingress_skip_too_small_64KB_bytes += ondisk_byte_size;
         }
@@ -1621,6 +2261,161 @@ namespace rgw::dedup {
     return next_shard;
   }
 
+  // The sample is taken by hashing the bucket-index shard name so every copy of
+  // an object has the same probability to be sampled regardless of its bucket
+  //---------------------------------------------------------------------------
+  static bool bucket_index_shard_in_sample(const std::string &bucket_key,
+                                           uint32_t shard,
+                                           uint32_t sample_percent)
+  {
+    const std::string key = bilog_pos_key(bucket_key, shard);
+    return (ceph_str_hash_rjenkins(key.c_str(), key.size()) % 100) < sample_percent;
+  }
+
+  //---------------------------------------------------------------------------
+  static bool skip_dirent(const DoutPrefixProvider   *dpp,
+                          const rgw::sal::Bucket     *bucket,
+                          const rgw_bucket_dir_entry &dirent)
+  {
+    if (unlikely((!dirent.exists && !dirent.is_delete_marker()) || !dirent.pending_map.empty())) {
+      // TBD: should we bailout ???
+      ldpp_dout(dpp, 1) << __func__ << "::ERR: bad dirent::" << bucket->get_name()
+                        << "/" << dirent.key.name << "::instance="
+                        << dirent.key.instance << dendl;
+      return true;
+    }
+    else if (unlikely(dirent.is_delete_marker())) {
+      ldpp_dout(dpp, 20) << __func__ << "::skip delete_marker::" << bucket->get_name()
+                         << "/" << dirent.key.name << "::instance="
+                         << dirent.key.instance << dendl;
+      return true;
+    }
+    return false;
+  }
+
+  // Ingest the objects added to a bucket-index shard since @prev_pos
+  // The shard is skipped when its header version didn't change.
+  // Returns -ERANGE when the log was trimmed beyond @prev_pos (or was never
+  //   written) and the caller must fallback to a full listing of the shard
+  //---------------------------------------------------------------------------
+  int Background::ingress_bucket_shard_bilog(disk_block_array_t     &disk_arr,
+                                             const rgw::sal::Bucket *bucket,
+                                             librados::IoCtx        &ioctx,
+                                             const std::string      &oid,
+                                             const bilog_pos_t      &prev_pos,
+                                             bilog_pos_t            *p_next_pos, /* OUT */
+                                             worker_stats_t         *p_worker_stats)
+  {
+    const rgw_obj_index_key null_marker;
+    const string null_prefix, null_delimiter;
+    const bool list_versions = true;
+    const int max_entries = 1000;
+    rgw_cls_list_ret list_ret;
+    cls_rgw_bi_log_list_ret first_ret, log_ret;
+    librados::ObjectReadOperation op;
+    d_ctl.bucket_index_throttle.acquire();
+    // a single entry listing is used for reading the shard header
+    cls_rgw_bucket_list_op(op, null_marker, null_prefix, null_delimiter, 1,
+                           list_versions, &list_ret);
+    cls_rgw_bilog_list(op, "", 1, &first_ret);
+    cls_rgw_bilog_list(op, prev_pos.marker, max_entries, &log_ret);
+    int ret = rgw_rados_operate(dpp, ioctx, oid, std::move(op), nullptr, null_yield);
+    if (unlikely(ret < 0)) {
+      ldpp_dout(dpp, 1) << __func__ << "::ERR: failed rgw_rados_operate() ret="
+                        << ret << "::" << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+
+    const rgw_bucket_dir_header &header = list_ret.dir.header;
+    if (header.ver == prev_pos.ver) {
+      ldpp_dout(dpp, 20) << __func__ << "::unchanged shard::" << oid << dendl;
+      p_worker_stats->ingress_skip_unchanged_shards++;
+      *p_next_pos = prev_pos;
+      return 0;
+    }
+    // bilog trim removes the oldest entries, so as long as our marker is not
+    // older than the first entry we didn't miss any change
+    if (prev_pos.marker.empty() || first_ret.entries.empty() ||
+        first_ret.entries.front().id > prev_pos.marker) {
+      ldpp_dout(dpp, 10) << __func__ << "::bilog was trimmed::" << oid << dendl;
+      return -ERANGE;
+    }
+
+    p_next_pos->ver = header.ver;
+    p_next_pos->marker = prev_pos.marker;
+    // the same object could be logged multiple times
+    std::set<rgw_obj_index_key> keys;
+    while (true) {
+      for (const auto &entry : log_ret.entries) {
+        p_next_pos->marker = entry.id;
+        p_worker_stats->ingress_bilog_entries++;
+        if (entry.op == CLS_RGW_OP_ADD && entry.state == CLS_RGW_STATE_COMPLETE) {
+          keys.emplace(entry.object, entry.instance);
+        }
+      }
+      if (!log_ret.truncated) {
+        break;
+      }
+
+      if (unlikely(d_ctl.should_pause())) {
+        handle_pause_req(__func__);
+      }
+      if (unlikely(d_ctl.should_stop())) {
+        return -ECANCELED;
+      }
+      librados::ObjectReadOperation log_op;
+      log_ret = cls_rgw_bi_log_list_ret();
+      d_ctl.bucket_index_throttle.acquire();
+      cls_rgw_bilog_list(log_op, p_next_pos->marker, max_entries, &log_ret);
+      ret = rgw_rados_operate(dpp, ioctx, oid, std::move(log_op), nullptr, null_yield);
+      if (unlikely(ret < 0)) {
+        ldpp_dout(dpp, 1) << __func__ << "::ERR: failed rgw_rados_operate() ret="
+                          << ret << "::" << cpp_strerror(-ret) << dendl;
+        return ret;
+      }
+    }
+
+    ldpp_dout(dpp, 20) << __func__ << "::" << oid << "::changed objs="
+                       << keys.size() << dendl;
+    for (const auto &key : keys) {
+      check_and_update_worker_heartbeat(disk_arr.d_worker_id, p_worker_stats->ingress_obj);
+      if (unlikely(d_ctl.should_pause())) {
+        handle_pause_req(__func__);
+      }
+      if (unlikely(d_ctl.should_stop())) {
+        return -ECANCELED;
+      }
+
+      rgw_cls_bi_entry bi_entry;
+      d_ctl.bucket_index_throttle.acquire();
+      ret = cls_rgw_bi_get(ioctx, oid, BIIndexType::Instance, key, &bi_entry);
+      if (ret == -ENOENT) {
+        // the object was removed after it was logged
+        continue;
+      }
+      else if (unlikely(ret < 0)) {
+        ldpp_dout(dpp, 1) << __func__ << "::ERR: failed cls_rgw_bi_get() ret="
+                          << ret << "::" << cpp_strerror(-ret) << dendl;
+        return ret;
+      }
+
+      rgw_bucket_dir_entry dirent;
+      try {
+        auto p = bi_entry.data.cbegin();
+        decode(dirent, p);
+      } catch (const buffer::error&) {
+        ldpp_dout(dpp, 1) << __func__ << "::ERR: failed dirent decode::"
+                          << bucket->get_name() << "/" << key.name << dendl;
+        continue;
+      }
+      if (skip_dirent(dpp, bucket, dirent)) {
+        continue;
+      }
+      ingress_bucket_idx_single_object(disk_arr, bucket, dirent, p_worker_stats);
+    }
+    return 0;
+  }
+
   // This function process bucket-index shards of a given @bucket
   // The bucket-index-shards are stored in a group of @oids
   // The @oids are using a simple map from the shard-id to the oid holding bucket-indices
@@ -1645,6 +2440,17 @@ namespace rgw::dedup {
     const bool list_versions = true;
     const int max_entries = 1000;
     uint32_t obj_count = 0;
+    // bucket-index positions of the previous scan and of this scan
+    const std::string bucket_key = bucket->get_key().get_key();
+    std::map<std::string, bilog_pos_t> prev_pos_map, next_pos_map;
+    if (d_incremental && current_shard < num_shards) {
+      std::set<std::string> keys;
+      for (uint32_t shard = current_shard; shard < num_shards; shard += num_work_shards) {
+        keys.insert(bilog_pos_key(bucket_key, shard));
+      }
+      // a missing position forces a full listing of the shard
+      read_bilog_pos(d_prev_baseline_ioctx, worker_id, keys, &prev_pos_map, dpp);
+    }
 
     while (current_shard < num_shards ) {
       check_and_update_worker_heartbeat(worker_id, p_worker_stats->ingress_obj);
@@ -1656,6 +2462,33 @@ namespace rgw::dedup {
       }
 
       const string& oid = oids[current_shard];
+      const bool first_page = marker.empty();
+      if (d_sample_percent < 100 && first_page &&
+          !bucket_index_shard_in_sample(bucket_key, current_shard, d_sample_percent)) {
+        p_worker_stats->ingress_skip_unsampled_shards++;
+        current_shard = move_to_next_bucket_index_shard(dpp, current_shard, num_work_shards,
+                                                        bucket->get_name(), &marker);
+        continue;
+      }
+      if (d_keep_baseline && first_page) {
+        const std::string pos_key = bilog_pos_key(bucket_key, current_shard);
+        auto itr = prev_pos_map.find(pos_key);
+        if (itr != prev_pos_map.end()) {
+          bilog_pos_t next_pos;
+          int ret = ingress_bucket_shard_bilog(disk_arr, bucket, ioctx, oid,
+                                               itr->second, &next_pos, p_worker_stats);
+          if (ret == 0) {
+            next_pos_map[pos_key] = next_pos;
+            current_shard = move_to_next_bucket_index_shard(dpp, current_shard, num_work_shards,
+                                                            bucket->get_name(), &marker);
+            continue;
+          }
+          else if (ret == -ECANCELED) {
+            return ret;
+          }
+          // fallback to a full listing of the shard
+        }
+      }
       rgw_cls_list_ret result;
       librados::ObjectReadOperation op;
       d_ctl.bucket_index_throttle.acquire();
@@ -1670,6 +2503,12 @@ namespace rgw::dedup {
                                                         bucket->get_name(), &marker);
         continue;
       }
+      if (d_keep_baseline && first_page) {
+        // changes made after this point will be ingested by the next scan
+        const rgw_bucket_dir_header &header = result.dir.header;
+        next_pos_map[bilog_pos_key(bucket_key, current_shard)] =
+          bilog_pos_t{header.max_marker, header.ver};
+      }
       obj_count += result.dir.m.size();
       for (auto& entry : result.dir.m) {
         const rgw_bucket_dir_entry& dirent = entry.second;
@@ -1677,15 +2516,7 @@ namespace rgw::dedup {
         marker = dirent.key;
         ldpp_dout(dpp, 20) << __func__ << "::dirent = " << bucket->get_name() << "/"
                            << marker.name << "::instance=" << marker.instance << dendl;
-        if (unlikely((!dirent.exists && !dirent.is_delete_marker()) || !dirent.pending_map.empty())) {
-          // TBD: should we bailout ???
-          ldpp_dout(dpp, 1) << __func__ << "::ERR: bad dirent::" << bucket->get_name()
-                            << "/" << marker.name << "::instance=" << marker.instance << dendl;
-          continue;
-        }
-        else if (unlikely(dirent.is_delete_marker())) {
-          ldpp_dout(dpp, 20) << __func__ << "::skip delete_marker::" << bucket->get_name()
-                             << "/" << marker.name << "::instance=" << marker.instance << dendl;
+        if (skip_dirent(dpp, bucket, dirent)) {
           continue;
         }
         ret = ingress_bucket_idx_single_object(disk_arr, bucket, dirent, p_worker_stats);
@@ -1703,6 +2534,9 @@ namespace rgw::dedup {
                            << obj_count << "::new_shard=" << current_shard << dendl;
       }
     }
+    if (d_keep_baseline) {
+      write_bilog_pos(d_next_baseline_ioctx, worker_id, next_pos_map, dpp);
+    }
     ldpp_dout(dpp, 15) << __func__ << "::Finished processing Bucket "
                        << bucket->get_name() << ", num_shards=" << num_shards
                        << ", obj_count=" << obj_count << dendl;
@@ -1784,18 +2618,58 @@ namespace rgw::dedup {
                                                 &p_stats->failed_map_overflow);
     ceph_assert(sc_idx == 0);
     uint32_t slab_count_arr[num_work_shards];
+    std::unordered_set<std::string> delta_objs;
+    std::unordered_set<std::string> *p_delta_objs = (d_incremental ? &delta_objs : nullptr);
+    // removes leftover runs when the shard processing is aborted
+    spill_runs_t spill(dpp, d_dedup_cluster_ioctx, md5_shard);
     // first load all etags to hashtable to find dedups
     // the entries come from bucket-index and got minimal info (etag, size)
-    for (work_shard_t worker_id = 0; worker_id < num_work_shards; worker_id++) {
-      process_all_slabs(p_table, STEP_BUILD_TABLE, md5_shard, worker_id,
-                        slab_count_arr+worker_id, p_stats, nullptr, &remapper);
-      if (unlikely(d_ctl.should_stop())) {
-        ldpp_dout(dpp, 5) << __func__ << "::STEP_BUILD_TABLE::STOPPED\n" << dendl;
-        return -ECANCELED;
+    {
+      // the fastlane records are copied to the baseline of the next scan
+      std::unique_ptr<disk_block_t[]> baseline_arr;
+      std::optional<disk_block_seq_t> baseline_seq;
+      worker_stats_t wstat;
+      if (d_keep_baseline) {
+        baseline_arr = std::make_unique<disk_block_t[]>(DISK_BLOCK_COUNT);
+        baseline_seq.emplace(dpp, baseline_arr.get(), BASELINE_WORK_SHARD,
+                             md5_shard, &wstat);
+      }
+      disk_block_seq_t *p_baseline_seq = (baseline_seq ? &*baseline_seq : nullptr);
+      for (work_shard_t worker_id = 0; worker_id < num_work_shards; worker_id++) {
+        process_all_slabs(d_dedup_cluster_ioctx, p_table, STEP_BUILD_TABLE, md5_shard,
+                          worker_id, slab_count_arr+worker_id, p_stats,
+                          p_baseline_seq, &remapper, p_delta_objs, &spill);
+        if (unlikely(d_ctl.should_stop())) {
+          ldpp_dout(dpp, 5) << __func__ << "::STEP_BUILD_TABLE::STOPPED\n" << dendl;
+          return -ECANCELED;
+        }
       }
+      if (d_incremental) {
+        // must come after the new records so stale baseline records are skipped
+        uint32_t baseline_slab_count = 0;
+        process_all_slabs(d_prev_baseline_ioctx, p_table, STEP_BUILD_TABLE, md5_shard,
+                          BASELINE_WORK_SHARD, &baseline_slab_count, p_stats,
+                          p_baseline_seq, &remapper, p_delta_objs, &spill);
+        if (unlikely(d_ctl.should_stop())) {
+          ldpp_dout(dpp, 5) << __func__ << "::STEP_BUILD_TABLE::STOPPED\n" << dendl;
+          return -ECANCELED;
+        }
+      }
+      if (p_baseline_seq) {
+        p_baseline_seq->flush_disk_records(d_next_baseline_ioctx);
+      }
+    }
+    if (spill.runs_count() > 0) {
+      // the duplicates are counted while merging the runs, only entries which
+      // could still be deduped are loaded back to the table
+      const bool load_table = (d_ctl.dedup_type == dedup_req_type_t::DEDUP_TYPE_EXEC);
+      const bool keep_singletons = (d_cdc != nullptr);
+      spill.merge_runs(p_table, load_table, keep_singletons, d_incremental, p_stats);
+    }
+    else {
+      p_table->count_duplicates(&p_stats->small_objs_stat, &p_stats->big_objs_stat,
+                                &p_stats->dup_head_bytes_estimate);
     }
-    p_table->count_duplicates(&p_stats->small_objs_stat, &p_stats->big_objs_stat,
-                              &p_stats->dup_head_bytes_estimate);
     display_table_stat_counters(dpp, p_stats);
 
     ldpp_dout(dpp, 10) << __func__ << "::MD5 Loop::" << d_ctl.dedup_type << dendl;
@@ -1811,7 +2685,25 @@ namespace rgw::dedup {
     return 0;
 #endif
 
-    p_table->remove_singletons_and_redistribute_keys();
+    if (d_cdc) {
+      // must run before the singletons are purged from the table
+      // on incremental scans the baseline singletons were chunked by earlier runs
+      ldpp_dout(dpp, 10) << __func__ << "::STEP_CHUNK_DEDUP::started..." << dendl;
+      for (work_shard_t worker_id = 0; worker_id < num_work_shards; worker_id++) {
+        uint32_t slab_count = 0;
+        process_all_slabs(d_dedup_cluster_ioctx, p_table, STEP_CHUNK_DEDUP, md5_shard,
+                          worker_id, &slab_count, p_stats, nullptr, &remapper, nullptr,
+                          nullptr);
+        if (unlikely(d_ctl.should_stop())) {
+          ldpp_dout(dpp, 5) << __func__ << "::STEP_CHUNK_DEDUP::STOPPED\n" << dendl;
+          return -ECANCELED;
+        }
+      }
+      ldpp_dout(dpp, 10) << __func__ << "::STEP_CHUNK_DEDUP::finished..." << dendl;
+    }
+
+    // on incremental scans only duplicates with a new copy are processed
+    p_table->remove_singletons_and_redistribute_keys(d_incremental);
     // The SLABs holds minimal data set brought from the bucket-index
     // Objects participating in DEDUP need to read attributes from the Head-Object
     // TBD  - find a better name than num_work_shards for the combined output
@@ -1820,8 +2712,9 @@ namespace rgw::dedup {
       worker_stats_t wstat;
       disk_block_seq_t disk_block_seq(dpp, arr, num_work_shards, md5_shard, &wstat);
       for (work_shard_t worker_id = 0; worker_id < num_work_shards; worker_id++) {
-        process_all_slabs(p_table, STEP_READ_ATTRIBUTES, md5_shard, worker_id,
-                          slab_count_arr+worker_id, p_stats, &disk_block_seq, &remapper);
+        process_all_slabs(d_dedup_cluster_ioctx, p_table, STEP_READ_ATTRIBUTES,
+                          md5_shard, worker_id, slab_count_arr+worker_id, p_stats,
+                          &disk_block_seq, &remapper, p_delta_objs, nullptr);
         if (unlikely(d_ctl.should_stop())) {
           ldpp_dout(dpp, 5) << __func__ << "::STEP_READ_ATTRIBUTES::STOPPED\n" << dendl;
           return -ECANCELED;
@@ -1829,13 +2722,26 @@ namespace rgw::dedup {
         // we finished processing output SLAB from @worker_id -> remove them
         remove_slabs(worker_id, md5_shard, slab_count_arr[worker_id]);
       }
+      if (d_incremental) {
+        // the baseline SLABs are removed after the new baseline is committed
+        uint32_t baseline_slab_count = 0;
+        process_all_slabs(d_prev_baseline_ioctx, p_table, STEP_READ_ATTRIBUTES,
+                          md5_shard, BASELINE_WORK_SHARD, &baseline_slab_count,
+                          p_stats, &disk_block_seq, &remapper, p_delta_objs,
+                          nullptr);
+        if (unlikely(d_ctl.should_stop())) {
+          ldpp_dout(dpp, 5) << __func__ << "::STEP_READ_ATTRIBUTES::STOPPED\n" << dendl;
+          return -ECANCELED;
+        }
+      }
       disk_block_seq.flush_disk_records(d_dedup_cluster_ioctx);
     }
 
     ldpp_dout(dpp, 10) << __func__ << "::STEP_REMOVE_DUPLICATES::started..." << dendl;
     uint32_t slab_count = 0;
-    process_all_slabs(p_table, STEP_REMOVE_DUPLICATES, md5_shard, num_work_shards,
-                      &slab_count, p_stats, nullptr, &remapper);
+    process_all_slabs(d_dedup_cluster_ioctx, p_table, STEP_REMOVE_DUPLICATES, md5_shard,
+                      num_work_shards, &slab_count, p_stats, nullptr, &remapper, nullptr,
+                      nullptr);
     if (unlikely(d_ctl.should_stop())) {
       ldpp_dout(dpp, 5) << __func__ << "::STEP_REMOVE_DUPLICATES::STOPPED\n" << dendl;
       return -ECANCELED;
@@ -2076,7 +2982,14 @@ namespace rgw::dedup {
     utime_t start_time = ceph_clock_now();
     md5_stats_t md5_stats;
     //DEDUP_DYN_ALLOC
-    dedup_table_t table(dpp, d_head_object_size, raw_mem, raw_mem_size);
+    uint64_t table_size = raw_mem_size;
+    const uint64_t debug_entries = cct->_conf.get_val<uint64_t>("rgw_dedup_debug_table_entries");
+    if (unlikely(debug_entries)) {
+      // a tiny table forces a spill on small systems
+      table_size = std::min(table_size, debug_entries * sizeof(dedup_table_t::table_entry_t));
+    }
+    dedup_table_t table(dpp, d_head_object_size, raw_mem, table_size);
+    table.set_small_object_dedup(d_small_obj_dedup);
     int ret = objects_dedup_single_md5_shard(&table, md5_shard, &md5_stats, num_work_shards);
     if (ret == 0) {
       md5_stats.duration = ceph_clock_now() - start_time;
@@ -2222,6 +3135,144 @@ namespace rgw::dedup {
     }
   }
 
+  //---------------------------------------------------------------------------
+  int Background::setup_baseline(const dedup_epoch_t *p_epoch,
+                                 const baseline_state_t *p_prev_baseline)
+  {
+    d_keep_baseline = p_epoch->incremental;
+    d_incremental   = false;
+    if (!d_keep_baseline) {
+      // a full scan removes the dedup pool at the end (including the baseline)
+      return 0;
+    }
+
+    int ret = open_baseline_ioctx(d_dedup_cluster_ioctx, p_epoch->serial,
+                                  d_next_baseline_ioctx, dpp);
+    if (unlikely(ret != 0)) {
+      return ret;
+    }
+
+    if (!p_prev_baseline) {
+      ldpp_dout(dpp, 5) << __func__ << "::no baseline, using a full scan" << dendl;
+      return 0;
+    }
+    // the baseline SLABs must use the same layout as the current scan
+    if (p_prev_baseline->num_md5_shards != p_epoch->num_md5_shards ||
+        p_prev_baseline->num_work_shards != p_epoch->num_work_shards ||
+        p_prev_baseline->serial >= p_epoch->serial) {
+      ldpp_dout(dpp, 5) << __func__ << "::incompatible " << *p_prev_baseline
+                        << ", using a full scan" << dendl;
+      return 0;
+    }
+
+    ret = open_baseline_ioctx(d_dedup_cluster_ioctx, p_prev_baseline->serial,
+                              d_prev_baseline_ioctx, dpp);
+    if (unlikely(ret != 0)) {
+      return ret;
+    }
+    d_prev_baseline = *p_prev_baseline;
+    d_incremental = true;
+    ldpp_dout(dpp, 5) << __func__ << "::incremental scan on top of "
+                      << d_prev_baseline << dendl;
+    return 0;
+  }
+
+  // Make the baseline created by this scan the base of the next incremental scan
+  //---------------------------------------------------------------------------
+  int Background::commit_baseline(const dedup_epoch_t *p_epoch)
+  {
+    baseline_state_t new_baseline = { p_epoch->serial, ceph_clock_now(),
+                                      p_epoch->num_work_shards,
+                                      p_epoch->num_md5_shards };
+    const baseline_state_t *p_old = (d_incremental ? &d_prev_baseline : nullptr);
+    int ret = commit_baseline_state(d_dedup_cluster_ioctx, p_old, new_baseline, dpp);
+    if (ret == -ECANCELED && !d_incremental) {
+      // a baseline we didn't use was left by an older scan, replace it
+      baseline_state_t old_baseline;
+      if (read_baseline_state(d_dedup_cluster_ioctx, &old_baseline, dpp) == 0 &&
+          old_baseline.serial < new_baseline.serial) {
+        ret = commit_baseline_state(d_dedup_cluster_ioctx, &old_baseline,
+                                    new_baseline, dpp);
+      }
+    }
+    if (ret == 0) {
+      // the winner removes the old baseline and leftovers from aborted scans
+      remove_stale_baselines(d_dedup_cluster_ioctx, p_epoch->serial, dpp);
+    }
+    return ret;
+  }
+
+#ifdef FULL_DEDUP_SUPPORT
+  //---------------------------------------------------------------------------
+  // The OSD refuses set_chunk() on objects of an erasure coded pool
+  static bool has_ec_data_pool(const DoutPrefixProvider *dpp,
+                               rgw::sal::RadosStore     *store,
+                               librados::Rados          *rados_handle)
+  {
+    const auto& zone_params = store->svc()->zone->get_zone_params();
+    for (const auto& [id, placement] : zone_params.placement_pools) {
+      for (const auto& [sc, storage_class] : placement.storage_classes.get_all()) {
+        if (!storage_class.data_pool) {
+          continue;
+        }
+        const std::string& pool_name = storage_class.data_pool->name;
+        // replicated pools have no erasure code profile
+        int ret = rados_handle->mon_command(
+          "{\"prefix\": \"osd pool get\", \"pool\": \"" + pool_name +
+          "\", \"var\": \"erasure_code_profile\"}", {}, nullptr, nullptr);
+        if (ret == 0) {
+          ldpp_dout(dpp, 1) << __func__ << "::data pool " << pool_name
+                            << " (" << id << "/" << sc << ") is erasure coded"
+                            << dendl;
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+#endif
+
+  // The chunk mode is optional and any failure to set it up only disables it
+  //---------------------------------------------------------------------------
+  void Background::setup_chunk_dedup()
+  {
+    d_cdc.reset();
+    d_chunk_ioctx.close();
+#ifdef FULL_DEDUP_SUPPORT
+    if (d_ctl.dedup_type != dedup_req_type_t::DEDUP_TYPE_EXEC) {
+      return;
+    }
+    const auto pool_name = cct->_conf.get_val<std::string>("rgw_dedup_chunk_pool");
+    if (pool_name.empty()) {
+      return;
+    }
+    if (has_ec_data_pool(dpp, store, rados_handle)) {
+      ldpp_dout(dpp, 1) << __func__ << "::ERR: chunk mode doesn't support "
+                        << "erasure coded data pools, chunk mode is disabled"
+                        << dendl;
+      return;
+    }
+
+    int ret = rados_handle->ioctx_create(pool_name.c_str(), d_chunk_ioctx);
+    if (unlikely(ret != 0)) {
+      ldpp_dout(dpp, 1) << __func__ << "::ERR: failed ioctx_create(" << pool_name
+                        << "), chunk mode is disabled::" << cpp_strerror(-ret) << dendl;
+      return;
+    }
+    const auto algo = cct->_conf.get_val<std::string>("rgw_dedup_chunk_algorithm");
+    const uint64_t chunk_size = cct->_conf.get_val<Option::size_t>("rgw_dedup_chunk_size");
+    d_cdc = CDC::create(algo, cbits(chunk_size) - 1);
+    if (unlikely(!d_cdc)) {
+      ldpp_dout(dpp, 1) << __func__ << "::ERR: bad chunk algorithm " << algo
+                        << ", chunk mode is disabled" << dendl;
+      d_chunk_ioctx.close();
+      return;
+    }
+    ldpp_dout(dpp, 5) << __func__ << "::chunk_pool=" << pool_name << "::algo="
+                      << algo << "::chunk_size=" << chunk_size << dendl;
+#endif
+  }
+
   //---------------------------------------------------------------------------
   int Background::setup(dedup_epoch_t *p_epoch)
   {
@@ -2231,14 +3282,22 @@ namespace rgw::dedup {
     }
 
     md5_shard_t num_md5_shards = calc_num_md5_shards(d_all_buckets_obj_count);
-    num_md5_shards = std::min(num_md5_shards, MAX_MD5_SHARD);
+    // every md5 shard adds 2MB to the memory allocated by each RGW.
+    // With a memory limit the shards may hold more objects than the table can
+    // fit and the table is spilled to the dedup pool
+    md5_shard_t max_md5_shards = MAX_MD5_SHARD;
+    const uint64_t mem_limit = cct->_conf.get_val<Option::size_t>("rgw_dedup_memory_limit");
+    if (mem_limit) {
+      const uint64_t per_shard_size = DISK_BLOCK_COUNT * sizeof(disk_block_t);
+      max_md5_shards = (md5_shard_t)std::clamp<uint64_t>(mem_limit / per_shard_size,
+                                                         MIN_MD5_SHARD, MAX_MD5_SHARD);
+    }
+    num_md5_shards = std::min(num_md5_shards, max_md5_shards);
     num_md5_shards = std::max(num_md5_shards, MIN_MD5_SHARD);
     work_shard_t num_work_shards = num_md5_shards;
-    num_work_shards = std::min(num_work_shards, MAX_WORK_SHARD);
+    // the last worker-id is reserved for the incremental baseline SLABs
+    num_work_shards = std::min(num_work_shards, (work_shard_t)(BASELINE_WORK_SHARD - 1));
 
-    ldpp_dout(dpp, 5) << __func__ << "::obj_count=" <<d_all_buckets_obj_count
-                      << "::num_md5_shards=" << num_md5_shards
-                      << "::num_work_shards=" << num_work_shards << dendl;
     // init handles and create the dedup_pool
     ret = init_rados_access_handles(true);
     if (ret != 0) {
@@ -2248,6 +3307,19 @@ namespace rgw::dedup {
     }
     display_ioctx_state(dpp, d_dedup_cluster_ioctx, __func__);
 
+    baseline_state_t prev_baseline;
+    bool has_baseline = (read_baseline_state(d_dedup_cluster_ioctx, &prev_baseline, dpp) == 0);
+    if (has_baseline && num_md5_shards <= prev_baseline.num_md5_shards &&
+        prev_baseline.num_md5_shards <= max_md5_shards &&
+        prev_baseline.num_work_shards < BASELINE_WORK_SHARD) {
+      // keep the baseline layout so an incremental scan could use it
+      num_md5_shards  = prev_baseline.num_md5_shards;
+      num_work_shards = prev_baseline.num_work_shards;
+    }
+    ldpp_dout(dpp, 5) << __func__ << "::obj_count=" <<d_all_buckets_obj_count
+                      << "::num_md5_shards=" << num_md5_shards
+                      << "::num_work_shards=" << num_work_shards << dendl;
+
     ret = d_cluster.reset(store, p_epoch, num_work_shards, num_md5_shards);
     if (ret != 0) {
       ldpp_dout(dpp, 1) << __func__ << "::ERR: failed cluster.init()" << dendl;
@@ -2270,7 +3342,23 @@ namespace rgw::dedup {
     }
 
     ldpp_dout(dpp, 10) <<__func__ << "::" << *p_epoch << dendl;
+    ret = setup_baseline(p_epoch, has_baseline ? &prev_baseline : nullptr);
+    if (ret != 0) {
+      return ret;
+    }
     d_ctl.dedup_type = p_epoch->dedup_type;
+    // small objects are only loaded into the table when they are deduped
+    d_small_obj_dedup = (d_ctl.dedup_type == dedup_req_type_t::DEDUP_TYPE_EXEC &&
+                         cct->_conf.get_val<bool>("rgw_dedup_small_objects"));
+    // sampling is only allowed on estimate scans (validated by the admin cmd)
+    d_sample_percent = 100;
+    if (d_ctl.dedup_type == dedup_req_type_t::DEDUP_TYPE_ESTIMATE &&
+        !p_epoch->incremental && p_epoch->sample_percent > 0) {
+      d_sample_percent = std::min(p_epoch->sample_percent, 100U);
+    }
+    // read the AIO window on every scan so a config change applies to the next one
+    d_verify_max_aio = std::max<uint64_t>(
+      cct->_conf.get_val<uint64_t>("rgw_dedup_verify_max_aio"), 1);
 #ifdef FULL_DEDUP_SUPPORT
     ceph_assert(d_ctl.dedup_type == dedup_req_type_t::DEDUP_TYPE_EXEC ||
                 d_ctl.dedup_type == dedup_req_type_t::DEDUP_TYPE_ESTIMATE);
@@ -2278,6 +3366,7 @@ namespace rgw::dedup {
     ceph_assert(d_ctl.dedup_type == dedup_req_type_t::DEDUP_TYPE_ESTIMATE);
 #endif
     ldpp_dout(dpp, 10) << __func__ << "::" << d_ctl.dedup_type << dendl;
+    setup_chunk_dedup();
 
     return 0;
   }
@@ -2713,7 +3802,13 @@ namespace rgw::dedup {
                                RAW_MEM_SIZE, num_work_shards, num_md5_shards);
             // Wait for all other md5 shards to finish
             md5_shards_barrier(num_md5_shards);
-            safe_pool_delete(store, dpp, pool_id);
+            if (!d_keep_baseline) {
+              safe_pool_delete(store, dpp, pool_id);
+            }
+            else if (!d_ctl.should_stop()) {
+              // keep the pool with the baseline for the next incremental scan
+              commit_baseline(&epoch);
+            }
           }
           else {
             ldpp_dout(dpp, 5) <<__func__ << "::stop req from barrier" << dendl;
@@ -14,13 +14,17 @@
 
 #pragma once
 #include "common/dout.h"
+#include "common/CDC.h"
 #include "rgw_common.h"
 #include "rgw_dedup_utils.h"
 #include "rgw_dedup_table.h"
 #include "rgw_dedup_cluster.h"
+#include "rgw_dedup_incremental.h"
+#include "rgw_dedup_spill.h"
 #include "rgw_realm_reloader.h"
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <variant>
 #include <iostream>
 #include <ostream>
@@ -65,6 +69,8 @@ namespace rgw::dedup {
   class disk_block_seq_t;
   struct disk_record_t;
   struct key_t;
+  // set on tail-objects which were split into chunks by the chunk mode
+  constexpr const char* RGW_DEDUP_ATTR_CHUNKED = "rgw.dedup.attr.chunked";
   //Interval between each execution of the script is set to 5 seconds
   static inline constexpr int INIT_EXECUTE_INTERVAL = 5;
   class Background : public RGWRealmReloader::Pauser {
@@ -94,7 +100,8 @@ namespace rgw::dedup {
       STEP_BUCKET_INDEX_INGRESS,
       STEP_BUILD_TABLE,
       STEP_READ_ATTRIBUTES,
-      STEP_REMOVE_DUPLICATES
+      STEP_REMOVE_DUPLICATES,
+      STEP_CHUNK_DEDUP
     };
 
     void run();
@@ -115,6 +122,13 @@ namespace rgw::dedup {
                                           const rgw::sal::Bucket     *bucket,
                                           const rgw_bucket_dir_entry &entry,
                                           worker_stats_t             *p_worker_stats /*IN-OUT*/);
+    int  ingress_bucket_shard_bilog(disk_block_array_t     &disk_arr,
+                                    const rgw::sal::Bucket *bucket,
+                                    librados::IoCtx        &ioctx,
+                                    const std::string      &oid,
+                                    const bilog_pos_t      &prev_pos,
+                                    bilog_pos_t            *p_next_pos, /* OUT */
+                                    worker_stats_t         *p_worker_stats /*IN-OUT*/);
     int  process_bucket_shards(disk_block_array_t &disk_arr,
                                const rgw::sal::Bucket *bucket,
                                std::map<int,std::string> &oids,
@@ -169,17 +183,22 @@ namespace rgw::dedup {
                                   const struct disk_record_t *p_rec,
                                   disk_block_id_t block_id,
                                   record_id_t rec_id,
+                                  bool delta,
                                   md5_stats_t *p_stats,
-                                  remapper_t *remapper);
+                                  remapper_t *remapper,
+                                  spill_runs_t *p_spill);
 
-    int  process_all_slabs(dedup_table_t *p_table,
+    int  process_all_slabs(librados::IoCtx &ioctx,
+                           dedup_table_t *p_table,
                            dedup_step_t step,
                            md5_shard_t md5_shard,
                            work_shard_t work_shard,
                            uint32_t *p_seq_count,
                            md5_stats_t *p_stats /* IN-OUT */,
                            disk_block_seq_t *p_disk_block_arr,
-                           remapper_t *remapper);
+                           remapper_t *remapper,
+                           std::unordered_set<std::string> *p_delta_objs,
+                           spill_runs_t *p_spill);
 
 #ifdef FULL_DEDUP_SUPPORT
     int calc_object_blake3(const disk_record_t *p_rec, uint8_t *p_hash);
@@ -217,9 +236,25 @@ namespace rgw::dedup {
                      const disk_record_t *p_tgt_rec,
                      md5_stats_t         *p_stats,
                      bool                 is_shared_manifest_src);
+    int dedup_small_object(const disk_record_t *p_src_rec,
+                           const disk_record_t *p_tgt_rec,
+                           md5_stats_t         *p_stats,
+                           bool                 has_shared_manifest_src);
+    int evict_tail_object(librados::IoCtx &ioctx, const std::string &oid);
+    int chunk_dedup_tail_object(librados::IoCtx   &ioctx,
+                                const std::string &oid,
+                                md5_stats_t       *p_stats); /* IN-OUT */
+    int chunk_dedup_record(dedup_table_t       *p_table,
+                           const disk_record_t *p_rec,
+                           md5_stats_t         *p_stats, /* IN-OUT */
+                           remapper_t          *remapper);
 #endif
     int  remove_slabs(unsigned worker_id, unsigned md5_shard, uint32_t slab_count);
     int  init_rados_access_handles(bool init_pool);
+    void setup_chunk_dedup();
+    int  setup_baseline(const dedup_epoch_t *p_epoch,
+                        const baseline_state_t *p_prev_baseline);
+    int  commit_baseline(const dedup_epoch_t *p_epoch);
 
     // private data members
     rgw::sal::Driver* driver = nullptr;
@@ -235,9 +270,24 @@ namespace rgw::dedup {
     unsigned d_heart_beat_max_elapsed_sec;
     uint64_t d_all_buckets_obj_count   = 0;
     uint64_t d_all_buckets_obj_size    = 0;
+    // incremental scan state
+    bool d_keep_baseline = false; // create a baseline for the next scan
+    bool d_incremental   = false; // only ingest changes since the prev baseline
+    baseline_state_t d_prev_baseline;
+    librados::IoCtx d_prev_baseline_ioctx;
+    librados::IoCtx d_next_baseline_ioctx;
+    // estimate scans may only read a sample of the bucket-index shards
+    uint32_t d_sample_percent = 100;
+    // chunk mode state (only set on exec sessions with a chunk-pool)
+    librados::IoCtx d_chunk_ioctx;
+    std::unique_ptr<CDC> d_cdc;
     // we don't benefit from deduping RGW objects smaller than head-object size
     uint32_t d_min_obj_size_for_dedup = (4ULL * 1024 * 1024);
     uint32_t d_head_object_size       = (4ULL * 1024 * 1024);
+    // dedup single-part objects stored in the head-object (64KB-4MB)
+    bool d_small_obj_dedup = false;
+    // concurrent rados reads issued by the BLAKE3 calculation of a single object
+    uint32_t d_verify_max_aio = 16;
     control_t d_ctl;
     uint64_t d_watch_handle = 0;
     DedupWatcher d_watcher_ctx;
@@ -30,6 +30,7 @@
 #include "include/denc.h"
 #include "rgw_sal.h"
 #include "driver/rados/rgw_sal_rados.h"
+#include <cmath>
 #include <cstdlib>
 #include <ctime>
 #include <string>
@@ -175,6 +176,8 @@ namespace rgw::dedup {
                         const DoutPrefixProvider *dpp,
                         const dedup_epoch_t *p_old_epoch,
                         dedup_req_type_t dedup_type,
+                        bool incremental,
+                        uint32_t sample_percent,
                         work_shard_t num_work_shards,
                         md5_shard_t num_md5_shards)
   {
@@ -185,7 +188,8 @@ namespace rgw::dedup {
     }
 
     dedup_epoch_t new_epoch = { p_old_epoch->serial + 1, dedup_type,
-                                ceph_clock_now(), num_work_shards, num_md5_shards};
+                                ceph_clock_now(), num_work_shards, num_md5_shards,
+                                incremental, sample_percent};
     bufferlist old_epoch_bl, new_epoch_bl, err_bl;
     encode(*p_old_epoch, old_epoch_bl);
     encode(new_epoch, new_epoch_bl);
@@ -362,6 +366,7 @@ namespace rgw::dedup {
       else {
         ret = swap_epoch(store, dpp, p_epoch,
                          static_cast<dedup_req_type_t> (p_epoch->dedup_type),
+                         p_epoch->incremental, p_epoch->sample_percent,
                          num_work_shards, num_md5_shards);
       }
     }
@@ -962,13 +967,67 @@ namespace rgw::dedup {
     return all_members_time.end_time;
   }
 
+  struct sampled_estimate_t {
+    uint64_t dedup_bytes;
+    uint64_t dedup_bytes_low;
+    uint64_t dedup_bytes_high;
+  };
+
+  // A sampled scan reads a fraction @p of the bucket-index shards, so every
+  // index entry is seen with probability @p and the total is scaled by 1/p.
+  // The number of distinct objects can't be scaled that way: copies in
+  // different shards are sampled independently, but copies sharing a shard
+  // are seen (or missed) together.
+  // We use the GEE estimator (Charikar et al.) which scales the keys seen once
+  // by sqrt(1/p), with the keys seen more than once scaled by 1/p since they
+  // might be such shard-local groups rather than a sample of more copies.
+  // The bounds assume that all/none of the distinct keys have copies outside
+  // of the sample; the low bound is the dedup space of the sample scaled by
+  // 1/p, which is exact when all copies of a key share a shard.
+  // All values are in dedupable bytes (object size minus the head-object).
+  //---------------------------------------------------------------------------
+  static sampled_estimate_t calc_sampled_estimate(const dedup_stats_t &ds,
+                                                  uint32_t sample_percent)
+  {
+    const double p = (double)sample_percent / 100;
+    const double total_bytes   = (ds.singleton_bytes + ds.unique_bytes +
+                                  ds.dedup_bytes_estimate) / p;
+    const double distinct_low  = ds.singleton_bytes + ds.unique_bytes;
+    const double distinct_high = (ds.singleton_bytes + ds.unique_bytes) / p;
+    const double distinct_gee  = ds.singleton_bytes / std::sqrt(p) +
+                                 ds.unique_bytes / p;
+    return { (uint64_t)(total_bytes - distinct_gee),
+             (uint64_t)(total_bytes - distinct_high),
+             (uint64_t)(total_bytes - distinct_low) };
+  }
+
+  //---------------------------------------------------------------------------
+  static void show_sampled_estimate_fmt(const dedup_stats_t &ds,
+                                        uint32_t sample_percent,
+                                        Formatter *fmt)
+  {
+    sampled_estimate_t est = calc_sampled_estimate(ds, sample_percent);
+    Formatter::ObjectSection section{*fmt, "sampled_estimate"};
+    fmt->dump_unsigned("sample_percent", sample_percent);
+    fmt->dump_unsigned("dedup_bytes_estimate", est.dedup_bytes);
+    fmt->dump_unsigned("dedup_bytes_low", est.dedup_bytes_low);
+    fmt->dump_unsigned("dedup_bytes_high", est.dedup_bytes_high);
+  }
+
   //---------------------------------------------------------------------------
   static void show_dedup_ratio_estimate_fmt(const worker_stats_t &wrk_stats_sum,
                                             const md5_stats_t &md5_stats_sum,
+                                            uint32_t sample_percent,
                                             Formatter *fmt)
   {
     uint64_t s3_bytes_before = wrk_stats_sum.ingress_obj_bytes;
     uint64_t s3_dedup_bytes  = md5_stats_sum.big_objs_stat.dedup_bytes_estimate;
+    if (sample_percent < 100) {
+      // scale the sample to the full system
+      s3_bytes_before = (s3_bytes_before * 100) / sample_percent;
+      s3_dedup_bytes  = calc_sampled_estimate(md5_stats_sum.big_objs_stat,
+                                              sample_percent).dedup_bytes;
+    }
     uint64_t s3_bytes_after  = s3_bytes_before - s3_dedup_bytes;
     Formatter::ObjectSection section{*fmt, "dedup_ratio_estimate"};
     fmt->dump_unsigned("s3_bytes_before", s3_bytes_before);
@@ -1100,7 +1159,12 @@ namespace rgw::dedup {
         show_incomplete_shards_fmt(has_incomplete_shards, num_md5_shards, sp_arr, fmt);
         show_time_func_fmt(md5_start_time, show_time, owner_map, fmt);
       }
-      show_dedup_ratio_estimate_fmt(wrk_stats_sum, md5_stats_sum, fmt);
+      if (epoch.sample_percent < 100) {
+        show_sampled_estimate_fmt(md5_stats_sum.big_objs_stat,
+                                  epoch.sample_percent, fmt);
+      }
+      show_dedup_ratio_estimate_fmt(wrk_stats_sum, md5_stats_sum,
+                                    epoch.sample_percent, fmt);
       show_dedup_ratio_actual_fmt(wrk_stats_sum, md5_stats_sum, fmt);
     }
 
@@ -1297,9 +1361,22 @@ namespace rgw::dedup {
   // command-line called from radosgw-admin.cc
   int cluster::dedup_restart_scan(rgw::sal::RadosStore *store,
                                   dedup_req_type_t dedup_type,
+                                  bool incremental,
+                                  uint32_t sample_percent,
                                   const DoutPrefixProvider *dpp)
   {
-    ldpp_dout(dpp, 1) << __func__ << "::dedup_type = " << dedup_type << dendl;
+    ldpp_dout(dpp, 1) << __func__ << "::dedup_type = " << dedup_type
+                      << "::incremental=" << incremental
+                      << "::sample_percent=" << sample_percent << dendl;
+
+    // only an estimate scan can be sampled and it never keeps a baseline
+    if (sample_percent == 0 || sample_percent > 100 ||
+        (sample_percent < 100 &&
+         (dedup_type != dedup_req_type_t::DEDUP_TYPE_ESTIMATE || incremental))) {
+      ldpp_dout(dpp, 1) << __func__ << "::ERR: bad sample_percent="
+                        << sample_percent << dendl;
+      return -EINVAL;
+    }
 
     dedup_epoch_t old_epoch;
     // store the previous epoch for cmp-swap
@@ -1336,7 +1413,8 @@ namespace rgw::dedup {
 #else
     ceph_assert(dedup_type == dedup_req_type_t::DEDUP_TYPE_ESTIMATE);
 #endif
-    ret = swap_epoch(store, dpp, &old_epoch, dedup_type, 0, 0);
+    ret = swap_epoch(store, dpp, &old_epoch, dedup_type, incremental,
+                     sample_percent, 0, 0);
     if (ret == 0) {
       ldpp_dout(dpp, 10) << __func__ << "::Epoch object was reset" << dendl;
       return dedup_control(store, dpp, URGENT_MSG_RESTART);
@@ -101,6 +101,8 @@ namespace rgw::dedup {
                                urgent_msg_t urgent_msg);
     static int   dedup_restart_scan(rgw::sal::RadosStore *store,
                                     dedup_req_type_t dedup_type,
+                                    bool incremental,
+                                    uint32_t sample_percent,
                                     const DoutPrefixProvider *dpp);
 
     //---------------------------------------------------------------------------
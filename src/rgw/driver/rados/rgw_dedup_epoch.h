@@ -30,24 +30,30 @@ namespace rgw::dedup {
     utime_t time;
     uint32_t num_work_shards = 0;
     uint32_t num_md5_shards = 0;
+    // scan only the bucket-index log entries added since the last baseline
+    bool incremental = false;
+    // estimate scans may read only a sample of the bucket-index shards
+    uint32_t sample_percent = 100;
   };
 
   //---------------------------------------------------------------------------
   inline void encode(const dedup_epoch_t& o, ceph::bufferlist& bl)
   {
-    ENCODE_START(1, 1, bl);
+    ENCODE_START(3, 1, bl);
     encode(o.serial, bl);
     encode(static_cast<int32_t>(o.dedup_type), bl);
     encode(o.time, bl);
     encode(o.num_work_shards, bl);
     encode(o.num_md5_shards, bl);
+    encode(o.incremental, bl);
+    encode(o.sample_percent, bl);
     ENCODE_FINISH(bl);
   }
 
   //---------------------------------------------------------------------------
   inline void decode(dedup_epoch_t& o, ceph::bufferlist::const_iterator& bl)
   {
-    DECODE_START(1, bl);
+    DECODE_START(3, bl);
     decode(o.serial, bl);
     int32_t dedup_type;
     decode(dedup_type, bl);
@@ -55,6 +61,18 @@ namespace rgw::dedup {
     decode(o.time, bl);
     decode(o.num_work_shards, bl);
     decode(o.num_md5_shards, bl);
+    if (struct_v >= 2) {
+      decode(o.incremental, bl);
+    }
+    else {
+      o.incremental = false;
+    }
+    if (struct_v >= 3) {
+      decode(o.sample_percent, bl);
+    }
+    else {
+      o.sample_percent = 100;
+    }
     DECODE_FINISH(bl);
   }
 
@@ -67,6 +85,12 @@ namespace rgw::dedup {
     out << ep.dedup_type << "::serial=" << ep.serial;
     out << "::num_work_shards=" << ep.num_work_shards;
     out << "::num_md5_shards=" << ep.num_md5_shards;
+    if (ep.incremental) {
+      out << "::incremental";
+    }
+    if (ep.sample_percent < 100) {
+      out << "::sample_percent=" << ep.sample_percent;
+    }
     return out;
   }
 
@@ -0,0 +1,222 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2;
+// vim: ts=8 sw=2 sts=2 expandtab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Author: Gabriel BenHanokh <gbenhano@redhat.com>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "rgw_dedup_incremental.h"
+#include "include/rados/rados_types.hpp"
+#include "include/rados/buffer.h"
+#include "include/rados/librados.hpp"
+#include "common/errno.h"
+#include <vector>
+
+static constexpr auto dout_subsys = ceph_subsys_rgw_dedup;
+
+namespace rgw::dedup {
+  static constexpr const char* BASELINE_NAMESPACE_PREFIX = "dedup.baseline.";
+  static constexpr const char* BILOG_POS_OBJ_PREFIX = "DEDUP.BILOG.POS.";
+
+  //---------------------------------------------------------------------------
+  static std::string baseline_namespace(uint32_t serial)
+  {
+    return BASELINE_NAMESPACE_PREFIX + std::to_string(serial);
+  }
+
+  //---------------------------------------------------------------------------
+  static std::string bilog_pos_oid(work_shard_t worker_id)
+  {
+    return BILOG_POS_OBJ_PREFIX + std::to_string(worker_id);
+  }
+
+  //---------------------------------------------------------------------------
+  std::string bilog_pos_key(const std::string &bucket_key, uint32_t bidx_shard)
+  {
+    return bucket_key + ":" + std::to_string(bidx_shard);
+  }
+
+  //---------------------------------------------------------------------------
+  int open_baseline_ioctx(const librados::IoCtx    &pool_ioctx,
+                          uint32_t                  serial,
+                          librados::IoCtx          &baseline_ioctx, /* OUT */
+                          const DoutPrefixProvider *dpp)
+  {
+    if (unlikely(!pool_ioctx.is_valid())) {
+      ldpp_dout(dpp, 1) << __func__ << "::ERR: invalid pool ioctx" << dendl;
+      return -EINVAL;
+    }
+    // IoCtx copy shares the underlying state, dup() gives us our own namespace
+    baseline_ioctx.dup(pool_ioctx);
+    baseline_ioctx.set_namespace(baseline_namespace(serial));
+    ldpp_dout(dpp, 10) << __func__ << "::namespace="
+                       << baseline_namespace(serial) << dendl;
+    return 0;
+  }
+
+  //---------------------------------------------------------------------------
+  int read_baseline_state(librados::IoCtx          &ioctx,
+                          baseline_state_t         *p_state, /* OUT */
+                          const DoutPrefixProvider *dpp)
+  {
+    bufferlist bl;
+    int ret = ioctx.getxattr(DEDUP_BASELINE_OBJ, RGW_DEDUP_ATTR_BASELINE, bl);
+    if (ret <= 0) {
+      if (ret == 0) {
+        ret = -ENODATA;
+      }
+      ldpp_dout(dpp, 10) << __func__ << "::no baseline::"
+                         << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+
+    try {
+      auto p = bl.cbegin();
+      decode(*p_state, p);
+    } catch (const buffer::error&) {
+      ldpp_dout(dpp, 1) << __func__ << "::ERR: failed baseline decode" << dendl;
+      return -EINVAL;
+    }
+    ldpp_dout(dpp, 10) << __func__ << "::" << *p_state << dendl;
+    return 0;
+  }
+
+  // Only a single RGW wins the cmp-swap and becomes the owner of the cleanup
+  //---------------------------------------------------------------------------
+  int commit_baseline_state(librados::IoCtx          &ioctx,
+                            const baseline_state_t   *p_old_state,
+                            const baseline_state_t   &new_state,
+                            const DoutPrefixProvider *dpp)
+  {
+    bufferlist old_bl, new_bl;
+    encode(new_state, new_bl);
+    // an empty bufferlist matches a missing attribute
+    if (p_old_state) {
+      encode(*p_old_state, old_bl);
+    }
+    librados::ObjectWriteOperation op;
+    op.create(false);
+    op.cmpxattr(RGW_DEDUP_ATTR_BASELINE, CEPH_OSD_CMPXATTR_OP_EQ, old_bl);
+    op.setxattr(RGW_DEDUP_ATTR_BASELINE, new_bl);
+    int ret = ioctx.operate(DEDUP_BASELINE_OBJ, &op);
+    if (ret == 0) {
+      ldpp_dout(dpp, 10) << __func__ << "::" << new_state << dendl;
+    }
+    else if (ret == -ECANCELED) {
+      ldpp_dout(dpp, 10) << __func__ << "::baseline was committed by a peer"
+                         << dendl;
+    }
+    else {
+      ldpp_dout(dpp, 1) << __func__ << "::ERR: failed ioctx.operate("
+                        << DEDUP_BASELINE_OBJ << "), err is "
+                        << cpp_strerror(-ret) << dendl;
+    }
+    return ret;
+  }
+
+  //---------------------------------------------------------------------------
+  int read_bilog_pos(librados::IoCtx                      &baseline_ioctx,
+                     work_shard_t                          worker_id,
+                     const std::set<std::string>          &keys,
+                     std::map<std::string, bilog_pos_t>   *p_pos_map, /* OUT */
+                     const DoutPrefixProvider             *dpp)
+  {
+    std::map<std::string, bufferlist> vals;
+    std::string oid(bilog_pos_oid(worker_id));
+    int ret = baseline_ioctx.omap_get_vals_by_keys(oid, keys, &vals);
+    if (ret < 0) {
+      if (ret != -ENOENT) {
+        ldpp_dout(dpp, 5) << __func__ << "::ERR: failed omap_get_vals_by_keys("
+                          << oid << ")::" << cpp_strerror(-ret) << dendl;
+      }
+      return ret;
+    }
+
+    for (const auto& [key, bl] : vals) {
+      bilog_pos_t pos;
+      try {
+        auto p = bl.cbegin();
+        decode(pos, p);
+      } catch (const buffer::error&) {
+        // treat as a missing position which forces a full listing of the shard
+        ldpp_dout(dpp, 1) << __func__ << "::ERR: bad bilog pos::" << key << dendl;
+        continue;
+      }
+      p_pos_map->emplace(key, std::move(pos));
+    }
+    return 0;
+  }
+
+  //---------------------------------------------------------------------------
+  int write_bilog_pos(librados::IoCtx                          &baseline_ioctx,
+                      work_shard_t                              worker_id,
+                      const std::map<std::string, bilog_pos_t> &pos_map,
+                      const DoutPrefixProvider                 *dpp)
+  {
+    if (pos_map.empty()) {
+      return 0;
+    }
+
+    std::map<std::string, bufferlist> vals;
+    for (const auto& [key, pos] : pos_map) {
+      encode(pos, vals[key]);
+    }
+    std::string oid(bilog_pos_oid(worker_id));
+    int ret = baseline_ioctx.omap_set(oid, vals);
+    if (ret < 0) {
+      ldpp_dout(dpp, 5) << __func__ << "::ERR: failed omap_set(" << oid << ")::"
+                        << cpp_strerror(-ret) << dendl;
+    }
+    return ret;
+  }
+
+  // Remove all baseline namespaces other than the one owned by @serial
+  // Namespaces left behind by aborted scans are removed as well
+  //---------------------------------------------------------------------------
+  int remove_stale_baselines(librados::IoCtx          &ioctx,
+                             uint32_t                  serial,
+                             const DoutPrefixProvider *dpp)
+  {
+    librados::IoCtx all_ns_ioctx;
+    all_ns_ioctx.dup(ioctx);
+    all_ns_ioctx.set_namespace(librados::all_nspaces);
+    const std::string prefix(BASELINE_NAMESPACE_PREFIX);
+    const std::string active_ns(baseline_namespace(serial));
+    std::vector<std::pair<std::string, std::string>> stale_objs;
+    try {
+      for (auto itr = all_ns_ioctx.nobjects_begin();
+           itr != all_ns_ioctx.nobjects_end(); ++itr) {
+        const std::string &nspace = itr->get_nspace();
+        if (nspace.compare(0, prefix.size(), prefix) == 0 && nspace != active_ns) {
+          stale_objs.emplace_back(nspace, itr->get_oid());
+        }
+      }
+    } catch (const std::system_error& e) {
+      ldpp_dout(dpp, 1) << __func__ << "::ERR: failed listing::" << e.what() << dendl;
+      return -e.code().value();
+    }
+
+    librados::IoCtx ns_ioctx;
+    ns_ioctx.dup(ioctx);
+    unsigned failure_count = 0;
+    for (const auto& [nspace, oid] : stale_objs) {
+      ns_ioctx.set_namespace(nspace);
+      int ret = ns_ioctx.remove(oid);
+      if (ret != 0 && ret != -ENOENT) {
+        ldpp_dout(dpp, 5) << __func__ << "::ERR: failed remove(" << nspace << "/"
+                          << oid << ")::" << cpp_strerror(-ret) << dendl;
+        failure_count++;
+      }
+    }
+    ldpp_dout(dpp, 10) << __func__ << "::removed " << stale_objs.size() - failure_count
+                       << " stale objects, failure_count=" << failure_count << dendl;
+    return failure_count;
+  }
+} //namespace rgw::dedup
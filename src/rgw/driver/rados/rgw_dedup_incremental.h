@@ -0,0 +1,132 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2;
+// vim: ts=8 sw=2 sts=2 expandtab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Author: Gabriel BenHanokh <gbenhano@redhat.com>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#pragma once
+
+#include "common/Clock.h" // for ceph_clock_now()
+#include "common/dout.h"
+#include "include/rados/librados.hpp"
+#include "rgw_dedup_utils.h"
+
+#include <map>
+#include <set>
+#include <string>
+
+namespace rgw::dedup {
+  // An incremental scan keeps the fastlane records of the previous scan (the
+  // baseline) in a namespace of the dedup-pool together with the bucket-index
+  // position reached on every bucket-index shard.
+  // The next scan only ingests bucket-index shards which were modified since
+  // and matches the new records against the baseline.
+  constexpr const char* DEDUP_BASELINE_OBJ = "DEDUP.BASELINE";
+  constexpr const char* RGW_DEDUP_ATTR_BASELINE = "rgw.dedup.attr.baseline";
+  // the baseline SLABs are stored using the last worker-id
+  const work_shard_t BASELINE_WORK_SHARD = MAX_WORK_SHARD;
+
+  //===========================================================================
+  struct baseline_state_t {
+    uint32_t serial = 0;          // serial of the epoch which created the baseline
+    utime_t  time;
+    uint32_t num_work_shards = 0;
+    uint32_t num_md5_shards = 0;
+  };
+
+  //---------------------------------------------------------------------------
+  inline void encode(const baseline_state_t& o, ceph::bufferlist& bl)
+  {
+    ENCODE_START(1, 1, bl);
+    encode(o.serial, bl);
+    encode(o.time, bl);
+    encode(o.num_work_shards, bl);
+    encode(o.num_md5_shards, bl);
+    ENCODE_FINISH(bl);
+  }
+
+  //---------------------------------------------------------------------------
+  inline void decode(baseline_state_t& o, ceph::bufferlist::const_iterator& bl)
+  {
+    DECODE_START(1, bl);
+    decode(o.serial, bl);
+    decode(o.time, bl);
+    decode(o.num_work_shards, bl);
+    decode(o.num_md5_shards, bl);
+    DECODE_FINISH(bl);
+  }
+
+  //---------------------------------------------------------------------------
+  inline std::ostream& operator<<(std::ostream &out, const baseline_state_t &bs)
+  {
+    utime_t elapsed = ceph_clock_now() - bs.time;
+    out << "BASELINE::serial=" << bs.serial << "::age=" << elapsed;
+    out << "::num_work_shards=" << bs.num_work_shards;
+    out << "::num_md5_shards=" << bs.num_md5_shards;
+    return out;
+  }
+
+  //===========================================================================
+  // The position reached on a single bucket-index shard
+  struct bilog_pos_t {
+    std::string marker;  // the last bilog entry consumed
+    uint64_t    ver = 0; // the bucket-index header version when it was consumed
+  };
+
+  //---------------------------------------------------------------------------
+  inline void encode(const bilog_pos_t& o, ceph::bufferlist& bl)
+  {
+    ENCODE_START(1, 1, bl);
+    encode(o.marker, bl);
+    encode(o.ver, bl);
+    ENCODE_FINISH(bl);
+  }
+
+  //---------------------------------------------------------------------------
+  inline void decode(bilog_pos_t& o, ceph::bufferlist::const_iterator& bl)
+  {
+    DECODE_START(1, bl);
+    decode(o.marker, bl);
+    decode(o.ver, bl);
+    DECODE_FINISH(bl);
+  }
+
+  std::string bilog_pos_key(const std::string &bucket_key, uint32_t bidx_shard);
+
+  int open_baseline_ioctx(const librados::IoCtx    &pool_ioctx,
+                          uint32_t                  serial,
+                          librados::IoCtx          &baseline_ioctx, /* OUT */
+                          const DoutPrefixProvider *dpp);
+
+  int read_baseline_state(librados::IoCtx          &ioctx,
+                          baseline_state_t         *p_state, /* OUT */
+                          const DoutPrefixProvider *dpp);
+
+  int commit_baseline_state(librados::IoCtx          &ioctx,
+                            const baseline_state_t   *p_old_state,
+                            const baseline_state_t   &new_state,
+                            const DoutPrefixProvider *dpp);
+
+  int read_bilog_pos(librados::IoCtx                      &baseline_ioctx,
+                     work_shard_t                          worker_id,
+                     const std::set<std::string>          &keys,
+                     std::map<std::string, bilog_pos_t>   *p_pos_map, /* OUT */
+                     const DoutPrefixProvider             *dpp);
+
+  int write_bilog_pos(librados::IoCtx                          &baseline_ioctx,
+                      work_shard_t                              worker_id,
+                      const std::map<std::string, bilog_pos_t> &pos_map,
+                      const DoutPrefixProvider                 *dpp);
+
+  int remove_stale_baselines(librados::IoCtx          &ioctx,
+                             uint32_t                  serial,
+                             const DoutPrefixProvider *dpp);
+} //namespace rgw::dedup
@@ -0,0 +1,331 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2;
+// vim: ts=8 sw=2 sts=2 expandtab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Author: Gabriel BenHanokh <gbenhano@redhat.com>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "rgw_dedup_inline.h"
+#include "rgw_rados.h"
+#include "rgw_tools.h"
+#include "services/svc_zone.h"
+#include "cls/refcount/cls_refcount_client.h"
+#include "common/errno.h"
+#include "common/strtol.h"
+#include "BLAKE3/c/blake3.h"
+
+#include <array>
+#include <map>
+#include <set>
+
+static constexpr auto dout_subsys = ceph_subsys_rgw_dedup;
+
+namespace rgw::dedup {
+  static constexpr const char* INLINE_FP_NAMESPACE = "dedup.fp";
+  static constexpr const char* INLINE_FP_OBJ_PREFIX = "DEDUP.FP.";
+  static constexpr unsigned INLINE_FP_NUM_SHARDS = 64;
+
+  //---------------------------------------------------------------------------
+  std::string inline_fp_key(const uint8_t *p_hash,
+                            uint64_t       head_size,
+                            uint64_t       obj_size)
+  {
+    std::array<char, BLAKE3_OUT_LEN * 2 + 1> hex;
+    buf_to_hex(p_hash, BLAKE3_OUT_LEN, hex.data());
+    return std::string(hex.data()) + ":" + std::to_string(head_size) + ":" +
+      std::to_string(obj_size);
+  }
+
+  //---------------------------------------------------------------------------
+  bool inline_fp_parse_key(const std::string &fp_key,
+                           uint64_t          *p_head_size, /* OUT */
+                           uint64_t          *p_obj_size)  /* OUT */
+  {
+    // HASH:HEAD_SIZE:OBJ_SIZE
+    const auto pos1 = fp_key.find(':');
+    if (pos1 != BLAKE3_OUT_LEN * 2) {
+      return false;
+    }
+    const auto pos2 = fp_key.find(':', pos1 + 1);
+    if (pos2 == std::string::npos) {
+      return false;
+    }
+    std::string err;
+    *p_head_size = strict_strtoll(fp_key.substr(pos1 + 1, pos2 - pos1 - 1), 10, &err);
+    if (!err.empty()) {
+      return false;
+    }
+    *p_obj_size = strict_strtoll(fp_key.substr(pos2 + 1), 10, &err);
+    return err.empty();
+  }
+
+  // the key starts with the hash so the first byte is evenly distributed
+  //---------------------------------------------------------------------------
+  static std::string inline_fp_oid(const std::string &fp_key)
+  {
+    unsigned shard = hexdigit(fp_key[0]) << 4 | hexdigit(fp_key[1]);
+    return INLINE_FP_OBJ_PREFIX + std::to_string(shard % INLINE_FP_NUM_SHARDS);
+  }
+
+  //---------------------------------------------------------------------------
+  static int open_inline_fp_ioctx(const DoutPrefixProvider *dpp,
+                                  RGWRados                 *rados,
+                                  librados::IoCtx          &ioctx) /* OUT */
+  {
+    rgw_pool pool = rados->svc.zone->get_zone_params().log_pool;
+    pool.ns = INLINE_FP_NAMESPACE;
+    int ret = rgw_init_ioctx(dpp, rados->get_rados_handle(), pool, ioctx, true, true);
+    if (unlikely(ret < 0)) {
+      ldpp_dout(dpp, 1) << __func__ << "::ERR: failed rgw_init_ioctx(" << pool
+                        << ")::" << cpp_strerror(-ret) << dendl;
+    }
+    return ret;
+  }
+
+  //---------------------------------------------------------------------------
+  int inline_fp_lookup(const DoutPrefixProvider *dpp,
+                       RGWRados                 *rados,
+                       const std::string        &fp_key,
+                       inline_fp_entry_t        *p_entry, /* OUT */
+                       optional_yield            y)
+  {
+    librados::IoCtx ioctx;
+    int ret = open_inline_fp_ioctx(dpp, rados, ioctx);
+    if (unlikely(ret < 0)) {
+      return ret;
+    }
+
+    const std::set<std::string> keys{fp_key};
+    std::map<std::string, bufferlist> vals;
+    librados::ObjectReadOperation op;
+    op.omap_get_vals_by_keys(keys, &vals, nullptr);
+    ret = rgw_rados_operate(dpp, ioctx, inline_fp_oid(fp_key), std::move(op),
+                            nullptr, y);
+    if (ret < 0) {
+      if (ret != -ENOENT) {
+        ldpp_dout(dpp, 5) << __func__ << "::ERR: failed omap_get_vals_by_keys()::"
+                          << cpp_strerror(-ret) << dendl;
+      }
+      return ret;
+    }
+
+    auto itr = vals.find(fp_key);
+    if (itr == vals.end()) {
+      return -ENOENT;
+    }
+    try {
+      auto p = itr->second.cbegin();
+      decode(*p_entry, p);
+    } catch (const buffer::error&) {
+      ldpp_dout(dpp, 1) << __func__ << "::ERR: bad entry::" << fp_key << dendl;
+      return -EINVAL;
+    }
+    return 0;
+  }
+
+  //---------------------------------------------------------------------------
+  int inline_fp_store(const DoutPrefixProvider *dpp,
+                      RGWRados                 *rados,
+                      const std::string        &fp_key,
+                      const inline_fp_entry_t  &entry,
+                      optional_yield            y)
+  {
+    librados::IoCtx ioctx;
+    int ret = open_inline_fp_ioctx(dpp, rados, ioctx);
+    if (unlikely(ret < 0)) {
+      return ret;
+    }
+
+    std::map<std::string, bufferlist> vals;
+    encode(entry, vals[fp_key]);
+    librados::ObjectWriteOperation op;
+    op.omap_set(vals);
+    ret = rgw_rados_operate(dpp, ioctx, inline_fp_oid(fp_key), std::move(op), y);
+    if (unlikely(ret < 0)) {
+      ldpp_dout(dpp, 5) << __func__ << "::ERR: failed omap_set()::"
+                        << cpp_strerror(-ret) << dendl;
+    }
+    return ret;
+  }
+
+  //---------------------------------------------------------------------------
+  int inline_fp_load_manifest(const DoutPrefixProvider *dpp,
+                              RGWRados                 *rados,
+                              const inline_fp_entry_t  &entry,
+                              RGWObjManifest           *p_manifest, /* OUT */
+                              optional_yield            y)
+  {
+    rgw_rados_ref ref;
+    int ret = rgw_get_rados_ref(dpp, rados->get_rados_handle(), entry.head, &ref);
+    if (unlikely(ret < 0)) {
+      ldpp_dout(dpp, 5) << __func__ << "::ERR: failed rgw_get_rados_ref("
+                        << entry.head << ")::" << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+
+    bufferlist bl;
+    librados::ObjectReadOperation op;
+    op.getxattr(RGW_ATTR_MANIFEST, &bl, nullptr);
+    ret = rgw_rados_operate(dpp, ref.ioctx, ref.obj.oid, std::move(op), nullptr, y);
+    if (ret < 0) {
+      // source object was removed
+      ldpp_dout(dpp, 10) << __func__ << "::failed reading manifest of "
+                         << entry.head << "::" << cpp_strerror(-ret) << dendl;
+      return (ret == -ENODATA ? -ENOENT : ret);
+    }
+
+    try {
+      auto p = bl.cbegin();
+      decode(*p_manifest, p);
+    } catch (const buffer::error&) {
+      ldpp_dout(dpp, 1) << __func__ << "::ERR: bad manifest::" << entry.head << dendl;
+      return -EINVAL;
+    }
+
+    // source object was overwritten and no longer owns the indexed tail
+    if (p_manifest->get_prefix() != entry.prefix || !p_manifest->has_tail()) {
+      ldpp_dout(dpp, 10) << __func__ << "::stale entry::" << entry.head << dendl;
+      return -ENOENT;
+    }
+
+    // force explicit tail_placement as the new object could be on another bucket
+    const rgw_bucket_placement& tail_placement = p_manifest->get_tail_placement();
+    if (tail_placement.bucket.name.empty()) {
+      p_manifest->set_tail_placement(tail_placement.placement_rule, entry.bucket);
+    }
+    return 0;
+  }
+
+  //---------------------------------------------------------------------------
+  int inline_fp_find_source(const DoutPrefixProvider *dpp,
+                            RGWRados                 *rados,
+                            const std::string        &fp_key,
+                            uint64_t                  head_size,
+                            uint64_t                  obj_size,
+                            const rgw_placement_rule &tail_rule,
+                            const rgw_obj            &head_obj,
+                            RGWObjManifest           *p_manifest, /* OUT */
+                            optional_yield            y)
+  {
+    inline_fp_entry_t entry;
+    int ret = inline_fp_lookup(dpp, rados, fp_key, &entry, y);
+    if (ret < 0) {
+      return ret;
+    }
+    ret = inline_fp_load_manifest(dpp, rados, entry, p_manifest, y);
+    if (ret < 0) {
+      return ret;
+    }
+
+    // the shared tail must be laid out exactly as ours would be
+    if (p_manifest->get_obj_size() != obj_size ||
+        p_manifest->get_head_size() != head_size ||
+        p_manifest->get_tail_placement().placement_rule != tail_rule) {
+      ldpp_dout(dpp, 10) << __func__ << "::layout mismatch with " << entry.head << dendl;
+      return -ENOENT;
+    }
+    rgw_pool tail_pool;
+    if (!rados->get_obj_data_pool(tail_rule, head_obj, &tail_pool)) {
+      return -EIO;
+    }
+    auto miter = p_manifest->obj_find(dpp, head_size);
+    if (miter == p_manifest->obj_end(dpp) ||
+        miter.get_location().get_raw_obj(rados).pool != tail_pool) {
+      ldpp_dout(dpp, 10) << __func__ << "::tail pool mismatch with " << entry.head << dendl;
+      return -ENOENT;
+    }
+    ldpp_dout(dpp, 20) << __func__ << "::" << fp_key << " -> " << entry.head << dendl;
+    return 0;
+  }
+
+  //---------------------------------------------------------------------------
+  static int update_tail_refs(const DoutPrefixProvider *dpp,
+                              RGWRados                 *rados,
+                              const RGWObjManifest     &manifest,
+                              const std::string        &tag,
+                              bool                      get_ref,
+                              optional_yield            y)
+  {
+    // the tail-tag attribute is stored with a trailing null
+    const std::string ref_tag = tag + '\0';
+    const uint64_t head_size = manifest.get_head_size();
+    unsigned count = 0;
+    int ret = 0;
+    for (auto p = manifest.obj_begin(dpp); p != manifest.obj_end(dpp); ++p) {
+      if (p.get_ofs() < head_size) {
+        // skip the head-object
+        continue;
+      }
+      rgw_rados_ref obj;
+      ret = rgw_get_rados_ref(dpp, rados->get_rados_handle(),
+                              p.get_location().get_raw_obj(rados), &obj);
+      if (unlikely(ret < 0)) {
+        ldpp_dout(dpp, 1) << __func__ << "::ERR: failed rgw_get_rados_ref()::"
+                          << cpp_strerror(-ret) << dendl;
+        break;
+      }
+
+      librados::ObjectWriteOperation op;
+      if (get_ref) {
+        cls_refcount_get(op, ref_tag, true);
+      }
+      else {
+        obj.ioctx.set_pool_full_try();  // allow rollback at pool quota limit
+        cls_refcount_put(op, ref_tag, true);
+      }
+      ret = rgw_rados_operate(dpp, obj.ioctx, obj.obj.oid, std::move(op), y);
+      if (unlikely(ret < 0)) {
+        ldpp_dout(dpp, 1) << __func__ << "::ERR: failed refcount update ("
+                          << obj.obj.oid << ")::" << cpp_strerror(-ret) << dendl;
+        break;
+      }
+      count++;
+    }
+
+    if (ret < 0 && get_ref && count > 0) {
+      // rollback the refs taken so far
+      for (auto p = manifest.obj_begin(dpp); p != manifest.obj_end(dpp) && count; ++p) {
+        if (p.get_ofs() < head_size) {
+          continue;
+        }
+        rgw_rados_ref obj;
+        if (rgw_get_rados_ref(dpp, rados->get_rados_handle(),
+                              p.get_location().get_raw_obj(rados), &obj) == 0) {
+          obj.ioctx.set_pool_full_try();
+          librados::ObjectWriteOperation op;
+          cls_refcount_put(op, ref_tag, true);
+          rgw_rados_operate(dpp, obj.ioctx, obj.obj.oid, std::move(op), y);
+        }
+        count--;
+      }
+    }
+    return ret;
+  }
+
+  //---------------------------------------------------------------------------
+  int inline_fp_get_tail_refs(const DoutPrefixProvider *dpp,
+                              RGWRados                 *rados,
+                              const RGWObjManifest     &manifest,
+                              const std::string        &tag,
+                              optional_yield            y)
+  {
+    return update_tail_refs(dpp, rados, manifest, tag, true, y);
+  }
+
+  //---------------------------------------------------------------------------
+  void inline_fp_put_tail_refs(const DoutPrefixProvider *dpp,
+                               RGWRados                 *rados,
+                               const RGWObjManifest     &manifest,
+                               const std::string        &tag,
+                               optional_yield            y)
+  {
+    update_tail_refs(dpp, rados, manifest, tag, false, y);
+  }
+} //namespace rgw::dedup
@@ -0,0 +1,119 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2;
+// vim: ts=8 sw=2 sts=2 expandtab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Author: Gabriel BenHanokh <gbenhano@redhat.com>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#pragma once
+
+#include "common/dout.h"
+#include "include/rados/librados.hpp"
+#include "rgw_common.h"
+#include "rgw_obj_manifest.h"
+
+#include <string>
+
+class RGWRados;
+
+namespace rgw::dedup {
+  // Inline dedup keeps a persistent fingerprint index of the tail data of
+  // plain (not encrypted/compressed) atomic objects.
+  // The index is stored as omap entries on sharded objects in the zone
+  // log-pool (namespace "dedup.fp") and is consulted by the put path which
+  // shares the tail-objects of a matching object instead of writing new ones.
+  // Entries are never trusted blindly: the source head-object must still hold
+  // a manifest with the recorded tail prefix (tail-objects are immutable and
+  // their prefix is unique per upload).
+
+  //===========================================================================
+  struct inline_fp_entry_t {
+    rgw_bucket  bucket;  // bucket owning the tail-objects
+    rgw_raw_obj head;    // source head-object
+    std::string prefix;  // tail prefix of the source manifest
+  };
+
+  //---------------------------------------------------------------------------
+  inline void encode(const inline_fp_entry_t& o, ceph::bufferlist& bl)
+  {
+    ENCODE_START(1, 1, bl);
+    encode(o.bucket, bl);
+    encode(o.head, bl);
+    encode(o.prefix, bl);
+    ENCODE_FINISH(bl);
+  }
+
+  //---------------------------------------------------------------------------
+  inline void decode(inline_fp_entry_t& o, ceph::bufferlist::const_iterator& bl)
+  {
+    DECODE_START(1, bl);
+    decode(o.bucket, bl);
+    decode(o.head, bl);
+    decode(o.prefix, bl);
+    DECODE_FINISH(bl);
+  }
+
+  // @p_hash is the BLAKE3 of the tail data (the bytes following the head)
+  std::string inline_fp_key(const uint8_t *p_hash,
+                            uint64_t       head_size,
+                            uint64_t       obj_size);
+
+  // extract the head/object sizes encoded in a fingerprint key
+  bool inline_fp_parse_key(const std::string &fp_key,
+                           uint64_t          *p_head_size, /* OUT */
+                           uint64_t          *p_obj_size); /* OUT */
+
+  int inline_fp_lookup(const DoutPrefixProvider *dpp,
+                       RGWRados                 *rados,
+                       const std::string        &fp_key,
+                       inline_fp_entry_t        *p_entry, /* OUT */
+                       optional_yield            y);
+
+  int inline_fp_store(const DoutPrefixProvider *dpp,
+                      RGWRados                 *rados,
+                      const std::string        &fp_key,
+                      const inline_fp_entry_t  &entry,
+                      optional_yield            y);
+
+  // read and validate the manifest of the source object
+  // returns -ENOENT when the entry is stale
+  int inline_fp_load_manifest(const DoutPrefixProvider *dpp,
+                              RGWRados                 *rados,
+                              const inline_fp_entry_t  &entry,
+                              RGWObjManifest           *p_manifest, /* OUT */
+                              optional_yield            y);
+
+  // find an indexed object whose tail can be shared by a new object with the
+  // same layout (@head_size/@obj_size) placed with @tail_rule
+  // returns -ENOENT when there is no usable source
+  int inline_fp_find_source(const DoutPrefixProvider *dpp,
+                            RGWRados                 *rados,
+                            const std::string        &fp_key,
+                            uint64_t                  head_size,
+                            uint64_t                  obj_size,
+                            const rgw_placement_rule &tail_rule,
+                            const rgw_obj            &head_obj,
+                            RGWObjManifest           *p_manifest, /* OUT */
+                            optional_yield            y);
+
+  // take a reference on all the tail-objects of @manifest using @tag
+  // on failure all references taken are released
+  int inline_fp_get_tail_refs(const DoutPrefixProvider *dpp,
+                              RGWRados                 *rados,
+                              const RGWObjManifest     &manifest,
+                              const std::string        &tag,
+                              optional_yield            y);
+
+  void inline_fp_put_tail_refs(const DoutPrefixProvider *dpp,
+                               RGWRados                 *rados,
+                               const RGWObjManifest     &manifest,
+                               const std::string        &tag,
+                               optional_yield            y);
+} //namespace rgw::dedup
@@ -0,0 +1,380 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2;
+// vim: ts=8 sw=2 sts=2 expandtab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Author: Gabriel BenHanokh <gbenhano@redhat.com>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "rgw_dedup_spill.h"
+#include "include/ceph_assert.h"
+#include "common/errno.h"
+
+#include <algorithm>
+
+static constexpr auto dout_subsys = ceph_subsys_rgw_dedup;
+
+namespace rgw::dedup {
+  using table_entry_t = dedup_table_t::table_entry_t;
+  using value_t = dedup_table_t::value_t;
+
+  //===========================================================================
+  class spill_runs_t::run_writer_t {
+  public:
+    run_writer_t(spill_runs_t *_p_owner, uint16_t run_id) : p_owner(_p_owner) {
+      run.run_id = run_id;
+    }
+
+    int append(const key_t &key, const value_t &val) {
+      table_entry_t entry;
+      entry.key = key;
+      entry.val = val;
+      bl.append((const char*)&entry, sizeof(entry));
+      run.num_entries++;
+      if (bl.length() >= SPILL_PART_SIZE) {
+        return flush();
+      }
+      return 0;
+    }
+
+    int finish(run_t *p_run /* OUT */) {
+      int ret = flush();
+      *p_run = run;
+      return ret;
+    }
+
+  private:
+    int flush() {
+      if (bl.length() == 0) {
+        return 0;
+      }
+      std::string oid(p_owner->get_part_name(run.run_id, run.num_parts));
+      // count the part before the write so a partial write is removed as well
+      run.num_parts++;
+      int ret = p_owner->ioctx.write_full(oid, bl);
+      if (unlikely(ret < 0)) {
+        ldpp_dout(p_owner->dpp, 1) << __func__ << "::ERR: failed write_full("
+                                   << oid << ")::" << cpp_strerror(-ret) << dendl;
+        return ret;
+      }
+      ldpp_dout(p_owner->dpp, 20) << __func__ << "::oid=" << oid << "::len="
+                                  << bl.length() << dendl;
+      bl.clear();
+      return 0;
+    }
+
+    spill_runs_t *p_owner;
+    run_t         run;
+    bufferlist    bl;
+  };
+
+  //===========================================================================
+  class spill_runs_t::run_reader_t {
+  public:
+    run_reader_t(spill_runs_t *_p_owner, const run_t &_run) :
+      p_owner(_p_owner), run(_run) {}
+
+    // returns 0 with a valid peek() or -ENOENT when the run is exhausted
+    int next() {
+      if (p_curr && ++p_curr < p_end) {
+        return 0;
+      }
+      if (part_id >= run.num_parts) {
+        p_curr = p_end = nullptr;
+        return -ENOENT;
+      }
+
+      std::string oid(p_owner->get_part_name(run.run_id, part_id++));
+      bl.clear();
+      int ret = p_owner->ioctx.read(oid, bl, 0, 0);
+      if (unlikely(ret <= 0 || bl.length() % sizeof(table_entry_t))) {
+        if (ret >= 0) {
+          ret = -EIO;
+        }
+        ldpp_dout(p_owner->dpp, 1) << __func__ << "::ERR: failed reading " << oid
+                                   << "::" << cpp_strerror(-ret) << dendl;
+        p_curr = p_end = nullptr;
+        return ret;
+      }
+      // c_str() rebuilds the bufferlist into a single contiguous buffer
+      p_curr = (const table_entry_t*)bl.c_str();
+      p_end  = p_curr + (bl.length() / sizeof(table_entry_t));
+      return 0;
+    }
+
+    const table_entry_t* peek() const { return p_curr; }
+
+  private:
+    spill_runs_t        *p_owner;
+    run_t                run;
+    uint32_t             part_id = 0;
+    bufferlist           bl;
+    const table_entry_t *p_curr = nullptr;
+    const table_entry_t *p_end  = nullptr;
+  };
+
+  //---------------------------------------------------------------------------
+  spill_runs_t::spill_runs_t(const DoutPrefixProvider *_dpp,
+                             librados::IoCtx          &_ioctx,
+                             md5_shard_t               _md5_shard) :
+    dpp(_dpp), ioctx(_ioctx), md5_shard(_md5_shard)
+  {
+  }
+
+  //---------------------------------------------------------------------------
+  spill_runs_t::~spill_runs_t()
+  {
+    for (const auto &run : runs) {
+      remove_run(run);
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  std::string spill_runs_t::get_part_name(uint16_t run_id, uint32_t part_id) const
+  {
+    // RUN.MD5_ID.RUN_ID.PART_ID
+    const char *RUN_NAME_FORMAT = "RUN.%03X.%04X.%05X";
+    static constexpr uint32_t RUN_NAME_SIZE = 20;
+    char name_buf[RUN_NAME_SIZE];
+    unsigned n = snprintf(name_buf, sizeof(name_buf), RUN_NAME_FORMAT,
+                          md5_shard, run_id, part_id);
+    return std::string(name_buf, n);
+  }
+
+  //---------------------------------------------------------------------------
+  void spill_runs_t::remove_run(const run_t &run)
+  {
+    for (uint32_t part_id = 0; part_id < run.num_parts; part_id++) {
+      std::string oid(get_part_name(run.run_id, part_id));
+      int ret = ioctx.remove(oid);
+      if (ret != 0 && ret != -ENOENT) {
+        ldpp_dout(dpp, 5) << __func__ << "::ERR: failed remove(" << oid << ")::"
+                          << cpp_strerror(-ret) << dendl;
+      }
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  int spill_runs_t::merge(const std::vector<run_t> &in_runs, const merge_cb_t &cb)
+  {
+    std::vector<run_reader_t> readers;
+    readers.reserve(in_runs.size());
+    for (const auto &run : in_runs) {
+      readers.emplace_back(this, run);
+      int ret = readers.back().next();
+      if (unlikely(ret < 0 && ret != -ENOENT)) {
+        return ret;
+      }
+    }
+
+    // the fan-in is bounded by MAX_SPILL_RUNS (unless a compaction failed) so
+    // a linear scan is good enough
+    while (true) {
+      const table_entry_t *p_min = nullptr;
+      for (const auto &reader : readers) {
+        const table_entry_t *p_entry = reader.peek();
+        if (p_entry && (!p_min || p_entry->key < p_min->key)) {
+          p_min = p_entry;
+        }
+      }
+      if (!p_min) {
+        return 0;
+      }
+
+      // keys are unique inside a run so every run holds at most one copy
+      const key_t key = p_min->key;
+      value_t val;
+      bool first = true;
+      for (auto &reader : readers) {
+        const table_entry_t *p_entry = reader.peek();
+        if (!p_entry || p_entry->key != key) {
+          continue;
+        }
+        if (first) {
+          val = p_entry->val;
+          first = false;
+        }
+        else {
+          dedup_table_t::merge_values(&val, p_entry->val);
+        }
+        int ret = reader.next();
+        if (unlikely(ret < 0 && ret != -ENOENT)) {
+          return ret;
+        }
+      }
+
+      int ret = cb(key, val);
+      if (unlikely(ret < 0)) {
+        return ret;
+      }
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  // merge all the runs starting at index @first into a single run of @level
+  int spill_runs_t::compact_runs(size_t first, uint8_t level, md5_stats_t *p_stats)
+  {
+    ceph_assert(first < runs.size());
+    const std::vector<run_t> in_runs(runs.begin() + first, runs.end());
+    run_writer_t writer(this, next_run_id++);
+    int ret = merge(in_runs, [&writer](const key_t &key, const value_t &val) {
+      return writer.append(key, val);
+    });
+    run_t compacted_run;
+    if (ret == 0) {
+      ret = writer.finish(&compacted_run);
+    }
+    else {
+      writer.finish(&compacted_run);
+    }
+
+    if (unlikely(ret < 0)) {
+      ldpp_dout(dpp, 1) << __func__ << "::ERR: failed compaction of "
+                        << in_runs.size() << " runs::" << cpp_strerror(-ret) << dendl;
+      remove_run(compacted_run);
+      p_stats->failed_spill++;
+      return ret;
+    }
+
+    compacted_run.level = level;
+    ldpp_dout(dpp, 10) << __func__ << "::compacted " << in_runs.size()
+                       << " runs into run #" << compacted_run.run_id
+                       << "::level=" << (int)level
+                       << "::num_entries=" << compacted_run.num_entries << dendl;
+    for (const auto &run : in_runs) {
+      remove_run(run);
+    }
+    runs.resize(first);
+    runs.push_back(compacted_run);
+    p_stats->compacted_runs++;
+    return 0;
+  }
+
+  //---------------------------------------------------------------------------
+  // The runs of the lowest level are always at the end of the vector, once
+  // there are MAX_SPILL_RUNS of them they move up a level (which may cascade)
+  void spill_runs_t::compact_levels(md5_stats_t *p_stats)
+  {
+    while (runs.size() >= MAX_SPILL_RUNS) {
+      const uint8_t level = runs.back().level;
+      const size_t first = runs.size() - MAX_SPILL_RUNS;
+      if (runs[first].level != level) {
+        return;
+      }
+      // a failed compaction leaves the old runs intact, keep going with them
+      if (compact_runs(first, level + 1, p_stats) < 0) {
+        return;
+      }
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  int spill_runs_t::spill_table(dedup_table_t *p_table, md5_stats_t *p_stats)
+  {
+    uint32_t count = p_table->sort_entries();
+    if (count == 0) {
+      p_table->reset();
+      return 0;
+    }
+
+    const table_entry_t *p_entries = p_table->get_entries();
+    run_writer_t writer(this, next_run_id++);
+    int ret = 0;
+    for (uint32_t idx = 0; idx < count && ret == 0; idx++) {
+      ret = writer.append(p_entries[idx].key, p_entries[idx].val);
+    }
+    run_t run;
+    if (ret == 0) {
+      ret = writer.finish(&run);
+    }
+    else {
+      writer.finish(&run);
+    }
+    // the table was sorted in place and its hash layout is gone either way
+    p_table->reset();
+
+    if (unlikely(ret < 0)) {
+      ldpp_dout(dpp, 1) << __func__ << "::ERR: failed spilling " << count
+                        << " entries::" << cpp_strerror(-ret) << dendl;
+      remove_run(run);
+      p_stats->failed_spill++;
+      p_stats->failed_table_load += count;
+      return ret;
+    }
+
+    ldpp_dout(dpp, 10) << __func__ << "::md5_shard=" << md5_shard
+                       << "::spilled " << count << " entries to run #"
+                       << run.run_id << " (" << run.num_parts << " parts)" << dendl;
+    runs.push_back(run);
+    p_stats->spilled_runs++;
+    p_stats->spilled_entries += count;
+    compact_levels(p_stats);
+    return 0;
+  }
+
+  //---------------------------------------------------------------------------
+  int spill_runs_t::merge_runs(dedup_table_t *p_table,
+                               bool           load_table,
+                               bool           keep_singletons,
+                               bool           delta_only,
+                               md5_stats_t   *p_stats)
+  {
+    // the table is reloaded from the merge output so its content must be
+    // spilled as well
+    int ret = spill_table(p_table, p_stats);
+    if (unlikely(ret < 0)) {
+      ldpp_dout(dpp, 1) << __func__ << "::ERR: failed spilling the last batch, "
+                        << "merging the older runs only" << dendl;
+    }
+
+    // bring the fan-in down to MAX_SPILL_RUNS, every pass merges just enough
+    // of the smallest runs (at the end) and at most MAX_SPILL_RUNS of them
+    while (runs.size() > MAX_SPILL_RUNS) {
+      const size_t fan_in = std::min<size_t>(MAX_SPILL_RUNS,
+                                             runs.size() - MAX_SPILL_RUNS + 1);
+      const size_t first = runs.size() - fan_in;
+      if (compact_runs(first, runs[first].level, p_stats) < 0) {
+        break;
+      }
+    }
+
+    ret = merge(runs, [&](const key_t &key, const value_t &val) {
+      p_table->count_entry(key, val, &p_stats->small_objs_stat,
+                           &p_stats->big_objs_stat,
+                           &p_stats->dup_head_bytes_estimate);
+      if (!load_table || !p_table->can_dedup_object(key)) {
+        return 0;
+      }
+      if ((val.is_singleton() && !keep_singletons) ||
+          (delta_only && !val.is_delta())) {
+        return 0;
+      }
+      if (unlikely(p_table->insert_merged_entry(key, val) != 0)) {
+        p_stats->failed_table_load++;
+      }
+      return 0;
+    });
+    if (unlikely(ret < 0)) {
+      // whatever was loaded so far is still valid and can be deduped
+      ldpp_dout(dpp, 1) << __func__ << "::ERR: failed merging " << runs.size()
+                        << " runs::" << cpp_strerror(-ret) << dendl;
+      p_stats->failed_spill++;
+    }
+    else {
+      ldpp_dout(dpp, 10) << __func__ << "::md5_shard=" << md5_shard
+                         << "::merged " << runs.size() << " runs" << dendl;
+    }
+
+    for (const auto &run : runs) {
+      remove_run(run);
+    }
+    runs.clear();
+    return ret;
+  }
+} //namespace rgw::dedup
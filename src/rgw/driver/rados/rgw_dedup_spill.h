@@ -0,0 +1,94 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2;
+// vim: ts=8 sw=2 sts=2 expandtab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Author: Gabriel BenHanokh <gbenhano@redhat.com>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#pragma once
+
+#include "common/dout.h"
+#include "include/rados/librados.hpp"
+#include "rgw_dedup_table.h"
+#include "rgw_dedup_utils.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace rgw::dedup {
+  // The dedup table is allocated once with a fixed size, an md5 shard holding
+  // more objects than the table can fit is processed by spilling the table.
+  // Whenever the table reaches its high-water mark the entries are sorted in
+  // place and written as a sorted run to the dedup pool, then the table is
+  // cleared for the next batch.
+  // At the end of the build step all runs are merged back (k-way merge which
+  // sums the counters of identical keys) and only entries which could still
+  // be deduped are loaded into the table (usually a small fraction).
+  // Runs are compacted size-tiered: the table spills are level-0 runs and
+  // whenever MAX_SPILL_RUNS runs of the same level exist they are merged into
+  // a single run of the next level. Every entry is rewritten once per level
+  // (log of the spills count) and the final merge first compacts the smallest
+  // runs so its fan-in, and the memory it uses, stay bounded as well.
+  class spill_runs_t {
+  public:
+    static constexpr unsigned MAX_SPILL_RUNS = 16;
+    // every run is split into parts to keep the RADOS objects small
+    static constexpr unsigned SPILL_PART_SIZE = (1024 * 1024);
+    static constexpr unsigned SPILL_PART_ENTRIES =
+      SPILL_PART_SIZE / sizeof(dedup_table_t::table_entry_t);
+
+    spill_runs_t(const DoutPrefixProvider *_dpp,
+                 librados::IoCtx          &_ioctx,
+                 md5_shard_t               _md5_shard);
+    // remove all runs still stored in the dedup pool
+    ~spill_runs_t();
+
+    unsigned runs_count() const { return runs.size(); }
+
+    // write the content of @p_table as a new sorted run and reset the table
+    int spill_table(dedup_table_t *p_table, md5_stats_t *p_stats);
+
+    // Merge the table content with all spilled runs, collect the duplicates
+    // stats and reload the table (when @load_table is set) with entries which
+    // could be deduped.
+    // Singletons are only loaded with @keep_singletons and entries without a
+    // record from the incremental delta are skipped with @delta_only
+    int merge_runs(dedup_table_t *p_table,
+                   bool           load_table,
+                   bool           keep_singletons,
+                   bool           delta_only,
+                   md5_stats_t   *p_stats);
+
+  private:
+    struct run_t {
+      uint16_t run_id = 0;
+      uint8_t  level = 0;
+      uint32_t num_parts = 0;
+      uint64_t num_entries = 0;
+    };
+    class run_reader_t;
+    class run_writer_t;
+    using merge_cb_t = std::function<int(const key_t&, const dedup_table_t::value_t&)>;
+
+    std::string get_part_name(uint16_t run_id, uint32_t part_id) const;
+    int merge(const std::vector<run_t> &in_runs, const merge_cb_t &cb);
+    int compact_runs(size_t first, uint8_t level, md5_stats_t *p_stats);
+    void compact_levels(md5_stats_t *p_stats);
+    void remove_run(const run_t &run);
+
+    const DoutPrefixProvider *dpp;
+    librados::IoCtx          &ioctx;
+    md5_shard_t               md5_shard;
+    uint16_t                  next_run_id = 0;
+    // ordered by non-increasing level, new runs are appended at the end
+    std::vector<run_t>        runs;
+  };
+} //namespace rgw::dedup
@@ -63,6 +63,7 @@ namespace rgw::dedup {
 
     this->s.ref_tag_len     = 0;
     this->s.manifest_len    = 0;
+    this->s.xform_hash      = 0;
 
     this->s.shared_manifest = 0;
     memset(this->s.hash, 0, sizeof(this->s.hash));
@@ -95,6 +96,7 @@ namespace rgw::dedup {
     this->s.stor_class_len  = CEPHTOH_16(p_rec->s.stor_class_len);
     this->s.ref_tag_len     = CEPHTOH_16(p_rec->s.ref_tag_len);
     this->s.manifest_len    = CEPHTOH_16(p_rec->s.manifest_len);
+    this->s.xform_hash      = 0;
 
     const char *p = buff + sizeof(this->s);
     this->obj_name = std::string(p, this->s.obj_name_len);
@@ -122,6 +124,7 @@ namespace rgw::dedup {
     }
     else {
       this->s.shared_manifest = CEPHTOH_64(p_rec->s.shared_manifest);
+      this->s.xform_hash      = CEPHTOH_32(p_rec->s.xform_hash);
       // BLAKE3 hash has 256 bit splitted into multiple 64bit units
       const unsigned units = (256 / (sizeof(uint64_t)*8));
       static_assert(units == 4);
@@ -188,6 +191,7 @@ namespace rgw::dedup {
     }
     else {
       p_rec->s.shared_manifest = HTOCEPH_64(this->s.shared_manifest);
+      p_rec->s.xform_hash      = HTOCEPH_32(this->s.xform_hash);
       // BLAKE3 hash has 256 bit splitted into multiple 64bit units
       const unsigned units = (256 / (sizeof(uint64_t)*8));
       static_assert(units == 4);
@@ -284,6 +288,9 @@ namespace rgw::dedup {
       stream << "Dedicated Manifest Object\n";
     }
     stream << "Manifest len=" << rec.s.manifest_len << "\n";
+    if (rec.s.xform_hash) {
+      stream << "Transform hash=" << std::hex << rec.s.xform_hash << std::dec << "\n";
+    }
     return stream;
   }
 
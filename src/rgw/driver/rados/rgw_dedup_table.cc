@@ -14,8 +14,10 @@
 
 #include "rgw_dedup_table.h"
 #include "include/ceph_assert.h"
+#include <algorithm>
 #include <cstring>
 #include <iostream>
+#include <limits>
 
 namespace rgw::dedup {
 
@@ -35,7 +37,7 @@ namespace rgw::dedup {
   }
 
   //---------------------------------------------------------------------------
-  void dedup_table_t::remove_singletons_and_redistribute_keys()
+  void dedup_table_t::remove_singletons_and_redistribute_keys(bool delta_only)
   {
     for (uint32_t tab_idx = 0; tab_idx < entries_count; tab_idx++) {
       if (!hash_tab[tab_idx].val.is_occupied()) {
@@ -48,10 +50,15 @@ namespace rgw::dedup {
         continue;
       }
 
+      // all copies were already processed by a previous run
+      if (delta_only && !hash_tab[tab_idx].val.is_delta()) {
+        hash_tab[tab_idx].val.clear_flags();
+        redistributed_clear++;
+        continue;
+      }
+
       const key_t &key = hash_tab[tab_idx].key;
-      // This is an approximation only since size is stored in 4KB resolution
-      uint64_t byte_size_approx = disk_blocks_to_byte_size(key.size_4k_units);
-      if (!key.multipart_object() && (byte_size_approx <= head_object_size)) {
+      if (!can_dedup_object(key)) {
         hash_tab[tab_idx].val.clear_flags();
         redistributed_clear++;
         continue;
@@ -108,9 +115,13 @@ namespace rgw::dedup {
   int dedup_table_t::add_entry(key_t *p_key,
                                disk_block_id_t block_id,
                                record_id_t rec_id,
-                               bool shared_manifest)
+                               bool shared_manifest,
+                               bool delta)
   {
     value_t new_val(block_id, rec_id, shared_manifest);
+    if (delta) {
+      new_val.set_delta();
+    }
     uint32_t idx = find_entry(p_key);
     value_t &val = hash_tab[idx].val;
     if (!val.is_occupied()) {
@@ -129,6 +140,10 @@ namespace rgw::dedup {
     else {
       ceph_assert(hash_tab[idx].key == *p_key);
       val.count ++;
+      if (delta || val.is_delta()) {
+        new_val.set_delta();
+        val.set_delta();
+      }
       if (!val.has_shared_manifest() && shared_manifest) {
         // replace value!
         ldpp_dout(dpp, 20) << __func__ << "::Replace with shared_manifest::["
@@ -202,6 +217,70 @@ namespace rgw::dedup {
     return 0;
   }
 
+  //---------------------------------------------------------------------------
+  bool dedup_table_t::is_small_object(const key_t &key) const
+  {
+    // This is an approximation only since size is stored in 4KB resolution
+    uint64_t byte_size_approx = disk_blocks_to_byte_size(key.size_4k_units);
+    return (!key.multipart_object() && (byte_size_approx <= head_object_size));
+  }
+
+  //---------------------------------------------------------------------------
+  bool dedup_table_t::can_dedup_object(const key_t &key) const
+  {
+    if (!is_small_object(key)) {
+      return true;
+    }
+    uint64_t byte_size_approx = disk_blocks_to_byte_size(key.size_4k_units);
+    return (small_object_dedup && byte_size_approx >= MIN_SMALL_OBJ_DEDUP_SIZE);
+  }
+
+  //---------------------------------------------------------------------------
+  void dedup_table_t::count_entry(const key_t &key,
+                                  const value_t &val,
+                                  dedup_stats_t *p_small_objs,
+                                  dedup_stats_t *p_big_objs,
+                                  uint64_t *p_duplicate_head_bytes) const
+  {
+    // This is an approximation only since size is stored in 4KB resolution
+    uint64_t byte_size_approx = disk_blocks_to_byte_size(key.size_4k_units);
+    uint32_t duplicate_count = (val.count -1);
+
+    // skip small single part objects which we can't dedup
+    if (is_small_object(key)) {
+      if (val.is_singleton()) {
+        p_small_objs->singleton_count++;
+      }
+      else {
+        p_small_objs->duplicate_count += duplicate_count;
+        p_small_objs->unique_count ++;
+        p_small_objs->dedup_bytes_estimate += (duplicate_count * byte_size_approx);
+      }
+      return;
+    }
+
+    uint64_t dup_bytes_approx = calc_deduped_bytes(head_object_size,
+                                                   key.num_parts,
+                                                   byte_size_approx);
+    if (val.is_singleton()) {
+      p_big_objs->singleton_count++;
+      p_big_objs->singleton_bytes += dup_bytes_approx;
+    }
+    else {
+      ceph_assert(val.count > 1);
+      p_big_objs->unique_bytes += dup_bytes_approx;
+      p_big_objs->dedup_bytes_estimate += (duplicate_count * dup_bytes_approx);
+      p_big_objs->duplicate_count += duplicate_count;
+      p_big_objs->unique_count ++;
+
+      if (!key.multipart_object()) {
+        // single part objects duplicate the head object when dedup is used
+        uint64_t dup_head_bytes = duplicate_count * head_object_size;
+        *p_duplicate_head_bytes += dup_head_bytes;
+      }
+    }
+  }
+
   //---------------------------------------------------------------------------
   void dedup_table_t::count_duplicates(dedup_stats_t *p_small_objs,
                                        dedup_stats_t *p_big_objs,
@@ -211,44 +290,71 @@ namespace rgw::dedup {
       if (!hash_tab[tab_idx].val.is_occupied()) {
         continue;
       }
+      count_entry(hash_tab[tab_idx].key, hash_tab[tab_idx].val, p_small_objs,
+                  p_big_objs, p_duplicate_head_bytes);
+    }
+  }
 
-      const key_t &key = hash_tab[tab_idx].key;
-      // This is an approximation only since size is stored in 4KB resolution
-      uint64_t byte_size_approx = disk_blocks_to_byte_size(key.size_4k_units);
-      uint32_t duplicate_count = (hash_tab[tab_idx].val.count -1);
-
-      // skip small single part objects which we can't dedup
-      if (!key.multipart_object() && (byte_size_approx <= head_object_size)) {
-        if (hash_tab[tab_idx].val.is_singleton()) {
-          p_small_objs->singleton_count++;
-        }
-        else {
-          p_small_objs->duplicate_count += duplicate_count;
-          p_small_objs->unique_count ++;
-          p_small_objs->dedup_bytes_estimate += (duplicate_count * byte_size_approx);
+  //---------------------------------------------------------------------------
+  uint32_t dedup_table_t::sort_entries()
+  {
+    // move all occupied entries to the front of the slab
+    uint32_t count = 0;
+    for (uint32_t tab_idx = 0; tab_idx < entries_count; tab_idx++) {
+      if (hash_tab[tab_idx].val.is_occupied()) {
+        if (count != tab_idx) {
+          hash_tab[count] = hash_tab[tab_idx];
         }
-        continue;
+        count++;
       }
+    }
+    ceph_assert(count == occupied_count);
+    std::sort(hash_tab, hash_tab + count,
+              [](const table_entry_t &a, const table_entry_t &b) {
+                return a.key < b.key;
+              });
+    ldpp_dout(dpp, 20) << __func__ << "::sorted " << count << " entries" << dendl;
+    return count;
+  }
 
-      if (hash_tab[tab_idx].val.is_singleton()) {
-        p_big_objs->singleton_count++;
-      }
-      else {
-        ceph_assert(hash_tab[tab_idx].val.count > 1);
-        uint64_t dup_bytes_approx = calc_deduped_bytes(head_object_size,
-                                                       key.num_parts,
-                                                       byte_size_approx);
-        p_big_objs->dedup_bytes_estimate += (duplicate_count * dup_bytes_approx);
-        p_big_objs->duplicate_count += duplicate_count;
-        p_big_objs->unique_count ++;
-
-        if (!key.multipart_object()) {
-          // single part objects duplicate the head object when dedup is used
-          uint64_t dup_head_bytes = duplicate_count * head_object_size;
-          *p_duplicate_head_bytes += dup_head_bytes;
-        }
-      }
+  //---------------------------------------------------------------------------
+  void dedup_table_t::reset()
+  {
+    memset(hash_tab, 0, entries_count * sizeof(table_entry_t));
+    values_count = 0;
+    occupied_count = 0;
+  }
+
+  //---------------------------------------------------------------------------
+  void dedup_table_t::merge_values(value_t *p_dst, const value_t &src)
+  {
+    // counters saturate instead of wrapping around
+    uint32_t count = (uint32_t)p_dst->count + src.count;
+    bool delta = (p_dst->is_delta() || src.is_delta());
+    if (!p_dst->has_shared_manifest() && src.has_shared_manifest()) {
+      // prefer a source which already has a shared_manifest
+      *p_dst = src;
     }
+    p_dst->count = std::min(count, (uint32_t)std::numeric_limits<uint16_t>::max());
+    if (delta) {
+      p_dst->set_delta();
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  int dedup_table_t::insert_merged_entry(const key_t &key, const value_t &val)
+  {
+    if (occupied_count >= entries_count) {
+      return -EOVERFLOW;
+    }
+    uint32_t idx = find_entry(&key);
+    ceph_assert(!hash_tab[idx].val.is_occupied());
+    hash_tab[idx].key = key;
+    hash_tab[idx].val = val;
+    hash_tab[idx].val.set_occupied();
+    occupied_count++;
+    values_count += val.count;
+    return 0;
   }
 
 } // namespace rgw::dedup
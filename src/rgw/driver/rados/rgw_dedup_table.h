@@ -44,6 +44,11 @@ namespace rgw::dedup {
       return !operator==(other);
     }
 
+    // byte order is only used to sort spilled runs, any total order will do
+    bool operator<(const struct key_t& other) const {
+      return (memcmp(this, &other, sizeof(other)) < 0);
+    }
+
     uint64_t hash() const {
       // The MD5 is already a hashing function so no need for another hash
       return this->md5_low;
@@ -91,6 +96,8 @@ namespace rgw::dedup {
       inline bool is_occupied() const { return flags.is_occupied(); }
       inline void set_occupied() { this->flags.set_occupied();  }
       inline void clear_occupied() { this->flags.clear_occupied(); }
+      inline bool is_delta() const { return flags.is_delta(); }
+      inline void set_delta() { this->flags.set_delta(); }
 
       disk_block_id_t block_idx; // 32 bits
       uint16_t        count;     // 16 bits
@@ -99,12 +106,19 @@ namespace rgw::dedup {
     } __attribute__((__packed__));
     static_assert(sizeof(value_t) == 8);
 
+    // 32 Bytes unified entries
+    struct table_entry_t {
+      key_t key;
+      value_t val;
+    } __attribute__((__packed__));
+    static_assert(sizeof(table_entry_t) == 32);
+
     dedup_table_t(const DoutPrefixProvider* _dpp,
                   uint32_t _head_object_size,
                   uint8_t *p_slab,
                   uint64_t slab_size);
     int add_entry(key_t *p_key, disk_block_id_t block_id, record_id_t rec_id,
-                  bool shared_manifest);
+                  bool shared_manifest, bool delta);
     void update_entry(key_t *p_key, disk_block_id_t block_id, record_id_t rec_id,
                       bool shared_manifest);
 
@@ -117,21 +131,41 @@ namespace rgw::dedup {
     void count_duplicates(dedup_stats_t *p_small_objs_stat,
                           dedup_stats_t *p_big_objs_stat,
                           uint64_t *p_duplicate_head_bytes);
-
-    void remove_singletons_and_redistribute_keys();
+    void count_entry(const key_t &key,
+                     const value_t &val,
+                     dedup_stats_t *p_small_objs_stat,
+                     dedup_stats_t *p_big_objs_stat,
+                     uint64_t *p_duplicate_head_bytes) const;
+    bool is_small_object(const key_t &key) const;
+    // small single-part objects are only deduped in small-object mode
+    void set_small_object_dedup(bool enable) { small_object_dedup = enable; }
+    bool can_dedup_object(const key_t &key) const;
+
+    // Spill support:
+    // once the table passed its high-water mark it should be spilled, the
+    // entries are compacted to the front of the slab and sorted by key.
+    // The sorted entries stay valid until the next call to reset()
+    bool need_spill() const {
+      return (occupied_count >= entries_count - (entries_count / 8));
+    }
+    uint32_t sort_entries();
+    const table_entry_t* get_entries() const { return hash_tab; }
+    void reset();
+    // insert an entry merged from spilled runs (key must not be in the table)
+    int insert_merged_entry(const key_t &key, const value_t &val);
+    // sum the counters of two copies of the same key and pick the source
+    static void merge_values(value_t *p_dst, const value_t &src);
+
+    // when @delta_only is set, entries without a record from the current
+    // incremental delta are purged as well (they were handled by an earlier run)
+    void remove_singletons_and_redistribute_keys(bool delta_only);
   private:
-    // 32 Bytes unified entries
-    struct table_entry_t {
-      key_t key;
-      value_t val;
-    } __attribute__((__packed__));
-    static_assert(sizeof(table_entry_t) == 32);
-
     uint32_t find_entry(const key_t *p_key) const;
     uint32_t       values_count = 0;
     uint32_t       entries_count = 0;
     uint32_t       occupied_count = 0;
     uint32_t       head_object_size = (4ULL * 1024 * 1024);
+    bool           small_object_dedup = false;
     table_entry_t *hash_tab = nullptr;
 
     // stat counters
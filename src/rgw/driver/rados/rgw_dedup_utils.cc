@@ -144,6 +144,8 @@ namespace rgw::dedup {
     this->unique_count += other.unique_count;
     this->duplicate_count += other.duplicate_count;
     this->dedup_bytes_estimate += other.dedup_bytes_estimate;
+    this->singleton_bytes += other.singleton_bytes;
+    this->unique_bytes += other.unique_bytes;
     return *this;
   }
 
@@ -160,22 +162,28 @@ namespace rgw::dedup {
   //---------------------------------------------------------------------------
   void encode(const dedup_stats_t& ds, ceph::bufferlist& bl)
   {
-    ENCODE_START(1, 1, bl);
+    ENCODE_START(2, 1, bl);
     encode(ds.singleton_count, bl);
     encode(ds.unique_count, bl);
     encode(ds.duplicate_count, bl);
     encode(ds.dedup_bytes_estimate, bl);
+    encode(ds.singleton_bytes, bl);
+    encode(ds.unique_bytes, bl);
     ENCODE_FINISH(bl);
   }
 
   //---------------------------------------------------------------------------
   void decode(dedup_stats_t& ds, ceph::bufferlist::const_iterator& bl)
   {
-    DECODE_START(1, bl);
+    DECODE_START(2, bl);
     decode(ds.singleton_count, bl);
     decode(ds.unique_count, bl);
     decode(ds.duplicate_count, bl);
     decode(ds.dedup_bytes_estimate, bl);
+    if (struct_v >= 2) {
+      decode(ds.singleton_bytes, bl);
+      decode(ds.unique_bytes, bl);
+    }
     DECODE_FINISH(bl);
   }
 
@@ -384,6 +392,9 @@ namespace rgw::dedup {
     this->ingress_skip_too_small += other.ingress_skip_too_small;
     this->ingress_skip_too_small_64KB_bytes += other.ingress_skip_too_small_64KB_bytes;
     this->ingress_skip_too_small_64KB += other.ingress_skip_too_small_64KB;
+    this->ingress_bilog_entries += other.ingress_bilog_entries;
+    this->ingress_skip_unchanged_shards += other.ingress_skip_unchanged_shards;
+    this->ingress_skip_unsampled_shards += other.ingress_skip_unsampled_shards;
 
     return *this;
   }
@@ -404,6 +415,9 @@ namespace rgw::dedup {
       if (this->small_multipart_obj) {
         f->dump_unsigned("Small Multipart obj count", this->small_multipart_obj);
       }
+      if (this->ingress_bilog_entries) {
+        f->dump_unsigned("Bucket-Index Log entries", this->ingress_bilog_entries);
+      }
     }
 
     {
@@ -448,6 +462,14 @@ namespace rgw::dedup {
                            this->ingress_skip_too_small_64KB_bytes);
         }
       }
+      if (this->ingress_skip_unchanged_shards) {
+        f->dump_unsigned("Ingress skip: unchanged Bucket-Index shards",
+                         this->ingress_skip_unchanged_shards);
+      }
+      if (this->ingress_skip_unsampled_shards) {
+        f->dump_unsigned("Ingress skip: unsampled Bucket-Index shards",
+                         this->ingress_skip_unsampled_shards);
+      }
     }
 
     {
@@ -475,7 +497,7 @@ namespace rgw::dedup {
   //---------------------------------------------------------------------------
   void encode(const worker_stats_t& w, ceph::bufferlist& bl)
   {
-    ENCODE_START(1, 1, bl);
+    ENCODE_START(3, 1, bl);
     encode(w.ingress_obj, bl);
     encode(w.ingress_obj_bytes, bl);
     encode(w.egress_records, bl);
@@ -503,13 +525,17 @@ namespace rgw::dedup {
     encode(w.ingress_skip_too_small_64KB, bl);
 
     encode(w.duration, bl);
+
+    encode(w.ingress_bilog_entries, bl);
+    encode(w.ingress_skip_unchanged_shards, bl);
+    encode(w.ingress_skip_unsampled_shards, bl);
     ENCODE_FINISH(bl);
   }
 
   //---------------------------------------------------------------------------
   void decode(worker_stats_t& w, ceph::bufferlist::const_iterator& bl)
   {
-    DECODE_START(1, bl);
+    DECODE_START(3, bl);
     decode(w.ingress_obj, bl);
     decode(w.ingress_obj_bytes, bl);
     decode(w.egress_records, bl);
@@ -532,6 +558,13 @@ namespace rgw::dedup {
     decode(w.ingress_skip_too_small_64KB, bl);
 
     decode(w.duration, bl);
+    if (struct_v >= 2) {
+      decode(w.ingress_bilog_entries, bl);
+      decode(w.ingress_skip_unchanged_shards, bl);
+    }
+    if (struct_v >= 3) {
+      decode(w.ingress_skip_unsampled_shards, bl);
+    }
     DECODE_FINISH(bl);
   }
 
@@ -583,6 +616,30 @@ namespace rgw::dedup {
     this->md_throttle_sleep_time_usec += other.md_throttle_sleep_time_usec;
     this->failed_table_load       += other.failed_table_load;
     this->failed_map_overflow     += other.failed_map_overflow;
+
+    this->chunked_objects         += other.chunked_objects;
+    this->chunked_tail_objs       += other.chunked_tail_objs;
+    this->chunks                  += other.chunks;
+    this->dup_chunks              += other.dup_chunks;
+    this->dup_chunks_bytes        += other.dup_chunks_bytes;
+    this->failed_chunk_dedup      += other.failed_chunk_dedup;
+    this->evicted_chunked_tails   += other.evicted_chunked_tails;
+    this->skipped_shared_tails    += other.skipped_shared_tails;
+
+    this->spilled_runs            += other.spilled_runs;
+    this->spilled_entries         += other.spilled_entries;
+    this->compacted_runs          += other.compacted_runs;
+    this->failed_spill            += other.failed_spill;
+
+    this->ingress_transformed_objs       += other.ingress_transformed_objs;
+    this->ingress_transformed_objs_bytes += other.ingress_transformed_objs_bytes;
+    this->xform_mismatch                 += other.xform_mismatch;
+
+    this->deduped_small_objects       += other.deduped_small_objects;
+    this->deduped_small_objects_bytes += other.deduped_small_objects_bytes;
+    this->small_blobs                 += other.small_blobs;
+    this->failed_small_blob           += other.failed_small_blob;
+    this->failed_small_blob_rollback  += other.failed_small_blob_rollback;
     return *this;
   }
 
@@ -621,6 +678,28 @@ namespace rgw::dedup {
       f->dump_unsigned("Dedup Bytes Estimate", ds.dedup_bytes_estimate);
     }
 
+    // Small Objects Dedup Section:
+    // Single-part objects with all their data in the head-object
+    if (this->deduped_small_objects || this->small_blobs) {
+      Formatter::ObjectSection small_dedup(*f, "small objects dedup");
+      f->dump_unsigned("Deduped Small Obj", this->deduped_small_objects);
+      f->dump_unsigned("Deduped Small Bytes", this->deduped_small_objects_bytes);
+      f->dump_unsigned("Shared Blobs", this->small_blobs);
+    }
+
+    // Chunk Dedup Section:
+    // Singleton objects which had their tail-objects split into shared chunks
+    if (this->chunked_objects || this->skipped_shared_tails) {
+      Formatter::ObjectSection chunk(*f, "Chunk Dedup");
+      f->dump_unsigned("Chunked Obj", this->chunked_objects);
+      f->dump_unsigned("Chunked Tail Obj", this->chunked_tail_objs);
+      f->dump_unsigned("Chunks", this->chunks);
+      f->dump_unsigned("Duplicate Chunks", this->dup_chunks);
+      f->dump_unsigned("Deduped Chunk Bytes", this->dup_chunks_bytes);
+      f->dump_unsigned("Evicted Chunked Tail Obj", this->evicted_chunked_tails);
+      f->dump_unsigned("Skipped Shared Tail Obj", this->skipped_shared_tails);
+    }
+
     // Potential Dedup Section:
     // What could be gained by allowing dedup for smaller objects (64KB-4MB)
     // Space wasted because of duplicated head-object (4MB)
@@ -650,6 +729,15 @@ namespace rgw::dedup {
       if (this->failed_map_overflow) {
         f->dump_unsigned("Failed Remap Overflow", this->failed_map_overflow);
       }
+      if (this->ingress_transformed_objs) {
+        f->dump_unsigned("Compressed/Encrypted objs", this->ingress_transformed_objs);
+        f->dump_unsigned("Compressed/Encrypted Bytes", this->ingress_transformed_objs_bytes);
+      }
+      if (this->spilled_runs) {
+        f->dump_unsigned("Spilled Table Runs", this->spilled_runs);
+        f->dump_unsigned("Spilled Table Entries", this->spilled_entries);
+        f->dump_unsigned("Compacted Table Runs", this->compacted_runs);
+      }
 
       f->dump_unsigned("Valid HASH attrs", this->valid_hash_attrs);
       f->dump_unsigned("Invalid HASH attrs", this->invalid_hash_attrs);
@@ -715,6 +803,19 @@ namespace rgw::dedup {
       if (this->failed_dedup) {
         f->dump_unsigned("Failed Dedup", this->failed_dedup);
       }
+      if (this->failed_chunk_dedup) {
+        f->dump_unsigned("Failed Chunk Dedup", this->failed_chunk_dedup);
+      }
+      if (this->failed_small_blob) {
+        f->dump_unsigned("Failed Small Blob", this->failed_small_blob);
+      }
+      if (this->failed_small_blob_rollback) {
+        f->dump_unsigned("Failed Small Blob Rollback",
+                         this->failed_small_blob_rollback);
+      }
+      if (this->failed_spill) {
+        f->dump_unsigned("Failed Table Spill", this->failed_spill);
+      }
     }
 
     {
@@ -728,13 +829,16 @@ namespace rgw::dedup {
       if (this->size_mismatch) {
         f->dump_unsigned("Size mismatch SRC/TGT", this->size_mismatch);
       }
+      if (this->xform_mismatch) {
+        f->dump_unsigned("Transform mismatch SRC/TGT", this->xform_mismatch);
+      }
     }
   }
 
   //---------------------------------------------------------------------------
   void encode(const md5_stats_t& m, ceph::bufferlist& bl)
   {
-    ENCODE_START(1, 1, bl);
+    ENCODE_START(6, 1, bl);
 
     encode(m.small_objs_stat, bl);
     encode(m.big_objs_stat, bl);
@@ -782,13 +886,38 @@ namespace rgw::dedup {
     encode(m.failed_map_overflow, bl);
 
     encode(m.duration, bl);
+
+    encode(m.chunked_objects, bl);
+    encode(m.chunked_tail_objs, bl);
+    encode(m.chunks, bl);
+    encode(m.dup_chunks, bl);
+    encode(m.dup_chunks_bytes, bl);
+    encode(m.failed_chunk_dedup, bl);
+
+    encode(m.spilled_runs, bl);
+    encode(m.spilled_entries, bl);
+    encode(m.compacted_runs, bl);
+    encode(m.failed_spill, bl);
+
+    encode(m.ingress_transformed_objs, bl);
+    encode(m.ingress_transformed_objs_bytes, bl);
+    encode(m.xform_mismatch, bl);
+
+    encode(m.deduped_small_objects, bl);
+    encode(m.deduped_small_objects_bytes, bl);
+    encode(m.small_blobs, bl);
+    encode(m.failed_small_blob, bl);
+    encode(m.failed_small_blob_rollback, bl);
+
+    encode(m.evicted_chunked_tails, bl);
+    encode(m.skipped_shared_tails, bl);
     ENCODE_FINISH(bl);
   }
 
   //---------------------------------------------------------------------------
   void decode(md5_stats_t& m, ceph::bufferlist::const_iterator& bl)
   {
-    DECODE_START(1, bl);
+    DECODE_START(6, bl);
     decode(m.small_objs_stat, bl);
     decode(m.big_objs_stat, bl);
     decode(m.ingress_slabs, bl);
@@ -835,6 +964,36 @@ namespace rgw::dedup {
     decode(m.failed_map_overflow, bl);
 
     decode(m.duration, bl);
+    if (struct_v >= 2) {
+      decode(m.chunked_objects, bl);
+      decode(m.chunked_tail_objs, bl);
+      decode(m.chunks, bl);
+      decode(m.dup_chunks, bl);
+      decode(m.dup_chunks_bytes, bl);
+      decode(m.failed_chunk_dedup, bl);
+    }
+    if (struct_v >= 3) {
+      decode(m.spilled_runs, bl);
+      decode(m.spilled_entries, bl);
+      decode(m.compacted_runs, bl);
+      decode(m.failed_spill, bl);
+    }
+    if (struct_v >= 4) {
+      decode(m.ingress_transformed_objs, bl);
+      decode(m.ingress_transformed_objs_bytes, bl);
+      decode(m.xform_mismatch, bl);
+    }
+    if (struct_v >= 5) {
+      decode(m.deduped_small_objects, bl);
+      decode(m.deduped_small_objects_bytes, bl);
+      decode(m.small_blobs, bl);
+      decode(m.failed_small_blob, bl);
+      decode(m.failed_small_blob_rollback, bl);
+    }
+    if (struct_v >= 6) {
+      decode(m.evicted_chunked_tails, bl);
+      decode(m.skipped_shared_tails, bl);
+    }
     DECODE_FINISH(bl);
   }
 } //namespace rgw::dedup
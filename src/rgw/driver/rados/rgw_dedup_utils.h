@@ -70,6 +70,7 @@ namespace rgw::dedup {
     static constexpr uint8_t RGW_DEDUP_FLAG_SHARED_MANIFEST   = 0x02; // REC + TAB
     static constexpr uint8_t RGW_DEDUP_FLAG_OCCUPIED          = 0x04; // TAB
     static constexpr uint8_t RGW_DEDUP_FLAG_FASTLANE          = 0x08; // REC
+    static constexpr uint8_t RGW_DEDUP_FLAG_DELTA             = 0x10; // TAB
 
   public:
     dedup_flags_t() : flags(0) {}
@@ -84,6 +85,8 @@ namespace rgw::dedup {
     inline void clear_occupied() { this->flags &= ~RGW_DEDUP_FLAG_OCCUPIED; }
     inline bool is_fastlane()  const { return ((flags & RGW_DEDUP_FLAG_FASTLANE) != 0); }
     inline void set_fastlane()  { flags |= RGW_DEDUP_FLAG_FASTLANE; }
+    inline bool is_delta()  const { return ((flags & RGW_DEDUP_FLAG_DELTA) != 0); }
+    inline void set_delta()  { flags |= RGW_DEDUP_FLAG_DELTA; }
   private:
     uint8_t flags;
   };
@@ -182,6 +185,9 @@ namespace rgw::dedup {
     uint64_t unique_count = 0;
     uint64_t duplicate_count = 0;
     uint64_t dedup_bytes_estimate = 0;
+    // dedupable bytes of a single copy, used to scale sampled scans
+    uint64_t singleton_bytes = 0;
+    uint64_t unique_bytes = 0;
   };
 
   std::ostream& operator<<(std::ostream &out, const dedup_stats_t& stats);
@@ -219,6 +225,12 @@ namespace rgw::dedup {
     uint64_t ingress_skip_too_small_64KB_bytes = 0;
     uint64_t ingress_skip_too_small_64KB = 0;
 
+    // incremental scan
+    uint64_t ingress_bilog_entries = 0;
+    uint64_t ingress_skip_unchanged_shards = 0;
+    // sampled estimate scan
+    uint64_t ingress_skip_unsampled_shards = 0;
+
     utime_t  duration = {0, 0};
   };
   std::ostream& operator<<(std::ostream &out, const worker_stats_t &s);
@@ -276,6 +288,36 @@ namespace rgw::dedup {
     uint64_t md_throttle_sleep_time_usec = 0;
     uint64_t failed_table_load = 0;
     uint64_t failed_map_overflow = 0;
+
+    // chunk-level dedup of singleton objects
+    uint64_t chunked_objects = 0;
+    uint64_t chunked_tail_objs = 0;
+    uint64_t chunks = 0;
+    uint64_t dup_chunks = 0;
+    uint64_t dup_chunks_bytes = 0;
+    uint64_t failed_chunk_dedup = 0;
+    // chunked tails evicted again, and tails left alone as other objects share them
+    uint64_t evicted_chunked_tails = 0;
+    uint64_t skipped_shared_tails = 0;
+
+    // md5 shards which didn't fit in the table were spilled to sorted runs
+    uint64_t spilled_runs = 0;
+    uint64_t spilled_entries = 0;
+    uint64_t compacted_runs = 0;
+    uint64_t failed_spill = 0;
+
+    // compressed and convergent-encrypted objects are deduped only with
+    // objects stored with the same transform (compression layout/key)
+    uint64_t ingress_transformed_objs = 0;
+    uint64_t ingress_transformed_objs_bytes = 0;
+    uint64_t xform_mismatch = 0;
+
+    // small-object mode (head data moved to a shared blob)
+    uint64_t deduped_small_objects = 0;
+    uint64_t deduped_small_objects_bytes = 0;
+    uint64_t small_blobs = 0;
+    uint64_t failed_small_blob = 0;
+    uint64_t failed_small_blob_rollback = 0; // the blob was leaked
     utime_t  duration = {0, 0};
   };
   std::ostream &operator<<(std::ostream &out, const md5_stats_t &s);
@@ -293,6 +335,9 @@ namespace rgw::dedup {
   // CEPH min allocation unit on disk is 4KB
   // TBD: take from config
   static constexpr uint64_t DISK_ALLOC_SIZE = 4*1024;
+  // single-part objects smaller than this are never deduped (not even in
+  // small-object mode where the head data is moved into a shared blob)
+  static constexpr uint64_t MIN_SMALL_OBJ_DEDUP_SIZE = 64*1024;
   // 16 bytes hexstring  -> 8 Byte uint64_t
   static inline constexpr unsigned HEX_UNIT_SIZE = 16;
 
@@ -366,7 +366,7 @@ class RGWGCIOManager {
     librados::AioCompletion *c{nullptr};
     string oid;
     int index{-1};
-    string tag;
+    std::vector<string> tags;
   };
 
   deque<IO> ios;
@@ -396,6 +396,14 @@ public:
 
   int schedule_io(IoCtx *ioctx, const string& oid, ObjectWriteOperation *op,
 		  int index, const string& tag) {
+    return schedule_io(ioctx, oid, op, index, std::vector<string>{tag});
+  }
+
+  /* a batched op drops the refs of several tags, each of them is accounted
+   * as a single shadow object removal once the op completes
+   */
+  int schedule_io(IoCtx *ioctx, const string& oid, ObjectWriteOperation *op,
+		  int index, std::vector<string> tags) {
     while (ios.size() > max_aio) {
       if (gc->going_down()) {
         return 0;
@@ -412,7 +420,7 @@ public:
     if (ret < 0) {
       return ret;
     }
-    ios.push_back(IO{IO::TailIO, c.get(), oid, index, tag});
+    ios.push_back(IO{IO::TailIO, c.get(), oid, index, std::move(tags)});
     c.release();
 
     return 0;
@@ -444,7 +452,9 @@ public:
     }
 
     if (! gc->transitioned_objects_cache[io.index]) {
-      schedule_tag_removal(io.index, io.tag);
+      for (const auto& tag : io.tags) {
+        schedule_tag_removal(io.index, tag);
+      }
     }
 
   done:
@@ -562,6 +572,67 @@ public:
   }
 }; // class RGWGCIOManger
 
+int RGWGC::send_batched_puts(int index, batched_puts_t& puts,
+                             RGWGCIOManager& io_manager)
+{
+  /* the map is ordered by pool, so a single ioctx is created per pool */
+  IoCtx ctx;
+  string last_pool;
+  bool pool_valid = false;
+  auto puts_guard = make_scope_guard(
+    [&]
+      {
+        puts.clear();
+      }
+    );
+
+  for (auto& [key, tags] : puts) {
+    const auto& [pool, loc, oid] = key;
+    if (pool != last_pool) {
+      last_pool = pool;
+      ctx = IoCtx();
+      int ret = rgw_init_ioctx(this, store->get_rados_handle(), pool, ctx);
+      pool_valid = (ret == 0);
+      if (ret < 0) {
+        ldpp_dout(this, 0) << "ERROR: failed to create ioctx pool=" <<
+          pool << dendl;
+        if (transitioned_objects_cache[index]) {
+          return ret;
+        }
+      }
+    }
+    if (! pool_valid) {
+      continue;
+    }
+
+    ctx.locator_set_key(loc);
+    ctx.set_pool_full_try(); // allow deletion at pool quota limit
+
+    ldpp_dout(this, 5) << "RGWGC::process removing " << pool << ":" << oid <<
+      ", num_refs=" << tags.size() << dendl;
+    ObjectWriteOperation op;
+    if (tags.size() == 1) {
+      cls_refcount_put(op, tags.front(), true);
+    } else {
+      cls_refcount_put_many(op, tags, true);
+    }
+
+    int ret = io_manager.schedule_io(&ctx, oid, &op, index, std::move(tags));
+    if (ret < 0) {
+      ldpp_dout(this, 0) <<
+        "WARNING: failed to schedule deletion for oid=" << oid << dendl;
+      if (transitioned_objects_cache[index]) {
+        //If deleting oid failed for any of them, we will not delete queue entries
+        return ret;
+      }
+    }
+    if (going_down()) {
+      return -EAGAIN;
+    }
+  }
+  return 0;
+}
+
 int RGWGC::process(int index, int max_secs, bool expired_only,
                    RGWGCIOManager& io_manager, optional_yield y)
 {
@@ -595,6 +666,12 @@ int RGWGC::process(int index, int max_secs, bool expired_only,
   string marker;
   string next_marker;
   bool truncated = false;
+  /* tails shared by several deleted objects (e.g. deduped tails) drop the refs
+   * of all the listed entries with a single op */
+  const bool batch_refcount = cct->_conf->rgw_gc_batch_refcount;
+  const uint64_t inject_timeout = cct->_conf->rgw_debug_inject_gc_timeout_entries;
+  uint64_t num_processed = 0;
+  batched_puts_t batched_puts;
   IoCtx *ctx = new IoCtx;
   do {
     int max = 100;
@@ -646,6 +723,7 @@ int RGWGC::process(int index, int max_secs, bool expired_only,
     marker = next_marker;
 
     string last_pool;
+    bool timed_out = false;
     std::list<cls_rgw_gc_obj_info>::iterator iter;
     for (iter = entries.begin(); iter != entries.end(); ++iter) {
       cls_rgw_gc_obj_info& info = *iter;
@@ -657,8 +735,12 @@ int RGWGC::process(int index, int max_secs, bool expired_only,
       cls_rgw_obj_chain& chain = info.chain;
 
       utime_t now = ceph_clock_now();
-      if (now >= end) {
-        goto done;
+      if (now >= end ||
+          (inject_timeout > 0 && num_processed++ >= inject_timeout)) {
+        /* finish the entries handled so far below, so that a chunk which
+         * can't be completed in time still makes progress */
+        timed_out = true;
+        break;
       }
       if (! transitioned_objects_cache[index]) {
         if (chain.objs.empty()) {
@@ -669,6 +751,10 @@ int RGWGC::process(int index, int max_secs, bool expired_only,
       }
       if (! chain.objs.empty()) {
 	for (const auto& obj : chain.objs) {
+	  if (batch_refcount) {
+	    batched_puts[{obj.pool, obj.loc, obj.key.name}].push_back(info.tag);
+	    continue;
+	  }
 	  if (obj.pool != last_pool) {
 	    delete ctx;
 	    ctx = new IoCtx;
@@ -712,20 +798,31 @@ int RGWGC::process(int index, int max_secs, bool expired_only,
 	} // chains loop
       } // else -- chains not empty
     } // entries loop
-    if (transitioned_objects_cache[index] && entries.size() > 0) {
+    if (! batched_puts.empty()) {
+      ret = send_batched_puts(index, batched_puts, io_manager);
+      if (ret < 0) {
+        goto done;
+      }
+    }
+    if (transitioned_objects_cache[index] && iter != entries.begin()) {
       ret = io_manager.drain_ios();
       if (ret < 0) {
         goto done;
       }
       //Remove the entries from the queue
-      ldpp_dout(this, 5) << "RGWGC::process removing entries, marker: " << marker << dendl;
-      ret = io_manager.remove_queue_entries(index, entries.size(), null_yield);
+      const auto num_entries = std::distance(entries.begin(), iter);
+      ldpp_dout(this, 5) << "RGWGC::process removing " << num_entries <<
+        " entries, marker: " << marker << dendl;
+      ret = io_manager.remove_queue_entries(index, num_entries, null_yield);
       if (ret < 0) {
         ldpp_dout(this, 0) <<
           "WARNING: failed to remove queue entries" << dendl;
         goto done;
       }
     }
+    if (timed_out) {
+      goto done;
+    }
   } while (truncated);
 
 done:
@@ -29,6 +29,11 @@ class RGWGC : public DoutPrefixProvider {
   int tag_index(const std::string& tag);
   int send_chain(const cls_rgw_obj_chain& chain, const std::string& tag, optional_yield y);
 
+  /* refcount puts of the listed entries, grouped by (pool, locator, oid) */
+  using batched_puts_t = std::map<std::tuple<std::string, std::string, std::string>,
+                                  std::vector<std::string>>;
+  int send_batched_puts(int index, batched_puts_t& puts, RGWGCIOManager& io_manager);
+
   class GCWorker : public Thread {
     const DoutPrefixProvider *dpp;
     CephContext *cct;
@@ -21,6 +21,7 @@
 #include "services/svc_sys_obj.h"
 #include "services/svc_zone.h"
 #include "rgw_sal_rados.h"
+#include "rgw_dedup_inline.h"
 
 #include "cls/version/cls_version_client.h"
 
@@ -130,6 +131,9 @@ int HeadObjectProcessor::process(bufferlist&& data, uint64_t logical_offset)
 }
 
 
+// tail data held back by inline dedup, across all uploads
+static InlineDedupBudget inline_dedup_budget;
+
 static int process_completed(const AioResultList& completed, RawObjSet *written)
 {
   std::optional<int> error;
@@ -289,7 +293,11 @@ int AtomicObjectProcessor::process_first_chunk(bufferlist&& data,
                                                DataProcessor **processor)
 {
   first_chunk = std::move(data);
-  *processor = &stripe;
+  if (dedup) {
+    *processor = &*dedup;
+  } else {
+    *processor = &stripe;
+  }
   return 0;
 }
 
@@ -365,9 +373,60 @@ int AtomicObjectProcessor::prepare(optional_yield y)
   // initialize the processors
   chunk = ChunkProcessor(&writer, chunk_size);
   stripe = StripeProcessor(&chunk, this, head_max_size);
+
+  // inline dedup only shares tails, the head is always written
+  const auto& conf = store->ctx()->_conf;
+  if (head_max_size > 0 && conf.get_val<bool>("rgw_dedup_inline")) {
+    dedup.emplace(&stripe, conf.get_val<Option::size_t>("rgw_dedup_inline_max_defer"),
+                  inline_dedup_budget,
+                  conf.get_val<Option::size_t>("rgw_dedup_inline_max_defer_total"));
+  }
   return 0;
 }
 
+int AtomicObjectProcessor::share_indexed_tail(const std::string& fp_key,
+                                              uint64_t head_size,
+                                              uint64_t actual_size,
+                                              RGWObjManifest *p_manifest,
+                                              optional_yield y)
+{
+  int r = rgw::dedup::inline_fp_find_source(dpp, store, fp_key, head_size,
+                                            actual_size, tail_placement_rule,
+                                            head_obj, p_manifest, y);
+  if (r < 0) {
+    return r;
+  }
+  r = rgw::dedup::inline_fp_get_tail_refs(dpp, store, *p_manifest, unique_tag, y);
+  if (r < 0) {
+    return r;
+  }
+  p_manifest->set_head(bucket_info.placement_rule, head_obj, head_size);
+  ldpp_dout(dpp, 10) << "inline dedup: " << head_obj << " shares the tail "
+                     << fp_key << dendl;
+  return 0;
+}
+
+int AtomicObjectProcessor::find_inline_dedup_source(const rgw::sal::Attrs& attrs,
+                                                    std::string *p_fp_key,
+                                                    RGWObjManifest *p_manifest,
+                                                    optional_yield y)
+{
+  // only plain objects with a tail are indexed
+  const uint64_t actual_size = get_actual_size();
+  const uint64_t head_size = first_chunk.length();
+  if (actual_size <= head_size ||
+      attrs.count(RGW_ATTR_CRYPT_MODE) ||
+      attrs.count(RGW_ATTR_COMPRESSION) ||
+      attrs.count(RGW_ATTR_CLOUD_TIER_TYPE)) {
+    return -ENOENT;
+  }
+
+  uint8_t hash[BLAKE3_OUT_LEN];
+  dedup->get_hash(hash);
+  *p_fp_key = rgw::dedup::inline_fp_key(hash, head_size, actual_size);
+  return share_indexed_tail(*p_fp_key, head_size, actual_size, p_manifest, y);
+}
+
 int AtomicObjectProcessor::complete(
 				size_t accounted_size,
 				const std::string& etag,
@@ -384,14 +443,62 @@ int AtomicObjectProcessor::complete(
 				const req_context& rctx,
 				uint32_t flags)
 {
+  std::string fp_key;
+  RGWObjManifest dedup_manifest;
+  bool deduped = false;
+  if (!shared_tail_fp.empty()) {
+    // only the head data was received, the tail has to be shared
+    uint64_t head_size = 0, obj_size = 0;
+    int r = -EINVAL;
+    if (rgw::dedup::inline_fp_parse_key(shared_tail_fp, &head_size, &obj_size) &&
+        head_size == get_actual_size() && head_size == first_chunk.length() &&
+        obj_size == shared_tail_size) {
+      r = share_indexed_tail(shared_tail_fp, head_size, obj_size, &dedup_manifest, rctx.y);
+    }
+    if (r < 0) {
+      // the local source went away after it was looked up, retry the fetch
+      ldpp_dout(dpp, 5) << "inline dedup: failed sharing the tail "
+                        << shared_tail_fp << " r=" << r << dendl;
+      return -EAGAIN;
+    }
+    deduped = true;
+    fp_key = shared_tail_fp;
+  } else if (dedup) {
+    deduped = (find_inline_dedup_source(attrs, &fp_key, &dedup_manifest, rctx.y) == 0);
+    if (deduped) {
+      // the deferred tail data is never written
+      dedup->discard();
+    } else {
+      // write the deferred tail data
+      int r = dedup->release();
+      if (r < 0) {
+        return r;
+      }
+    }
+  }
+
   int r = writer.drain();
   if (r < 0) {
+    if (deduped) {
+      rgw::dedup::inline_fp_put_tail_refs(dpp, store, dedup_manifest, unique_tag, rctx.y);
+    }
     return r;
   }
-  const uint64_t actual_size = get_actual_size();
-  r = manifest_gen.create_next(actual_size);
-  if (r < 0) {
-    return r;
+  const uint64_t actual_size = (shared_tail_fp.empty() ? get_actual_size() : shared_tail_size);
+  RGWObjManifest *pmanifest = &manifest;
+  if (!fp_key.empty()) {
+    // advertise the tail fingerprint so other zones can share the tail on sync
+    bufferlist fp_bl;
+    fp_bl.append(fp_key);
+    attrs[RGW_ATTR_DEDUP_TAIL_FP] = std::move(fp_bl);
+  }
+  if (deduped) {
+    pmanifest = &dedup_manifest;
+  } else {
+    r = manifest_gen.create_next(actual_size);
+    if (r < 0) {
+      return r;
+    }
   }
 
   obj_ctx.set_atomic(head_obj, true);
@@ -403,7 +510,7 @@ int AtomicObjectProcessor::complete(
 
   RGWRados::Object::Write obj_op(&op_target);
   obj_op.meta.data = &first_chunk;
-  obj_op.meta.manifest = &manifest;
+  obj_op.meta.manifest = pmanifest;
   obj_op.meta.ptag = &unique_tag; /* use req_id as operation tag */
   obj_op.meta.if_match = if_match;
   obj_op.meta.if_nomatch = if_nomatch;
@@ -418,7 +525,7 @@ int AtomicObjectProcessor::complete(
   obj_op.meta.zones_trace = zones_trace;
   obj_op.meta.modify_tail = true;
 
-  r = read_cloudtier_info_from_attrs(attrs, obj_op.meta.category, obj_op.meta.olh_epoch, manifest);
+  r = read_cloudtier_info_from_attrs(attrs, obj_op.meta.category, obj_op.meta.olh_epoch, *pmanifest);
 
   if (r < 0) { // incase of any errors while decoding tier_config/restore attrs
     return r;
@@ -431,12 +538,27 @@ int AtomicObjectProcessor::complete(
       // The head object write may eventually succeed, clear the set of objects for deletion. if it
       // doesn't ever succeed, we'll orphan any tail objects as if we'd crashed before that write
       writer.clear_written();
+    } else if (deduped) {
+      rgw::dedup::inline_fp_put_tail_refs(dpp, store, dedup_manifest, unique_tag, rctx.y);
     }
     return r;
   }
   if (!obj_op.meta.canceled) {
-    // on success, clear the set of objects for deletion
-    writer.clear_written();
+    // on success, clear the set of objects for deletion. a deduped object
+    // uses a shared tail so any tail data we wrote is removed
+    if (!deduped) {
+      writer.clear_written();
+    }
+    if (!deduped && !fp_key.empty()) {
+      // make this object a dedup source for future uploads
+      rgw::dedup::inline_fp_entry_t entry;
+      entry.bucket = head_obj.bucket;
+      store->obj_to_raw(bucket_info.placement_rule, head_obj, &entry.head);
+      entry.prefix = manifest.get_prefix();
+      rgw::dedup::inline_fp_store(dpp, store, fp_key, entry, rctx.y);
+    }
+  } else if (deduped) {
+    rgw::dedup::inline_fp_put_tail_refs(dpp, store, dedup_manifest, unique_tag, rctx.y);
   }
   if (pcanceled) {
     *pcanceled = obj_op.meta.canceled;
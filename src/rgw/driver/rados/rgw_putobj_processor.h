@@ -171,8 +171,24 @@ class AtomicObjectProcessor : public ManifestObjectProcessor {
   const std::optional<uint64_t> olh_epoch;
   const std::string unique_tag;
   bufferlist first_chunk; // written with the head in complete()
+  std::optional<InlineDedupProcessor> dedup; // set when inline dedup is enabled
+  std::string shared_tail_fp; // the tail is shared instead of being written
+  uint64_t shared_tail_size = 0;
 
   int process_first_chunk(bufferlist&& data, rgw::sal::DataProcessor **processor) override;
+  // share the tail of the object indexed under @fp_key, on success @p_manifest
+  // describes our object and holds a reference on the shared tail
+  int share_indexed_tail(const std::string& fp_key,
+                         uint64_t head_size,
+                         uint64_t actual_size,
+                         RGWObjManifest *p_manifest,
+                         optional_yield y);
+  // look for an existing copy of the tail in the fingerprint index.
+  // on success @p_manifest describes our object using the shared tail
+  int find_inline_dedup_source(const rgw::sal::Attrs& attrs,
+                               std::string *p_fp_key,
+                               RGWObjManifest *p_manifest,
+                               optional_yield y);
  public:
   AtomicObjectProcessor(Aio *aio, RGWRados* store,
                         RGWBucketInfo& bucket_info,
@@ -187,6 +203,14 @@ class AtomicObjectProcessor : public ManifestObjectProcessor {
       olh_epoch(olh_epoch), unique_tag(unique_tag)
   {}
 
+  // the tail of the object is already stored locally under @fp_key in the
+  // inline dedup index. only the head data is processed and complete() shares
+  // the indexed tail, so the object is created without transferring its tail
+  void set_shared_tail(const std::string& fp_key, uint64_t obj_size) {
+    shared_tail_fp = fp_key;
+    shared_tail_size = obj_size;
+  }
+
   // prepare a trivial manifest
   int prepare(optional_yield y) override;
   // write the head object atomically in a bucket index transaction
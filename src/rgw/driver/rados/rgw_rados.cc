@@ -60,6 +60,7 @@
 #include "rgw_bl_rados.h"
 #include "rgw_http_errors.h"
 #include "rgw_multipart_meta_filter.h"
+#include "rgw_dedup_inline.h"
 
 #undef fork // fails to compile RGWPeriod::fork() below
 
@@ -3616,6 +3617,7 @@ class RGWRadosPutObj : public RGWHTTPStreamRWRequest::ReceiveCB
   uint64_t extra_data_left{0};
   bool need_to_process_attrs{true};
   uint64_t data_len{0};
+  int http_status{0};
   map<string, bufferlist> src_attrs;
   uint64_t ofs{0};
   uint64_t lofs{0}; /* logical ofs */
@@ -3768,6 +3770,11 @@ public:
     return 0;
   }
 
+  // only part of the object data is transferred
+  void disable_etag_verify() {
+    try_etag_verify = false;
+  }
+
   int handle_data(bufferlist& bl, bool *pause) override {
     if (progress_cb) {
       progress_cb(data_len, progress_data);
@@ -3839,7 +3846,12 @@ public:
     }
   }
 
+  int get_http_status() const {
+    return http_status;
+  }
+
   int handle_headers(const map<string, string>& headers, int http_status) override {
+    this->http_status = http_status;
     if (src_bucket_perms && http_status != 403 && http_status != 401) {
       auto iter = headers.find("RGWX_PERM_CHECKED");
       // if the header is not present, we need to check the ACL
@@ -4445,6 +4457,49 @@ int RGWFetchObjFilter_Default::filter(CephContext *cct,
   return 0;
 }
 
+/*
+ * multisite dedup: a remote object written with inline dedup advertises the
+ * fingerprint of its tail. when the fingerprint is found in the local inline
+ * dedup index (with a usable layout) only the head has to be fetched.
+ * returns the head size to fetch or 0 when the whole object must be fetched
+ */
+static uint64_t find_sync_dedup_source(const DoutPrefixProvider *dpp,
+                                       RGWRados *store,
+                                       const map<string, bufferlist>& src_attrs,
+                                       uint64_t src_size,
+                                       const rgw_placement_rule& tail_rule,
+                                       const rgw_obj& dest_obj,
+                                       string *fp_key,
+                                       optional_yield y)
+{
+  auto iter = src_attrs.find(RGW_ATTR_DEDUP_TAIL_FP);
+  if (iter == src_attrs.end() ||
+      src_attrs.count(RGW_ATTR_CRYPT_MODE) ||
+      src_attrs.count(RGW_ATTR_COMPRESSION) ||
+      src_attrs.count(RGW_ATTR_CLOUD_TIER_TYPE)) {
+    return 0;
+  }
+  *fp_key = iter->second.to_str();
+  uint64_t head_size = 0, obj_size = 0;
+  if (!rgw::dedup::inline_fp_parse_key(*fp_key, &head_size, &obj_size) ||
+      obj_size != src_size || head_size == 0 || head_size >= obj_size) {
+    return 0;
+  }
+  // the head is written uncompressed so the tail can't be compressed either
+  const auto& compression_type = store->svc.zone->get_zone_params().get_compression_type(tail_rule);
+  if (compression_type != "none") {
+    return 0;
+  }
+  RGWObjManifest manifest;
+  int ret = rgw::dedup::inline_fp_find_source(dpp, store, *fp_key, head_size,
+                                              obj_size, tail_rule, dest_obj,
+                                              &manifest, y);
+  if (ret < 0) {
+    return 0;
+  }
+  return head_size;
+}
+
 int RGWRados::fetch_remote_obj(RGWObjectCtx& dest_obj_ctx,
                const rgw_owner* user_id,
                const rgw_user* perm_check_uid,
@@ -4611,6 +4666,11 @@ int RGWRados::fetch_remote_obj(RGWObjectCtx& dest_obj_ctx,
 
   obj_time_weight dest_mtime_weight;
   rgw_zone_set_entry dst_zone_trace(svc.zone->get_zone().id, dest_bucket_info.bucket.get_key());
+  // the size of the head to fetch when the tail is shared with a local copy
+  uint64_t shared_tail_head_size = 0;
+  uint64_t src_size = 0;
+  string shared_tail_fp;
+  string src_etag;
 
   if (copy_if_newer) {
     /* need to get mtime for destination */
@@ -4631,13 +4691,66 @@ int RGWRados::fetch_remote_obj(RGWObjectCtx& dest_obj_ctx,
   static constexpr bool skip_decrypt = true;
   static constexpr bool sync_cloudtiered = true;
 
+  if (!source_zone.empty() && cct->_conf.get_val<bool>("rgw_dedup_sync_fingerprint")) {
+    map<string, bufferlist> src_attrs;
+    int r = stat_remote_obj(rctx.dpp, dest_obj_ctx, user_id, info, source_zone,
+                            src_obj, src_bucket_info, nullptr, &src_size, pmod,
+                            unmod_ptr, high_precision_time, if_match, if_nomatch,
+                            &src_attrs, nullptr, nullptr, nullptr, &src_etag, rctx.y);
+    const rgw_placement_rule *ptail_rule = nullptr;
+    if (r >= 0) {
+      r = filter->filter(cct, src_obj.key, dest_bucket_info, dest_placement_rule,
+                         src_attrs, &override_owner, &ptail_rule);
+    }
+    // the ranged read is made conditional on the etag, without one the
+    // head could come from another version of the object
+    if (r >= 0 && !src_etag.empty()) {
+      shared_tail_head_size = find_sync_dedup_source(rctx.dpp, this, src_attrs, src_size,
+                                                     *ptail_rule, dest_obj, &shared_tail_fp,
+                                                     rctx.y);
+    }
+    if (shared_tail_head_size > 0) {
+      ldpp_dout(rctx.dpp, 10) << "fetching only the head of " << fetched_obj
+                              << ", the tail is shared with " << shared_tail_fp << dendl;
+      processor.set_shared_tail(shared_tail_fp, src_size);
+      cb.disable_etag_verify();
+    } else if (r < 0) {
+      // not fatal, the object is fetched as usual
+      ldpp_dout(rctx.dpp, 10) << "sync fingerprint lookup of " << fetched_obj
+                              << " failed r=" << r << dendl;
+    }
+  }
+
   static constexpr int NUM_ENPOINT_IOERROR_RETRIES = 20;
   for (int tries = 0; tries < NUM_ENPOINT_IOERROR_RETRIES; tries++) {
-    ret = conn->get_obj(rctx.dpp, user_id, perm_check_uid, info, src_obj, pmod, unmod_ptr,
-                        dest_mtime_weight.zone_short_id, dest_mtime_weight.pg_ver, prepend_meta, get_op, rgwx_stat,
-                        sync_manifest, skip_decrypt, &dst_zone_trace,
-                        sync_cloudtiered, true,
-                        &cb, &in_stream_req);
+    if (shared_tail_head_size > 0) {
+      RGWRESTConn::get_obj_params params;
+      params.uid = user_id;
+      params.perm_check_uid = perm_check_uid;
+      params.info = info;
+      params.mod_ptr = pmod;
+      params.unmod_ptr = unmod_ptr;
+      params.mod_pg_ver = dest_mtime_weight.pg_ver;
+      params.prepend_metadata = prepend_meta;
+      params.get_op = get_op;
+      params.rgwx_stat = rgwx_stat;
+      params.sync_manifest = sync_manifest;
+      params.skip_decrypt = skip_decrypt;
+      params.sync_cloudtiered = sync_cloudtiered;
+      params.dst_zone_trace = &dst_zone_trace;
+      params.cb = &cb;
+      params.etag = src_etag;
+      params.range_is_set = true;
+      params.range_start = 0;
+      params.range_end = shared_tail_head_size - 1;
+      ret = conn->get_obj(rctx.dpp, src_obj, params, true, &in_stream_req);
+    } else {
+      ret = conn->get_obj(rctx.dpp, user_id, perm_check_uid, info, src_obj, pmod, unmod_ptr,
+                          dest_mtime_weight.zone_short_id, dest_mtime_weight.pg_ver, prepend_meta, get_op, rgwx_stat,
+                          sync_manifest, skip_decrypt, &dst_zone_trace,
+                          sync_cloudtiered, true,
+                          &cb, &in_stream_req);
+    }
     if (ret < 0) {
       goto set_err_state;
     }
@@ -4645,6 +4758,12 @@ int RGWRados::fetch_remote_obj(RGWObjectCtx& dest_obj_ctx,
     ret = conn->complete_request(rctx.dpp, in_stream_req, &etag, &set_mtime,
                                  &accounted_size, nullptr, nullptr, rctx.y);
     if (ret < 0) {
+      if (shared_tail_head_size > 0 && cb.get_http_status() == 412) {
+        // the object changed since it was stat'd, sync retries it
+        ldpp_dout(rctx.dpp, 5) << fetched_obj << " changed while fetching its head" << dendl;
+        ret = -EAGAIN;
+        goto set_err_state;
+      }
       if (ret == -ERR_INTERNAL_ERROR && tries < NUM_ENPOINT_IOERROR_RETRIES - 1) {
         ldpp_dout(rctx.dpp, 20) << __func__ << "(): failed to fetch " << fetched_obj
                                 << " from remote. retries=" << tries << dendl;
@@ -4665,6 +4784,24 @@ int RGWRados::fetch_remote_obj(RGWObjectCtx& dest_obj_ctx,
         << " bytes but received " << cb.get_data_len() << dendl;
     goto set_err_state;
   }
+  if (shared_tail_head_size > 0) {
+    // the ranged read only returned the head, the tail is shared locally
+    if (accounted_size != shared_tail_head_size) {
+      ret = -EIO;
+      ldpp_dout(rctx.dpp, 0) << "ERROR: " << fetched_obj << " expected a head of "
+          << shared_tail_head_size << " bytes but received " << accounted_size << dendl;
+      goto set_err_state;
+    }
+    // the head must belong to the object whose tail fingerprint we share
+    auto fp = cb.get_attrs().find(RGW_ATTR_DEDUP_TAIL_FP);
+    if (fp == cb.get_attrs().end() || fp->second.to_str() != shared_tail_fp) {
+      ret = -EAGAIN;
+      ldpp_dout(rctx.dpp, 5) << fetched_obj << " tail fingerprint changed while "
+          << "fetching its head, expected " << shared_tail_fp << dendl;
+      goto set_err_state;
+    }
+    accounted_size = src_size;
+  }
 
   if (compressor && compressor->is_compressed()) {
     bufferlist tmp;
@@ -500,6 +500,9 @@ void usage()
   cout << "   --max-bucket-index-ops        specify max bucket-index requests per second allowed for an RGW during dedup, 0 means unlimited\n";
   cout << "   --max-metadata-ops            specify max metadata requests per second allowed for an RGW during dedup, 0 means unlimited\n";
   cout << "   --stat                        display dedup throttle setting\n";
+  cout << "\nDedup options:\n";
+  cout << "   --incremental                 only scan objects added since the last incremental dedup run\n";
+  cout << "   --sample-percent              dedup estimate reads only this percent of the bucket-index shards (1-100)\n";
   cout << "\nQuota options:\n";
   cout << "   --max-objects                 specify max objects (negative value to disable)\n";
   cout << "   --max-size                    specify max size (in B/K/M/G/T, negative value to disable)\n";
@@ -3675,6 +3678,7 @@ int main(int argc, const char **argv)
   int purge_keys = false;
   int yes_i_really_mean_it = false;
   int throttle_stat = false;
+  int dedup_incremental = false;
   int delete_child_objects = false;
   int fix = false;
   int remove_bad = false;
@@ -3731,6 +3735,7 @@ int main(int argc, const char **argv)
   int64_t max_write_bytes = 0;
   uint32_t max_bucket_index_ops = 0;
   uint32_t max_metadata_ops = 0;
+  uint32_t dedup_sample_percent = 100;
   bool have_max_objects = false;
   bool have_max_size = false;
   bool have_max_write_ops = false;
@@ -4079,6 +4084,12 @@ int main(int argc, const char **argv)
 	return EINVAL;
       }
       have_max_metadata_ops = true;
+    } else if (ceph_argparse_witharg(args, i, &val, "--sample-percent", (char*)NULL)) {
+      dedup_sample_percent = (int64_t)strict_strtoll(val.c_str(), 10, &err);
+      if (!err.empty() || dedup_sample_percent == 0 || dedup_sample_percent > 100) {
+	cerr << "ERROR: --sample-percent must be in the range 1-100" << std::endl;
+	return EINVAL;
+      }
     } else if (ceph_argparse_witharg(args, i, &val, "--date", "--time", (char*)NULL)) {
       date = val;
       if (end_date.empty())
@@ -4173,6 +4184,8 @@ int main(int argc, const char **argv)
       // do nothing
     } else if (ceph_argparse_binary_flag(args, i, &yes_i_really_mean_it, NULL, "--yes-i-really-mean-it", (char*)NULL)) {
       // do nothing
+    } else if (ceph_argparse_binary_flag(args, i, &dedup_incremental, NULL, "--incremental", (char*)NULL)) {
+      // do nothing
     } else if (ceph_argparse_binary_flag(args, i, &throttle_stat, NULL, "--stat", (char*)NULL)) {
       // do nothing
     } else if (ceph_argparse_binary_flag(args, i, &fix, NULL, "--fix", (char*)NULL)) {
@@ -9383,8 +9396,16 @@ next:
       dedup_req_type_t dedup_type = dedup_req_type_t::DEDUP_TYPE_NONE;
       if (opt_cmd == OPT::DEDUP_ESTIMATE) {
 	dedup_type = dedup_req_type_t::DEDUP_TYPE_ESTIMATE;
+	if (dedup_sample_percent < 100 && dedup_incremental) {
+	  cerr << "ERROR: --sample-percent can't be used with --incremental" << std::endl;
+	  return EINVAL;
+	}
       }
       else {
+	if (dedup_sample_percent < 100) {
+	  cerr << "ERROR: --sample-percent is only supported by dedup estimate" << std::endl;
+	  return EINVAL;
+	}
 	if (!yes_i_really_mean_it) {
 	  cerr << "Full Dedup is dangerous and could lead to data loss!\n"
 	       << "do you really mean it? (requires --yes-i-really-mean-it)"
@@ -9398,7 +9419,8 @@ next:
 #endif
       }
 
-      int ret = cluster::dedup_restart_scan(store, dedup_type, dpp());
+      int ret = cluster::dedup_restart_scan(store, dedup_type, dedup_incremental,
+                                            dedup_sample_percent, dpp());
       if (ret == 0) {
 	std::cout << "Dedup was restarted successfully" << std::endl;
       }
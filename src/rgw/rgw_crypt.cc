@@ -1038,6 +1038,51 @@ static int get_sse_s3_bucket_key(req_state *s, optional_yield y,
   return 0;
 }
 
+int rgw_crypt_convergent_fingerprint(const DoutPrefixProvider *dpp,
+                                     std::string_view content_md5,
+                                     std::string &fingerprint)
+{
+  fingerprint.clear();
+  std::string md5_bin;
+  try {
+    md5_bin = from_base64(content_md5);
+  } catch (...) {
+    md5_bin.clear();
+  }
+  if (md5_bin.length() != CEPH_CRYPTO_MD5_DIGESTSIZE) {
+    ldpp_dout(dpp, 5) << "ERROR: invalid Content-MD5 for convergent SSE-S3" << dendl;
+    return -ERR_INVALID_DIGEST;
+  }
+  char md5_hex[CEPH_CRYPTO_MD5_DIGESTSIZE * 2 + 1];
+  buf_to_hex((const unsigned char *)md5_bin.data(), md5_bin.length(), md5_hex);
+  fingerprint.assign(md5_hex);
+  return 0;
+}
+
+/*
+ * With rgw_crypt_sse_s3_convergent the object key is derived from the object
+ * MD5, which is only known up front for a single-part PUT carrying a
+ * Content-MD5 header (RGWPutObj fails the upload if the data doesn't match).
+ * Returns an empty fingerprint when convergent encryption doesn't apply.
+ */
+static int get_sse_s3_convergent_fingerprint(req_state *s,
+                                             std::string &fingerprint)
+{
+  fingerprint.clear();
+  if (!s->cct->_conf.get_val<bool>("rgw_crypt_sse_s3_convergent") ||
+      s->op_type != RGW_OP_PUT_OBJ ||
+      s->info.args.exists("uploadId") ||
+      s->info.args.exists("append")) {
+    return 0;
+  }
+
+  const char *content_md5 = s->info.env->get("HTTP_CONTENT_MD5");
+  if (!content_md5) {
+    return 0;
+  }
+  return rgw_crypt_convergent_fingerprint(s, content_md5, fingerprint);
+}
+
 int rgw_s3_prepare_encrypt(req_state* s, optional_yield y,
                            std::map<std::string, ceph::bufferlist>& attrs,
                            std::unique_ptr<BlockCrypt>* block_crypt,
@@ -1243,6 +1288,15 @@ int rgw_s3_prepare_encrypt(req_state* s, optional_yield y,
       set_attr(attrs, RGW_ATTR_CRYPT_CONTEXT, cooked_context);
       set_attr(attrs, RGW_ATTR_CRYPT_MODE, "AES256");
       set_attr(attrs, RGW_ATTR_CRYPT_KEYID, key_id);
+      std::string convergent;
+      res = get_sse_s3_convergent_fingerprint(s, convergent);
+      if (res != 0) {
+        return res;
+      }
+      if (!convergent.empty()) {
+        // key_version 0 is replaced by the version Vault used
+        set_attr(attrs, RGW_ATTR_CRYPT_CONVERGENT, "0:" + convergent);
+      }
       std::string actual_key;
       res = make_actual_key_from_sse_s3(s, attrs, y, actual_key);
       if (res != 0) {
@@ -179,3 +179,13 @@ static inline std::string get_str_attribute(const std::map<std::string, bufferli
 }
 
 int rgw_remove_sse_s3_bucket_key(req_state *s, optional_yield y);
+
+/**
+ * The convergent SSE-S3 fingerprint of an object: the hex of its base64
+ * Content-MD5. Identical plaintext has the same fingerprint, so the key
+ * derived from it under one bucket key is the same too.
+ * Returns -ERR_INVALID_DIGEST if content_md5 isn't a base64 MD5 digest.
+ */
+int rgw_crypt_convergent_fingerprint(const DoutPrefixProvider *dpp,
+                                     std::string_view content_md5,
+                                     std::string &fingerprint);
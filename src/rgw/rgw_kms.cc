@@ -178,6 +178,17 @@ add_name_val_to_obj(const char *n, std::string &v, rapidjson::GenericValue<E,A>
   add_name_val_to_obj(ns, v, d, allocator);
 }
 
+template<typename E, typename A = ZeroPoolAllocator>
+static inline void
+add_name_val_to_obj(const char *n, int v, rapidjson::GenericValue<E,A> &d,
+  A &allocator)
+{
+  rapidjson::GenericValue<E,A> name, val;
+  name.SetString(n, strlen(n), allocator);
+  val.SetInt(v);
+  d.AddMember(name, val, allocator);
+}
+
 template<typename E, typename A = ZeroPoolAllocator>
 static inline void
 add_name_val_to_obj(const char *n, bool v, rapidjson::GenericValue<E,A> &d,
@@ -631,6 +642,105 @@ public:
     }
   }
 
+  int convergent_key(const DoutPrefixProvider *dpp, map<string, bufferlist>& attrs,
+                     optional_yield y, std::string& actual_key)
+  {
+    std::string key_id = get_str_attribute(attrs, RGW_ATTR_CRYPT_KEYID);
+    if (compat == COMPAT_ONLY_OLD || key_id.find("/") != std::string::npos) {
+      ldpp_dout(dpp, 0) << "ERROR: convergent keys require a transit key" << dendl;
+      return -EINVAL;
+    }
+/*
+	RGW_ATTR_CRYPT_CONVERGENT: "<key_version>:<fingerprint>"
+	data: {input key_version}
+	post to prefix + /hmac/ + key_id + /sha2-256
+	jq: .data.hmac		-> "vault:v<key_version>:<base64 key>"
+	key_version 0 means latest, the version used is recorded in the attr
+*/
+    std::string convergent = get_str_attribute(attrs, RGW_ATTR_CRYPT_CONVERGENT);
+    size_t pos = convergent.find(':');
+    if (pos == std::string::npos || pos == 0) {
+      ldpp_dout(dpp, 0) << "ERROR: invalid " RGW_ATTR_CRYPT_CONVERGENT << dendl;
+      return -EINVAL;
+    }
+    int key_version = 0;
+    try {
+      key_version = std::stoi(convergent.substr(0, pos));
+    } catch (std::exception&) {
+      ldpp_dout(dpp, 0) << "ERROR: invalid key version in " RGW_ATTR_CRYPT_CONVERGENT << dendl;
+      return -EINVAL;
+    }
+    std::string input = to_base64(std::string_view(convergent).substr(pos + 1));
+
+    ZeroPoolDocument d { rapidjson::kObjectType };
+    auto &allocator { d.GetAllocator() };
+    bufferlist secret_bl;
+
+    add_name_val_to_obj("input", input, d, allocator);
+    if (key_version > 0) {
+      add_name_val_to_obj("key_version", key_version, d, allocator);
+    }
+    rapidjson::StringBuffer buf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buf);
+    if (!d.Accept(writer)) {
+      ldpp_dout(dpp, 0) << "ERROR: can't make json for vault" << dendl;
+      return -EINVAL;
+    }
+    std::string post_data { buf.GetString() };
+
+    int res = send_request(dpp, "POST", "/hmac/", key_id + "/sha2-256",
+                           post_data, y, secret_bl);
+    if (res < 0) {
+      ldpp_dout(dpp, 0) << "ERROR: Failed to send hmac request to Vault, res: "
+                        << res << " response: " << string_view(secret_bl.c_str(), secret_bl.length()) << dendl;
+      return res;
+    }
+
+    secret_bl.append('\0');
+    rapidjson::StringStream isw(secret_bl.c_str());
+    d.SetNull();
+    d.ParseStream<>(isw);
+
+    if (d.HasParseError()) {
+      ldpp_dout(dpp, 0) << "ERROR: Failed to parse JSON response from Vault: "
+	 << rapidjson::GetParseError_En(d.GetParseError()) << dendl;
+      return -EINVAL;
+    }
+    secret_bl.zero();
+
+    if (!d.IsObject()) {
+      ldpp_dout(dpp, 0) << "ERROR: response from Vault is not an object" << dendl;
+      return -EINVAL;
+    }
+    auto data_itr { d.FindMember("data") };
+    if (data_itr == d.MemberEnd() || !data_itr->value.IsObject()) {
+      ldpp_dout(dpp, 0) << "ERROR: no .data in response from Vault" << dendl;
+      return -EINVAL;
+    }
+    auto hmac_itr { data_itr->value.FindMember("hmac") };
+    if (hmac_itr == data_itr->value.MemberEnd() || !hmac_itr->value.IsString()) {
+      ldpp_dout(dpp, 0) << "ERROR: no .data.hmac in response from Vault" << dendl;
+      return -EINVAL;
+    }
+
+    // "vault:v<N>:<base64>"
+    std::string_view hmac { hmac_itr->value.GetString() };
+    constexpr std::string_view hmac_prefix { "vault:v" };
+    size_t sep = hmac.find(':', hmac_prefix.length());
+    if (hmac.substr(0, hmac_prefix.length()) != hmac_prefix ||
+        sep == std::string_view::npos) {
+      ldpp_dout(dpp, 0) << "ERROR: unexpected .data.hmac format from Vault" << dendl;
+      return -EINVAL;
+    }
+    if (key_version == 0) {
+      std::string used_version { hmac.substr(hmac_prefix.length(),
+                                             sep - hmac_prefix.length()) };
+      set_attr(attrs, RGW_ATTR_CRYPT_CONVERGENT,
+               used_version + convergent.substr(pos));
+    }
+    return decode_secret(dpp, std::string(hmac.substr(sep + 1)), actual_key);
+  }
+
   int create_bucket_key(const DoutPrefixProvider *dpp,
                         const std::string& key_name, optional_yield y)
   {
@@ -1051,6 +1161,9 @@ static int get_actual_key_from_vault(const DoutPrefixProvider *dpp,
   else if (RGW_SSE_KMS_VAULT_SE_TRANSIT == secret_engine){
     TransitSecretEngine engine(cct, kctx, std::move(secret_engine_parms));
     std::string key_id = get_str_attribute(attrs, RGW_ATTR_CRYPT_KEYID);
+    if (attrs.find(RGW_ATTR_CRYPT_CONVERGENT) != attrs.end()) {
+      return engine.convergent_key(dpp, attrs, y, actual_key);
+    }
     return make_it
 	? engine.make_actual_key(dpp, attrs, y, actual_key)
 	: engine.reconstitute_actual_key(dpp, attrs, y, actual_key);
@@ -96,4 +96,94 @@ int StripeProcessor::process(bufferlist&& data, uint64_t offset)
   return Pipe::process(std::move(data), offset - bounds.first);
 }
 
+
+bool InlineDedupBudget::try_get(uint64_t bytes, uint64_t max)
+{
+  uint64_t cur = used.load();
+  do {
+    if (max && cur + bytes > max) {
+      return false;
+    }
+  } while (!used.compare_exchange_weak(cur, cur + bytes));
+  return true;
+}
+
+void InlineDedupBudget::put(uint64_t bytes)
+{
+  [[maybe_unused]] uint64_t prev = used.fetch_sub(bytes);
+  ceph_assert(prev >= bytes);
+}
+
+
+void InlineDedupProcessor::put_budget()
+{
+  if (reserved) {
+    budget.put(reserved);
+    reserved = 0;
+  }
+}
+
+int InlineDedupProcessor::process(bufferlist&& data, uint64_t offset)
+{
+  if (data.length() == 0) {
+    if (pass_through) {
+      return Pipe::process(std::move(data), offset);
+    }
+    // hold back the flush with the data
+    flushed = true;
+    flush_offset = offset;
+    return 0;
+  }
+
+  for (const auto& bptr : data.buffers()) {
+    blake3_hasher_update(&hasher, (const unsigned char *)bptr.c_str(), bptr.length());
+  }
+  if (pass_through) {
+    return Pipe::process(std::move(data), offset);
+  }
+
+  const uint64_t len = data.length();
+  deferred_bytes += len;
+  deferred.emplace_back(std::move(data), offset);
+  if (deferred_bytes > max_defer || !budget.try_get(len, budget_max)) {
+    // too big to hold back, from now on we only calculate the fingerprint
+    pass_through = true;
+    return release();
+  }
+  reserved += len;
+  return 0;
+}
+
+int InlineDedupProcessor::release()
+{
+  auto pending = std::move(deferred);
+  deferred.clear();
+  deferred_bytes = 0;
+  put_budget();
+  for (auto& [data, offset] : pending) {
+    int r = Pipe::process(std::move(data), offset);
+    if (r < 0) {
+      return r;
+    }
+  }
+  if (flushed) {
+    flushed = false;
+    return Pipe::process({}, flush_offset);
+  }
+  return 0;
+}
+
+void InlineDedupProcessor::discard()
+{
+  deferred.clear();
+  deferred_bytes = 0;
+  flushed = false;
+  put_budget();
+}
+
+void InlineDedupProcessor::get_hash(uint8_t *p_hash) const
+{
+  blake3_hasher_finalize(&hasher, p_hash, BLAKE3_OUT_LEN);
+}
+
 } // namespace rgw::putobj
@@ -15,8 +15,12 @@
 
 #pragma once
 
+#include <atomic>
+#include <list>
+
 #include "include/buffer.h"
 #include "rgw_sal.h"
+#include "BLAKE3/c/blake3.h"
 
 namespace rgw::putobj {
 
@@ -70,4 +74,58 @@ class StripeProcessor : public Pipe {
   int process(bufferlist&& data, uint64_t data_offset) override;
 };
 
+
+// bytes of tail data held back by inline dedup, shared by the uploads of a
+// gateway
+class InlineDedupBudget {
+  std::atomic<uint64_t> used = 0;
+ public:
+  // reserve @bytes unless more than @max would be in use, zero means no limit
+  bool try_get(uint64_t bytes, uint64_t max);
+  void put(uint64_t bytes);
+  uint64_t get_used() const { return used; }
+};
+
+// a pipe that hashes the tail data for inline dedup. the tail is held back
+// until the fingerprint is known so a duplicate tail is never written. once
+// more than max_defer bytes are pending, or the shared budget is exhausted,
+// everything is passed through and a duplicate tail has to be removed on
+// completion
+class InlineDedupProcessor : public Pipe {
+  blake3_hasher hasher;
+  const uint64_t max_defer;
+  InlineDedupBudget& budget;
+  const uint64_t budget_max;
+  std::list<std::pair<bufferlist, uint64_t>> deferred; // data and offset
+  uint64_t deferred_bytes = 0;
+  uint64_t reserved = 0; // bytes taken from the budget
+  bool pass_through = false;
+  bool flushed = false; // the flush request was held back
+  uint64_t flush_offset = 0;
+
+  void put_budget();
+ public:
+  InlineDedupProcessor(rgw::sal::DataProcessor *next, uint64_t max_defer,
+                       InlineDedupBudget& budget, uint64_t budget_max)
+    : Pipe(next), max_defer(max_defer), budget(budget), budget_max(budget_max)
+  {
+    blake3_hasher_init(&hasher);
+  }
+  ~InlineDedupProcessor() override { put_budget(); }
+
+  int process(bufferlist&& data, uint64_t offset) override;
+
+  // send the deferred data (and flush) to the next processor
+  int release();
+
+  // drop the deferred data, the tail is shared instead
+  void discard();
+
+  // true when some of the tail was already written
+  bool has_written() const { return pass_through; }
+
+  // finalize the BLAKE3 of the tail data
+  void get_hash(uint8_t *p_hash) const;
+};
+
 } // namespace rgw::putobj
@@ -31,6 +31,16 @@
                              max deviation from target [default: 5]
      --upmap-pool <poolname> restrict upmap balancing to 1 or more pools
      --upmap-active          Act like an active balancer, keep applying changes until balanced
+     --balance <file>        balance bytes, pgs and primaries with pg upmap entries,
+                             writing commands to <file> [default: - for stdout],
+                             --upmap-max and --upmap-pool apply
+     --balance-rounds <count> simulate <count> rounds of balancing [default: 1]
+     --balance-max-bytes <bytes>
+                             max bytes moved per round [default: 0, no limit]
+     --balance-weights <bytes>,<pgs>,<primaries>
+                             weights of the objectives [default: 1,1,1]
+     --balance-threads <count> threads scoring the moves [default: 1]
+     --pg-stats <file>       pg sizes for --balance, from 'ceph pg dump pgs --format=json'
      --dump <format>         displays the map in plain text when <format> is 'plain', 'json' if specified format is not supported
      --tree                  displays a tree of the map
      --test-crush [--range-first <first> --range-last <last>] map pgs to acting osds
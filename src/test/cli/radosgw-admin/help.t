@@ -362,6 +362,10 @@
      --max-metadata-ops            specify max metadata requests per second allowed for an RGW during dedup, 0 means unlimited
      --stat                        display dedup throttle setting
   
+  Dedup options:
+     --incremental                 only scan objects added since the last incremental dedup run
+     --sample-percent              dedup estimate reads only this percent of the bucket-index shards (1-100)
+  
   Quota options:
      --max-objects                 specify max objects (negative value to disable)
      --max-size                    specify max size (in B/K/M/G/T, negative value to disable)
@@ -397,6 +397,62 @@ TEST(cls_refcount, set) /* test refcount using implicit referencing of newly cre
   ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
 }
 
+TEST(cls_refcount, put_many) /* drop several references with a single call */
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  /* create pool */
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  string oid = "obj";
+
+  /* create object */
+
+  ASSERT_EQ(0, ioctx.create(oid, true));
+
+  /* take 3 references */
+
+  string tags[3] = { "tag0", "tag1", "tag2" };
+  for (int i = 0; i < 3; i++) {
+    librados::ObjectWriteOperation *op = new_op();
+    cls_refcount_get(*op, tags[i]);
+    ASSERT_EQ(0, ioctx.operate(oid, op));
+    delete op;
+  }
+
+  list<string> refs;
+  ASSERT_EQ(0, cls_refcount_read(ioctx, oid, &refs));
+  ASSERT_EQ(3, (int)refs.size());
+
+  /* drop 2 refs, a repeated tag is only dropped once */
+
+  librados::ObjectWriteOperation *op = new_op();
+  cls_refcount_put_many(*op, {tags[0], tags[1], tags[0]});
+  ASSERT_EQ(0, ioctx.operate(oid, op));
+  delete op;
+
+  refs.clear();
+  ASSERT_EQ(0, cls_refcount_read(ioctx, oid, &refs));
+  ASSERT_EQ(1, (int)refs.size());
+  ASSERT_EQ(tags[2], refs.front());
+
+  /* drop the last ref, object should be removed */
+
+  op = new_op();
+  cls_refcount_put_many(*op, {tags[2]});
+  ASSERT_EQ(0, ioctx.operate(oid, op));
+  delete op;
+
+  ASSERT_EQ(-ENOENT, ioctx.stat(oid, NULL, NULL));
+
+  /* remove pool */
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
+
 TEST(cls_refcount, test_implicit_ec) /* test refcount using implicit referencing of newly created objects */
 {
   librados::Rados rados;
@@ -1277,6 +1277,78 @@ unsigned count_mapped(const auto &v) {
   return ret;
 }
 
+TEST_F(CRUSHTest, straw2_batch) {
+  // mapping a range of inputs at once should give the same result as
+  // mapping them one by one.  use buckets larger than the block of
+  // draws computed at once, with some zero weights in them.
+  std::unique_ptr<CrushWrapper> c(new CrushWrapper);
+  const int ROOT_TYPE = 2;
+  c->set_type_name(ROOT_TYPE, "root");
+  const int HOST_TYPE = 1;
+  c->set_type_name(HOST_TYPE, "host");
+  const int OSD_TYPE = 0;
+  c->set_type_name(OSD_TYPE, "osd");
+
+  const int num_hosts = 5;
+  const int per_host = 150;
+  const int n = num_hosts * per_host;
+  c->set_max_devices(n);
+
+  int hosts[num_hosts], host_weights[num_hosts];
+  for (int h = 0; h < num_hosts; ++h) {
+    int items[per_host], weights[per_host];
+    for (int i = 0; i < per_host; ++i) {
+      items[i] = h * per_host + i;
+      weights[i] = (i % 13 == 0) ? 0 : 0x10000 + 0x1000 * (i % 7);
+    }
+    crush_bucket *b = crush_make_bucket(c->get_crush_map(),
+					CRUSH_BUCKET_STRAW2,
+					CRUSH_HASH_RJENKINS1,
+					HOST_TYPE, per_host, items, weights);
+    EXPECT_EQ(0, crush_add_bucket(c->get_crush_map(), 0, b, &hosts[h]));
+    EXPECT_EQ(0, c->set_item_name(hosts[h], "host" + stringify(h)));
+    host_weights[h] = b->weight;
+  }
+  int root;
+  crush_bucket *b = crush_make_bucket(c->get_crush_map(),
+				      CRUSH_BUCKET_STRAW2,
+				      CRUSH_HASH_RJENKINS1,
+				      ROOT_TYPE, num_hosts, hosts,
+				      host_weights);
+  EXPECT_EQ(0, crush_add_bucket(c->get_crush_map(), 0, b, &root));
+  EXPECT_EQ(0, c->set_item_name(root, "default"));
+  int rule = c->add_simple_rule("rule0", "default", "host", "",
+				"indep", pg_pool_t::TYPE_ERASURE);
+  EXPECT_EQ(0, rule);
+  c->finalize();
+
+  vector<unsigned> reweight(n, 0x10000);
+  for (int i = 0; i < n; i += 11) {
+    reweight[i] = 0;
+  }
+  const int maxout = 4;
+  const unsigned count = 1000;
+  vector<int> x(count);
+  for (unsigned i = 0; i < count; ++i) {
+    x[i] = i * 7919;
+  }
+  vector<int> out, out_len;
+  c->do_rule_batch(rule, x.data(), count, out, out_len, maxout, reweight, 0);
+  ASSERT_EQ(count, out_len.size());
+  for (unsigned i = 0; i < count; ++i) {
+    vector<int> expected;
+    c->do_rule(rule, x[i], expected, maxout, reweight, 0);
+    ASSERT_EQ((int)expected.size(), out_len[i]);
+    for (int j = 0; j < out_len[i]; ++j) {
+      ASSERT_EQ(expected[j], out[i * maxout + j]);
+      if (expected[j] != CRUSH_ITEM_NONE) {
+	ASSERT_NE(0, expected[j] % per_host % 13);
+	ASSERT_NE(0, expected[j] % 11);
+      }
+    }
+  }
+}
+
 TEST_F(CRUSHTest, msr_4_host_2_choose_rule) {
   cluster_test_spec_t spec{3, 4, 3, 1, 3};
   auto [rootno, c] = create_crush_heirarchy(cct, spec);
@@ -931,6 +931,132 @@ TEST(ErasureCodeLrc, encode_decode_2)
   }
 }
 
+TEST(ErasureCodeLrc, apply_delta)
+{
+  ErasureCodeLrc lrc(g_conf().get_val<std::string>("erasure_code_dir"));
+  ErasureCodeProfile profile;
+  profile["mapping"] =
+    "__DD__DD";
+  const char *description_string =
+    "[ "
+    "  [ \"_cDD_cDD\", \"\" ]," // global layer
+    "  [ \"c_DD____\", \"\" ]," // first local layer
+    "  [ \"____cDDD\", \"\" ]," // second local layer
+    "]";
+  profile["layers"] = description_string;
+  EXPECT_EQ(0, lrc.init(profile, &cerr));
+  EXPECT_TRUE(lrc.get_supported_optimizations() &
+              ErasureCodeInterface::FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION);
+  const unsigned int chunk_size = 4096;
+  const shard_id_set data{shard_id_t(2), shard_id_t(3),
+                          shard_id_t(6), shard_id_t(7)};
+  // returns all the chunks, the data chunk 3 being filled with c3
+  auto encode = [&](char c3) {
+    shard_id_map<bufferptr> in(lrc.get_chunk_count());
+    shard_id_map<bufferptr> out(lrc.get_chunk_count());
+    char c = 'A';
+    for (unsigned int i = 0; i < lrc.get_chunk_count(); ++i) {
+      bufferptr ptr(buffer::create_page_aligned(chunk_size));
+      if (data.contains(shard_id_t(i))) {
+        memset(ptr.c_str(), i == 3 ? c3 : c, chunk_size);
+        c++;
+        in[shard_id_t(i)] = ptr;
+      } else {
+        ptr.zero();
+        out[shard_id_t(i)] = ptr;
+      }
+    }
+    EXPECT_EQ(0, lrc.encode_chunks(in, out));
+    for (auto &&[shard, ptr] : out)
+      in[shard] = ptr;
+    return in;
+  };
+  shard_id_map<bufferptr> old_chunks = encode('B');
+  shard_id_map<bufferptr> new_chunks = encode('Z');
+
+  // the delta of chunk 3 reaches the global parity 1 and 5, the local
+  // parity 0 and through the global parity 5 the local parity 4 too
+  bufferptr delta(buffer::create_page_aligned(chunk_size));
+  lrc.encode_delta(old_chunks[shard_id_t(3)], new_chunks[shard_id_t(3)],
+                   &delta);
+  shard_id_map<bufferptr> in(lrc.get_chunk_count());
+  shard_id_map<bufferptr> out(lrc.get_chunk_count());
+  in[shard_id_t(3)] = delta;
+  for (unsigned int i = 0; i < lrc.get_chunk_count(); ++i) {
+    if (!data.contains(shard_id_t(i)))
+      out[shard_id_t(i)] = old_chunks[shard_id_t(i)];
+  }
+  lrc.apply_delta(in, out);
+  for (unsigned int i = 0; i < lrc.get_chunk_count(); ++i) {
+    if (data.contains(shard_id_t(i)))
+      continue;
+    EXPECT_EQ(0, memcmp(out[shard_id_t(i)].c_str(),
+                        new_chunks[shard_id_t(i)].c_str(), chunk_size))
+      << "chunk " << i;
+  }
+}
+
+TEST(ErasureCodeLrc, apply_delta_kml)
+{
+  ErasureCodeLrc lrc(g_conf().get_val<std::string>("erasure_code_dir"));
+  ErasureCodeProfile profile;
+  profile["k"] = "4";
+  profile["m"] = "2";
+  profile["l"] = "3";
+  EXPECT_EQ(0, lrc.init(profile, &cerr));
+  EXPECT_TRUE(lrc.get_supported_optimizations() &
+              ErasureCodeInterface::FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION);
+  const unsigned int chunk_size = 4096;
+  shard_id_set data;
+  const vector<shard_id_t> &mapping = lrc.get_chunk_mapping();
+  for (unsigned int i = 0; i < lrc.get_data_chunk_count(); i++)
+    data.insert(mapping[i]);
+  // returns all the chunks, the data chunks being filled with first, first+1...
+  auto encode = [&](char first) {
+    shard_id_map<bufferptr> in(lrc.get_chunk_count());
+    shard_id_map<bufferptr> out(lrc.get_chunk_count());
+    char c = first;
+    for (unsigned int i = 0; i < lrc.get_chunk_count(); ++i) {
+      bufferptr ptr(buffer::create_page_aligned(chunk_size));
+      if (data.contains(shard_id_t(i))) {
+        memset(ptr.c_str(), c++, chunk_size);
+        in[shard_id_t(i)] = ptr;
+      } else {
+        ptr.zero();
+        out[shard_id_t(i)] = ptr;
+      }
+    }
+    EXPECT_EQ(0, lrc.encode_chunks(in, out));
+    for (auto &&[shard, ptr] : out)
+      in[shard] = ptr;
+    return in;
+  };
+  shard_id_map<bufferptr> old_chunks = encode('A');
+  shard_id_map<bufferptr> new_chunks = encode('a');
+
+  // the deltas of all the data chunks, spread over both local groups,
+  // applied at once
+  shard_id_map<bufferptr> in(lrc.get_chunk_count());
+  shard_id_map<bufferptr> out(lrc.get_chunk_count());
+  for (auto shard : data) {
+    bufferptr delta(buffer::create_page_aligned(chunk_size));
+    lrc.encode_delta(old_chunks[shard], new_chunks[shard], &delta);
+    in[shard] = delta;
+  }
+  for (unsigned int i = 0; i < lrc.get_chunk_count(); ++i) {
+    if (!data.contains(shard_id_t(i)))
+      out[shard_id_t(i)] = old_chunks[shard_id_t(i)];
+  }
+  lrc.apply_delta(in, out);
+  for (unsigned int i = 0; i < lrc.get_chunk_count(); ++i) {
+    if (data.contains(shard_id_t(i)))
+      continue;
+    EXPECT_EQ(0, memcmp(out[shard_id_t(i)].c_str(),
+                        new_chunks[shard_id_t(i)].c_str(), chunk_size))
+      << "chunk " << i;
+  }
+}
+
 /*
  * Local Variables:
  * compile-command: "cd ../.. ;
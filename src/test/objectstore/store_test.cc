@@ -32,6 +32,7 @@
 #if defined(WITH_BLUESTORE)
 #include "os/bluestore/BlueStore.h"
 #include "os/bluestore/BlueFS.h"
+#include "os/bluestore/ZonedAllocator.h"
 #endif
 #include "include/Context.h"
 #include "common/buffer_instrumentation.h"
@@ -1368,6 +1369,23 @@ TEST_P(StoreTest, CompressionTest) {
   doCompressionTest();
 }
 
+TEST_P(StoreTest, CompressionThreadsTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_compression_threads", "2");
+  SetVal(g_conf(), "bluestore_compression_algorithm", "snappy");
+  SetVal(g_conf(), "bluestore_compression_mode", "force");
+  SetVal(g_conf(), "bluestore_compression_max_blob_size", "65536");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  // the compression workers are started on mount
+  int r = store->umount();
+  ASSERT_EQ(r, 0);
+  r = store->mount();
+  ASSERT_EQ(r, 0);
+  doCompressionTest();
+}
+
 TEST_P(StoreTest, SimpleObjectTest) {
   int r;
   coll_t cid;
@@ -2419,6 +2437,68 @@ TEST_P(StoreTestSpecificAUSize, BluestoreFragmentedBlobTest) {
     ASSERT_EQ( 0u, statfs.data_compressed_allocated);
   }
 }
+
+TEST_P(StoreTest, BluestorePrefetch) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  int r;
+  coll_t cid;
+  const unsigned num_objects = 16;
+  vector<ghobject_t> oids;
+  for (unsigned i = 0; i < num_objects; ++i) {
+    oids.emplace_back(hobject_t(sobject_t("Object " + stringify(i),
+					  CEPH_NOSNAP)));
+  }
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    for (auto& oid : oids) {
+      bufferlist bl;
+      bl.append(std::string(4096, 'a'));
+      t.write(cid, oid, 0, bl.length(), bl);
+    }
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // drop the onode cache
+  ch.reset();
+  r = store->umount();
+  ASSERT_EQ(0, r);
+  r = store->mount();
+  ASSERT_EQ(0, r);
+  ch = store->open_collection(cid);
+
+  PerfCounters* logger = const_cast<PerfCounters*>(store->get_perf_counters());
+  auto loaded = logger->get(l_bluestore_prefetch_onodes);
+  // a missing object is not an error
+  oids.emplace_back(hobject_t(sobject_t("Missing", CEPH_NOSNAP)));
+  store->prefetch(ch, oids, ObjectStore::PREFETCH_DATA);
+  for (unsigned i = 0; i < 100; ++i) {
+    if (logger->get(l_bluestore_prefetch_onodes) - loaded >= num_objects) {
+      break;
+    }
+    usleep(10 * 1000);
+  }
+  ASSERT_EQ(logger->get(l_bluestore_prefetch_onodes) - loaded, num_objects);
+  // everything is cached now
+  store->prefetch(ch, oids);
+  for (unsigned i = 0; i < num_objects; ++i) {
+    bufferlist bl;
+    r = store->read(ch, oids[i], 0, 4096, bl);
+    ASSERT_EQ(r, 4096);
+  }
+  ASSERT_EQ(logger->get(l_bluestore_prefetch_onodes) - loaded, num_objects);
+  {
+    ObjectStore::Transaction t;
+    for (unsigned i = 0; i < num_objects; ++i) {
+      t.remove(cid, oids[i]);
+    }
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
 #endif
 
 TEST_P(StoreTest, ManySmallWrite) {
@@ -8626,6 +8706,309 @@ TEST_P(StoreTestSpecificAUSize, DeferredOnBigOverwrite1) {
   }
 }
 
+TEST_P(StoreTestSpecificAUSize, KVSyncLanes) {
+
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  size_t block_size = 4096;
+  SetVal(g_conf(), "bluestore_kv_sync_lanes", "4");
+  SetVal(g_conf(), "bluestore_fsck_on_umount", "false");
+  StartDeferred(0x10000);
+  // every small overwrite below takes the deferred path
+  SetVal(g_conf(), "bluestore_prefer_deferred_size", "65536");
+  g_conf().apply_changes(nullptr);
+
+  PerfCounters* logger = const_cast<PerfCounters*>(store->get_perf_counters());
+  const unsigned col_count = 8;
+  const unsigned rounds = 64;
+  int r;
+  std::vector<coll_t> cids;
+  std::vector<ObjectStore::CollectionHandle> chs;
+  ghobject_t hoid(hobject_t("test", "", CEPH_NOSNAP, 0, -1, ""));
+  bufferlist init_bl;
+  init_bl.append(std::string(0x10000, '-'));
+  for (unsigned i = 0; i < col_count; ++i) {
+    cids.emplace_back(spg_t(pg_t(i, 1), shard_id_t::NO_SHARD));
+    chs.push_back(store->create_new_collection(cids[i]));
+    ObjectStore::Transaction t;
+    t.create_collection(cids[i], 0);
+    t.write(cids[i], hoid, 0, init_bl.length(), init_bl);
+    r = queue_transaction(store, chs[i], std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+
+  // the sequencers are spread over the lanes, each one must still see its
+  // commits in submission order
+  uint64_t deferred0 = logger->get(l_bluestore_issued_deferred_writes);
+  ceph::mutex lock = ceph::make_mutex("KVSyncLanes::lock");
+  std::vector<std::vector<unsigned>> committed(col_count);
+  for (unsigned n = 0; n < rounds; ++n) {
+    for (unsigned i = 0; i < col_count; ++i) {
+      ObjectStore::Transaction t;
+      bufferlist bl;
+      bl.append(std::string(block_size, 'a' + (n + i) % 26));
+      t.write(cids[i], hoid, (n % 16) * block_size, bl.length(), bl);
+      t.register_on_commit(make_lambda_context([&, i, n](int) {
+	std::lock_guard l(lock);
+	committed[i].push_back(n);
+      }));
+      r = store->queue_transaction(chs[i], std::move(t));
+      ASSERT_EQ(r, 0);
+    }
+  }
+  for (unsigned i = 0; i < col_count; ++i) {
+    C_SaferCond c;
+    ObjectStore::Transaction t;
+    t.touch(cids[i], hoid);
+    t.register_on_commit(&c);
+    r = store->queue_transaction(chs[i], std::move(t));
+    ASSERT_EQ(r, 0);
+    c.wait();
+  }
+  {
+    std::lock_guard l(lock);
+    for (unsigned i = 0; i < col_count; ++i) {
+      ASSERT_EQ(committed[i].size(), rounds);
+      for (unsigned n = 0; n < rounds; ++n) {
+	ASSERT_EQ(committed[i][n], n);
+      }
+    }
+  }
+  ASSERT_GT(logger->get(l_bluestore_issued_deferred_writes), deferred0);
+
+  // the data written through the deferred path is what we read back
+  auto check = [&]() {
+    for (unsigned i = 0; i < col_count; ++i) {
+      bufferlist bl;
+      r = store->read(chs[i], hoid, 0, 16 * block_size, bl);
+      ASSERT_EQ(r, int(16 * block_size));
+      for (unsigned b = 0; b < 16; ++b) {
+	unsigned n = rounds - 16 + b;
+	ASSERT_EQ(std::string(bl.c_str() + b * block_size, block_size),
+		  std::string(block_size, 'a' + (n + i) % 26));
+      }
+    }
+  };
+  check();
+
+  // every deferred transaction has been retired once the store is down
+  chs.clear();
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
+  ceph_assert(bstore);
+  bstore->umount();
+  {
+    KeyValueDB* kv = nullptr;
+    ASSERT_EQ(bstore->open_db_environment(&kv, true, false), 0);
+    auto it = kv->get_iterator("L");
+    it->seek_to_first();
+    ASSERT_FALSE(it->valid());
+    it.reset();
+    bstore->close_db_environment();
+  }
+  ASSERT_EQ(bstore->fsck(false), 0);
+  ASSERT_EQ(bstore->mount(), 0);
+  for (unsigned i = 0; i < col_count; ++i) {
+    chs.push_back(store->open_collection(cids[i]));
+  }
+  check();
+  for (unsigned i = 0; i < col_count; ++i) {
+    ObjectStore::Transaction t;
+    t.remove(cids[i], hoid);
+    t.remove_collection(cids[i]);
+    r = queue_transaction(store, chs[i], std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_P(StoreTestSpecificAUSize, DeferredAdaptivePolicy) {
+
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  size_t block_size = 4096;
+  StartDeferred(block_size);
+  SetVal(g_conf(), "bluestore_prefer_deferred_size", "65536");
+  // re-evaluate on every call, latencies are fed in by hand below
+  SetVal(g_conf(), "bluestore_deferred_adaptive_interval", "0");
+  SetVal(g_conf(), "bluestore_deferred_adaptive_db_latency", "0.01");
+  SetVal(g_conf(), "bluestore_deferred_adaptive_main_latency", "0.01");
+  SetVal(g_conf(), "bluestore_deferred_adaptive_max_batch_factor", "4");
+  SetVal(g_conf(), "bluestore_deferred_adaptive", "true");
+  g_conf().apply_changes(nullptr);
+
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
+  ceph_assert(bstore);
+  PerfCounters* logger = const_cast<PerfCounters*>(store->get_perf_counters());
+  ASSERT_EQ(logger->get(l_bluestore_deferred_cutoff), 65536u);
+  uint64_t batch_ops_conf = logger->get(l_bluestore_deferred_batch_ops);
+
+  // slow DB device: the cutoff halves down to min_alloc_size, never below,
+  // and the batch size is left alone
+  uint64_t last = 65536;
+  for (unsigned i = 0; i < 10; ++i) {
+    bstore->debug_deferred_policy_note(true, make_timespan(1.0));
+    bstore->debug_deferred_policy_update();
+    uint64_t cutoff = logger->get(l_bluestore_deferred_cutoff);
+    ASSERT_LE(cutoff, last);
+    ASSERT_GE(cutoff, block_size);
+    last = cutoff;
+  }
+  ASSERT_EQ(logger->get(l_bluestore_deferred_cutoff), block_size);
+  ASSERT_EQ(logger->get(l_bluestore_deferred_batch_ops), batch_ops_conf);
+
+  // DB recovers: the cutoff grows back to, and stops at, the configured value
+  for (unsigned i = 0; i < 64; ++i) {
+    bstore->debug_deferred_policy_note(true, make_timespan(0));
+  }
+  for (unsigned i = 0; i < 20; ++i) {
+    bstore->debug_deferred_policy_update();
+    uint64_t cutoff = logger->get(l_bluestore_deferred_cutoff);
+    ASSERT_GE(cutoff, last);
+    last = cutoff;
+  }
+  ASSERT_EQ(logger->get(l_bluestore_deferred_cutoff), 65536u);
+
+  // slow main device: the batch size grows up to max_batch_factor times
+  // the configured one
+  for (unsigned i = 0; i < 10; ++i) {
+    bstore->debug_deferred_policy_note(false, make_timespan(1.0));
+    bstore->debug_deferred_policy_update();
+    ASSERT_LE(logger->get(l_bluestore_deferred_batch_ops), batch_ops_conf * 4);
+  }
+  ASSERT_EQ(logger->get(l_bluestore_deferred_batch_ops), batch_ops_conf * 4);
+  ASSERT_EQ(logger->get(l_bluestore_deferred_cutoff), block_size);
+
+  // turning it off restores the configured values
+  SetVal(g_conf(), "bluestore_deferred_adaptive", "false");
+  g_conf().apply_changes(nullptr);
+  ASSERT_EQ(logger->get(l_bluestore_deferred_cutoff), 65536u);
+  ASSERT_EQ(logger->get(l_bluestore_deferred_batch_ops), batch_ops_conf);
+}
+
+TEST_P(StoreTestSpecificAUSize, ZonedCleaner) {
+
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  size_t block_size = 4096;
+  SetVal(g_conf(), "bluestore_allocator", "zoned");
+  SetVal(g_conf(), "bluestore_zone_size", "1048576");
+  // zones are only cleaned by hand below
+  SetVal(g_conf(), "bluestore_zoned_cleaner_free_ratio", "0");
+  StartDeferred(block_size);
+  SetVal(g_conf(), "bluestore_prefer_deferred_size", "0");
+  g_conf().apply_changes(nullptr);
+
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
+  ceph_assert(bstore);
+  auto za = dynamic_cast<ZonedAllocator*>(bstore->debug_get_alloc());
+  ASSERT_TRUE(za);
+  PerfCounters* logger = const_cast<PerfCounters*>(store->get_perf_counters());
+
+  const unsigned obj_count = 64;
+  const size_t obj_size = 0x10000;
+  coll_t cid(spg_t(pg_t(0, 1), shard_id_t::NO_SHARD));
+  auto ch = store->create_new_collection(cid);
+  auto make_oid = [](unsigned i) {
+    return ghobject_t(hobject_t("zoned_" + stringify(i), "", CEPH_NOSNAP, 0,
+				1, ""));
+  };
+  auto content = [&](unsigned i, unsigned round) {
+    return std::string(obj_size, 'a' + (i + round) % 26);
+  };
+  int r;
+  {
+    // written at once, so that full zones hold nothing but these objects
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    for (unsigned i = 0; i < obj_count; ++i) {
+      bufferlist bl;
+      bl.append(content(i, 0));
+      t.write(cid, make_oid(i), 0, bl.length(), bl);
+    }
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    // half of the space in these zones becomes dead
+    ObjectStore::Transaction t;
+    for (unsigned i = 0; i < obj_count; i += 2) {
+      bufferlist bl;
+      bl.append(content(i, 1));
+      t.write(cid, make_oid(i), 0, bl.length(), bl);
+    }
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  auto check = [&]() {
+    for (unsigned i = 0; i < obj_count; ++i) {
+      bufferlist bl;
+      r = store->read(ch, make_oid(i), 0, obj_size, bl);
+      ASSERT_EQ(r, int(obj_size));
+      ASSERT_EQ(std::string(bl.c_str(), bl.length()),
+		content(i, i % 2 ? 0 : 1));
+    }
+  };
+  check();
+
+  // the first pass after mount walks all objects, the later ones are
+  // driven by the zone index
+  uint64_t resets = za->get_num_resets();
+  uint64_t cleaned = logger->get(l_bluestore_zoned_cleaned_zones);
+  std::set<int64_t> zones;
+  for (unsigned n = 0; n < 64; ++n) {
+    int64_t zone = bstore->debug_zoned_clean(obj_size);
+    if (zone < 0) {
+      break;
+    }
+    ASSERT_EQ(0u, za->get_zone_live(zone));
+    zones.insert(zone);
+  }
+  ASSERT_LT(bstore->debug_zoned_clean(obj_size), 0);
+  ASSERT_GE(zones.size(), 2u);
+  ASSERT_LE(resets + zones.size(), za->get_num_resets());
+  ASSERT_EQ(cleaned + zones.size(),
+	    logger->get(l_bluestore_zoned_cleaned_zones));
+  ASSERT_GT(logger->get(l_bluestore_zoned_relocated_bytes), 0u);
+  check();
+
+  ch.reset();
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(false), 0);
+  ASSERT_EQ(bstore->mount(), 0);
+  ch = store->open_collection(cid);
+  check();
+  {
+    // small overwrites go to new blobs as well, never deferred in place
+    SetVal(g_conf(), "bluestore_prefer_deferred_size", "65536");
+    g_conf().apply_changes(nullptr);
+    uint64_t deferred = logger->get(l_bluestore_issued_deferred_writes);
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append(std::string(block_size, 'z'));
+    t.write(cid, make_oid(1), block_size, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(deferred, logger->get(l_bluestore_issued_deferred_writes));
+    std::string expected = content(1, 0);
+    expected.replace(block_size, block_size, block_size, 'z');
+    bufferlist rbl;
+    r = store->read(ch, make_oid(1), 0, obj_size, rbl);
+    ASSERT_EQ(r, int(obj_size));
+    ASSERT_EQ(expected, std::string(rbl.c_str(), rbl.length()));
+  }
+  {
+    ObjectStore::Transaction t;
+    for (unsigned i = 0; i < obj_count; ++i) {
+      t.remove(cid, make_oid(i));
+    }
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTestSpecificAUSize, DeferredOnBigOverwrite2) {
 
   if (string(GetParam()) != "bluestore")
@@ -10323,6 +10706,95 @@ TEST_P(StoreTestSpecificAUSize, BluestoreBrokenZombieRepairTest) {
   bstore->mount();
 }
 
+TEST_P(StoreTestSpecificAUSize, BluestoreAllocationJournalRestore) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  SetVal(g_conf(), "bluestore_fsck_on_mount", "false");
+  SetVal(g_conf(), "bluestore_fsck_on_umount", "false");
+  SetVal(g_conf(), "bluestore_allocation_journal", "true");
+  SetVal(g_conf(), "bluestore_allocation_journal_region_size", "1048576");
+  SetVal(g_conf(), "bluestore_allocation_journal_compact_deltas", "8");
+  // never restore from the allocation file, as after an unplanned shutdown
+  SetVal(g_conf(),
+    "bluestore_debug_inject_allocation_from_file_failure", "1");
+  g_conf().apply_changes(nullptr);
+
+  StartDeferred(0x10000);
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
+  ceph_assert(bstore);
+
+  const size_t obj_count = 64;
+  coll_t cid(spg_t(pg_t(0, 1), shard_id_t::NO_SHARD));
+  auto ch = store->create_new_collection(cid);
+  int r;
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  bufferlist bl;
+  bl.append(string(0x30000, 'a'));
+  for (size_t i = 0; i < obj_count; i++) {
+    ObjectStore::Transaction t;
+    t.write(cid, make_object(stringify(i).c_str(), 1), 0, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  for (size_t i = 0; i < obj_count; i += 3) {
+    ObjectStore::Transaction t;
+    t.remove(cid, make_object(stringify(i).c_str(), 1));
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ch.reset(nullptr);
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(false), 0);
+
+  // the checkpoint rewritten on mount must replay to the same map
+  ASSERT_EQ(bstore->mount(), 0);
+  ch = store->open_collection(cid);
+  for (size_t i = 1; i < obj_count; i += 3) {
+    ObjectStore::Transaction t;
+    t.write(cid, make_object(stringify(i).c_str(), 1), 0, bl.length(), bl);
+    t.remove(cid, make_object(stringify(i + 1).c_str(), 1));
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ch.reset(nullptr);
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(false), 0);
+
+  // repair does not journal its changes, so it must drop the journal
+  ASSERT_EQ(bstore->repair(false), 0);
+  {
+    KeyValueDB* kv = nullptr;
+    ASSERT_EQ(bstore->open_db_environment(&kv, true, false), 0);
+    auto it = kv->get_iterator("J");
+    it->seek_to_first();
+    ASSERT_FALSE(it->valid());
+    it.reset();
+    bstore->close_db_environment();
+  }
+  // the next mount recovers with the onode scan and starts a new journal
+  ASSERT_EQ(bstore->mount(), 0);
+  ch = store->open_collection(cid);
+  for (size_t i = 2; i < obj_count; i += 3) {
+    ObjectStore::Transaction t;
+    t.write(cid, make_object(stringify(i).c_str(), 1), 0, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ch.reset(nullptr);
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(false), 0);
+
+  SetVal(g_conf(),
+    "bluestore_debug_inject_allocation_from_file_failure", "0");
+  g_conf().apply_changes(nullptr);
+  bstore->mount();
+}
+
 TEST_P(StoreTestSpecificAUSize, BluestoreRepairSharedBlobTest) {
   if (string(GetParam()) != "bluestore")
     return;
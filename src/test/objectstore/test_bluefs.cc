@@ -1176,6 +1176,52 @@ TEST_F(BlueFS_wal, wal_v2_check)
   fs.umount();
 }
 
+TEST_F(BlueFS_wal, wal_v2_prealloc)
+{
+  constexpr uint64_t M = 1048576;
+  ConfSaver conf(g_ceph_context->_conf);
+  conf.SetVal("bluefs_wal_envelope_mode", "true");
+  conf.SetVal("bluefs_wal_prealloc_size", stringify(8 * M).c_str());
+  conf.ApplyChanges();
+
+  Create(M * 256, M * 128, M * 64);
+  ASSERT_EQ(0, fs.mount());
+  ASSERT_EQ(0, fs.mkdir("db.wal"));
+  BlueFS::FileWriter *h;
+  ASSERT_EQ(0, fs.open_for_write("db.wal", "wal1.log", &h, false));
+  std::string data(4096, 'x');
+  h->append(data.c_str(), data.length());
+  fs.fsync(h);
+  ASSERT_GE(h->file->fnode.get_allocated(), 8 * M);
+  // more appends fit in the preallocated extents
+  auto extents = h->file->fnode.extents.size();
+  for (unsigned i = 0; i < 100; i++) {
+    h->append(data.c_str(), data.length());
+    fs.fsync(h);
+  }
+  ASSERT_EQ(extents, h->file->fnode.extents.size());
+  // closing the WAL gives the tail back
+  ASSERT_EQ(0, fs.truncate(h, h->file->fnode.content_size));
+  fs.fsync(h);
+  ASSERT_LT(h->file->fnode.get_allocated(), 8 * M);
+  fs.close_writer(h);
+
+  bufferlist content;
+  for (unsigned i = 0; i < 101; i++) {
+    content.append(data);
+  }
+  fs.umount();
+  fs.mount();
+  bufferlist read_content;
+  BlueFS::FileReader *reader;
+  ASSERT_EQ(0, fs.open_for_read("db.wal", "wal1.log", &reader));
+  ASSERT_EQ((int)content.length(),
+	    fs.read(reader, 0, content.length(), &read_content, nullptr));
+  ASSERT_EQ(content, read_content);
+  delete reader;
+  fs.umount();
+}
+
 TEST_F(BlueFS_wal, wal_v2_check_feature)
 {
   SKIP_JENKINS();
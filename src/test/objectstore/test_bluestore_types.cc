@@ -139,6 +139,54 @@ TEST(sb_info_space_efficient_map_t, size) {
   dump_mempools();
 }
 
+TEST(OnodeCacheShard, warm_tier) {
+  std::unique_ptr<BlueStore::OnodeCacheShard> oc{
+      BlueStore::OnodeCacheShard::create(g_ceph_context, "lru", NULL)};
+  bufferlist v;
+  v.append(std::string(100, 'v'));
+  bufferlist out;
+
+  // disabled by default
+  oc->warm_update("key0", v);
+  ASSERT_FALSE(oc->warm_lookup("key0", &out));
+
+  const uint64_t entry = 4 + 100 + sizeof(BlueStore::OnodeCacheShard::WarmOnode);
+  oc->set_warm_max(3 * entry);
+  for (int i = 0; i < 3; i++) {
+    oc->warm_update("key" + stringify(i), v);
+  }
+  uint64_t onodes = 0, bytes = 0;
+  oc->add_warm_stats(&onodes, &bytes);
+  ASSERT_EQ(3u, onodes);
+  ASSERT_EQ(3 * entry, bytes);
+
+  // touch key0 so key1 is the oldest one
+  ASSERT_TRUE(oc->warm_lookup("key0", &out));
+  ASSERT_TRUE(out.contents_equal(v));
+  oc->warm_update("key3", v);
+  out.clear();
+  ASSERT_FALSE(oc->warm_lookup("key1", &out));
+  ASSERT_TRUE(oc->warm_lookup("key0", &out));
+
+  // updates replace the value
+  bufferlist v2;
+  v2.append(std::string(100, 'w'));
+  oc->warm_update("key2", v2);
+  out.clear();
+  ASSERT_TRUE(oc->warm_lookup("key2", &out));
+  ASSERT_TRUE(out.contents_equal(v2));
+
+  oc->warm_remove("key2");
+  out.clear();
+  ASSERT_FALSE(oc->warm_lookup("key2", &out));
+
+  oc->set_warm_max(entry);
+  onodes = bytes = 0;
+  oc->add_warm_stats(&onodes, &bytes);
+  ASSERT_EQ(1u, onodes);
+  ASSERT_EQ(entry, bytes);
+}
+
 TEST(bluestore_extent_ref_map_t, add) {
   bluestore_extent_ref_map_t m;
   m.get(10, 10);
@@ -394,6 +442,49 @@ TEST(bluestore_blob_t, calc_csum) {
   }
 }
 
+TEST(bluestore_blob_t, calc_csum_fragmented) {
+  // 100 blocks, so the contiguous verify path crosses a batch boundary
+  const unsigned block = 512;
+  const unsigned blocks = 100;
+  bufferptr bp(block * blocks);
+  for (unsigned i = 0; i < bp.length(); ++i) {
+    bp.c_str()[i] = (i * 7 + i / block) & 0xff;
+  }
+  bufferlist contiguous;
+  contiguous.append(bp);
+  bufferlist fragmented;
+  for (unsigned off = 0; off < bp.length(); off += 300) {
+    fragmented.append(bufferptr(bp, off, std::min(300u, bp.length() - off)));
+  }
+  ASSERT_GT(fragmented.get_num_buffers(), 1u);
+
+  for (unsigned csum_type = Checksummer::CSUM_NONE + 1;
+       csum_type < Checksummer::CSUM_MAX; ++csum_type) {
+    cout << "csum_type " << Checksummer::get_csum_type_string(csum_type)
+         << std::endl;
+    bluestore_blob_t a, b;
+    a.init_csum(csum_type, 9, bp.length());
+    b.init_csum(csum_type, 9, bp.length());
+    a.calc_csum(0, contiguous);
+    b.calc_csum(0, fragmented);
+    ASSERT_TRUE(a.csum_data.contents_equal(b.csum_data.c_str(),
+					   b.csum_data.length()));
+
+    int bad_off;
+    uint64_t bad_csum;
+    ASSERT_EQ(0, a.verify_csum(0, fragmented, &bad_off, &bad_csum));
+    ASSERT_EQ(-1, bad_off);
+    ASSERT_EQ(0, b.verify_csum(0, contiguous, &bad_off, &bad_csum));
+    ASSERT_EQ(-1, bad_off);
+
+    bufferlist broken;
+    broken.append(contiguous.c_str(), contiguous.length());
+    broken.c_str()[70 * block + 3] ^= 0x5a;
+    ASSERT_EQ(-1, a.verify_csum(0, broken, &bad_off, &bad_csum));
+    ASSERT_EQ((int)(70 * block), bad_off);
+  }
+}
+
 TEST(bluestore_blob_t, csum_bench) {
   bufferlist bl;
   bufferptr bp(10485760);
@@ -4106,6 +4197,29 @@ TEST(bluestore_blob_use_tracker_t, mempool_stats_test) {
   }
 }
 
+TEST(BlueStore, compress_pool_shutdown) {
+  BlueStore::CompressPool pool;
+  pool.start(4);
+  for (unsigned round = 0; round < 1000; ++round) {
+    std::array<std::atomic<unsigned>, 2> hits = {};
+    // the submitter often runs both items before a worker wakes up, the
+    // helper entries queued for it are left behind
+    pool.run(hits.size(), [&](size_t i) { ++hits[i]; });
+    ASSERT_EQ(1u, hits[0]);
+    ASSERT_EQ(1u, hits[1]);
+  }
+  pool.shutdown();
+  ASSERT_TRUE(pool.queue.empty());
+  ASSERT_TRUE(pool.workers.empty());
+
+  // the pool can be restarted
+  pool.start(2);
+  std::atomic<unsigned> sum = {0};
+  pool.run(100, [&](size_t i) { sum += i; });
+  ASSERT_EQ(4950u, sum);
+  pool.shutdown();
+}
+
 int main(int argc, char **argv) {
   auto args = argv_to_vec(argc, argv);
   auto cct =
@@ -0,0 +1,233 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:nil -*-
+// vim: ts=8 sw=2 sts=2 expandtab
+
+#include <iostream>
+#include <gtest/gtest.h>
+
+#include "os/bluestore/ZonedAllocator.h"
+
+const uint64_t _1m = 1024 * 1024;
+const uint64_t _4m = 4 * 1024 * 1024;
+
+static interval_set<uint64_t> free_extents(ZonedAllocator& za)
+{
+  interval_set<uint64_t> res;
+  za.foreach([&](uint64_t o, uint64_t l) {
+    res.insert(o, l);
+  });
+  return res;
+}
+
+TEST(ZonedAllocator, sequential)
+{
+  uint64_t block_size = 0x1000;
+  ZonedAllocator za(g_ceph_context, 4 * _4m, block_size, _4m,
+    "test_zoned_allocator");
+  ASSERT_EQ(0, za.get_free());
+
+  za.init_add_free(0, 4 * _4m);
+  ASSERT_EQ(4 * _4m, za.get_free());
+
+  // allocations follow each other and wrap into the next zone
+  uint64_t last = 0;
+  for (unsigned i = 0; i < 5; ++i) {
+    PExtentVector extents;
+    auto r = za.allocate(_1m, block_size, 0, -1, &extents);
+    ASSERT_EQ(r, _1m);
+    ASSERT_EQ(extents.size(), 1);
+    ASSERT_EQ(extents[0].offset, last);
+    last += _1m;
+  }
+  ASSERT_EQ(4 * _4m - 5 * _1m, za.get_free());
+
+  // a request over the zone boundary is split
+  {
+    PExtentVector extents;
+    auto r = za.allocate(_4m, block_size, 0, -1, &extents);
+    ASSERT_EQ(r, _4m);
+    ASSERT_EQ(extents.size(), 2);
+    ASSERT_EQ(extents[0].offset, 5 * _1m);
+    ASSERT_EQ(extents[0].length, 3 * _1m);
+    ASSERT_EQ(extents[1].offset, 2 * _4m);
+    ASSERT_EQ(extents[1].length, _1m);
+  }
+
+  // max_alloc_size caps the extents
+  {
+    PExtentVector extents;
+    auto r = za.allocate(_1m, block_size, _1m / 2, -1, &extents);
+    ASSERT_EQ(r, _1m);
+    ASSERT_EQ(extents.size(), 2);
+    ASSERT_EQ(extents[0].offset, 2 * _4m + _1m);
+    ASSERT_EQ(extents[1].offset, 2 * _4m + _1m + _1m / 2);
+  }
+}
+
+TEST(ZonedAllocator, release_and_reset)
+{
+  uint64_t block_size = 0x1000;
+  ZonedAllocator za(g_ceph_context, 2 * _4m, block_size, _4m,
+    "test_zoned_allocator");
+  za.init_add_free(0, 2 * _4m);
+
+  PExtentVector extents;
+  auto r = za.allocate(_4m, block_size, _1m, -1, &extents);
+  ASSERT_EQ(r, _4m);
+  ASSERT_EQ(extents.size(), 4);
+  ASSERT_EQ(_4m, za.get_free());
+
+  // released space below the write pointer is dead, not free
+  interval_set<uint64_t> release_set;
+  release_set.insert(extents[1].offset, extents[1].length);
+  release_set.insert(extents[3].offset, extents[3].length);
+  za.release(release_set);
+  ASSERT_EQ(_4m, za.get_free());
+  ASSERT_EQ(2 * _1m, za.get_dead());
+  ASSERT_EQ(0, za.get_num_resets());
+
+  // but it is reported as such to the allocation map
+  auto free = free_extents(za);
+  ASSERT_TRUE(free.contains(_1m, _1m));
+  ASSERT_TRUE(free.contains(3 * _1m, _1m + _4m));
+
+  uint64_t dead = 0;
+  ASSERT_EQ(0, za.pick_zone_to_clean(_1m, {}, &dead));
+  ASSERT_EQ(2 * _1m, dead);
+  ASSERT_EQ(2 * _1m, za.get_zone_live(0));
+  ASSERT_EQ(-1, za.pick_zone_to_clean(3 * _1m));
+
+  // the zone is reset once all of it is dead
+  release_set.clear();
+  release_set.insert(extents[0].offset, extents[0].length);
+  release_set.insert(extents[2].offset, extents[2].length);
+  za.release(release_set);
+  ASSERT_EQ(2 * _4m, za.get_free());
+  ASSERT_EQ(0, za.get_dead());
+  ASSERT_EQ(1, za.get_num_resets());
+  ASSERT_EQ(-1, za.pick_zone_to_clean(0));
+
+  // the reset zone is written again from its start
+  extents.clear();
+  r = za.allocate(2 * _4m, block_size, 0, -1, &extents);
+  ASSERT_EQ(r, 2 * _4m);
+  ASSERT_EQ(extents.size(), 2);
+  ASSERT_EQ(extents[0].offset, 0);
+  ASSERT_EQ(extents[1].offset, _4m);
+
+  extents.clear();
+  r = za.allocate(block_size, block_size, 0, -1, &extents);
+  ASSERT_EQ(r, -ENOSPC);
+}
+
+TEST(ZonedAllocator, pick_and_seal)
+{
+  uint64_t block_size = 0x1000;
+  ZonedAllocator za(g_ceph_context, 3 * _4m, block_size, _4m,
+    "test_zoned_allocator");
+  za.init_add_free(0, 3 * _4m);
+
+  // zone 0 is full, zone 1 is partially written but not open
+  PExtentVector extents;
+  auto r = za.allocate(_4m, block_size, _1m, -1, &extents);
+  ASSERT_EQ(r, _4m);
+  za.init_rm_free(_4m, _1m);
+  ASSERT_EQ(2 * _4m - _1m, za.get_free());
+
+  interval_set<uint64_t> release_set;
+  release_set.insert(0, _1m);
+  release_set.insert(_4m, _1m / 2);
+  za.release(release_set);
+  ASSERT_EQ(3 * _1m, za.get_zone_live(0));
+  ASSERT_EQ(_1m / 2, za.get_zone_live(_4m));
+
+  // busy zones are never picked
+  interval_set<uint64_t> busy;
+  busy.insert(_1m, block_size);
+  uint64_t dead = 0;
+  ASSERT_EQ(_4m, za.pick_zone_to_clean(_1m / 2, busy, &dead));
+  ASSERT_EQ(_1m / 2, dead);
+
+  // the picked zone is sealed and takes no new allocations
+  ASSERT_TRUE(za.is_zone_full(_4m));
+  ASSERT_EQ(_1m / 2, za.get_zone_live(_4m));
+  ASSERT_EQ(_4m, za.get_free());
+  extents.clear();
+  r = za.allocate(_1m, block_size, 0, -1, &extents);
+  ASSERT_EQ(r, _1m);
+  ASSERT_EQ(1, extents.size());
+  ASSERT_EQ(2 * _4m, extents[0].offset);
+
+  // and is reset once its live data is gone
+  release_set.clear();
+  release_set.insert(_4m + _1m / 2, _1m / 2);
+  za.release(release_set);
+  ASSERT_EQ(0, za.get_zone_live(_4m));
+  ASSERT_FALSE(za.is_zone_full(_4m));
+  ASSERT_EQ(1, za.get_num_resets());
+  ASSERT_EQ(2 * _4m - _1m, za.get_free());
+}
+
+TEST(ZonedAllocator, alignment)
+{
+  uint64_t block_size = 0x1000;
+  ZonedAllocator za(g_ceph_context, _4m, block_size, _4m,
+    "test_zoned_allocator");
+  za.init_add_free(0, _4m);
+
+  PExtentVector extents;
+  auto r = za.allocate(block_size, block_size, 0, -1, &extents);
+  ASSERT_EQ(r, block_size);
+  // the gap up to the larger unit is skipped
+  r = za.allocate(0x10000, 0x10000, 0, -1, &extents);
+  ASSERT_EQ(r, 0x10000);
+  ASSERT_EQ(extents.size(), 2);
+  ASSERT_EQ(extents[1].offset, 0x10000);
+  ASSERT_EQ(0x10000 - block_size, za.get_dead());
+  ASSERT_EQ(_4m - 0x20000, za.get_free());
+}
+
+TEST(ZonedAllocator, init)
+{
+  uint64_t block_size = 0x1000;
+  ZonedAllocator za(g_ceph_context, 3 * _4m, block_size, _4m,
+    "test_zoned_allocator");
+
+  // zone 0: used head, a hole, used, free tail
+  za.init_add_free(_1m, _1m);
+  za.init_add_free(3 * _1m, _1m);
+  // zone 1: a hole right in front of the free tail is merged into it
+  za.init_add_free(_4m + _1m, _1m);
+  za.init_add_free(_4m + 2 * _1m, 2 * _1m);
+  // zone 2: entirely free, then the head is taken again
+  za.init_add_free(2 * _4m, _4m);
+  za.init_rm_free(2 * _4m, _1m);
+
+  ASSERT_EQ(_1m + 3 * _1m + 3 * _1m, za.get_free());
+  ASSERT_EQ(_1m, za.get_dead());
+
+  interval_set<uint64_t> expected;
+  expected.insert(_1m, _1m);
+  expected.insert(3 * _1m, _1m);
+  expected.insert(_4m + _1m, 3 * _1m);
+  expected.insert(2 * _4m + _1m, 3 * _1m);
+  ASSERT_EQ(expected, free_extents(za));
+
+  // taking the free space ahead of the write pointer skips the space below
+  za.init_rm_free(2 * _4m + 2 * _1m, _1m);
+  ASSERT_EQ(2 * _1m, za.get_dead());
+  ASSERT_EQ(_1m + 3 * _1m + _1m, za.get_free());
+
+  // taking dead space back
+  za.init_rm_free(_1m, _1m);
+  ASSERT_EQ(_1m, za.get_dead());
+
+  // restarting from the reported map gives the same state
+  ZonedAllocator za2(g_ceph_context, 3 * _4m, block_size, _4m,
+    "test_zoned_allocator2");
+  za.foreach([&](uint64_t o, uint64_t l) {
+    za2.init_add_free(o, l);
+  });
+  ASSERT_EQ(za.get_free(), za2.get_free());
+  ASSERT_EQ(za.get_dead(), za2.get_dead());
+  ASSERT_EQ(free_extents(za), free_extents(za2));
+}
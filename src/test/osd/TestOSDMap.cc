@@ -2,6 +2,7 @@
 #include "gtest/gtest.h"
 #include "osd/OSDMap.h"
 #include "osd/OSDMapMapping.h"
+#include "osd/UpmapBalancer.h"
 #include "mon/OSDMonitor.h"
 #include "mon/PGMap.h"
 
@@ -302,6 +303,47 @@ public:
     cout << "first: " << *first << std::endl;;
     cout << "primary: " << *primary << std::endl;;
   }
+  void update_mapping() {
+    mapping.update(osdmap);
+  }
+  bool get_mapping_changes(const OSDMap::Incremental& inc,
+			   std::set<int64_t> *pools, vector<pg_t> *pgs) {
+    return mapping._get_changed(osdmap, inc, pools, pgs);
+  }
+  /**
+   * apply inc, update the mapping from it and check the mapping of every
+   * pg. returns the number of pgs which have been remapped, or -1 if the
+   * whole mapping was.
+   */
+  int apply_and_check_mapping(const OSDMap::Incremental& inc) {
+    osdmap.apply_incremental(inc);
+    std::set<int64_t> pools;
+    vector<pg_t> pgs;
+    int remapped = -1;
+    if (mapping._get_changed(osdmap, inc, &pools, &pgs)) {
+      remapped = pgs.size();
+      for (auto pool : pools) {
+	remapped += osdmap.get_pg_pool(pool)->get_pg_num();
+      }
+    }
+    mapping.update(osdmap, inc);
+    EXPECT_EQ(osdmap.get_epoch(), mapping.get_epoch());
+    for (auto& [poolid, pi] : osdmap.get_pools()) {
+      for (unsigned ps = 0; ps < pi.get_pg_num(); ++ps) {
+	pg_t pgid(ps, poolid);
+	vector<int> up, acting, up2, acting2;
+	int up_primary, acting_primary, up_primary2, acting_primary2;
+	osdmap.pg_to_up_acting_osds(pgid, &up, &up_primary,
+				    &acting, &acting_primary);
+	mapping.get(pgid, &up2, &up_primary2, &acting2, &acting_primary2);
+	EXPECT_EQ(up, up2) << pgid;
+	EXPECT_EQ(up_primary, up_primary2) << pgid;
+	EXPECT_EQ(acting, acting2) << pgid;
+	EXPECT_EQ(acting_primary, acting_primary2) << pgid;
+      }
+    }
+    return remapped;
+  }
   void clean_pg_upmaps(CephContext *cct,
                        const OSDMap& om,
                        OSDMap::Incremental& pending_inc) {
@@ -775,6 +817,195 @@ TEST_F(OSDMapTest, PrimaryAffinity) {
   }
 }
 
+TEST_F(OSDMapTest, IncrementalMapping) {
+  set_up_map();
+  update_mapping();
+  unsigned total_pgs = 0;
+  for (auto& p : osdmap.get_pools()) {
+    total_pgs += p.second.get_pg_num();
+  }
+
+  // marking an osd down only remaps the pgs it was part of
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_state[0] = CEPH_OSD_UP;
+    int remapped = apply_and_check_mapping(inc);
+    ASSERT_GT(remapped, 0);
+    ASSERT_LT(remapped, (int)total_pgs);
+  }
+  // and so does marking it out
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_weight[0] = CEPH_OSD_OUT;
+    int remapped = apply_and_check_mapping(inc);
+    ASSERT_GE(remapped, 0);
+    ASSERT_LT(remapped, (int)total_pgs);
+  }
+  // bringing it back might move any pg
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_state[0] = CEPH_OSD_UP;
+    inc.new_weight[0] = CEPH_OSD_IN;
+    ASSERT_EQ((int)total_pgs, apply_and_check_mapping(inc));
+  }
+  // temp and upmap entries only remap their pgs
+  pg_t pgid = osdmap.raw_pg_to_pg(pg_t(0, my_rep_pool));
+  vector<int> up;
+  int up_primary;
+  osdmap.pg_to_raw_up(pgid, &up, &up_primary);
+  int spare = -1;
+  for (int osd = 0; osd < osdmap.get_max_osd(); ++osd) {
+    if (std::find(up.begin(), up.end(), osd) == up.end()) {
+      spare = osd;
+      break;
+    }
+  }
+  ASSERT_GE(spare, 0);
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_pg_upmap_items[pgid] =
+      mempool::osdmap::vector<pair<int32_t,int32_t>>{{up[0], spare}};
+    ASSERT_EQ(1, apply_and_check_mapping(inc));
+  }
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_pg_temp[pgid] = mempool::osdmap::vector<int>(up.begin(), up.end());
+    inc.new_primary_temp[pgid] = up[1];
+    ASSERT_EQ(1, apply_and_check_mapping(inc));
+  }
+  // an osd going down which is only in the upmap and temp of the pg
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_state[up[0]] = CEPH_OSD_UP;
+    apply_and_check_mapping(inc);
+  }
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_primary_affinity[spare] = 0;
+    apply_and_check_mapping(inc);
+  }
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.old_pg_upmap_items.insert(pgid);
+    inc.new_pg_temp[pgid] = {};
+    inc.new_primary_temp[pgid] = -1;
+    ASSERT_EQ(1, apply_and_check_mapping(inc));
+  }
+  // changing the placement of a pool remaps all of it
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    pg_pool_t pool = *osdmap.get_pg_pool(my_rep_pool);
+    pool.set_pgp_num(pool.get_pgp_num() / 2);
+    pool.last_change = inc.epoch;
+    inc.new_pools[my_rep_pool] = pool;
+    ASSERT_EQ((int)pool.get_pg_num(), apply_and_check_mapping(inc));
+  }
+  // as does a crush change under its rule, but not an unrelated one
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    CrushWrapper newcrush;
+    get_crush(osdmap, newcrush);
+    newcrush.adjust_item_weightf(g_ceph_context, 1, 2.0);
+    newcrush.encode(inc.crush, CEPH_FEATURES_SUPPORTED_DEFAULT);
+    ASSERT_EQ((int)total_pgs, apply_and_check_mapping(inc));
+  }
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    CrushWrapper newcrush;
+    get_crush(osdmap, newcrush);
+    int id;
+    ASSERT_EQ(0, newcrush.add_bucket(0, CRUSH_BUCKET_STRAW2,
+				     CRUSH_HASH_DEFAULT,
+				     newcrush.get_type_id("root"), 0,
+				     nullptr, nullptr, &id));
+    newcrush.encode(inc.crush, CEPH_FEATURES_SUPPORTED_DEFAULT);
+    ASSERT_EQ(0, apply_and_check_mapping(inc));
+  }
+  // several epochs at once can't be followed
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_state[1] = CEPH_OSD_UP;
+    osdmap.apply_incremental(inc);
+    OSDMap::Incremental inc2(osdmap.get_epoch() + 1);
+    inc2.new_state[2] = CEPH_OSD_UP;
+    osdmap.apply_incremental(inc2);
+    std::set<int64_t> pools;
+    vector<pg_t> pgs;
+    ASSERT_FALSE(get_mapping_changes(inc2, &pools, &pgs));
+  }
+}
+
+TEST_F(OSDMapTest, UpmapBalancer) {
+  set_up_map(10);
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_require_min_compat_client = ceph_release_t::reef;
+    osdmap.apply_incremental(inc);
+  }
+  // pgs of different sizes
+  map<pg_t,uint64_t> pg_bytes;
+  for (auto& [pid, pool] : osdmap.get_pools()) {
+    for (unsigned ps = 0; ps < pool.get_pg_num(); ++ps) {
+      pg_bytes[pg_t(ps, pid)] = (ps % 7 + 1) << 20;
+    }
+  }
+  auto check_mapping = [this](const OSDMap& tmp) {
+    for (auto& [pid, pool] : osdmap.get_pools()) {
+      for (unsigned ps = 0; ps < pool.get_pg_num(); ++ps) {
+        pg_t pgid(ps, pid);
+        vector<int> up, tmp_up;
+        int primary, tmp_primary;
+        osdmap.pg_to_up_acting_osds(pgid, &up, &primary, nullptr, nullptr);
+        tmp.pg_to_up_acting_osds(pgid, &tmp_up, &tmp_primary, nullptr, nullptr);
+        ASSERT_EQ(up, tmp_up);
+        ASSERT_EQ(primary, tmp_primary);
+        set<int> osds(up.begin(), up.end());
+        ASSERT_EQ(osds.size(), up.size());
+      }
+    }
+  };
+
+  UpmapBalancer::options_t opts;
+  opts.max_moves = 5;
+  opts.num_threads = 4;
+  UpmapBalancer balancer(g_ceph_context, osdmap, opts, {}, pg_bytes);
+  auto initial = balancer.calc_score();
+  ASSERT_GT(initial.total, 0);
+  auto score = initial;
+  for (int round = 0; round < 20; ++round) {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    UpmapBalancer::round_t r;
+    int changed = balancer.run_round(&inc, &r);
+    ASSERT_LE(changed, 5);
+    ASSERT_EQ(changed, (int)(r.moves + r.primary_moves));
+    if (changed == 0)
+      break;
+    ASSERT_LT(r.after.total, r.before.total);
+    ASSERT_LE(r.before.total, score.total * (1 + 1e-9));
+    score = r.after;
+    // the plan is what the balancer simulated
+    osdmap.apply_incremental(inc);
+    check_mapping(balancer.get_osdmap());
+  }
+  ASSERT_LT(score.total, initial.total);
+  ASSERT_NEAR(score.total, balancer.calc_score().total, 1e-9);
+
+  // data movement per round is capped
+  opts.max_moves = 100;
+  opts.max_bytes = 8 << 20;
+  opts.primary_upmaps = false;
+  UpmapBalancer capped(g_ceph_context, osdmap, opts, {my_rep_pool}, pg_bytes);
+  OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+  UpmapBalancer::round_t r;
+  capped.run_round(&inc, &r);
+  ASSERT_LE(r.bytes, opts.max_bytes);
+  ASSERT_EQ(0u, r.primary_moves);
+  ASSERT_TRUE(inc.new_pg_upmap_primary.empty());
+  for (auto& [pgid, items] : inc.new_pg_upmap_items) {
+    ASSERT_EQ(my_rep_pool, pgid.pool());
+  }
+}
+
 TEST_F(OSDMapTest, get_osd_crush_node_flags) {
   set_up_map();
 
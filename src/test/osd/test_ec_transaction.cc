@@ -18,6 +18,7 @@
 #include "osd/ECTransaction.h"
 #include "common/debug.h"
 #include "osd/ECBackend.h"
+#include "erasure-code/lrc/ErasureCodeLrc.h"
 
 #include "test/unit.cc"
 
@@ -29,6 +30,11 @@ struct mydpp : public DoutPrefixProvider {
 
 #define dout_context g_ceph_context
 
+// the read cost the RMW pipeline takes from its configuration
+static uint64_t pdw_read_op_cost() {
+  return g_ceph_context->_conf.get_val<Option::size_t>("ec_pdw_read_op_cost");
+}
+
 struct ECTestOp : ECCommon::RMWPipeline::Op {
   PGTransactionUPtr t;
 };
@@ -58,7 +64,8 @@ TEST(ectransaction, two_writes_separated_append)
     0,
     std::nullopt,
     std::nullopt,
-    0);
+    0,
+    pdw_read_op_cost());
 
   generic_derr << "plan " << plan << dendl;
 
@@ -94,7 +101,8 @@ TEST(ectransaction, two_writes_separated_misaligned_overwrite)
     oi.size,
     oi,
     std::nullopt,
-    0);
+    0,
+    pdw_read_op_cost());
 
   generic_derr << "plan " << plan << dendl;
 
@@ -132,7 +140,8 @@ TEST(ectransaction, partial_write)
     0,
     oi,
     std::nullopt,
-    0);
+    0,
+    pdw_read_op_cost());
 
   generic_derr << "plan " << plan << dendl;
 
@@ -172,7 +181,8 @@ TEST(ectransaction, overlapping_write_non_aligned)
     8,
     oi,
     std::nullopt,
-    0);
+    0,
+    pdw_read_op_cost());
 
   generic_derr << "plan " << plan << dendl;
 
@@ -213,7 +223,8 @@ TEST(ectransaction, test_appending_write_non_aligned)
     8,
     oi,
     std::nullopt,
-    0);
+    0,
+    pdw_read_op_cost());
 
   generic_derr << "plan " << plan << dendl;
 
@@ -254,7 +265,8 @@ TEST(ectransaction, append_with_large_hole)
     4096,
     oi,
     std::nullopt,
-    0);
+    0,
+    pdw_read_op_cost());
 
   generic_derr << "plan " << plan << dendl;
 
@@ -295,7 +307,8 @@ TEST(ectransaction, test_append_not_page_aligned_with_large_hole)
     EC_ALIGN_SIZE,
     oi,
     std::nullopt,
-    0);
+    0,
+    pdw_read_op_cost());
 
   generic_derr << "plan " << plan << dendl;
 
@@ -338,7 +351,8 @@ TEST(ectransaction, test_overwrite_with_missing)
     42*(EC_ALIGN_SIZE / 4),
     oi,
     std::nullopt,
-    0);
+    0,
+    pdw_read_op_cost());
 
   generic_derr << "plan " << plan << dendl;
 
@@ -377,7 +391,8 @@ TEST(ectransaction, truncate_to_bigger_without_write)
     4096,
     std::nullopt,
     std::nullopt,
-    0);
+    0,
+    pdw_read_op_cost());
 
   generic_derr << "plan " << plan << dendl;
 
@@ -406,7 +421,8 @@ TEST(ectransaction, truncate_to_smalelr_without_write) {
     16*EC_ALIGN_SIZE,
     std::nullopt,
     std::nullopt,
-    0);
+    0,
+    pdw_read_op_cost());
 
   generic_derr << "plan " << plan << dendl;
 
@@ -451,7 +467,8 @@ TEST(ectransaction, delete_and_write_misaligned) {
     16*EC_ALIGN_SIZE,
     std::nullopt,
     std::nullopt,
-    0);
+    0,
+    pdw_read_op_cost());
 
   generic_derr << "plan " << plan << dendl;
 
@@ -493,7 +510,8 @@ TEST(ectransaction, truncate_to_stripe) {
     16*EC_ALIGN_SIZE,
     std::nullopt,
     std::nullopt,
-    0);
+    0,
+    pdw_read_op_cost());
 
   generic_derr << "plan " << plan << dendl;
 
@@ -504,4 +522,221 @@ TEST(ectransaction, truncate_to_stripe) {
   // Truncating to a whole shard - no writes needed.
   ECUtil::shard_extent_set_t ref_write(sinfo.get_k_plus_m());
   ASSERT_EQ(ref_write, plan.will_write);
-}
\ No newline at end of file
+}
+
+// A page overwritten in a full stripe: the parity delta write reads three
+// shards, the read-modify-write seven.
+TEST(ectransaction, parity_delta_write_cost_small_overwrite) {
+  hobject_t h;
+  const uint64_t chunk_size = 16 * EC_ALIGN_SIZE;
+  PGTransaction::ObjectOperation op;
+  bufferlist a;
+  a.append_zero(EC_ALIGN_SIZE);
+  op.buffer_updates.insert(0, a.length(), PGTransaction::ObjectOperation::BufferUpdate::Write{a, 0});
+
+  pg_pool_t pool;
+  pool.set_flag(pg_pool_t::FLAG_EC_OPTIMIZATIONS);
+  ECUtil::stripe_info_t sinfo(8, 2, 8 * chunk_size, &pool, std::vector<shard_id_t>(0));
+  object_info_t oi;
+  oi.size = 8 * chunk_size;
+  shard_id_set shards;
+  shards.insert_range(shard_id_t(0), 10);
+
+  ECTransaction::WritePlanObj plan(
+    h,
+    op,
+    sinfo,
+    shards,
+    shards,
+    false,
+    oi.size,
+    oi,
+    std::nullopt,
+    0,
+    pdw_read_op_cost());
+
+  generic_derr << "plan " << plan << dendl;
+
+  ASSERT_TRUE(plan.do_parity_delta_write);
+  ECUtil::shard_extent_set_t ref_read(sinfo.get_k_plus_m());
+  ref_read[shard_id_t(0)].insert(0, EC_ALIGN_SIZE);
+  ref_read[shard_id_t(8)].insert(0, EC_ALIGN_SIZE);
+  ref_read[shard_id_t(9)].insert(0, EC_ALIGN_SIZE);
+  ASSERT_EQ(ref_read, plan.to_read);
+}
+
+// A whole chunk overwritten in a short stripe: both plans read three
+// shards, but the read-modify-write reads less as the third one is mostly
+// past the end of the object.
+TEST(ectransaction, parity_delta_write_cost_short_stripe) {
+  hobject_t h;
+  const uint64_t chunk_size = 16 * EC_ALIGN_SIZE;
+  PGTransaction::ObjectOperation op;
+  bufferlist a;
+  a.append_zero(chunk_size);
+  op.buffer_updates.insert(0, a.length(), PGTransaction::ObjectOperation::BufferUpdate::Write{a, 0});
+
+  pg_pool_t pool;
+  pool.set_flag(pg_pool_t::FLAG_EC_OPTIMIZATIONS);
+  ECUtil::stripe_info_t sinfo(8, 2, 8 * chunk_size, &pool, std::vector<shard_id_t>(0));
+  object_info_t oi;
+  oi.size = 3 * chunk_size + EC_ALIGN_SIZE;
+  shard_id_set shards;
+  shards.insert_range(shard_id_t(0), 10);
+
+  for (uint64_t op_cost : {uint64_t(0), uint64_t(64 * 1024), uint64_t(1 << 30)}) {
+    ECTransaction::WritePlanObj plan(
+      h,
+      op,
+      sinfo,
+      shards,
+      shards,
+      false,
+      oi.size,
+      oi,
+      std::nullopt,
+      0,
+      op_cost);
+
+    generic_derr << "plan " << plan << dendl;
+
+    // With as many shards read either way, the cost of a read doesn't
+    // change the choice.
+    ASSERT_FALSE(plan.do_parity_delta_write);
+    ECUtil::shard_extent_set_t ref_read(sinfo.get_k_plus_m());
+    ref_read[shard_id_t(1)].insert(0, chunk_size);
+    ref_read[shard_id_t(2)].insert(0, chunk_size);
+    ref_read[shard_id_t(3)].insert(0, EC_ALIGN_SIZE);
+    ASSERT_EQ(ref_read, plan.to_read);
+  }
+}
+
+// Two writes to different halves of two chunks: the parity delta write
+// reads half of each written chunk and the whole parity, the
+// read-modify-write the other halves and the little of the third shard
+// within the object.
+TEST(ectransaction, parity_delta_write_cost_split_writes) {
+  hobject_t h;
+  const uint64_t chunk_size = 16 * EC_ALIGN_SIZE;
+  PGTransaction::ObjectOperation op;
+  bufferlist a, b;
+  a.append_zero(chunk_size / 2);
+  op.buffer_updates.insert(0, a.length(), PGTransaction::ObjectOperation::BufferUpdate::Write{a, 0});
+  b.append_zero(chunk_size / 2);
+  op.buffer_updates.insert(chunk_size + chunk_size / 2, b.length(), PGTransaction::ObjectOperation::BufferUpdate::Write{b, 0});
+
+  pg_pool_t pool;
+  pool.set_flag(pg_pool_t::FLAG_EC_OPTIMIZATIONS);
+  ECUtil::stripe_info_t sinfo(8, 1, 8 * chunk_size, &pool, std::vector<shard_id_t>(0));
+  shard_id_set shards;
+  shards.insert_range(shard_id_t(0), 9);
+
+  {
+    object_info_t oi;
+    oi.size = 2 * chunk_size + EC_ALIGN_SIZE;
+    ECTransaction::WritePlanObj plan(
+      h,
+      op,
+      sinfo,
+      shards,
+      shards,
+      false,
+      oi.size,
+      oi,
+      std::nullopt,
+      0,
+      pdw_read_op_cost());
+
+    generic_derr << "plan " << plan << dendl;
+
+    ASSERT_FALSE(plan.do_parity_delta_write);
+    ECUtil::shard_extent_set_t ref_read(sinfo.get_k_plus_m());
+    ref_read[shard_id_t(0)].insert(chunk_size / 2, chunk_size / 2);
+    ref_read[shard_id_t(1)].insert(0, chunk_size / 2);
+    ref_read[shard_id_t(2)].insert(0, EC_ALIGN_SIZE);
+    ASSERT_EQ(ref_read, plan.to_read);
+  }
+
+  {
+    // Over a full stripe the read-modify-write reads all eight shards.
+    object_info_t oi;
+    oi.size = 8 * chunk_size;
+    ECTransaction::WritePlanObj plan(
+      h,
+      op,
+      sinfo,
+      shards,
+      shards,
+      false,
+      oi.size,
+      oi,
+      std::nullopt,
+      0,
+      pdw_read_op_cost());
+
+    generic_derr << "plan " << plan << dendl;
+
+    ASSERT_TRUE(plan.do_parity_delta_write);
+    ECUtil::shard_extent_set_t ref_read(sinfo.get_k_plus_m());
+    ref_read[shard_id_t(0)].insert(0, chunk_size / 2);
+    ref_read[shard_id_t(1)].insert(chunk_size / 2, chunk_size / 2);
+    ref_read[shard_id_t(8)].insert(0, chunk_size);
+    ASSERT_EQ(ref_read, plan.to_read);
+  }
+}
+
+// A small overwrite in an LRC pool: the parity delta write reads the
+// written data shard and every coding shard, local parity included, which
+// is still less than the other data shards of the read-modify-write.
+TEST(ectransaction, parity_delta_write_lrc) {
+  auto lrc = std::make_shared<ErasureCodeLrc>(
+    g_conf().get_val<std::string>("erasure_code_dir"));
+  ceph::ErasureCodeProfile profile;
+  profile["k"] = "8";
+  profile["m"] = "2";
+  profile["l"] = "5";
+  ASSERT_EQ(0, lrc->init(profile, &std::cerr));
+  const uint64_t flags = lrc->get_supported_optimizations();
+  ASSERT_TRUE(flags & ceph::ErasureCodeInterface::FLAG_EC_PLUGIN_OPTIMIZED_SUPPORTED);
+  ASSERT_TRUE(flags & ceph::ErasureCodeInterface::FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION);
+
+  hobject_t h;
+  const uint64_t chunk_size = 16 * EC_ALIGN_SIZE;
+  PGTransaction::ObjectOperation op;
+  bufferlist a;
+  a.append_zero(EC_ALIGN_SIZE);
+  op.buffer_updates.insert(0, a.length(), PGTransaction::ObjectOperation::BufferUpdate::Write{a, 0});
+
+  pg_pool_t pool;
+  pool.set_flag(pg_pool_t::FLAG_EC_OPTIMIZATIONS);
+  ECUtil::stripe_info_t sinfo(lrc, &pool, 8 * chunk_size);
+  ASSERT_EQ(4u, sinfo.get_m());
+  object_info_t oi;
+  oi.size = 8 * chunk_size;
+  shard_id_set shards;
+  shards.insert_range(shard_id_t(0), sinfo.get_k_plus_m());
+
+  ECTransaction::WritePlanObj plan(
+    h,
+    op,
+    sinfo,
+    shards,
+    shards,
+    false,
+    oi.size,
+    oi,
+    std::nullopt,
+    0,
+    pdw_read_op_cost());
+
+  generic_derr << "plan " << plan << dendl;
+
+  ASSERT_TRUE(plan.do_parity_delta_write);
+  ECUtil::shard_extent_set_t ref_read(sinfo.get_k_plus_m());
+  ref_read[sinfo.get_shard(raw_shard_id_t(0))].insert(0, EC_ALIGN_SIZE);
+  for (auto shard : sinfo.get_parity_shards()) {
+    ref_read[shard].insert(0, EC_ALIGN_SIZE);
+  }
+  ASSERT_EQ(ref_read, plan.to_read);
+  ASSERT_EQ(ref_read, plan.will_write);
+}
@@ -693,4 +693,59 @@ TEST(ECExtentCache, test_invalidate_lru)
     cl.complete_write(*op5);
     op5.reset();
   }
-}
\ No newline at end of file
+}
+
+TEST(ECExtentCache, lru_stats)
+{
+  Client cl(32, 2, 1, 1024);
+  auto to_read = iset_from_vector({{{0, 2}}, {{0, 2}}}, cl.get_stripe_info());
+  auto to_write = iset_from_vector({{{0, 10}}, {{0, 10}}}, cl.get_stripe_info());
+  auto do_op = [&cl, &to_read, &to_write](bool expect_read) {
+    optional op = cl.cache.prepare(cl.oid, to_read, to_write, 10, 10, false,
+      [&cl](ECExtentCache::OpRef &op)
+      {
+        cl.cache_ready(op->get_hoid(), op->get_result());
+      });
+    cl.cache_execute(*op);
+    ASSERT_EQ(expect_read, (bool)cl.active_reads);
+    if (expect_read) {
+      cl.complete_read();
+    }
+    cl.complete_write(*op);
+    op.reset();
+  };
+
+  do_op(true);
+  auto stats = cl.lru.get_stats();
+  ASSERT_EQ(0u, stats.hits);
+  ASSERT_EQ(1u, stats.misses);
+  ASSERT_EQ(0u, stats.read_hit_bytes);
+  ASSERT_EQ(4u, stats.read_miss_bytes);
+  ASSERT_EQ(1u, stats.lines);
+  ASSERT_LT(0u, stats.bytes);
+  ASSERT_EQ(1024u, stats.max_bytes);
+
+  // The line outlived the op, the next one reads nothing.
+  do_op(false);
+  stats = cl.lru.get_stats();
+  ASSERT_EQ(1u, stats.hits);
+  ASSERT_EQ(4u, stats.read_hit_bytes);
+  ASSERT_EQ(4u, stats.read_miss_bytes);
+  ASSERT_EQ(0u, stats.evictions);
+
+  // Shrinking the budget evicts straight away.
+  uint64_t bytes = stats.bytes;
+  cl.lru.set_max_size(0);
+  stats = cl.lru.get_stats();
+  ASSERT_EQ(1u, stats.evictions);
+  ASSERT_EQ(bytes, stats.evicted_bytes);
+  ASSERT_EQ(0u, stats.lines);
+  ASSERT_EQ(0u, stats.bytes);
+
+  do_op(true);
+  stats = cl.lru.get_stats();
+  ASSERT_EQ(1u, stats.hits);
+  ASSERT_EQ(2u, stats.misses);
+  ASSERT_EQ(8u, stats.read_miss_bytes);
+  ASSERT_EQ(2u, stats.evictions);
+}
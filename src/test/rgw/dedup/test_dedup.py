@@ -96,6 +96,22 @@ def rados(args, **kwargs):
     cmd = [test_path + 'test-rgw-call.sh', 'call_rgw_rados', 'noname'] + args
     return bash(cmd, **kwargs)
 
+#-----------------------------------------------
+def ceph(args, **kwargs):
+    """ ceph command """
+    cmd = [test_path + 'test-rgw-call.sh', 'call_ceph', 'noname'] + args
+    return bash(cmd, **kwargs)
+
+#-----------------------------------------------
+def set_rgw_config(name, val):
+    result = ceph(['config', 'set', 'client.rgw', name, str(val)])
+    assert result[1] == 0
+
+#-----------------------------------------------
+def rm_rgw_config(name):
+    result = ceph(['config', 'rm', 'client.rgw', name])
+    assert result[1] == 0
+
 #-----------------------------------------------
 def gen_bucket_name():
     global num_buckets
@@ -277,6 +293,7 @@ MULTIPART_SIZE=(16*MB)
 default_config = TransferConfig(multipart_threshold=MULTIPART_SIZE, multipart_chunksize=MULTIPART_SIZE)
 ETAG_ATTR="user.rgw.etag"
 POOLNAME="default.rgw.buckets.data"
+CHUNK_POOLNAME="dedup.chunks"
 
 #-------------------------------------------------------------------------------
 def write_file(filename, size):
@@ -434,6 +451,13 @@ def count_object_parts_in_all_buckets(verbose=False):
     return count
 
 
+#-------------------------------------------------------------------------------
+def count_objects_in_pool(poolname):
+    result = rados(['ls', '-p ', poolname])
+    assert result[1] == 0
+    return len(result[0].split())
+
+
 #-------------------------------------------------------------------------------
 def cleanup_local():
     if os.path.isdir(OUT_DIR):
@@ -480,6 +504,13 @@ def verify_pool_is_empty():
     assert count_object_parts_in_all_buckets() == 0
 
 
+#-------------------------------------------------------------------------------
+def gc_and_count_objects():
+    result = admin(['gc', 'process', '--include-all'])
+    assert result[1] == 0
+    return count_object_parts_in_all_buckets()
+
+
 #-------------------------------------------------------------------------------
 def cleanup(bucket_name, conn):
     if cleanup_local():
@@ -846,6 +877,15 @@ def verify_objects(bucket_name, files, conn, expected_results, config):
     log.debug("verify_objects::completed successfully!!")
 
 
+#-------------------------------------------------------------------------------
+def verify_object(bucket_name, key, filename, conn, config):
+    tempfile = OUT_DIR + "temp"
+    conn.download_file(bucket_name, key, tempfile, Config=config)
+    result = bash(['cmp', tempfile, OUT_DIR + filename])
+    assert result[1] == 0 ,"Files %s and %s differ!!" % (key, tempfile)
+    os.remove(tempfile)
+
+
 #-------------------------------------------------------------------------------
 def verify_objects_multi(files, conns, bucket_names, expected_results, config):
     max_tenants=len(conns)
@@ -1014,6 +1054,12 @@ def verify_dedup_ratio(expected_dedup_stats, dedup_ratio):
     assert s3_bytes_after == dedup_ratio.s3_bytes_after
     assert ratio == dedup_ratio.ratio
 
+#-------------------------------------------------------------------------------
+def read_dedup_json():
+    result = admin(['dedup', 'stats'])
+    assert result[1] == 0
+    return json.loads(result[0])
+
 #-------------------------------------------------------------------------------
 def read_dedup_stats(dry_run):
     dedup_work_was_completed = False
@@ -1021,10 +1067,7 @@ def read_dedup_stats(dry_run):
     dedup_ratio_estimate=Dedup_Ratio()
     dedup_ratio_actual=Dedup_Ratio()
 
-    result = admin(['dedup', 'stats'])
-    assert result[1] == 0
-
-    jstats=json.loads(result[0])
+    jstats=read_dedup_json()
     worker_stats=jstats['worker_stats']
     main=worker_stats['main']
     skipped=worker_stats['skipped']
@@ -1078,17 +1121,22 @@ def set_bucket_index_throttling(limit):
     log.debug(result[0])
 
 #-------------------------------------------------------------------------------
-def exec_dedup_internal(expected_dedup_stats, dry_run, max_dedup_time):
+def exec_dedup_internal(expected_dedup_stats, dry_run, max_dedup_time, incremental=False,
+                        sample_percent=100):
     ### set throttling to a rand val between 50-200 IOPS (i.e. 50K-200K objs)
     limit=random.randint(50, 200)
     set_bucket_index_throttling(limit)
 
-    log.debug("sending exec_dedup request: dry_run=%d", dry_run)
+    log.debug("sending exec_dedup request: dry_run=%d, incremental=%d, sample_percent=%d",
+              dry_run, incremental, sample_percent)
+    extra_args = ['--incremental'] if incremental else []
+    if sample_percent < 100:
+        extra_args += ['--sample-percent', str(sample_percent)]
     if dry_run:
-        result = admin(['dedup', 'estimate'])
+        result = admin(['dedup', 'estimate'] + extra_args)
         reset_full_dedup_stats(expected_dedup_stats)
     else:
-        result = admin(['dedup', 'exec', '--yes-i-really-mean-it'])
+        result = admin(['dedup', 'exec', '--yes-i-really-mean-it'] + extra_args)
 
     assert result[1] == 0
     log.debug("wait for dedup to complete")
@@ -1113,7 +1161,8 @@ def exec_dedup_internal(expected_dedup_stats, dry_run, max_dedup_time):
             set_bucket_index_throttling(limit)
 
 #-------------------------------------------------------------------------------
-def exec_dedup(expected_dedup_stats, dry_run, verify_stats=True):
+def exec_dedup(expected_dedup_stats, dry_run, verify_stats=True, incremental=False,
+               sample_percent=100):
     # dedup should complete in less than 5 minutes
     max_dedup_time = 5*60
     if expected_dedup_stats.deduped_obj > 10000:
@@ -1123,7 +1172,8 @@ def exec_dedup(expected_dedup_stats, dry_run, verify_stats=True):
     elif expected_dedup_stats.deduped_obj > 1000:
         max_dedup_time = 5 * 60
 
-    ret=exec_dedup_internal(expected_dedup_stats, dry_run, max_dedup_time)
+    ret=exec_dedup_internal(expected_dedup_stats, dry_run, max_dedup_time, incremental,
+                            sample_percent)
     dedup_time = ret[0]
     dedup_stats = ret[1]
     dedup_ratio_estimate = ret[2]
@@ -1858,6 +1908,355 @@ def test_dedup_small_with_tenants():
         cleanup_all_buckets(bucket_names, conns)
 
 
+#-------------------------------------------------------------------------------
+# Small objects dedup (rgw_dedup_small_objects):
+# 1) upload 2 copies of 2 single-part objects smaller than the head-object
+# 2) execute DEDUP!! the SRC head data is moved into a shared blob and both
+#    heads are truncated, so we should have one more rados object per file
+# 3) read all objects back
+# 4) delete the copies of each file in a different order (SRC first on one of
+#    them, TGT first on the other) and verify that the blob is kept by GC while
+#    a copy is left, and released with the last copy
+@pytest.mark.basic_test
+def test_dedup_small_objects():
+    #return
+
+    if full_dedup_is_disabled():
+        return
+
+    prepare_test()
+    bucket_name = gen_bucket_name()
+    log.debug("test_dedup_small_objects: connect to AWS ...")
+    conn=get_single_connection()
+    config=default_config
+    set_rgw_config('rgw_dedup_small_objects', 'true')
+    try:
+        files=[]
+        gen_files_fixed_copies(files, 2, 1*MB, 2)
+        conn.create_bucket(Bucket=bucket_name)
+        indices=[0] * len(files)
+        ret=upload_objects(bucket_name, files, indices, conn, config)
+        dedup_stats = ret[1]
+        s3_objects_total = ret[2]
+
+        exec_dedup(dedup_stats, False, False)
+        md5_stats=read_dedup_json()['md5_stats']
+        small=md5_stats['small objects dedup']
+        assert small['Deduped Small Obj'] == len(files)
+        assert small['Shared Blobs'] == len(files)
+
+        # every head is kept (truncated) and each file got a blob
+        expected_results = s3_objects_total + len(files)
+        verify_objects(bucket_name, files, conn, expected_results, config)
+
+        for (f, order) in zip(files, ([0, 1], [1, 0])):
+            filename=f[0]
+            first=gen_object_name(filename, order[0])
+            second=gen_object_name(filename, order[1])
+
+            conn.delete_object(Bucket=bucket_name, Key=first)
+            expected_results -= 1
+            # the blob is still referenced by the second copy
+            assert gc_and_count_objects() == expected_results
+            verify_object(bucket_name, second, filename, conn, config)
+
+            conn.delete_object(Bucket=bucket_name, Key=second)
+            # the head and the blob are both gone
+            expected_results -= 2
+            assert gc_and_count_objects() == expected_results
+
+        assert expected_results == 0
+    finally:
+        rm_rgw_config('rgw_dedup_small_objects')
+        # cleanup must be executed even after a failure
+        cleanup(bucket_name, conn)
+
+
+#-------------------------------------------------------------------------------
+# Chunk dedup (rgw_dedup_chunk_pool):
+# 1) upload 2 singleton objects with different head-objects and an identical
+#    tail-object (so full-object dedup can't share anything between them)
+# 2) execute DEDUP!! with fixed size chunks, both tail-objects are split into
+#    chunks and every chunk of the second tail is a duplicate
+# 3) read both objects back through the chunk manifests
+# 4) remove the objects one by one, the chunks should be kept while referenced
+#    by a tail-object and released by the OSD with the last reference
+@pytest.mark.basic_test
+def test_dedup_chunks():
+    #return
+
+    if full_dedup_is_disabled():
+        return
+
+    prepare_test()
+    bucket_name = gen_bucket_name()
+    log.debug("test_dedup_chunks: connect to AWS ...")
+    conn=get_single_connection()
+    config=default_config
+    chunk_size=64*KB
+    chunks_per_tail=RADOS_OBJ_SIZE//chunk_size
+    result = ceph(['osd', 'pool', 'create', CHUNK_POOLNAME])
+    assert result[1] == 0
+    set_rgw_config('rgw_dedup_chunk_pool', CHUNK_POOLNAME)
+    set_rgw_config('rgw_dedup_chunk_algorithm', 'fixed')
+    set_rgw_config('rgw_dedup_chunk_size', chunk_size)
+    try:
+        files=[]
+        obj_size=2*RADOS_OBJ_SIZE
+        gen_files_fixed_copies(files, 1, obj_size, 1)
+        # same tail as the first file behind a different head
+        filename=files[0][0] + "_TAIL"
+        with open(OUT_DIR + files[0][0], "rb") as fin:
+            fin.seek(RADOS_OBJ_SIZE)
+            tail=fin.read()
+        with open(OUT_DIR + filename, "wb") as fout:
+            fout.write(os.urandom(RADOS_OBJ_SIZE))
+            fout.write(tail)
+        files.append((filename, obj_size, 1))
+
+        conn.create_bucket(Bucket=bucket_name)
+        indices=[0] * len(files)
+        ret=upload_objects(bucket_name, files, indices, conn, config)
+        expected_results = ret[0]
+        dedup_stats = ret[1]
+
+        exec_dedup(dedup_stats, False, False)
+        chunk_stats=read_dedup_json()['md5_stats']['Chunk Dedup']
+        assert chunk_stats['Chunked Obj'] == len(files)
+        assert chunk_stats['Chunked Tail Obj'] == len(files)
+        assert chunk_stats['Chunks'] == len(files) * chunks_per_tail
+        assert chunk_stats['Duplicate Chunks'] == chunks_per_tail
+        assert chunk_stats['Deduped Chunk Bytes'] == RADOS_OBJ_SIZE
+        assert count_objects_in_pool(CHUNK_POOLNAME) == chunks_per_tail
+
+        # the tail-objects are kept as (evicted) chunk manifests
+        verify_objects(bucket_name, files, conn, expected_results, config)
+
+        conn.delete_object(Bucket=bucket_name, Key=gen_object_name(files[0][0], 0))
+        assert gc_and_count_objects() == expected_results - 2
+        assert count_objects_in_pool(CHUNK_POOLNAME) == chunks_per_tail
+        verify_object(bucket_name, gen_object_name(filename, 0), filename, conn, config)
+
+        conn.delete_object(Bucket=bucket_name, Key=gen_object_name(filename, 0))
+        assert gc_and_count_objects() == 0
+        # the OSD drops the chunk references asynchronously
+        wait_time = 0
+        while count_objects_in_pool(CHUNK_POOLNAME) != 0:
+            assert wait_time < 60
+            time.sleep(5)
+            wait_time += 5
+
+        # CopyObject takes a reference on the tail-objects, which makes the OSD
+        # promote the chunks of an evicted tail back into it
+        files=[]
+        gen_files_fixed_copies(files, 2, obj_size, 1)
+        chunked_file=files[0][0]
+        shared_file=files[1][0]
+        chunked_key=gen_object_name(chunked_file, 0)
+        shared_key=gen_object_name(shared_file, 0)
+        ret=upload_objects(bucket_name, files[:1], [0], conn, config)
+        exec_dedup(ret[1], False, False)
+        chunk_stats=read_dedup_json()['md5_stats']['Chunk Dedup']
+        assert chunk_stats['Chunked Tail Obj'] == 1
+
+        ret=upload_objects(bucket_name, files[1:], [0], conn, config, False)
+        for key in (chunked_key, shared_key):
+            conn.copy_object(Bucket=bucket_name, Key=key + "_COPY",
+                             CopySource={'Bucket': bucket_name, 'Key': key})
+        verify_object(bucket_name, chunked_key + "_COPY", chunked_file, conn, config)
+        # the copies are removed, but GC still holds their tail references
+        for key in (chunked_key, shared_key):
+            conn.delete_object(Bucket=bucket_name, Key=key + "_COPY")
+
+        exec_dedup(ret[1], False, False)
+        chunk_stats=read_dedup_json()['md5_stats']['Chunk Dedup']
+        assert chunk_stats['Evicted Chunked Tail Obj'] == 1
+        assert chunk_stats['Skipped Shared Tail Obj'] == 1
+        assert chunk_stats['Chunked Tail Obj'] == 0
+
+        # once GC dropped the references the shared tail is chunked too
+        gc_and_count_objects()
+        exec_dedup(ret[1], False, False)
+        chunk_stats=read_dedup_json()['md5_stats']['Chunk Dedup']
+        assert chunk_stats['Evicted Chunked Tail Obj'] == 1
+        assert chunk_stats['Skipped Shared Tail Obj'] == 0
+        assert chunk_stats['Chunked Tail Obj'] == 1
+        assert count_objects_in_pool(CHUNK_POOLNAME) == 2 * chunks_per_tail
+        verify_object(bucket_name, chunked_key, chunked_file, conn, config)
+        verify_object(bucket_name, shared_key, shared_file, conn, config)
+    finally:
+        rm_rgw_config('rgw_dedup_chunk_size')
+        rm_rgw_config('rgw_dedup_chunk_algorithm')
+        rm_rgw_config('rgw_dedup_chunk_pool')
+        # cleanup must be executed even after a failure
+        cleanup(bucket_name, conn)
+        ceph(['osd', 'pool', 'rm', CHUNK_POOLNAME, CHUNK_POOLNAME,
+              '--yes-i-really-really-mean-it'])
+
+
+#-------------------------------------------------------------------------------
+def get_obj_compression(bucket_name, key):
+    result = admin(['object', 'stat', '--bucket', bucket_name, '--object', key])
+    assert result[1] == 0
+    stat = json.loads(result[0])
+    if 'compression' not in stat:
+        return 'none'
+    return stat['compression']['compression_type']
+
+
+#-------------------------------------------------------------------------------
+# set the compression of the default placement and wait for the RGW to reload
+# the zone (a probe object is written until it comes back with the new type)
+def set_default_compression(compression, bucket_name, conn):
+    result = admin(['zone', 'placement', 'modify',
+                    '--placement-id', 'default-placement',
+                    '--storage-class', 'STANDARD',
+                    '--compression', compression])
+    assert result[1] == 0
+    result = admin(['period', 'update', '--commit'])
+    assert result[1] == 0
+
+    probe='compression_probe'
+    wait_time = 0
+    while True:
+        conn.put_object(Bucket=bucket_name, Key=probe, Body=b'probe' * KB)
+        if get_obj_compression(bucket_name, probe) == compression:
+            break
+        assert wait_time < 60
+        time.sleep(5)
+        wait_time += 5
+    conn.delete_object(Bucket=bucket_name, Key=probe)
+
+
+#------------------------------------------------------------------------------
+# Compressed objects are matched by their logical ETAG and share the
+# tail-objects of a source stored with the same compression. Copies of the
+# same data stored with a different compression type are not deduped
+@pytest.mark.basic_test
+def test_dedup_compressed():
+    #return
+
+    if full_dedup_is_disabled():
+        return
+
+    prepare_test()
+    bucket_name = gen_bucket_name()
+    log.debug("test_dedup_compressed: connect to AWS ...")
+    conn=get_single_connection()
+    config=default_config
+    conn.create_bucket(Bucket=bucket_name)
+    try:
+        set_default_compression('zlib', bucket_name, conn)
+        files=[]
+        num_copies=3
+        gen_files_fixed_copies(files, 2, 2*RADOS_OBJ_SIZE, num_copies)
+        (shared_file, mixed_file) = (files[0][0], files[1][0])
+        for i in range(0, num_copies):
+            key=gen_object_name(shared_file, i)
+            conn.upload_file(OUT_DIR + shared_file, bucket_name, key, Config=config)
+            assert get_obj_compression(bucket_name, key) == 'zlib'
+        mixed_zlib=gen_object_name(mixed_file, 0)
+        conn.upload_file(OUT_DIR + mixed_file, bucket_name, mixed_zlib, Config=config)
+
+        # the same data stored with another compression type
+        set_default_compression('snappy', bucket_name, conn)
+        mixed_snappy=gen_object_name(mixed_file, 1)
+        conn.upload_file(OUT_DIR + mixed_file, bucket_name, mixed_snappy, Config=config)
+        assert get_obj_compression(bucket_name, mixed_snappy) == 'snappy'
+
+        exec_dedup(Dedup_Stats(), False, False)
+        md5_stats=read_dedup_json()['md5_stats']
+        assert md5_stats['notify']['Compressed/Encrypted objs'] == num_copies + 2
+        assert md5_stats['main']['Deduped Obj (this cycle)'] == num_copies - 1
+        failures=md5_stats['logical failures']
+        assert failures['Transform mismatch SRC/TGT'] == 1
+        assert 'HASH mismatch' not in failures
+
+        # the deduped copies keep their compression attributes and decompress
+        # the shared tail-objects
+        for i in range(0, num_copies):
+            key=gen_object_name(shared_file, i)
+            assert get_obj_compression(bucket_name, key) == 'zlib'
+            verify_object(bucket_name, key, shared_file, conn, config)
+        verify_object(bucket_name, mixed_zlib, mixed_file, conn, config)
+        verify_object(bucket_name, mixed_snappy, mixed_file, conn, config)
+
+        # the shared tails stay alive as long as one copy references them
+        for i in range(0, num_copies - 1):
+            conn.delete_object(Bucket=bucket_name, Key=gen_object_name(shared_file, i))
+        gc_and_count_objects()
+        key=gen_object_name(shared_file, num_copies - 1)
+        verify_object(bucket_name, key, shared_file, conn, config)
+    finally:
+        set_default_compression('none', bucket_name, conn)
+        # cleanup must be executed even after a failure
+        cleanup(bucket_name, conn)
+
+
+#-------------------------------------------------------------------------------
+def count_gc_entries():
+    result = admin(['gc', 'list', '--include-all'])
+    assert result[1] == 0
+    return len(json.loads(result[0]))
+
+
+#------------------------------------------------------------------------------
+# Deleted deduped objects leave GC entries which all point to the same shared
+# tail-objects, so GC drops their references with a single put_many per tail.
+# Every GC pass is made to time out after the first entry of each shard, so a
+# shard holding several entries is stopped in the middle of its listed chunk:
+# every pass must still retire the entries it handled.
+@pytest.mark.basic_test
+def test_dedup_gc_batched_refcount():
+    #return
+
+    if full_dedup_is_disabled():
+        return
+
+    prepare_test()
+    bucket_name = gen_bucket_name()
+    log.debug("test_dedup_gc_batched_refcount: connect to AWS ...")
+    conn=get_single_connection()
+    config=default_config
+    try:
+        files=[]
+        # more copies than GC shards, so some shards get several entries
+        num_copies=48
+        gen_files_fixed_copies(files, 1, RADOS_OBJ_SIZE + 64*KB, num_copies)
+        conn.create_bucket(Bucket=bucket_name)
+        indices=[0] * len(files)
+        ret=upload_objects(bucket_name, files, indices, conn, config)
+        expected_results = ret[0]
+        dedup_stats = ret[1]
+        exec_dedup(dedup_stats, False, True)
+        verify_objects(bucket_name, files, conn, expected_results, config)
+
+        delete_bucket_with_all_objects(bucket_name, conn)
+        gc_entries = count_gc_entries()
+        assert gc_entries >= num_copies
+
+        gc_args=['gc', 'process', '--include-all',
+                 '--rgw-gc-batch-refcount=true',
+                 '--rgw-debug-inject-gc-timeout-entries=1']
+        passes = 0
+        while gc_entries > 0:
+            assert passes < num_copies
+            result = admin(gc_args)
+            assert result[1] == 0
+            passes += 1
+            remaining = count_gc_entries()
+            log.debug("GC pass %d: %d entries left", passes, remaining)
+            assert remaining < gc_entries
+            gc_entries = remaining
+
+        # several entries of a shard can't be retired by a single pass
+        assert passes > 1
+        assert count_object_parts_in_all_buckets() == 0
+    finally:
+        # cleanup must be executed even after a failure
+        cleanup(bucket_name, conn)
+
+
 #------------------------------------------------------------------------------
 # Trivial incremental dedup:
 # 1) Run the @simple_dedup test above without cleanup post dedup
@@ -2329,6 +2728,84 @@ def test_dedup_inc_with_remove_multi_tenants():
         cleanup_all_buckets(bucket_names, conns)
 
 
+#-------------------------------------------------------------------------------
+# Incremental dedup sessions (dedup exec --incremental):
+# 1) upload objects and run an incremental session, the first one is a full
+#    scan creating the baseline so the stats should match a full dedup
+# 2) add one copy of every object and run another incremental session, the new
+#    copies are deduped against the sources recorded in the baseline
+# 3) run a third incremental session without any change, all bucket-index
+#    shards should be skipped and nothing deduped
+# 4) remove the first copy of every object and verify that the other copies
+#    are intact after GC (i.e. the ref-counts taken incrementally are valid)
+@pytest.mark.basic_test
+def test_dedup_incremental():
+    #return
+
+    if full_dedup_is_disabled():
+        return
+
+    config=default_config
+    prepare_test()
+    bucket_name = gen_bucket_name()
+    log.debug("test_dedup_incremental: connect to AWS ...")
+    conn=get_single_connection()
+    try:
+        files=[]
+        # singletons and pairs, each object has a single tail-object
+        gen_files_fixed_copies(files, 3, 6*MB, 1)
+        gen_files_fixed_copies(files, 3, 6*MB, 2)
+        conn.create_bucket(Bucket=bucket_name)
+        indices=[0] * len(files)
+        ret=upload_objects(bucket_name, files, indices, conn, config)
+        expected_results = ret[0]
+        stats_base = ret[1]
+
+        dry_run=False
+        exec_dedup(stats_base, dry_run, incremental=True)
+        verify_objects(bucket_name, files, conn, expected_results, config)
+
+        # upload one more copy of every object
+        indices=[]
+        files_combined=[]
+        for f in files:
+            indices.append(f[2])
+            files_combined.append((f[0], f[1], f[2] + 1))
+
+        ret=upload_objects(bucket_name, files_combined, indices, conn, config, False)
+        expected_results = ret[0]
+        log.debug("test_dedup_incremental: incremental dedup:")
+        ret=exec_dedup(ret[1], dry_run, False, incremental=True)
+        dedup_stats = ret[1]
+        assert dedup_stats.deduped_obj == len(files)
+        verify_objects(bucket_name, files_combined, conn, expected_results, config)
+
+        log.debug("test_dedup_incremental: incremental dedup without changes:")
+        ret=exec_dedup(Dedup_Stats(), dry_run, False, incremental=True)
+        dedup_stats = ret[1]
+        assert dedup_stats.deduped_obj == 0
+        skipped=read_dedup_json()['worker_stats']['skipped']
+        assert skipped['Ingress skip: unchanged Bucket-Index shards'] > 0
+        verify_objects(bucket_name, files_combined, conn, expected_results, config)
+
+        # remove the oldest copy (a dedup source for the singletons)
+        for f in files_combined:
+            conn.delete_object(Bucket=bucket_name, Key=gen_object_name(f[0], 0))
+
+        # the copies left keep their head-objects and share one tail-object
+        expected_results = 0
+        for f in files_combined:
+            num_heads = f[2] - 1
+            expected_results += (num_heads + 1)
+        assert gc_and_count_objects() == expected_results
+        for f in files_combined:
+            for i in range(1, f[2]):
+                verify_object(bucket_name, gen_object_name(f[0], i), f[0], conn, config)
+    finally:
+        # cleanup must be executed even after a failure
+        cleanup(bucket_name, conn)
+
+
 #-------------------------------------------------------------------------------
 # Incremental dedup with object removal:
 # 1) Run the @simple_dedup test above without cleanup post dedup
@@ -2558,6 +3035,83 @@ def test_dedup_small_multipart():
     simple_dedup(conn, files, bucket_name, True, config2, False)
 
 
+#-------------------------------------------------------------------------------
+# Dedup table spill (rgw_dedup_memory_limit):
+# shrink the dedup table so every md5 shard spills it to sorted runs and run
+# the @simple_dedup test above. The duplicates are collected while merging
+# the runs, so the stats, the read back and the ref-counts released by the
+# cleanup should be the same as with a table holding all the objects
+@pytest.mark.basic_test
+def test_dedup_spill():
+    #return
+
+    if full_dedup_is_disabled():
+        return
+
+    prepare_test()
+    log.debug("test_dedup_spill: connect to AWS ...")
+    config2=TransferConfig(multipart_threshold=4*KB, multipart_chunksize=1*MB)
+    conn=get_single_connection()
+    bucket_name=gen_bucket_name()
+    set_rgw_config('rgw_dedup_memory_limit', 8*MB)
+    # spilled when 56 entries are used, every table gets ~90 keys
+    set_rgw_config('rgw_dedup_debug_table_entries', 64)
+    try:
+        files=[]
+        # few duplicates so the merged entries fit back in the table
+        gen_files_fixed_copies(files, 320, 4*KB, 1)
+        gen_files_fixed_copies(files, 40, 4*KB, 2)
+        simple_dedup(conn, files, bucket_name, False, config2, False)
+
+        md5_stats=read_dedup_json()['md5_stats']
+        notify=md5_stats['notify']
+        assert notify['Spilled Table Runs'] > 0
+        assert 'Failed Table Load' not in notify
+        assert 'Failed Table Spill' not in md5_stats['system failures']
+    finally:
+        rm_rgw_config('rgw_dedup_debug_table_entries')
+        rm_rgw_config('rgw_dedup_memory_limit')
+        # cleanup must be executed even after a failure
+        cleanup(bucket_name, conn)
+
+
+#-------------------------------------------------------------------------------
+# BLAKE3 reads window (rgw_dedup_verify_max_aio):
+# the duplicates are uploaded without a HASH attribute, so dedup has to read
+# and hash every rados-object of the candidates before deduping them.
+# Run the @simple_dedup test above with a single read inflight and with a
+# window larger than the rados-objects count of the candidates. Both should
+# calculate the same hash so the stats, the read back and the ref-counts
+# released by the cleanup should be the same
+@pytest.mark.basic_test
+def test_dedup_verify_aio():
+    #return
+
+    if full_dedup_is_disabled():
+        return
+
+    prepare_test()
+    log.debug("test_dedup_verify_aio: connect to AWS ...")
+    conn=get_single_connection()
+    for max_aio in (1, 16):
+        bucket_name=gen_bucket_name()
+        set_rgw_config('rgw_dedup_verify_max_aio', max_aio)
+        try:
+            files=[]
+            # multipart objects with many tail-objects and a partial last part
+            gen_files_fixed_copies(files, 3, 40*MB, 2)
+            gen_files_fixed_copies(files, 2, 37*MB + 123, 3)
+            simple_dedup(conn, files, bucket_name, False, default_config, False)
+
+            md5_stats=read_dedup_json()['md5_stats']
+            assert md5_stats['notify']['Invalid HASH attrs'] > 0
+            assert 'HASH mismatch' not in md5_stats['logical failures']
+        finally:
+            rm_rgw_config('rgw_dedup_verify_max_aio')
+            # cleanup must be executed even after a failure
+            cleanup(bucket_name, conn)
+
+
 #-------------------------------------------------------------------------------
 @pytest.mark.basic_test
 def test_dedup_large_scale_with_tenants():
@@ -2837,6 +3391,78 @@ def test_dedup_dry_small():
     small_single_part_objs_dedup(conn, bucket_name, True)
 
 
+#-------------------------------------------------------------------------------
+# Sampled dedup estimate (dedup estimate --sample-percent):
+# 1) sampling is rejected for exec and incremental sessions and out of range
+# 2) run a 50% sampled estimate and verify that some bucket-index shards were
+#    skipped, the estimate is within its bounds and it is scaled to the system
+# 3) an estimate changes nothing so all objects should read back with the same
+#    rados objects count, and the cleanup should release all of them
+@pytest.mark.basic_test
+def test_dedup_dry_sampled():
+    #return
+
+    if full_dedup_is_disabled():
+        return
+
+    for args in (['dedup', 'exec', '--yes-i-really-mean-it', '--sample-percent', '50'],
+                 ['dedup', 'estimate', '--incremental', '--sample-percent', '50'],
+                 ['dedup', 'estimate', '--sample-percent', '0'],
+                 ['dedup', 'estimate', '--sample-percent', '101']):
+        result = admin(args)
+        assert result[1] != 0
+
+    prepare_test()
+    log.debug("test_dedup_dry_sampled: connect to AWS ...")
+    config2=TransferConfig(multipart_threshold=4*KB, multipart_chunksize=1*MB)
+    conn=get_single_connection()
+    bucket_name=gen_bucket_name()
+    try:
+        files=[]
+        gen_files_fixed_copies(files, 300, 4*KB, 2)
+        conn.create_bucket(Bucket=bucket_name)
+        # enough shards for the sampled fraction to be close to the percent
+        result = admin(['bucket', 'reshard', '--bucket', bucket_name,
+                        '--num-shards', '101', '--yes-i-really-mean-it'])
+        assert result[1] == 0
+        indices=[0] * len(files)
+        ret=upload_objects(bucket_name, files, indices, conn, config2)
+        dedup_stats = ret[1]
+        rados_objects_total = count_object_parts_in_all_buckets()
+
+        sample_percent=50
+        dry_run=True
+        exec_dedup(dedup_stats, dry_run, False, sample_percent=sample_percent)
+        jstats=read_dedup_json()
+        sampled=jstats['sampled_estimate']
+        assert sampled['sample_percent'] == sample_percent
+        assert sampled['dedup_bytes_low'] <= sampled['dedup_bytes_estimate']
+        assert sampled['dedup_bytes_estimate'] <= sampled['dedup_bytes_high']
+
+        # the copies are spread over the shards, so about half of the pairs
+        # are seen whole: the bounds hold the real value (allowing for the
+        # sampled shards not being exactly half of them) and the estimate
+        # is in the right range
+        expected=dedup_stats.dedup_bytes_estimate
+        assert expected > 0
+        log.debug("test_dedup_dry_sampled: expected=%d, sampled=%s", expected, sampled)
+        assert sampled['dedup_bytes_low'] <= expected * 1.2
+        assert expected <= sampled['dedup_bytes_high'] * 1.2
+        assert abs(sampled['dedup_bytes_estimate'] - expected) <= expected * 0.4
+
+        worker_stats=jstats['worker_stats']
+        assert worker_stats['skipped']['Ingress skip: unsampled Bucket-Index shards'] > 0
+        ingress_bytes=worker_stats['main']['Accum byte size Ingress Objs']
+        ratio=jstats['dedup_ratio_estimate']
+        assert ratio['s3_bytes_before'] == (ingress_bytes * 100) // sample_percent
+        assert (ratio['s3_bytes_before'] - ratio['s3_bytes_after']) == sampled['dedup_bytes_estimate']
+
+        verify_objects(bucket_name, files, conn, rados_objects_total, config2)
+    finally:
+        # cleanup must be executed even after a failure
+        cleanup(bucket_name, conn)
+
+
 #-------------------------------------------------------------------------------
 # 1) generate a mix of small and large random files and store them on disk
 # 2) upload a random number of copies from each file to bucket
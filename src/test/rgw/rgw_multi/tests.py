@@ -113,6 +113,12 @@ def bilog_list(zone, bucket, args = None):
     bilog, _ = zone.cluster.admin(cmd, read_only=True)
     return json.loads(bilog)
 
+def object_stat(zone, bucket, obj):
+    cmd = ['object', 'stat', '--bucket', bucket, '--object', obj]
+    cmd += ['--tenant', config.tenant, '--uid', user.name] if config.tenant else []
+    output, _ = zone.cluster.admin(cmd, read_only=True)
+    return json.loads(output)
+
 def bucket_list(zone, bucket, args = None):
     cmd = ['bucket', 'list', '--bucket', bucket, '--max-entries', '100000', '--uid', user.name] + (args or [])
     cmd += ['--tenant', config.tenant] if config.tenant else []
@@ -1660,6 +1666,60 @@ def test_encrypted_object_sync():
     key = bucket2.get_key('testobj-sse-kms')
     eq(data, key.get_contents_as_string(encoding='ascii'))
 
+def test_dedup_sync_fingerprint():
+    zonegroup = realm.master_zonegroup()
+    zonegroup_conns = ZonegroupConns(zonegroup)
+
+    if len(zonegroup.rw_zones) < 2:
+        raise SkipTest("test_dedup_sync_fingerprint skipped. Requires 2 or more zones in master zonegroup.")
+
+    (zone1, zone2) = zonegroup_conns.rw_zones[0:2]
+
+    # restart the gateways with inline dedup, which advertises the tail
+    # fingerprints, and with the fingerprint lookup on sync
+    dedup_args = ['--rgw-dedup-inline=true', '--rgw-dedup-sync-fingerprint=true']
+    for z in (zone1, zone2):
+        z.zone.stop()
+        z.zone.start(dedup_args)
+
+    # use try-finally to restart gateways even if something fails
+    try:
+        bucket_name = gen_bucket_name()
+        log.info('create bucket zone=%s name=%s', zone1.name, bucket_name)
+        zone1.conn.create_bucket(bucket_name)
+        zonegroup_meta_checkpoint(zonegroup)
+
+        # a copy of the data written locally on the second zone is the dedup
+        # source of the object synced from the first zone
+        size = 8 * 1024 * 1024
+        data = 'D' * size
+        new_key(zone2, bucket_name, 'local').set_contents_from_string(data)
+        zone_bucket_checkpoint(zone1.zone, zone2.zone, bucket_name)
+        new_key(zone1, bucket_name, 'synced').set_contents_from_string(data)
+        zone_bucket_checkpoint(zone2.zone, zone1.zone, bucket_name)
+
+        eq(data, get_key(zone2, bucket_name, 'synced').get_contents_as_string(encoding='ascii'))
+        local = object_stat(zone2.zone, bucket_name, 'local')
+        synced = object_stat(zone2.zone, bucket_name, 'synced')
+        eq(local['manifest']['prefix'], synced['manifest']['prefix'])
+        eq(size, synced['size'])
+
+        # replaced by other data of the same size, the whole object is fetched
+        data = 'E' * size
+        new_key(zone1, bucket_name, 'synced').set_contents_from_string(data)
+        zone_bucket_checkpoint(zone2.zone, zone1.zone, bucket_name)
+
+        eq(data, get_key(zone2, bucket_name, 'synced').get_contents_as_string(encoding='ascii'))
+        synced = object_stat(zone2.zone, bucket_name, 'synced')
+        assert_not_equal(local['manifest']['prefix'], synced['manifest']['prefix'])
+
+        # the local copy is intact once the synced object stopped sharing it
+        eq('D' * size, get_key(zone2, bucket_name, 'local').get_contents_as_string(encoding='ascii'))
+    finally:
+        for z in (zone1, zone2):
+            z.zone.stop()
+            z.zone.start()
+
 @attr('bucket_trim')
 def test_bucket_index_log_trim():
     zonegroup = realm.master_zonegroup()
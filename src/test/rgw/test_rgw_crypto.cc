@@ -18,6 +18,7 @@
 #include "rgw_common.h"
 #include "rgw_rados.h"
 #include "rgw_crypt.h"
+#include "rgw_b64.h"
 #include <gtest/gtest.h>
 #include "include/ceph_assert.h"
 #define dout_subsys ceph_subsys_rgw
@@ -813,6 +814,95 @@ TEST(TestRGWCrypto, verify_Encrypt_Decrypt)
 }
 
 
+static std::string content_md5_of(std::string_view data)
+{
+  unsigned char digest[CEPH_CRYPTO_MD5_DIGESTSIZE];
+  ceph::crypto::MD5 hash;
+  // Allow use of MD5 digest in FIPS mode for non-cryptographic purposes
+  hash.SetFlags(EVP_MD_CTX_FLAG_NON_FIPS_ALLOW);
+  hash.Update((const unsigned char *)data.data(), data.size());
+  hash.Final(digest);
+  return rgw::to_base64(std::string_view((const char *)digest, sizeof(digest)));
+}
+
+static std::string encrypt_all(const DoutPrefixProvider *dpp,
+                               const uint8_t *key, std::string_view data)
+{
+  ut_put_sink put_sink;
+  RGWPutObj_BlockEncrypt encrypt(dpp, g_ceph_context, &put_sink,
+                                 AES_256_CBC_create(dpp, g_ceph_context, key, 32),
+                                 null_yield);
+  bufferlist bl;
+  bl.append(data.data(), data.size());
+  encrypt.process(std::move(bl), 0);
+  encrypt.process({}, data.size());
+  return put_sink.get_sink();
+}
+
+TEST(TestRGWCrypto, verify_convergent_fingerprint)
+{
+  const NoDoutPrefix no_dpp(g_ceph_context, dout_subsys);
+  std::string data_a(100000, 'a');
+  std::string data_b(data_a);
+  data_b[50000] = 'b';
+
+  std::string fp_a1, fp_a2, fp_b;
+  ASSERT_EQ(rgw_crypt_convergent_fingerprint(&no_dpp, content_md5_of(data_a), fp_a1), 0);
+  ASSERT_EQ(rgw_crypt_convergent_fingerprint(&no_dpp, content_md5_of(data_a), fp_a2), 0);
+  ASSERT_EQ(rgw_crypt_convergent_fingerprint(&no_dpp, content_md5_of(data_b), fp_b), 0);
+
+  // identical plaintext yields the same key input, one byte changes it
+  ASSERT_EQ(fp_a1.length(), CEPH_CRYPTO_MD5_DIGESTSIZE * 2);
+  ASSERT_EQ(fp_a1, fp_a2);
+  ASSERT_NE(fp_a1, fp_b);
+
+  // the fingerprint is the hex of the MD5, as stored in RGW_ATTR_CRYPT_CONVERGENT
+  std::string fp_empty;
+  ASSERT_EQ(rgw_crypt_convergent_fingerprint(&no_dpp, content_md5_of(""), fp_empty), 0);
+  ASSERT_EQ(fp_empty, "d41d8cd98f00b204e9800998ecf8427e");
+}
+
+TEST(TestRGWCrypto, verify_convergent_fingerprint_invalid)
+{
+  const NoDoutPrefix no_dpp(g_ceph_context, dout_subsys);
+  std::string fp = "junk";
+  std::string short_md5 = rgw::to_base64(std::string(CEPH_CRYPTO_MD5_DIGESTSIZE - 1, 'x'));
+  for (std::string_view md5 : {std::string_view(""),
+                               std::string_view("not base64 at all!"),
+                               std::string_view(short_md5)}) {
+    ASSERT_EQ(rgw_crypt_convergent_fingerprint(&no_dpp, md5, fp), -ERR_INVALID_DIGEST);
+    ASSERT_TRUE(fp.empty());
+  }
+}
+
+TEST(TestRGWCrypto, verify_convergent_ciphertext)
+{
+  const NoDoutPrefix no_dpp(g_ceph_context, dout_subsys);
+  std::string data(3 * 4096 + 123, '\0');
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = i + i*i + (i >> 2);
+
+  // keys derived from one fingerprint under two bucket keys
+  uint8_t key_a[32];
+  uint8_t key_b[32];
+  for (size_t i = 0; i < sizeof(key_a); i++) {
+    key_a[i] = i;
+    key_b[i] = i ^ 0x5a;
+  }
+
+  // the same key encrypts identical plaintext to identical (dedupable) data
+  std::string enc_a1 = encrypt_all(&no_dpp, key_a, data);
+  std::string enc_a2 = encrypt_all(&no_dpp, key_a, data);
+  ASSERT_EQ(enc_a1.length(), data.length());
+  ASSERT_EQ(enc_a1, enc_a2);
+  ASSERT_NE(enc_a1, data);
+
+  // a different key yields different data
+  std::string enc_b = encrypt_all(&no_dpp, key_b, data);
+  ASSERT_EQ(enc_b.length(), data.length());
+  ASSERT_NE(enc_a1, enc_b);
+}
+
 int main(int argc, char **argv) {
   auto args = argv_to_vec(argc, argv);
   auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
@@ -221,6 +221,136 @@ TEST_F(TestSSEKMS, test_transit_reconstitutekey){
   ASSERT_EQ(actual_key, from_base64("3xfTra/dsIf3TMa3mAT2IxPpM7YWm/NvUb4gDfSDX4g="));
 }
 
+TEST_F(TestSSEKMS, test_transit_convergent_key){
+
+  std::string actual_key;
+  map<string, bufferlist> attrs;
+  const NoDoutPrefix no_dpp(cct, 1);
+
+  // Mocks the expected return Value from Vault Server using custom Argument Action
+  string post_json = R"({"data": {"hmac": "vault:v3:3xfTra/dsIf3TMa3mAT2IxPpM7YWm/NvUb4gDfSDX4g="}})";
+  EXPECT_CALL(*transit_engine, send_request(&no_dpp, StrEq("POST"), StrEq("/hmac/"), StrEq("my_key/sha2-256"),
+                                            StrEq(R"({"input":"ZDQxZDhjZDk4ZjAwYjIwNGU5ODAwOTk4ZWNmODQyN2U="})"), _, _))
+		.WillOnce(SetPointedValue(post_json));
+
+  set_attr(attrs, RGW_ATTR_CRYPT_KEYID, "my_key");
+  set_attr(attrs, RGW_ATTR_CRYPT_CONVERGENT, "0:d41d8cd98f00b204e9800998ecf8427e");
+
+  int res = transit_engine->convergent_key(&no_dpp, attrs, null_yield, actual_key);
+
+  ASSERT_EQ(res, 0);
+  ASSERT_EQ(actual_key, from_base64("3xfTra/dsIf3TMa3mAT2IxPpM7YWm/NvUb4gDfSDX4g="));
+  // the latest key version is recorded so reads don't depend on key rotation
+  ASSERT_EQ(get_str_attribute(attrs, RGW_ATTR_CRYPT_CONVERGENT), "3:d41d8cd98f00b204e9800998ecf8427e");
+}
+
+TEST_F(TestSSEKMS, test_transit_convergent_key_version){
+
+  std::string actual_key;
+  map<string, bufferlist> attrs;
+  const NoDoutPrefix no_dpp(cct, 1);
+
+  // Mocks the expected return Value from Vault Server using custom Argument Action
+  string post_json = R"({"data": {"hmac": "vault:v3:3xfTra/dsIf3TMa3mAT2IxPpM7YWm/NvUb4gDfSDX4g="}})";
+  EXPECT_CALL(*transit_engine, send_request(&no_dpp, StrEq("POST"), StrEq("/hmac/"), StrEq("my_key/sha2-256"),
+                                            StrEq(R"({"input":"ZDQxZDhjZDk4ZjAwYjIwNGU5ODAwOTk4ZWNmODQyN2U=","key_version":3})"), _, _))
+		.WillOnce(SetPointedValue(post_json));
+
+  set_attr(attrs, RGW_ATTR_CRYPT_KEYID, "my_key");
+  set_attr(attrs, RGW_ATTR_CRYPT_CONVERGENT, "3:d41d8cd98f00b204e9800998ecf8427e");
+
+  int res = transit_engine->convergent_key(&no_dpp, attrs, null_yield, actual_key);
+
+  ASSERT_EQ(res, 0);
+  ASSERT_EQ(actual_key, from_base64("3xfTra/dsIf3TMa3mAT2IxPpM7YWm/NvUb4gDfSDX4g="));
+  ASSERT_EQ(get_str_attribute(attrs, RGW_ATTR_CRYPT_CONVERGENT), "3:d41d8cd98f00b204e9800998ecf8427e");
+}
+
+TEST_F(TestSSEKMS, test_transit_convergent_key_errors){
+
+  std::string actual_key;
+  const NoDoutPrefix no_dpp(cct, 1);
+  const std::string fp { "d41d8cd98f00b204e9800998ecf8427e" };
+
+  // no request is sent for a versioned key-id, an old engine or a bad attribute
+  map<string, bufferlist> attrs;
+  set_attr(attrs, RGW_ATTR_CRYPT_KEYID, "my_key/1");
+  set_attr(attrs, RGW_ATTR_CRYPT_CONVERGENT, "0:" + fp);
+  ASSERT_EQ(transit_engine->convergent_key(&no_dpp, attrs, null_yield, actual_key), -EINVAL);
+
+  set_attr(attrs, RGW_ATTR_CRYPT_KEYID, "my_key");
+  ASSERT_EQ(old_engine->convergent_key(&no_dpp, attrs, null_yield, actual_key), -EINVAL);
+
+  for (const std::string attr : {fp, ":" + fp, "x:" + fp}) {
+    set_attr(attrs, RGW_ATTR_CRYPT_CONVERGENT, attr);
+    ASSERT_EQ(transit_engine->convergent_key(&no_dpp, attrs, null_yield, actual_key), -EINVAL);
+  }
+
+  std::string tests[5] {R"({"errors": ["permission denied"]})", R"({"data": {}})",
+    R"({"data": {"hmac": 7}})", R"({"data": {"hmac": "v3:3xfTra/dsIf3TMa3mAT2IxPpM7YWm"}})",
+    R"({"data": {"hmac": "vault:v3"}})"
+  };
+  for (const auto &test: tests) {
+    EXPECT_CALL(*transit_engine, send_request(&no_dpp, StrEq("POST"), StrEq("/hmac/"), StrEq("my_key/sha2-256"), _, _, _))
+		.WillOnce(SetPointedValue(test));
+    set_attr(attrs, RGW_ATTR_CRYPT_CONVERGENT, "0:" + fp);
+    ASSERT_EQ(transit_engine->convergent_key(&no_dpp, attrs, null_yield, actual_key), -EINVAL);
+    // the key version isn't updated by a failed request
+    ASSERT_EQ(get_str_attribute(attrs, RGW_ATTR_CRYPT_CONVERGENT), "0:" + fp);
+  }
+}
+
+
+// Computes the HMAC like Vault does: sha2-256 of the input keyed by the key-id
+class VaultHmacAction : public ActionInterface<SendRequestMethod> {
+ public:
+  int Perform(const ::std::tuple<const DoutPrefixProvider*, const char *, std::string_view, std::string_view, const std::string &, optional_yield, bufferlist &>& args) override {
+    std::string_view key_id = ::std::get<3>(args);
+    const std::string& postdata = ::std::get<4>(args);
+    bufferlist& bl = ::std::get<6>(args);
+
+    rapidjson::Document d;
+    d.Parse(postdata.c_str());
+    std::string input = from_base64(d["input"].GetString());
+
+    unsigned char hmac[CEPH_CRYPTO_HMACSHA256_DIGESTSIZE];
+    ceph::crypto::HMACSHA256 h((const unsigned char *)key_id.data(), key_id.size());
+    h.Update((const unsigned char *)input.data(), input.size());
+    h.Final(hmac);
+
+    bl.append(R"({"data": {"hmac": "vault:v1:)" +
+              to_base64(std::string_view((const char *)hmac, sizeof(hmac))) + R"("}})");
+    return 0;
+  }
+};
+
+TEST_F(TestSSEKMS, test_transit_convergent_key_derivation){
+
+  const NoDoutPrefix no_dpp(cct, 1);
+  EXPECT_CALL(*transit_engine, send_request(&no_dpp, StrEq("POST"), StrEq("/hmac/"), _, _, _, _))
+		.WillRepeatedly(MakeAction(new VaultHmacAction()));
+
+  auto derive = [&](const std::string& key_id, const std::string& fp) {
+    map<string, bufferlist> attrs;
+    set_attr(attrs, RGW_ATTR_CRYPT_KEYID, key_id);
+    set_attr(attrs, RGW_ATTR_CRYPT_CONVERGENT, "0:" + fp);
+    std::string actual_key;
+    EXPECT_EQ(transit_engine->convergent_key(&no_dpp, attrs, null_yield, actual_key), 0);
+    EXPECT_EQ(get_str_attribute(attrs, RGW_ATTR_CRYPT_CONVERGENT), "1:" + fp);
+    return actual_key;
+  };
+
+  const std::string fp_a { "d41d8cd98f00b204e9800998ecf8427e" };
+  const std::string fp_b { "0cc175b9c0f1b6a831c399e269772661" };
+  std::string key = derive("bucket_key_1", fp_a);
+  ASSERT_EQ(key.length(), 32u);
+  // identical plaintext under one bucket key yields the same object key
+  ASSERT_EQ(key, derive("bucket_key_1", fp_a));
+  // a different plaintext or a different bucket key yields a different key
+  ASSERT_NE(key, derive("bucket_key_1", fp_b));
+  ASSERT_NE(key, derive("bucket_key_2", fp_a));
+}
+
 TEST_F(TestSSEKMS, test_kv_backend){
 
   std::string_view my_key("my_key");
@@ -195,3 +195,120 @@ TEST(PutObj_Stripe, SkipFirstChunk)
   ASSERT_EQ(4u, mock.ops.size());
   EXPECT_EQ(Op({"", 4}), mock.ops[3]); // flush
 }
+
+TEST(PutObj_InlineDedup, Hit)
+{
+  MockProcessor mock;
+  rgw::putobj::InlineDedupBudget budget;
+  rgw::putobj::InlineDedupProcessor processor(&mock, 16, budget, 32);
+
+  ASSERT_EQ(0, processor.process(string_buf("4444"), 0));
+  ASSERT_EQ(0, processor.process(string_buf("4444"), 4));
+  ASSERT_EQ(0, processor.process({}, 8)); // flush
+  ASSERT_TRUE(mock.ops.empty()); // held back
+  EXPECT_FALSE(processor.has_written());
+  EXPECT_EQ(8u, budget.get_used());
+
+  processor.discard(); // the tail is shared
+  EXPECT_TRUE(mock.ops.empty());
+  EXPECT_EQ(0u, budget.get_used());
+}
+
+TEST(PutObj_InlineDedup, Miss)
+{
+  MockProcessor mock;
+  rgw::putobj::InlineDedupBudget budget;
+  rgw::putobj::InlineDedupProcessor processor(&mock, 16, budget, 32);
+
+  ASSERT_EQ(0, processor.process(string_buf("4444"), 0));
+  ASSERT_EQ(0, processor.process(string_buf("22"), 4));
+  ASSERT_EQ(0, processor.process({}, 6)); // flush
+  ASSERT_TRUE(mock.ops.empty());
+
+  ASSERT_EQ(0, processor.release());
+  ASSERT_EQ(3u, mock.ops.size());
+  EXPECT_EQ(Op({"4444", 0}), mock.ops[0]);
+  EXPECT_EQ(Op({"22", 4}), mock.ops[1]);
+  EXPECT_EQ(Op({"", 6}), mock.ops[2]);
+  EXPECT_FALSE(processor.has_written());
+  EXPECT_EQ(0u, budget.get_used());
+}
+
+TEST(PutObj_InlineDedup, Fingerprint)
+{
+  MockProcessor mock;
+  rgw::putobj::InlineDedupBudget budget;
+  rgw::putobj::InlineDedupProcessor a(&mock, 16, budget, 0);
+  rgw::putobj::InlineDedupProcessor b(&mock, 4, budget, 0);
+  rgw::putobj::InlineDedupProcessor c(&mock, 16, budget, 0);
+
+  // same data in different pieces, held back or not
+  ASSERT_EQ(0, a.process(string_buf("88888888"), 0));
+  ASSERT_EQ(0, b.process(string_buf("8888"), 0));
+  ASSERT_EQ(0, b.process(string_buf("8888"), 4));
+  ASSERT_EQ(0, c.process(string_buf("88888887"), 0));
+
+  uint8_t ha[BLAKE3_OUT_LEN], hb[BLAKE3_OUT_LEN], hc[BLAKE3_OUT_LEN];
+  a.get_hash(ha);
+  b.get_hash(hb);
+  c.get_hash(hc);
+  EXPECT_EQ(0, memcmp(ha, hb, sizeof(ha)));
+  EXPECT_NE(0, memcmp(ha, hc, sizeof(ha)));
+}
+
+TEST(PutObj_InlineDedup, OverflowMaxDefer)
+{
+  MockProcessor mock;
+  rgw::putobj::InlineDedupBudget budget;
+  rgw::putobj::InlineDedupProcessor processor(&mock, 6, budget, 0);
+
+  ASSERT_EQ(0, processor.process(string_buf("4444"), 0));
+  ASSERT_TRUE(mock.ops.empty());
+  EXPECT_EQ(4u, budget.get_used());
+
+  // past max_defer, the pending data is written and the rest passed through
+  ASSERT_EQ(0, processor.process(string_buf("4444"), 4));
+  ASSERT_EQ(2u, mock.ops.size());
+  EXPECT_EQ(Op({"4444", 0}), mock.ops[0]);
+  EXPECT_EQ(Op({"4444", 4}), mock.ops[1]);
+  EXPECT_TRUE(processor.has_written());
+  EXPECT_EQ(0u, budget.get_used());
+
+  ASSERT_EQ(0, processor.process(string_buf("22"), 8));
+  ASSERT_EQ(0, processor.process({}, 10)); // flush
+  ASSERT_EQ(4u, mock.ops.size());
+  EXPECT_EQ(Op({"22", 8}), mock.ops[2]);
+  EXPECT_EQ(Op({"", 10}), mock.ops[3]);
+
+  ASSERT_EQ(0, processor.release()); // nothing left
+  EXPECT_EQ(4u, mock.ops.size());
+}
+
+TEST(PutObj_InlineDedup, OverflowBudget)
+{
+  MockProcessor mock1, mock2;
+  rgw::putobj::InlineDedupBudget budget;
+  {
+    rgw::putobj::InlineDedupProcessor first(&mock1, 16, budget, 10);
+    rgw::putobj::InlineDedupProcessor second(&mock2, 16, budget, 10);
+
+    ASSERT_EQ(0, first.process(string_buf("88888888"), 0));
+    ASSERT_TRUE(mock1.ops.empty());
+    EXPECT_EQ(8u, budget.get_used());
+
+    // the shared budget is exhausted, the second upload is written through
+    ASSERT_EQ(0, second.process(string_buf("4444"), 0));
+    ASSERT_EQ(1u, mock2.ops.size());
+    EXPECT_EQ(Op({"4444", 0}), mock2.ops[0]);
+    EXPECT_TRUE(second.has_written());
+    EXPECT_FALSE(first.has_written());
+    EXPECT_EQ(8u, budget.get_used());
+
+    // the first upload keeps its reservation within the budget
+    ASSERT_EQ(0, first.process(string_buf("22"), 8));
+    ASSERT_TRUE(mock1.ops.empty());
+    EXPECT_EQ(10u, budget.get_used());
+  }
+  // an abandoned upload returns its reservation
+  EXPECT_EQ(0u, budget.get_used());
+}
@@ -117,6 +117,7 @@ TYPE(cls_lock_set_cookie_op)
 #include "cls/refcount/cls_refcount_ops.h"
 TYPE(cls_refcount_get_op)
 TYPE(cls_refcount_put_op)
+TYPE(cls_refcount_put_many_op)
 TYPE(cls_refcount_set_op)
 TYPE(cls_refcount_read_op)
 TYPE(cls_refcount_read_ret)
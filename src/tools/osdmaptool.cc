@@ -17,6 +17,7 @@
 #include <sys/stat.h>
 
 #include "common/ceph_argparse.h"
+#include "common/ceph_json.h"
 #include "common/errno.h"
 #include "common/JSONFormatter.h"
 #include "common/safe_io.h"
@@ -30,6 +31,7 @@
 
 #include "global/global_init.h"
 #include "osd/OSDMap.h"
+#include "osd/UpmapBalancer.h"
 
 using namespace std;
 
@@ -67,6 +69,16 @@ void usage()
   cout << "                           max deviation from target [default: 5]" << std::endl;
   cout << "   --upmap-pool <poolname> restrict upmap balancing to 1 or more pools" << std::endl;
   cout << "   --upmap-active          Act like an active balancer, keep applying changes until balanced" << std::endl;
+  cout << "   --balance <file>        balance bytes, pgs and primaries with pg upmap entries," << std::endl;
+  cout << "                           writing commands to <file> [default: - for stdout]," << std::endl;
+  cout << "                           --upmap-max and --upmap-pool apply" << std::endl;
+  cout << "   --balance-rounds <count> simulate <count> rounds of balancing [default: 1]" << std::endl;
+  cout << "   --balance-max-bytes <bytes>" << std::endl;
+  cout << "                           max bytes moved per round [default: 0, no limit]" << std::endl;
+  cout << "   --balance-weights <bytes>,<pgs>,<primaries>" << std::endl;
+  cout << "                           weights of the objectives [default: 1,1,1]" << std::endl;
+  cout << "   --balance-threads <count> threads scoring the moves [default: 1]" << std::endl;
+  cout << "   --pg-stats <file>       pg sizes for --balance, from 'ceph pg dump pgs --format=json'" << std::endl;
   cout << "   --dump <format>         displays the map in plain text when <format> is 'plain', 'json' if specified format is not supported" << std::endl;
   cout << "   --tree                  displays a tree of the map" << std::endl;
   cout << "   --test-crush [--range-first <first> --range-last <last>] map pgs to acting osds" << std::endl;
@@ -79,6 +91,44 @@ void usage()
   exit(1);
 }
 
+int read_pg_bytes(const std::string& fn, map<pg_t,uint64_t> *pg_bytes)
+{
+  struct pg_bytes_t {
+    pg_t pgid;
+    uint64_t bytes = 0;
+    void decode_json(JSONObj *obj) {
+      std::string s;
+      JSONDecoder::decode_json("pgid", s, obj, true);
+      if (!pgid.parse(s.c_str()))
+        throw JSONDecoder::err("invalid pgid " + s);
+      JSONObj *sum = obj->find_obj("stat_sum");
+      if (sum)
+        JSONDecoder::decode_json("num_bytes", bytes, sum, true);
+    }
+  };
+  JSONParser parser;
+  if (!parser.parse(fn.c_str())) {
+    cerr << "unable to parse " << fn << std::endl;
+    return -EINVAL;
+  }
+  vector<pg_bytes_t> stats;
+  try {
+    JSONDecoder::decode_json("pg_stats", stats, &parser, true);
+  } catch (const JSONDecoder::err& e) {
+    cerr << "unable to decode " << fn << ": " << e.what() << std::endl;
+    return -EINVAL;
+  }
+  for (auto& i : stats)
+    (*pg_bytes)[i.pgid] = i.bytes;
+  return 0;
+}
+
+void print_balance_score(const char *when, const UpmapBalancer::score_t& s)
+{
+  cout << " " << when << ": bytes " << s.bytes << " pgs " << s.pgs
+       << " primaries " << s.primaries << " total " << s.total << std::endl;
+}
+
 void print_inc_upmaps(const OSDMap::Incremental& pending_inc, int fd, bool vstart, std::string cmd="ceph")
 {
   ostringstream ss;
@@ -182,6 +232,12 @@ int main(int argc, const char **argv)
   std::random_device::result_type *upmap_p_seed = nullptr;
   bool read = false;
   std::string read_pool;
+  bool balance = false;
+  int balance_rounds = 1;
+  uint64_t balance_max_bytes = 0;
+  int balance_threads = 1;
+  UpmapBalancer::options_t balance_opts;
+  std::string pg_stats_file;
 
   int64_t pg_num = -1;
   bool test_map_pgs_dump_all = false;
@@ -215,6 +271,24 @@ int main(int argc, const char **argv)
       upmap = true;
     } else if (ceph_argparse_witharg(args, i, &upmap_file, "--read", (char*)NULL)) {
 	read = true;
+    } else if (ceph_argparse_witharg(args, i, &upmap_file, "--balance", (char*)NULL)) {
+      balance = true;
+    } else if (ceph_argparse_witharg(args, i, &balance_rounds, err, "--balance-rounds", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &val, err, "--balance-max-bytes", (char*)NULL)) {
+      string interr;
+      balance_max_bytes = strict_strtoll(val.c_str(), 10, &interr);
+      if (interr.length() > 0) {
+        cerr << "error parsing integer value " << interr << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    } else if (ceph_argparse_witharg(args, i, &val, "--balance-weights", (char*)NULL)) {
+      if (sscanf(val.c_str(), "%lf,%lf,%lf", &balance_opts.bytes_weight,
+		 &balance_opts.pgs_weight, &balance_opts.primaries_weight) != 3) {
+        cerr << "error parsing weights " << val << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    } else if (ceph_argparse_witharg(args, i, &balance_threads, err, "--balance-threads", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &pg_stats_file, "--pg-stats", (char*)NULL)) {
     } else if (ceph_argparse_witharg(args, i, &upmap_max, err, "--upmap-max", (char*)NULL)) {
     } else if (ceph_argparse_witharg(args, i, &upmap_deviation, err, "--upmap-deviation", (char*)NULL)) {
     } else if (ceph_argparse_witharg(args, i, (int *)&upmap_seed, err, "--upmap-seed", (char*)NULL)) {
@@ -317,6 +391,10 @@ int main(int argc, const char **argv)
     cerr << me << ": upmap-deviation must be >= 1" << std::endl;
     usage();
   }
+  if (balance_rounds < 1 || balance_threads < 1) {
+    cerr << me << ": balance-rounds and balance-threads must be >= 1" << std::endl;
+    usage();
+  }
   if (!read && osd_size_aware) {
     cerr << me << ": osd-size-aware is only applicable to read mode" << std::endl;
     usage();
@@ -461,7 +539,7 @@ int main(int argc, const char **argv)
     OSDMap::clean_temps(g_ceph_context, osdmap, tmpmap, &pending_inc);
   }
   int upmap_fd = STDOUT_FILENO;
-  if (upmap || upmap_cleanup || read) {
+  if (upmap || upmap_cleanup || read || balance) {
     if (upmap_file != "-") {
       upmap_fd = ::open(upmap_file.c_str(), O_CREAT|O_WRONLY|O_TRUNC, 0644);
       if (upmap_fd < 0) {
@@ -675,6 +753,60 @@ int main(int argc, const char **argv)
     } while(upmap_active);
   }
 skip_upmap:
+  if (balance) {
+    set<int64_t> pools;
+    for (auto& s : upmap_pools) {
+      int64_t p = osdmap.lookup_pg_pool_name(s);
+      if (p < 0) {
+	cerr << " pool " << s << " does not exist" << std::endl;
+	exit(1);
+      }
+      pools.insert(p);
+    }
+    map<pg_t,uint64_t> pg_bytes;
+    if (!pg_stats_file.empty()) {
+      if (read_pg_bytes(pg_stats_file, &pg_bytes) < 0)
+	exit(1);
+      cout << "read sizes of " << pg_bytes.size() << " pgs from "
+	   << pg_stats_file << std::endl;
+    }
+    balance_opts.max_moves = std::max(upmap_max, 0);
+    balance_opts.max_bytes = balance_max_bytes;
+    balance_opts.num_threads = balance_threads;
+    cout << "balance, max-count " << balance_opts.max_moves
+	 << ", max-bytes " << balance_opts.max_bytes
+	 << ", weights " << balance_opts.bytes_weight
+	 << "," << balance_opts.pgs_weight
+	 << "," << balance_opts.primaries_weight << std::endl;
+    UpmapBalancer balancer(g_ceph_context, osdmap, balance_opts, pools,
+			   pg_bytes);
+    for (int round = 1; round <= balance_rounds; ++round) {
+      OSDMap::Incremental pending_inc(osdmap.get_epoch()+1);
+      pending_inc.fsid = osdmap.get_fsid();
+      UpmapBalancer::round_t r;
+      struct timespec begin, end;
+      clock_gettime(CLOCK_MONOTONIC, &begin);
+      int did = balancer.run_round(&pending_inc, &r);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      float elapsed_time = (end.tv_sec - begin.tv_sec) + 1.0e-9*(end.tv_nsec - begin.tv_nsec);
+      cout << "round " << round << ": moved " << r.moves << " pgs ("
+	   << byte_u_t(r.bytes) << "), " << r.primary_moves
+	   << " primaries in " << elapsed_time << " secs" << std::endl;
+      print_balance_score("before", r.before);
+      print_balance_score("after", r.after);
+      if (did == 0) {
+	cout << "Unable to find further optimization, "
+	     << "or distribution is already perfect" << std::endl;
+	break;
+      }
+      print_inc_upmaps(pending_inc, upmap_fd, vstart);
+      if (save) {
+	int ret = osdmap.apply_incremental(pending_inc);
+	ceph_assert(ret == 0);
+	modified = true;
+      }
+    }
+  }
   if (upmap_file != "-") {
     ::close(upmap_fd);
   }